@@ -0,0 +1,406 @@
+/**
+ * Offline load driver: links one module's real media bug callbacks against a switch_* shim (this directory)
+ * and drives N synthetic sessions through them without FreeSWITCH, to find how many concurrent sessions a
+ * module sustains and what each one costs.
+ *
+ * The module is loaded through its own load function and every session is started with the module's own
+ * API command (--start, with {uuid} replaced), so media bugs, channel variables, private data and events
+ * are set up by the module exactly as on a media server.  Each 20 ms frame is then read into the session's
+ * bugs on a media thread (SWITCH_ABC_TYPE_READ, the path fork_frame, dg_transcribe_frame and the
+ * simple_vad capture callback run on), and every callback is timed.
+ *
+ * In FreeSWITCH each session reads its media on its own thread, so what bounds concurrency is the CPU the
+ * callbacks take per frame period.  The harness models that with --threads media threads, each serving its
+ * share of the sessions once per tick: a media thread keeps up while serving one tick takes less than one
+ * 20 ms frame.  Sessions are added --step at a time up to --sessions; for every step it reports the time a
+ * callback takes per frame (p50/p99/max), the time a media thread takes per tick (p99/max), resident memory
+ * per session and events fired, and it stops ramping once the p99 tick no longer fits in the frame.  The
+ * largest step that fit is reported as the sustained concurrency.
+ *
+ * By default frames are fed as fast as the callbacks take them (--speed 0), which gives the cost alone;
+ * --speed 1 paces ticks in real time and --speed 10 at ten times real time, which lets modules with their
+ * own threads (the websocket service threads behind mod_audio_fork and mod_deepgram_transcribe) drain what
+ * the callbacks queue while they are measured.  Audio is a synthetic tone switched on for one second in
+ * every three over low noise, caller and far end alternating, or --file raw s16le mono at --rate.
+ *
+ * Build from this directory with the module's sources; its C files compile against switch.h here instead
+ * of FreeSWITCH's.  mod_simple_vad needs nothing else:
+ *
+ * M=../../modules/mod_simple_vad
+ * rm -f *.o && cc -O2 -c -I. switch_shim.c switch_json.c switch_vad.c $M/mod_simple_vad.c $M/vad_kernel.c
+ * c++ -O2 -std=c++11 -I. frame_harness.cpp *.o -pthread -lm -o frame_harness
+ * ./frame_harness --start "uuid_simple_vad {uuid} start 2 stereo" --sessions 20000 --step 2500
+ *
+ * mod_audio_fork needs what it links on a media server, and a websocket endpoint to stream to, such as
+ * ../ws_server.js or ../mock_asr_server.js:
+ *
+ * M=../../modules/mod_audio_fork
+ * rm -f *.o && cc -O2 -c -I. switch_shim.c switch_json.c switch_vad.c $M/mod_audio_fork.c
+ * c++ -O2 -std=c++11 -I. -I$M frame_harness.cpp $M/lws_glue.cpp $M/audio_pipe.cpp $M/parser.cpp \
+ *   $M/audio_encoder.cpp *.o -lwebsockets -lspeexdsp -lopus -lFLAC -lresolv -pthread -lm -o frame_harness
+ * ./frame_harness --start "uuid_audio_fork {uuid} start ws://127.0.0.1:3001 mono 16k" --connect-wait 2000 \
+ *   --speed 10 --sessions 1000 --step 100
+ *
+ * mod_deepgram_transcribe builds the same way from mod_deepgram_transcribe.c, dg_transcribe_glue.cpp,
+ * audio_pipe.cpp and parser.cpp.  It streams to api.deepgram.com, so point that name at
+ * ../mock_asr_server.js (see its header) and set the key the module requires:
+ *
+ * ./frame_harness --var DEEPGRAM_API_KEY=test --start "uuid_deepgram_transcribe {uuid} start en-US interim" \
+ *   --connect-wait 2000 --speed 10 --sessions 500 --step 50
+ *
+ * Keep --threads (default 1) at or below the cores the harness has to itself: media threads sharing a core
+ * are preempted mid-tick, and the preemption is counted as tick time.
+ *
+ * Other options: --secs seconds of audio per step (default 10), --rate session sample rate (default 8000),
+ * --stop a command run for every session before it hangs up, --var NAME=VALUE a channel variable set on
+ * every session (repeatable), --budget-ms the tick time a media thread may take (default 20), --log
+ * debug|info|notice|warning|err|crit to see the module's log.
+ *
+ * ../load_test.js drives the same API commands against a live FreeSWITCH instead, through the event socket,
+ * where codecs, RTP and the rest of the media path are part of what is measured.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "harness.h"
+
+namespace {
+
+  typedef std::chrono::steady_clock Clock;
+
+  const uint32_t kFrameMs = 20;
+
+  struct Options {
+    std::string start;
+    std::string stop;
+    std::string file;
+    unsigned int sessions = 100;
+    unsigned int step = 0;
+    unsigned int threads = 1;
+    unsigned int secs = 10;
+    unsigned int connectWaitMs = 0;
+    uint32_t rate = 8000;
+    double speed = 0;
+    double budgetMs = kFrameMs;
+    switch_log_level_t log = SWITCH_LOG_CRIT;
+  };
+
+  // log-linear: exact below 64 ns, then 64 buckets per power of two (within 1.6%)
+  class Histogram {
+  public:
+    Histogram() : m_counts(kBuckets, 0), m_total(0), m_max(0) {}
+
+    void add(uint64_t ns) {
+      m_counts[index(ns)]++;
+      m_total++;
+      if (ns > m_max) m_max = ns;
+    }
+    void merge(const Histogram& other) {
+      for (size_t i = 0; i < kBuckets; i++) m_counts[i] += other.m_counts[i];
+      m_total += other.m_total;
+      m_max = std::max(m_max, other.m_max);
+    }
+    uint64_t percentile(double p) const {
+      uint64_t target = (uint64_t) std::ceil(p * m_total), seen = 0;
+      for (size_t i = 0; i < kBuckets; i++) {
+        seen += m_counts[i];
+        if (seen >= target && seen > 0) return std::min(value(i), m_max);
+      }
+      return m_max;
+    }
+    uint64_t max() const { return m_max; }
+
+  private:
+    static const size_t kSub = 64;
+    static const size_t kBuckets = kSub * 60;
+
+    static size_t index(uint64_t v) {
+      if (v < kSub) return v;
+      int e = 63 - __builtin_clzll(v);
+      size_t i = (e - 5) * kSub + ((v >> (e - 6)) & (kSub - 1));
+      return std::min(i, kBuckets - 1);
+    }
+    static uint64_t value(size_t i) {
+      if (i < kSub) return i;
+      int e = i / kSub + 5;
+      uint64_t width = 1ULL << (e - 6);
+      return (kSub + i % kSub) * width + width / 2;
+    }
+
+    std::vector<uint64_t> m_counts;
+    uint64_t m_total;
+    uint64_t m_max;
+  };
+
+  struct Session {
+    switch_core_session_t* session;
+    std::string uuid;
+    unsigned int index;
+  };
+
+  struct StepResult {
+    Histogram frames;
+    Histogram ticks;
+  };
+
+  size_t rssBytes() {
+    long pages = 0, resident = 0;
+    FILE* fp = fopen("/proc/self/statm", "r");
+    if (fp) {
+      if (fscanf(fp, "%ld %ld", &pages, &resident) != 2) resident = 0;
+      fclose(fp);
+    }
+    return (size_t) resident * sysconf(_SC_PAGESIZE);
+  }
+
+  // a 400 Hz tone one second in every three over low noise; the far end talks while the caller is silent
+  std::vector<int16_t> synthesize(uint32_t rate, uint32_t offsetSecs) {
+    std::vector<int16_t> audio(rate * 3);
+    srand(1 + offsetSecs);
+    for (uint32_t i = 0; i < audio.size(); i++) {
+      double v = (rand() / (double) RAND_MAX - 0.5) * 40.0;
+      if (((i / rate) + offsetSecs) % 3 == 1) v += 8000.0 * sin(2.0 * M_PI * 400.0 * i / rate);
+      audio[i] = (int16_t) v;
+    }
+    return audio;
+  }
+
+  bool loadFile(const std::string& path, std::vector<int16_t>& audio) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return false;
+    std::vector<char> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    audio.resize(bytes.size() / sizeof(int16_t));
+    memcpy(audio.data(), bytes.data(), audio.size() * sizeof(int16_t));
+    return true;
+  }
+
+  std::string expand(const std::string& tmpl, const std::string& uuid) {
+    std::string cmd = tmpl;
+    size_t pos;
+    while ((pos = cmd.find("{uuid}")) != std::string::npos) cmd.replace(pos, 6, uuid);
+    return cmd;
+  }
+
+  // runs "<api> <args>" as fs_cli would; false unless the module answered +OK
+  bool runCommand(const std::string& line, std::string& reply) {
+    switch_stream_handle_t stream;
+    size_t space = line.find(' ');
+    std::string api = line.substr(0, space);
+    std::string args = space == std::string::npos ? "" : line.substr(space + 1);
+
+    SWITCH_STANDARD_STREAM(stream);
+    switch_api_execute(api.c_str(), args.c_str(), NULL, &stream);
+    reply = (const char *) stream.data;
+    free(stream.data);
+    while (!reply.empty() && (reply.back() == '\n' || reply.back() == '\r')) reply.pop_back();
+    return reply.compare(0, 3, "+OK") == 0;
+  }
+
+  void mediaThread(const std::vector<Session>& sessions, unsigned int first, unsigned int stride,
+    const std::vector<int16_t>& caller, const std::vector<int16_t>& farEnd, uint32_t samples, uint32_t frames,
+    double speed, StepResult& result) {
+    const uint32_t cycle = caller.size() / samples;
+    const Clock::duration period = speed > 0 ?
+      std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(kFrameMs / speed)) :
+      Clock::duration::zero();
+    Clock::time_point start = Clock::now();
+
+    for (uint32_t f = 0; f < frames; f++) {
+      Clock::time_point tick = Clock::now();
+      for (unsigned int i = first; i < sessions.size(); i += stride) {
+        // stagger sessions through the signal so they do not all change state on the same tick
+        size_t offset = (size_t) ((f + sessions[i].index * 7) % cycle) * samples;
+        Clock::time_point t0 = Clock::now();
+        harness_session_read(sessions[i].session, &caller[offset], &farEnd[offset], samples);
+        result.frames.add(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - t0).count());
+      }
+      result.ticks.add(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - tick).count());
+      if (speed > 0) std::this_thread::sleep_until(start + period * (f + 1));
+    }
+  }
+
+  void usage(const char* argv0) {
+    fprintf(stderr,
+      "usage: %s --start \"<api> {uuid} start ...\" [--stop \"<api> {uuid} stop ...\"] [--sessions n] [--step n]\n"
+      "       [--threads n] [--secs n] [--speed x] [--rate hz] [--file raw.s16le] [--connect-wait ms]\n"
+      "       [--budget-ms ms] [--var NAME=VALUE]... [--log level]\n", argv0);
+    exit(1);
+  }
+
+  switch_log_level_t logLevel(const char* name) {
+    static const struct { const char* name; switch_log_level_t level; } levels[] = {
+      {"debug", SWITCH_LOG_DEBUG}, {"info", SWITCH_LOG_INFO}, {"notice", SWITCH_LOG_NOTICE},
+      {"warning", SWITCH_LOG_WARNING}, {"err", SWITCH_LOG_ERROR}, {"error", SWITCH_LOG_ERROR},
+      {"crit", SWITCH_LOG_CRIT}
+    };
+    for (size_t i = 0; i < sizeof(levels) / sizeof(levels[0]); i++) {
+      if (0 == strcasecmp(name, levels[i].name)) return levels[i].level;
+    }
+    return SWITCH_LOG_CRIT;
+  }
+
+  Options parse(int argc, char** argv) {
+    Options opts;
+    for (int i = 1; i < argc; i++) {
+      std::string arg = argv[i];
+      if (i + 1 >= argc) usage(argv[0]);
+      const char* val = argv[++i];
+      if (arg == "--start") opts.start = val;
+      else if (arg == "--stop") opts.stop = val;
+      else if (arg == "--file") opts.file = val;
+      else if (arg == "--sessions") opts.sessions = (unsigned int) atoi(val);
+      else if (arg == "--step") opts.step = (unsigned int) atoi(val);
+      else if (arg == "--threads") opts.threads = (unsigned int) atoi(val);
+      else if (arg == "--secs") opts.secs = (unsigned int) atoi(val);
+      else if (arg == "--rate") opts.rate = (uint32_t) atoi(val);
+      else if (arg == "--speed") opts.speed = atof(val);
+      else if (arg == "--connect-wait") opts.connectWaitMs = (unsigned int) atoi(val);
+      else if (arg == "--budget-ms") opts.budgetMs = atof(val);
+      else if (arg == "--log") opts.log = logLevel(val);
+      else if (arg == "--var") {
+        std::string var = val;
+        size_t eq = var.find('=');
+        if (eq == std::string::npos) usage(argv[0]);
+        harness_set_default_variable(var.substr(0, eq).c_str(), var.substr(eq + 1).c_str());
+      }
+      else usage(argv[0]);
+    }
+    if (opts.start.empty() || opts.sessions == 0 || opts.threads == 0 || opts.secs == 0 ||
+      opts.rate < 8000 || opts.rate % 50 != 0) {
+      usage(argv[0]);
+    }
+    if (opts.step == 0 || opts.step > opts.sessions) opts.step = opts.sessions;
+    return opts;
+  }
+}
+
+int main(int argc, char** argv) {
+  Options opts = parse(argc, argv);
+  const uint32_t samples = opts.rate * kFrameMs / 1000;
+  const uint32_t frames = opts.secs * 1000 / kFrameMs;
+  std::vector<int16_t> caller, farEnd;
+  std::vector<Session> sessions;
+  unsigned int sustained = 0;
+  double sustainedTickMs = 0;
+  bool overloaded = false;
+
+  if (!opts.file.empty()) {
+    if (!loadFile(opts.file, caller) || caller.size() < samples) {
+      fprintf(stderr, "unable to read at least one frame of audio from %s\n", opts.file.c_str());
+      return 1;
+    }
+    caller.resize(caller.size() / samples * samples);
+    farEnd = caller;
+    std::rotate(farEnd.begin(), farEnd.begin() + (farEnd.size() / samples / 2) * samples, farEnd.end());
+  }
+  else {
+    caller = synthesize(opts.rate, 0);
+    farEnd = synthesize(opts.rate, 1);
+  }
+
+  harness_set_log_level(opts.log);
+  if (harness_module_load() != SWITCH_STATUS_SUCCESS) {
+    fprintf(stderr, "the module failed to load\n");
+    return 1;
+  }
+  const size_t baseRss = rssBytes();
+
+  char pace[64] = "as fast as possible";
+  if (opts.speed > 0) snprintf(pace, sizeof(pace), "%gx real time", opts.speed);
+  printf("%s, %u Hz, %u media thread%s, %u s of audio per step, %s\n", harness_module_name(), opts.rate,
+    opts.threads, opts.threads == 1 ? "" : "s", opts.secs, pace);
+  printf("%8s  %21s  %17s  %10s  %9s  %6s\n", "", "callback per frame, us", "tick per thread, ms", "rss/session",
+    "events/s", "bugs");
+  printf("%8s  %6s %6s %7s  %8s %8s  %10s  %9s  %6s\n", "sessions", "p50", "p99", "max", "p99", "max", "KB", "", "");
+
+  while (sessions.size() < opts.sessions && !overloaded) {
+    unsigned int target = std::min<unsigned int>(sessions.size() + opts.step, opts.sessions);
+    std::vector<StepResult> results(opts.threads);
+    std::vector<std::thread> threads;
+    uint64_t events;
+    unsigned int bugs = 0;
+    Clock::time_point began;
+    double elapsed;
+
+    while (sessions.size() < target) {
+      Session s;
+      std::string reply;
+      char uuid[64];
+
+      snprintf(uuid, sizeof(uuid), "harness-%06u", (unsigned int) sessions.size());
+      s.uuid = uuid;
+      s.index = sessions.size();
+      if (!(s.session = harness_session_create(uuid, opts.rate))) {
+        fprintf(stderr, "unable to create session %s\n", uuid);
+        return 1;
+      }
+      if (!runCommand(expand(opts.start, s.uuid), reply)) {
+        fprintf(stderr, "%s: %s\n", expand(opts.start, s.uuid).c_str(), reply.c_str());
+        harness_session_destroy(s.session);
+        return 1;
+      }
+      sessions.push_back(s);
+    }
+    if (opts.connectWaitMs) std::this_thread::sleep_for(std::chrono::milliseconds(opts.connectWaitMs));
+
+    events = harness_events_fired();
+    began = Clock::now();
+    for (unsigned int t = 0; t < opts.threads; t++) {
+      threads.push_back(std::thread(mediaThread, std::cref(sessions), t, opts.threads, std::cref(caller),
+        std::cref(farEnd), samples, frames, opts.speed, std::ref(results[t])));
+    }
+    for (auto& t : threads) t.join();
+    elapsed = std::chrono::duration<double>(Clock::now() - began).count();
+    events = harness_events_fired() - events;
+
+    StepResult step;
+    for (auto& r : results) {
+      step.frames.merge(r.frames);
+      step.ticks.merge(r.ticks);
+    }
+    for (auto& s : sessions) bugs += harness_session_bug_count(s.session);
+
+    double tickP99Ms = step.ticks.percentile(0.99) / 1e6;
+    size_t rss = rssBytes();
+    size_t growth = rss > baseRss ? rss - baseRss : 0;
+    printf("%8u  %6.1f %6.1f %7.1f  %8.2f %8.2f  %10.1f  %9.0f  %6u\n", (unsigned int) sessions.size(),
+      step.frames.percentile(0.50) / 1e3, step.frames.percentile(0.99) / 1e3, step.frames.max() / 1e3,
+      tickP99Ms, step.ticks.max() / 1e6, growth / 1024.0 / sessions.size(),
+      events / elapsed, bugs);
+    fflush(stdout);
+
+    if (tickP99Ms > opts.budgetMs) overloaded = true;
+    else {
+      sustained = sessions.size();
+      sustainedTickMs = tickP99Ms;
+    }
+  }
+
+  if (sustained == 0) {
+    printf("sustained: none; %u sessions already took longer than %.1f ms per tick at p99\n", opts.step, opts.budgetMs);
+  }
+  else {
+    printf("sustained: %s%u sessions on %u media thread%s (p99 tick %.2f ms of %.1f ms)%s\n",
+      overloaded ? "" : "at least ", sustained, opts.threads, opts.threads == 1 ? "" : "s", sustainedTickMs,
+      opts.budgetMs, overloaded ? "" : "; the ramp ended first, raise --sessions");
+  }
+
+  for (auto& s : sessions) {
+    std::string reply;
+    if (!opts.stop.empty()) runCommand(expand(opts.stop, s.uuid), reply);
+    harness_session_destroy(s.session);
+  }
+  harness_module_shutdown();
+  return 0;
+}
@@ -0,0 +1,53 @@
+/*
+ * harness.h -- what frame_harness calls to play the part of the FreeSWITCH core around one linked module.
+ *
+ * The module is started the way FreeSWITCH starts it (its load function, then its API command per call),
+ * and frames reach it the way they do on a media thread: each harness_session_read runs the READ callback
+ * of every media bug on the session once, and switch_core_media_bug_read inside the callback returns that
+ * frame.  Sessions, channel variables, private data, events and the session lookup used by the modules'
+ * own threads all behave as the core's do, so the module's code runs unchanged.
+ */
+#ifndef __HARNESS_H__
+#define __HARNESS_H__
+
+#include "switch.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* defined by the module's SWITCH_MODULE_DEFINITION */
+extern switch_loadable_module_function_table_t *harness_module;
+
+switch_status_t harness_module_load(void);
+void harness_module_shutdown(void);
+const char *harness_module_name(void);
+
+/* messages below this level are dropped; the default is SWITCH_LOG_CRIT */
+void harness_set_log_level(switch_log_level_t level);
+
+/* channel variables every new session starts with, as the dialplan would have set them */
+void harness_set_default_variable(const char *name, const char *value);
+
+switch_core_session_t *harness_session_create(const char *uuid, uint32_t rate);
+
+/* hangs up: removes the session's media bugs (CLOSE), waits out any read locks and frees it */
+void harness_session_destroy(switch_core_session_t *session);
+
+/*
+ * One frame period: every media bug on the session gets its READ callback, reading `samples` samples per
+ * channel of `read` (the caller) and `write` (the far end).  A bug whose callback returns SWITCH_FALSE is
+ * removed, as the core does.  Returns the number of bugs that ran.
+ */
+int harness_session_read(switch_core_session_t *session, const int16_t *read, const int16_t *write, uint32_t samples);
+
+uint32_t harness_session_bug_count(switch_core_session_t *session);
+
+/* events the module has fired since load */
+uint64_t harness_events_fired(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,371 @@
+/*
+ * switch.h -- the part of the FreeSWITCH core API the modules' media paths use, for frame_harness.
+ *
+ * Only what mod_simple_vad, mod_audio_fork and mod_deepgram_transcribe (and their glue) call is here.
+ * Names, signatures and macro shapes follow FreeSWITCH so the modules build unchanged against it; the
+ * behaviour behind them is in switch_shim.c, and harness.h adds the calls frame_harness needs to play
+ * the part of the core (creating sessions, reading frames into media bugs, running API commands).
+ */
+#ifndef __HARNESS_SWITCH_H__
+#define __HARNESS_SWITCH_H__
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SWITCH_DECLARE(type) type
+#define SWITCH_RECOMMENDED_BUFFER_SIZE (8192)
+#define SWITCH_RESAMPLE_QUALITY (2)
+#define SWITCH_PATH_SEPARATOR "/"
+#define SWITCH_TIME_T_FMT "ld"
+#define SWITCH_INT64_T_FMT "ld"
+#define SWITCH_SIZE_T_FMT "ld"
+
+typedef enum {
+	SWITCH_STATUS_SUCCESS,
+	SWITCH_STATUS_FALSE,
+	SWITCH_STATUS_TIMEOUT,
+	SWITCH_STATUS_RESTART,
+	SWITCH_STATUS_INTR,
+	SWITCH_STATUS_NOTIMPL,
+	SWITCH_STATUS_MEMERR,
+	SWITCH_STATUS_NOOP,
+	SWITCH_STATUS_RESAMPLE,
+	SWITCH_STATUS_GENERR,
+	SWITCH_STATUS_INUSE,
+	SWITCH_STATUS_BREAK,
+	SWITCH_STATUS_SOCKERR,
+	SWITCH_STATUS_MORE_DATA,
+	SWITCH_STATUS_NOTFOUND,
+	SWITCH_STATUS_UNLOAD,
+	SWITCH_STATUS_NOUNLOAD,
+	SWITCH_STATUS_IGNORE,
+	SWITCH_STATUS_TOO_SMALL,
+	SWITCH_STATUS_FOUND,
+	SWITCH_STATUS_CONTINUE,
+	SWITCH_STATUS_TERM,
+	SWITCH_STATUS_NOT_INITALIZED,
+	SWITCH_STATUS_TOO_LATE,
+	SWITCH_STATUS_XBREAK = 35,
+	SWITCH_STATUS_WINBREAK = 730035
+} switch_status_t;
+
+typedef enum {
+	SWITCH_FALSE = 0,
+	SWITCH_TRUE = 1
+} switch_bool_t;
+
+typedef int64_t switch_time_t;
+typedef uint32_t switch_size_t_unused;
+
+/* logging */
+
+typedef enum {
+	SWITCH_LOG_DEBUG10 = 110,
+	SWITCH_LOG_DEBUG = 7,
+	SWITCH_LOG_INFO = 6,
+	SWITCH_LOG_NOTICE = 5,
+	SWITCH_LOG_WARNING = 4,
+	SWITCH_LOG_ERROR = 3,
+	SWITCH_LOG_CRIT = 2,
+	SWITCH_LOG_ALERT = 1,
+	SWITCH_LOG_CONSOLE = 0
+} switch_log_level_t;
+
+typedef enum {
+	SWITCH_CHANNEL_ID_LOG,
+	SWITCH_CHANNEL_ID_LOG_CLEAN,
+	SWITCH_CHANNEL_ID_EVENT,
+	SWITCH_CHANNEL_ID_SESSION
+} switch_text_channel_t;
+
+#define SWITCH_CHANNEL_LOG SWITCH_CHANNEL_ID_LOG, __FILE__, __func__, __LINE__, NULL
+#define SWITCH_CHANNEL_SESSION_LOG(x) SWITCH_CHANNEL_ID_SESSION, __FILE__, __func__, __LINE__, (const char *) (x)
+
+void switch_log_printf(switch_text_channel_t channel, const char *file, const char *func, int line,
+	const char *userdata, switch_log_level_t level, const char *fmt, ...) __attribute__((format(printf, 7, 8)));
+
+/* memory, mutexes, atomics */
+
+typedef struct switch_memory_pool switch_memory_pool_t;
+typedef struct switch_mutex switch_mutex_t;
+
+#define SWITCH_MUTEX_DEFAULT 0x0
+#define SWITCH_MUTEX_NESTED 0x1
+#define SWITCH_MUTEX_UNNESTED 0x2
+
+switch_status_t switch_mutex_init(switch_mutex_t **lock, unsigned int flags, switch_memory_pool_t *pool);
+switch_status_t switch_mutex_destroy(switch_mutex_t *lock);
+switch_status_t switch_mutex_lock(switch_mutex_t *lock);
+switch_status_t switch_mutex_unlock(switch_mutex_t *lock);
+switch_status_t switch_mutex_trylock(switch_mutex_t *lock);
+
+typedef uint32_t switch_atomic_t;
+
+uint32_t switch_atomic_read(volatile switch_atomic_t *mem);
+void switch_atomic_set(volatile switch_atomic_t *mem, uint32_t val);
+void switch_atomic_add(volatile switch_atomic_t *mem, uint32_t val);
+void switch_atomic_inc(volatile switch_atomic_t *mem);
+int switch_atomic_dec(volatile switch_atomic_t *mem);
+
+switch_time_t switch_micro_time_now(void);
+
+/* strings */
+
+#define zstr(x) (!(x) || !*(x))
+#define switch_safe_free(it) if (it) {free(it);it=NULL;}
+#define switch_test_flag(obj, flag) ((obj)->flags & flag)
+#define switch_snprintf snprintf
+
+int switch_true(const char *expr);
+unsigned int switch_separate_string(char *buf, char delim, char **array, unsigned int arraylen);
+
+/* sessions, channels, codecs and frames */
+
+typedef struct switch_core_session switch_core_session_t;
+typedef struct switch_channel switch_channel_t;
+
+typedef struct switch_codec_implementation {
+	const char *iananame;
+	uint32_t samples_per_second;
+	uint32_t actual_samples_per_second;
+	int microseconds_per_packet;
+	uint32_t samples_per_packet;
+	uint32_t decoded_bytes_per_packet;
+	uint8_t number_of_channels;
+} switch_codec_implementation_t;
+
+typedef struct switch_codec {
+	const switch_codec_implementation_t *implementation;
+} switch_codec_t;
+
+typedef enum {
+	SFF_NONE = 0,
+	SFF_CNG = (1 << 0)
+} switch_frame_flag_enum_t;
+typedef uint32_t switch_frame_flag_t;
+
+typedef struct switch_frame {
+	switch_codec_t *codec;
+	void *data;
+	uint32_t datalen;
+	uint32_t buflen;
+	uint32_t samples;
+	uint32_t rate;
+	uint32_t channels;
+	switch_frame_flag_t flags;
+} switch_frame_t;
+
+typedef enum {
+	CF_ANSWERED = 1,
+	CF_BREAK
+} switch_channel_flag_t;
+
+switch_channel_t *switch_core_session_get_channel(switch_core_session_t *session);
+const char *switch_core_session_get_uuid(switch_core_session_t *session);
+switch_memory_pool_t *switch_core_session_get_pool(switch_core_session_t *session);
+void *switch_core_session_alloc(switch_core_session_t *session, size_t memory);
+char *switch_core_session_strdup(switch_core_session_t *session, const char *todup);
+switch_status_t switch_core_session_get_read_impl(switch_core_session_t *session, switch_codec_implementation_t *impp);
+switch_codec_t *switch_core_session_get_read_codec(switch_core_session_t *session);
+switch_core_session_t *switch_core_session_locate(const char *uuid_str);
+switch_status_t switch_core_session_read_lock(switch_core_session_t *session);
+void switch_core_session_rwunlock(switch_core_session_t *session);
+
+const char *switch_channel_get_name(switch_channel_t *channel);
+const char *switch_channel_get_variable(switch_channel_t *channel, const char *varname);
+switch_status_t switch_channel_set_variable(switch_channel_t *channel, const char *varname, const char *value);
+void *switch_channel_get_private(switch_channel_t *channel, const char *key);
+switch_status_t switch_channel_set_private(switch_channel_t *channel, const char *key, const void *private_info);
+switch_status_t switch_channel_pre_answer(switch_channel_t *channel);
+void switch_channel_set_flag_value(switch_channel_t *channel, switch_channel_flag_t flag, uint32_t value);
+
+/* media bugs */
+
+typedef struct switch_media_bug switch_media_bug_t;
+
+typedef enum {
+	SWITCH_ABC_TYPE_INIT,
+	SWITCH_ABC_TYPE_READ,
+	SWITCH_ABC_TYPE_WRITE,
+	SWITCH_ABC_TYPE_WRITE_REPLACE,
+	SWITCH_ABC_TYPE_READ_REPLACE,
+	SWITCH_ABC_TYPE_READ_PING,
+	SWITCH_ABC_TYPE_TAP_NATIVE_READ,
+	SWITCH_ABC_TYPE_TAP_NATIVE_WRITE,
+	SWITCH_ABC_TYPE_CLOSE
+} switch_abc_type_t;
+
+typedef enum {
+	SMBF_BOTH = 0,
+	SMBF_READ_STREAM = (1 << 0),
+	SMBF_WRITE_STREAM = (1 << 1),
+	SMBF_WRITE_REPLACE = (1 << 2),
+	SMBF_READ_REPLACE = (1 << 3),
+	SMBF_READ_PING = (1 << 4),
+	SMBF_STEREO = (1 << 5),
+	SMBF_ANSWER_REQ = (1 << 6),
+	SMBF_BRIDGE_REQ = (1 << 7),
+	SMBF_THREAD_LOCK = (1 << 8),
+	SMBF_PRUNE = (1 << 9),
+	SMBF_NO_PAUSE = (1 << 10)
+} switch_media_bug_flag_enum_t;
+typedef uint32_t switch_media_bug_flag_t;
+
+typedef switch_bool_t (*switch_media_bug_callback_t)(switch_media_bug_t *, void *, switch_abc_type_t);
+
+switch_status_t switch_core_media_bug_add(switch_core_session_t *session, const char *function, const char *target,
+	switch_media_bug_callback_t callback, void *user_data, time_t stop_time, switch_media_bug_flag_t flags,
+	switch_media_bug_t **new_bug);
+switch_status_t switch_core_media_bug_remove(switch_core_session_t *session, switch_media_bug_t **bug);
+switch_status_t switch_core_media_bug_read(switch_media_bug_t *bug, switch_frame_t *frame, switch_bool_t fill);
+switch_status_t switch_core_media_bug_flush(switch_media_bug_t *bug);
+void *switch_core_media_bug_get_user_data(switch_media_bug_t *bug);
+switch_core_session_t *switch_core_media_bug_get_session(switch_media_bug_t *bug);
+
+/* events */
+
+typedef enum {
+	SWITCH_EVENT_CUSTOM,
+	SWITCH_EVENT_CLONE,
+	SWITCH_EVENT_DETECTED_SPEECH = 53
+} switch_event_types_t;
+
+typedef enum {
+	SWITCH_STACK_BOTTOM = (1 << 0),
+	SWITCH_STACK_TOP = (1 << 1)
+} switch_stack_t;
+
+typedef struct switch_event_header {
+	char *name;
+	char *value;
+	struct switch_event_header *next;
+} switch_event_header_t;
+
+typedef struct switch_event {
+	switch_event_types_t event_id;
+	char *subclass_name;
+	switch_event_header_t *headers;
+	switch_event_header_t *last_header;
+	char *body;
+} switch_event_t;
+
+switch_status_t switch_event_reserve_subclass(const char *subclass_name);
+switch_status_t switch_event_free_subclass(const char *subclass_name);
+switch_status_t switch_event_create_subclass(switch_event_t **event, switch_event_types_t event_id, const char *subclass_name);
+switch_status_t switch_event_add_header(switch_event_t *event, switch_stack_t stack, const char *header_name,
+	const char *fmt, ...) __attribute__((format(printf, 4, 5)));
+switch_status_t switch_event_add_header_string(switch_event_t *event, switch_stack_t stack, const char *header_name,
+	const char *data);
+switch_status_t switch_event_add_body(switch_event_t *event, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+switch_status_t switch_event_fire(switch_event_t **event);
+void switch_event_destroy(switch_event_t **event);
+void switch_channel_event_set_data(switch_channel_t *channel, switch_event_t *event);
+
+/* loadable modules and api commands */
+
+typedef struct switch_stream_handle switch_stream_handle_t;
+typedef switch_status_t (*switch_stream_handle_write_function_t)(switch_stream_handle_t *handle, const char *fmt, ...);
+
+struct switch_stream_handle {
+	switch_stream_handle_write_function_t write_function;
+	void *data;
+	void *end;
+	size_t data_size;
+	size_t data_len;
+	size_t alloc_len;
+	size_t alloc_chunk;
+};
+
+switch_status_t switch_stream_write(switch_stream_handle_t *handle, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+#define SWITCH_STANDARD_STREAM(s) memset(&s, 0, sizeof(s)); s.data = malloc(1024); s.alloc_len = 1024; \
+	s.alloc_chunk = 1024; s.data_size = 1024; s.end = s.data; *(char *) s.data = '\0'; s.write_function = switch_stream_write
+
+typedef switch_status_t (*switch_api_function_t)(const char *cmd, switch_core_session_t *session, switch_stream_handle_t *stream);
+
+typedef struct switch_api_interface {
+	const char *interface_name;
+	const char *desc;
+	switch_api_function_t function;
+	const char *syntax;
+	struct switch_api_interface *next;
+} switch_api_interface_t;
+
+typedef enum {
+	SWITCH_ENDPOINT_INTERFACE,
+	SWITCH_TIMER_INTERFACE,
+	SWITCH_DIALPLAN_INTERFACE,
+	SWITCH_CODEC_INTERFACE,
+	SWITCH_APPLICATION_INTERFACE,
+	SWITCH_API_INTERFACE
+} switch_module_interface_name_t;
+
+typedef struct switch_loadable_module_interface {
+	const char *module_name;
+	switch_api_interface_t *api_interface;
+	switch_memory_pool_t *pool;
+} switch_loadable_module_interface_t;
+
+typedef switch_status_t (*switch_module_load_t)(switch_loadable_module_interface_t **, switch_memory_pool_t *);
+typedef switch_status_t (*switch_module_runtime_t)(void);
+typedef switch_status_t (*switch_module_shutdown_t)(void);
+
+typedef struct switch_loadable_module_function_table {
+	switch_module_load_t load;
+	switch_module_shutdown_t shutdown;
+	switch_module_runtime_t runtime;
+} switch_loadable_module_function_table_t;
+
+switch_loadable_module_interface_t *switch_loadable_module_create_module_interface(switch_memory_pool_t *pool, const char *name);
+void *switch_loadable_module_create_interface(switch_loadable_module_interface_t *mod, switch_module_interface_name_t iname);
+switch_status_t switch_api_execute(const char *cmd, const char *arg, switch_core_session_t *session, switch_stream_handle_t *stream);
+void switch_console_set_complete(const char *string);
+
+#define SWITCH_MODULE_LOAD_ARGS (switch_loadable_module_interface_t **module_interface, switch_memory_pool_t *pool)
+#define SWITCH_MODULE_LOAD_FUNCTION(name) switch_status_t name SWITCH_MODULE_LOAD_ARGS
+#define SWITCH_MODULE_RUNTIME_FUNCTION(name) switch_status_t name (void)
+#define SWITCH_MODULE_SHUTDOWN_FUNCTION(name) switch_status_t name (void)
+
+/* the harness links one module, and finds its function table through harness_module */
+#define SWITCH_MODULE_DEFINITION(name, load, shutdown, runtime) \
+	static const char modname[] = #name; \
+	switch_loadable_module_function_table_t name##_module_interface = { load, shutdown, runtime }; \
+	switch_loadable_module_function_table_t *harness_module = &name##_module_interface
+
+#define SWITCH_STANDARD_API(name) static switch_status_t name (const char *cmd, switch_core_session_t *session, \
+	switch_stream_handle_t *stream)
+
+#define SWITCH_ADD_API(api_int, int_name, descript, funcptr, syntax_string) \
+	for (;;) { \
+		api_int = (switch_api_interface_t *) switch_loadable_module_create_interface(*module_interface, SWITCH_API_INTERFACE); \
+		api_int->interface_name = int_name; \
+		api_int->desc = descript; \
+		api_int->function = funcptr; \
+		api_int->syntax = syntax_string; \
+		break; \
+	}
+
+struct switch_directories {
+	char *base_dir;
+	char *temp_dir;
+};
+extern struct switch_directories SWITCH_GLOBAL_dirs;
+
+#ifdef __cplusplus
+}
+#endif
+
+#include "switch_json.h"
+#include "switch_vad.h"
+
+#endif
@@ -0,0 +1,470 @@
+/*
+ * switch_json.c -- the cJSON subset declared in switch_json.h, for frame_harness.
+ */
+#include <ctype.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "switch_json.h"
+
+static cJSON *new_item(int type)
+{
+	cJSON *item = calloc(1, sizeof(*item));
+
+	if (item) item->type = type;
+	return item;
+}
+
+void cJSON_Delete(cJSON *item)
+{
+	while (item) {
+		cJSON *next = item->next;
+		if (item->child) cJSON_Delete(item->child);
+		free(item->valuestring);
+		free(item->string);
+		free(item);
+		item = next;
+	}
+}
+
+cJSON *cJSON_CreateNull(void) { return new_item(cJSON_NULL); }
+cJSON *cJSON_CreateTrue(void) { return new_item(cJSON_True); }
+cJSON *cJSON_CreateFalse(void) { return new_item(cJSON_False); }
+cJSON *cJSON_CreateBool(cJSON_bool boolean) { return new_item(boolean ? cJSON_True : cJSON_False); }
+cJSON *cJSON_CreateArray(void) { return new_item(cJSON_Array); }
+cJSON *cJSON_CreateObject(void) { return new_item(cJSON_Object); }
+
+cJSON *cJSON_CreateNumber(double num)
+{
+	cJSON *item = new_item(cJSON_Number);
+
+	if (item) {
+		item->valuedouble = num;
+		item->valueint = num >= 2147483647.0 ? 2147483647 : num <= -2147483648.0 ? (-2147483647 - 1) : (int) num;
+	}
+	return item;
+}
+
+cJSON *cJSON_CreateString(const char *string)
+{
+	cJSON *item = new_item(cJSON_String);
+
+	if (item && !(item->valuestring = strdup(string ? string : ""))) {
+		free(item);
+		return NULL;
+	}
+	return item;
+}
+
+void cJSON_AddItemToArray(cJSON *array, cJSON *item)
+{
+	cJSON *c;
+
+	if (!array || !item) return;
+	item->next = NULL;
+	if (!(c = array->child)) {
+		array->child = item;
+		item->prev = NULL;
+		return;
+	}
+	while (c->next) c = c->next;
+	c->next = item;
+	item->prev = c;
+}
+
+void cJSON_AddItemToObject(cJSON *object, const char *string, cJSON *item)
+{
+	if (!object || !item || !string) return;
+	free(item->string);
+	item->string = strdup(string);
+	cJSON_AddItemToArray(object, item);
+}
+
+cJSON *cJSON_AddNullToObject(cJSON *object, const char *name)
+{
+	cJSON *item = cJSON_CreateNull();
+
+	cJSON_AddItemToObject(object, name, item);
+	return item;
+}
+
+cJSON *cJSON_AddBoolToObject(cJSON *object, const char *name, cJSON_bool boolean)
+{
+	cJSON *item = cJSON_CreateBool(boolean);
+
+	cJSON_AddItemToObject(object, name, item);
+	return item;
+}
+
+cJSON *cJSON_AddNumberToObject(cJSON *object, const char *name, double number)
+{
+	cJSON *item = cJSON_CreateNumber(number);
+
+	cJSON_AddItemToObject(object, name, item);
+	return item;
+}
+
+cJSON *cJSON_AddStringToObject(cJSON *object, const char *name, const char *string)
+{
+	cJSON *item = cJSON_CreateString(string);
+
+	cJSON_AddItemToObject(object, name, item);
+	return item;
+}
+
+int cJSON_GetArraySize(const cJSON *array)
+{
+	cJSON *c;
+	int n = 0;
+
+	if (!array) return 0;
+	for (c = array->child; c; c = c->next) n++;
+	return n;
+}
+
+cJSON *cJSON_GetArrayItem(const cJSON *array, int index)
+{
+	cJSON *c;
+
+	if (!array || index < 0) return NULL;
+	for (c = array->child; c && index > 0; c = c->next) index--;
+	return c;
+}
+
+cJSON *cJSON_GetObjectItem(const cJSON *object, const char *string)
+{
+	cJSON *c;
+
+	if (!object || !string) return NULL;
+	for (c = object->child; c; c = c->next) {
+		if (c->string && !strcasecmp(c->string, string)) return c;
+	}
+	return NULL;
+}
+
+const char *cJSON_GetObjectCstr(const cJSON *object, const char *string)
+{
+	cJSON *item = cJSON_GetObjectItem(object, string);
+
+	return item && item->type == cJSON_String ? item->valuestring : NULL;
+}
+
+cJSON *cJSON_DetachItemFromObject(cJSON *object, const char *string)
+{
+	cJSON *item = cJSON_GetObjectItem(object, string);
+
+	if (!item) return NULL;
+	if (item->prev) item->prev->next = item->next;
+	if (item->next) item->next->prev = item->prev;
+	if (object->child == item) object->child = item->next;
+	item->prev = item->next = NULL;
+	return item;
+}
+
+void cJSON_DeleteItemFromObject(cJSON *object, const char *string)
+{
+	cJSON_Delete(cJSON_DetachItemFromObject(object, string));
+}
+
+cJSON_bool cJSON_IsFalse(const cJSON *item) { return item && item->type == cJSON_False; }
+cJSON_bool cJSON_IsTrue(const cJSON *item) { return item && item->type == cJSON_True; }
+cJSON_bool cJSON_IsBool(const cJSON *item) { return item && (item->type & (cJSON_True | cJSON_False)); }
+cJSON_bool cJSON_IsNull(const cJSON *item) { return item && item->type == cJSON_NULL; }
+cJSON_bool cJSON_IsNumber(const cJSON *item) { return item && item->type == cJSON_Number; }
+cJSON_bool cJSON_IsString(const cJSON *item) { return item && item->type == cJSON_String; }
+cJSON_bool cJSON_IsArray(const cJSON *item) { return item && item->type == cJSON_Array; }
+cJSON_bool cJSON_IsObject(const cJSON *item) { return item && item->type == cJSON_Object; }
+
+/* printing */
+
+typedef struct {
+	char *buf;
+	size_t len;
+	size_t size;
+	int failed;
+} printbuf_t;
+
+static void put(printbuf_t *p, const char *s, size_t n)
+{
+	if (p->failed) return;
+	if (p->len + n + 1 > p->size) {
+		size_t size = p->size ? p->size : 64;
+		char *buf;
+		while (p->len + n + 1 > size) size *= 2;
+		if (!(buf = realloc(p->buf, size))) {
+			p->failed = 1;
+			return;
+		}
+		p->buf = buf;
+		p->size = size;
+	}
+	memcpy(p->buf + p->len, s, n);
+	p->len += n;
+	p->buf[p->len] = '\0';
+}
+
+static void put_string(printbuf_t *p, const char *s)
+{
+	put(p, "\"", 1);
+	for (; s && *s; s++) {
+		unsigned char c = (unsigned char) *s;
+		char esc[8];
+		switch (c) {
+		case '"': put(p, "\\\"", 2); break;
+		case '\\': put(p, "\\\\", 2); break;
+		case '\b': put(p, "\\b", 2); break;
+		case '\f': put(p, "\\f", 2); break;
+		case '\n': put(p, "\\n", 2); break;
+		case '\r': put(p, "\\r", 2); break;
+		case '\t': put(p, "\\t", 2); break;
+		default:
+			if (c < 0x20) {
+				snprintf(esc, sizeof(esc), "\\u%04x", c);
+				put(p, esc, 6);
+			}
+			else put(p, s, 1);
+		}
+	}
+	put(p, "\"", 1);
+}
+
+static void put_item(printbuf_t *p, const cJSON *item)
+{
+	char num[32];
+	const cJSON *c;
+
+	switch (item->type & 0xff) {
+	case cJSON_NULL: put(p, "null", 4); break;
+	case cJSON_False: put(p, "false", 5); break;
+	case cJSON_True: put(p, "true", 4); break;
+	case cJSON_Number:
+		if (isnan(item->valuedouble) || isinf(item->valuedouble)) snprintf(num, sizeof(num), "null");
+		else if (item->valuedouble == (double) item->valueint) snprintf(num, sizeof(num), "%d", item->valueint);
+		else {
+			snprintf(num, sizeof(num), "%1.15g", item->valuedouble);
+			if (strtod(num, NULL) != item->valuedouble) snprintf(num, sizeof(num), "%1.17g", item->valuedouble);
+		}
+		put(p, num, strlen(num));
+		break;
+	case cJSON_String: put_string(p, item->valuestring); break;
+	case cJSON_Array:
+		put(p, "[", 1);
+		for (c = item->child; c; c = c->next) {
+			put_item(p, c);
+			if (c->next) put(p, ",", 1);
+		}
+		put(p, "]", 1);
+		break;
+	case cJSON_Object:
+		put(p, "{", 1);
+		for (c = item->child; c; c = c->next) {
+			put_string(p, c->string);
+			put(p, ":", 1);
+			put_item(p, c);
+			if (c->next) put(p, ",", 1);
+		}
+		put(p, "}", 1);
+		break;
+	default: break;
+	}
+}
+
+char *cJSON_PrintUnformatted(const cJSON *item)
+{
+	printbuf_t p = { NULL, 0, 0, 0 };
+
+	if (!item) return NULL;
+	put_item(&p, item);
+	if (p.failed) {
+		free(p.buf);
+		return NULL;
+	}
+	return p.buf;
+}
+
+/* the harness only logs what it prints, so there is no formatted variant */
+char *cJSON_Print(const cJSON *item)
+{
+	return cJSON_PrintUnformatted(item);
+}
+
+/* parsing */
+
+static const char *skip(const char *s)
+{
+	while (s && *s && isspace((unsigned char) *s)) s++;
+	return s;
+}
+
+static const char *parse_value(cJSON *item, const char *s, int depth);
+
+static unsigned parse_hex4(const char *s)
+{
+	unsigned h = 0;
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		char c = s[i];
+		h <<= 4;
+		if (c >= '0' && c <= '9') h += c - '0';
+		else if (c >= 'a' && c <= 'f') h += 10 + c - 'a';
+		else if (c >= 'A' && c <= 'F') h += 10 + c - 'A';
+		else return 0xffffffff;
+	}
+	return h;
+}
+
+static const char *parse_string(char **out, const char *s)
+{
+	const char *end = s + 1;
+	char *buf, *o;
+	size_t n = 0;
+
+	if (*s != '"') return NULL;
+	while (*end && *end != '"') {
+		if (*end == '\\' && end[1]) end++;
+		end++;
+		n++;
+	}
+	if (*end != '"') return NULL;
+	if (!(o = buf = malloc(n * 4 + 1))) return NULL;
+	for (s++; s < end; s++) {
+		if (*s != '\\') {
+			*o++ = *s;
+			continue;
+		}
+		switch (*++s) {
+		case 'b': *o++ = '\b'; break;
+		case 'f': *o++ = '\f'; break;
+		case 'n': *o++ = '\n'; break;
+		case 'r': *o++ = '\r'; break;
+		case 't': *o++ = '\t'; break;
+		case 'u': {
+			unsigned cp = end - s > 4 ? parse_hex4(s + 1) : 0xffffffff;
+			if (cp == 0xffffffff) {
+				free(buf);
+				return NULL;
+			}
+			s += 4;
+			if (cp >= 0xd800 && cp <= 0xdbff && end - s > 6 && s[1] == '\\' && s[2] == 'u') {
+				unsigned lo = parse_hex4(s + 3);
+				if (lo >= 0xdc00 && lo <= 0xdfff) {
+					cp = 0x10000 + (((cp & 0x3ff) << 10) | (lo & 0x3ff));
+					s += 6;
+				}
+			}
+			if (cp < 0x80) *o++ = (char) cp;
+			else if (cp < 0x800) {
+				*o++ = (char) (0xc0 | (cp >> 6));
+				*o++ = (char) (0x80 | (cp & 0x3f));
+			}
+			else if (cp < 0x10000) {
+				*o++ = (char) (0xe0 | (cp >> 12));
+				*o++ = (char) (0x80 | ((cp >> 6) & 0x3f));
+				*o++ = (char) (0x80 | (cp & 0x3f));
+			}
+			else {
+				*o++ = (char) (0xf0 | (cp >> 18));
+				*o++ = (char) (0x80 | ((cp >> 12) & 0x3f));
+				*o++ = (char) (0x80 | ((cp >> 6) & 0x3f));
+				*o++ = (char) (0x80 | (cp & 0x3f));
+			}
+			break;
+		}
+		default: *o++ = *s; break;
+		}
+	}
+	*o = '\0';
+	*out = buf;
+	return end + 1;
+}
+
+static const char *parse_members(cJSON *item, const char *s, int depth, char close)
+{
+	cJSON *last = NULL;
+
+	s = skip(s + 1);
+	if (*s == close) return s + 1;
+	for (;;) {
+		cJSON *child = new_item(cJSON_Invalid);
+		if (!child) return NULL;
+		if (last) {
+			last->next = child;
+			child->prev = last;
+		}
+		else item->child = child;
+		last = child;
+
+		if (close == '}') {
+			if (!(s = parse_string(&child->string, skip(s)))) return NULL;
+			s = skip(s);
+			if (*s != ':') return NULL;
+			s++;
+		}
+		if (!(s = parse_value(child, skip(s), depth + 1))) return NULL;
+		s = skip(s);
+		if (*s == ',') {
+			s++;
+			continue;
+		}
+		if (*s == close) return s + 1;
+		return NULL;
+	}
+}
+
+static const char *parse_value(cJSON *item, const char *s, int depth)
+{
+	char *end;
+
+	if (!s || depth > 1000) return NULL;
+	if (!strncmp(s, "null", 4)) {
+		item->type = cJSON_NULL;
+		return s + 4;
+	}
+	if (!strncmp(s, "false", 5)) {
+		item->type = cJSON_False;
+		return s + 5;
+	}
+	if (!strncmp(s, "true", 4)) {
+		item->type = cJSON_True;
+		item->valueint = 1;
+		return s + 4;
+	}
+	if (*s == '"') {
+		item->type = cJSON_String;
+		return parse_string(&item->valuestring, s);
+	}
+	if (*s == '-' || (*s >= '0' && *s <= '9')) {
+		double d = strtod(s, &end);
+		if (end == s) return NULL;
+		item->type = cJSON_Number;
+		item->valuedouble = d;
+		item->valueint = d >= 2147483647.0 ? 2147483647 : d <= -2147483648.0 ? (-2147483647 - 1) : (int) d;
+		return end;
+	}
+	if (*s == '[') {
+		item->type = cJSON_Array;
+		return parse_members(item, s, depth, ']');
+	}
+	if (*s == '{') {
+		item->type = cJSON_Object;
+		return parse_members(item, s, depth, '}');
+	}
+	return NULL;
+}
+
+cJSON *cJSON_Parse(const char *value)
+{
+	cJSON *item;
+
+	if (!value || !(item = new_item(cJSON_Invalid))) return NULL;
+	if (!parse_value(item, skip(value), 0)) {
+		cJSON_Delete(item);
+		return NULL;
+	}
+	return item;
+}
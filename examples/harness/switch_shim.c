@@ -0,0 +1,860 @@
+/*
+ * switch_shim.c -- the FreeSWITCH core behaviour behind switch.h and harness.h, for frame_harness.
+ *
+ * Everything the modules can reach from more than one thread is locked the way the core locks it: the
+ * session registry (switch_core_session_locate from the modules' service threads), a session's channel
+ * variables and private data, and its media bug list, which is held while a frame is read into the bugs
+ * so that an API "stop" on another thread waits for the callback in progress, as it does in the core.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <sys/time.h>
+
+#include "harness.h"
+
+struct switch_directories SWITCH_GLOBAL_dirs = { "/tmp", "/tmp" };
+
+static switch_log_level_t log_level = SWITCH_LOG_CRIT;
+static volatile uint64_t events_fired;
+
+/* memory pools: every allocation is kept on a list and freed with the pool */
+
+struct pool_block {
+	struct pool_block *next;
+	size_t pad;
+};
+
+struct switch_memory_pool {
+	pthread_mutex_t lock;
+	struct pool_block *blocks;
+};
+
+static switch_memory_pool_t *pool_create(void)
+{
+	switch_memory_pool_t *pool = calloc(1, sizeof(*pool));
+
+	if (pool) pthread_mutex_init(&pool->lock, NULL);
+	return pool;
+}
+
+static void *pool_alloc(switch_memory_pool_t *pool, size_t size)
+{
+	struct pool_block *block = calloc(1, sizeof(*block) + size);
+
+	if (!block) return NULL;
+	pthread_mutex_lock(&pool->lock);
+	block->next = pool->blocks;
+	pool->blocks = block;
+	pthread_mutex_unlock(&pool->lock);
+	return block + 1;
+}
+
+static void pool_destroy(switch_memory_pool_t *pool)
+{
+	struct pool_block *block, *next;
+
+	if (!pool) return;
+	for (block = pool->blocks; block; block = next) {
+		next = block->next;
+		free(block);
+	}
+	pthread_mutex_destroy(&pool->lock);
+	free(pool);
+}
+
+/* sessions */
+
+struct kv {
+	char *name;
+	char *value;
+	const void *ptr;
+	struct kv *next;
+};
+
+struct switch_channel {
+	switch_core_session_t *session;
+	char name[128];
+	pthread_mutex_t lock;
+	struct kv *variables;
+	struct kv *privates;
+	uint32_t flags;
+};
+
+struct switch_media_bug {
+	switch_core_session_t *session;
+	char function[64];
+	switch_media_bug_callback_t callback;
+	void *user_data;
+	switch_media_bug_flag_t flags;
+	const int16_t *read;
+	const int16_t *write;
+	uint32_t samples;
+	int pending;
+	struct switch_media_bug *next;
+};
+
+struct switch_core_session {
+	char uuid[64];
+	switch_memory_pool_t *pool;
+	struct switch_channel channel;
+	switch_codec_implementation_t impl;
+	switch_codec_t codec;
+	pthread_mutex_t bug_lock;
+	switch_media_bug_t *bugs;
+	int refs;
+	int destroying;
+	struct switch_core_session *next;
+};
+
+static pthread_mutex_t sessions_lock = PTHREAD_MUTEX_INITIALIZER;
+static switch_core_session_t *sessions;
+static struct kv *default_variables;
+
+static struct kv *kv_find(struct kv *list, const char *name)
+{
+	for (; list; list = list->next) {
+		if (!strcasecmp(list->name, name)) return list;
+	}
+	return NULL;
+}
+
+static void kv_free(struct kv *list)
+{
+	while (list) {
+		struct kv *next = list->next;
+		free(list->name);
+		free(list->value);
+		free(list);
+		list = next;
+	}
+}
+
+static void kv_set(struct kv **list, const char *name, const char *value, const void *ptr)
+{
+	struct kv *entry = kv_find(*list, name);
+
+	if (!entry) {
+		if (!(entry = calloc(1, sizeof(*entry))) || !(entry->name = strdup(name))) {
+			free(entry);
+			return;
+		}
+		entry->next = *list;
+		*list = entry;
+	}
+	free(entry->value);
+	entry->value = value ? strdup(value) : NULL;
+	entry->ptr = ptr;
+}
+
+void harness_set_default_variable(const char *name, const char *value)
+{
+	kv_set(&default_variables, name, value, NULL);
+}
+
+switch_core_session_t *harness_session_create(const char *uuid, uint32_t rate)
+{
+	switch_core_session_t *session = calloc(1, sizeof(*session));
+	pthread_mutexattr_t attr;
+	struct kv *var;
+
+	if (!session) return NULL;
+	if (!(session->pool = pool_create())) {
+		free(session);
+		return NULL;
+	}
+	snprintf(session->uuid, sizeof(session->uuid), "%s", uuid);
+	session->channel.session = session;
+	snprintf(session->channel.name, sizeof(session->channel.name), "harness/%s", uuid);
+	pthread_mutex_init(&session->channel.lock, NULL);
+	for (var = default_variables; var; var = var->next) kv_set(&session->channel.variables, var->name, var->value, NULL);
+
+	session->impl.iananame = "L16";
+	session->impl.samples_per_second = rate;
+	session->impl.actual_samples_per_second = rate;
+	session->impl.microseconds_per_packet = 20000;
+	session->impl.samples_per_packet = rate / 50;
+	session->impl.decoded_bytes_per_packet = rate / 50 * sizeof(int16_t);
+	session->impl.number_of_channels = 1;
+	session->codec.implementation = &session->impl;
+
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&session->bug_lock, &attr);
+	pthread_mutexattr_destroy(&attr);
+
+	pthread_mutex_lock(&sessions_lock);
+	session->next = sessions;
+	sessions = session;
+	pthread_mutex_unlock(&sessions_lock);
+	return session;
+}
+
+static void bug_close(switch_media_bug_t *bug)
+{
+	if (bug->callback) bug->callback(bug, bug->user_data, SWITCH_ABC_TYPE_CLOSE);
+	free(bug);
+}
+
+void harness_session_destroy(switch_core_session_t *session)
+{
+	switch_core_session_t **s;
+	int refs;
+
+	pthread_mutex_lock(&sessions_lock);
+	session->destroying = 1;
+	pthread_mutex_unlock(&sessions_lock);
+
+	pthread_mutex_lock(&session->bug_lock);
+	while (session->bugs) {
+		switch_media_bug_t *bug = session->bugs;
+		session->bugs = bug->next;
+		bug_close(bug);
+	}
+	pthread_mutex_unlock(&session->bug_lock);
+
+	/* a service thread may still be inside a locate..rwunlock pair */
+	do {
+		pthread_mutex_lock(&sessions_lock);
+		refs = session->refs;
+		if (!refs) {
+			for (s = &sessions; *s; s = &(*s)->next) {
+				if (*s == session) {
+					*s = session->next;
+					break;
+				}
+			}
+		}
+		pthread_mutex_unlock(&sessions_lock);
+		if (refs) usleep(1000);
+	} while (refs);
+
+	kv_free(session->channel.variables);
+	kv_free(session->channel.privates);
+	pthread_mutex_destroy(&session->channel.lock);
+	pthread_mutex_destroy(&session->bug_lock);
+	pool_destroy(session->pool);
+	free(session);
+}
+
+int harness_session_read(switch_core_session_t *session, const int16_t *read, const int16_t *write, uint32_t samples)
+{
+	switch_media_bug_t **link, *bug;
+	int ran = 0;
+
+	pthread_mutex_lock(&session->bug_lock);
+	link = &session->bugs;
+	while ((bug = *link)) {
+		bug->read = read;
+		bug->write = write;
+		bug->samples = samples;
+		bug->pending = 1;
+		ran++;
+		if (bug->callback && bug->callback(bug, bug->user_data, SWITCH_ABC_TYPE_READ) == SWITCH_FALSE) {
+			*link = bug->next;
+			bug_close(bug);
+			continue;
+		}
+		bug->pending = 0;
+		link = &bug->next;
+	}
+	pthread_mutex_unlock(&session->bug_lock);
+	return ran;
+}
+
+uint32_t harness_session_bug_count(switch_core_session_t *session)
+{
+	switch_media_bug_t *bug;
+	uint32_t count = 0;
+
+	pthread_mutex_lock(&session->bug_lock);
+	for (bug = session->bugs; bug; bug = bug->next) count++;
+	pthread_mutex_unlock(&session->bug_lock);
+	return count;
+}
+
+switch_channel_t *switch_core_session_get_channel(switch_core_session_t *session)
+{
+	return session ? &session->channel : NULL;
+}
+
+const char *switch_core_session_get_uuid(switch_core_session_t *session)
+{
+	return session ? session->uuid : NULL;
+}
+
+switch_memory_pool_t *switch_core_session_get_pool(switch_core_session_t *session)
+{
+	return session->pool;
+}
+
+void *switch_core_session_alloc(switch_core_session_t *session, size_t memory)
+{
+	return pool_alloc(session->pool, memory);
+}
+
+char *switch_core_session_strdup(switch_core_session_t *session, const char *todup)
+{
+	size_t len = strlen(todup) + 1;
+	char *dup = pool_alloc(session->pool, len);
+
+	if (dup) memcpy(dup, todup, len);
+	return dup;
+}
+
+switch_status_t switch_core_session_get_read_impl(switch_core_session_t *session, switch_codec_implementation_t *impp)
+{
+	*impp = session->impl;
+	return SWITCH_STATUS_SUCCESS;
+}
+
+switch_codec_t *switch_core_session_get_read_codec(switch_core_session_t *session)
+{
+	return &session->codec;
+}
+
+switch_core_session_t *switch_core_session_locate(const char *uuid_str)
+{
+	switch_core_session_t *session;
+
+	if (!uuid_str) return NULL;
+	pthread_mutex_lock(&sessions_lock);
+	for (session = sessions; session; session = session->next) {
+		if (!session->destroying && !strcmp(session->uuid, uuid_str)) {
+			session->refs++;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&sessions_lock);
+	return session;
+}
+
+switch_status_t switch_core_session_read_lock(switch_core_session_t *session)
+{
+	switch_status_t status = SWITCH_STATUS_FALSE;
+
+	pthread_mutex_lock(&sessions_lock);
+	if (!session->destroying) {
+		session->refs++;
+		status = SWITCH_STATUS_SUCCESS;
+	}
+	pthread_mutex_unlock(&sessions_lock);
+	return status;
+}
+
+void switch_core_session_rwunlock(switch_core_session_t *session)
+{
+	pthread_mutex_lock(&sessions_lock);
+	session->refs--;
+	pthread_mutex_unlock(&sessions_lock);
+}
+
+/* channels */
+
+const char *switch_channel_get_name(switch_channel_t *channel)
+{
+	return channel->name;
+}
+
+/* like the core, the value stays valid while the session lives unless the variable is set again */
+const char *switch_channel_get_variable(switch_channel_t *channel, const char *varname)
+{
+	struct kv *var;
+	const char *value = NULL;
+
+	if (!channel || !varname) return NULL;
+	pthread_mutex_lock(&channel->lock);
+	if ((var = kv_find(channel->variables, varname))) value = var->value;
+	pthread_mutex_unlock(&channel->lock);
+	return value;
+}
+
+switch_status_t switch_channel_set_variable(switch_channel_t *channel, const char *varname, const char *value)
+{
+	pthread_mutex_lock(&channel->lock);
+	kv_set(&channel->variables, varname, value, NULL);
+	pthread_mutex_unlock(&channel->lock);
+	return SWITCH_STATUS_SUCCESS;
+}
+
+void *switch_channel_get_private(switch_channel_t *channel, const char *key)
+{
+	struct kv *entry;
+	void *ptr = NULL;
+
+	pthread_mutex_lock(&channel->lock);
+	if ((entry = kv_find(channel->privates, key))) ptr = (void *) entry->ptr;
+	pthread_mutex_unlock(&channel->lock);
+	return ptr;
+}
+
+switch_status_t switch_channel_set_private(switch_channel_t *channel, const char *key, const void *private_info)
+{
+	pthread_mutex_lock(&channel->lock);
+	kv_set(&channel->privates, key, NULL, private_info);
+	pthread_mutex_unlock(&channel->lock);
+	return SWITCH_STATUS_SUCCESS;
+}
+
+switch_status_t switch_channel_pre_answer(switch_channel_t *channel)
+{
+	(void) channel;
+	return SWITCH_STATUS_SUCCESS;
+}
+
+void switch_channel_set_flag_value(switch_channel_t *channel, switch_channel_flag_t flag, uint32_t value)
+{
+	pthread_mutex_lock(&channel->lock);
+	if (value) channel->flags |= (1u << flag);
+	else channel->flags &= ~(1u << flag);
+	pthread_mutex_unlock(&channel->lock);
+}
+
+/* media bugs */
+
+switch_status_t switch_core_media_bug_add(switch_core_session_t *session, const char *function, const char *target,
+	switch_media_bug_callback_t callback, void *user_data, time_t stop_time, switch_media_bug_flag_t flags,
+	switch_media_bug_t **new_bug)
+{
+	switch_media_bug_t *bug = calloc(1, sizeof(*bug)), **link;
+
+	(void) target;
+	(void) stop_time;
+	if (!bug) return SWITCH_STATUS_MEMERR;
+	bug->session = session;
+	snprintf(bug->function, sizeof(bug->function), "%s", function ? function : "");
+	bug->callback = callback;
+	bug->user_data = user_data;
+	bug->flags = flags;
+
+	if (callback && callback(bug, user_data, SWITCH_ABC_TYPE_INIT) == SWITCH_FALSE) {
+		free(bug);
+		return SWITCH_STATUS_GENERR;
+	}
+
+	pthread_mutex_lock(&session->bug_lock);
+	for (link = &session->bugs; *link; link = &(*link)->next);
+	*link = bug;
+	pthread_mutex_unlock(&session->bug_lock);
+	*new_bug = bug;
+	return SWITCH_STATUS_SUCCESS;
+}
+
+switch_status_t switch_core_media_bug_remove(switch_core_session_t *session, switch_media_bug_t **bug)
+{
+	switch_media_bug_t **link;
+	switch_status_t status = SWITCH_STATUS_FALSE;
+
+	if (!bug || !*bug) return status;
+	pthread_mutex_lock(&session->bug_lock);
+	for (link = &session->bugs; *link; link = &(*link)->next) {
+		if (*link == *bug) {
+			*link = (*bug)->next;
+			bug_close(*bug);
+			*bug = NULL;
+			status = SWITCH_STATUS_SUCCESS;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&session->bug_lock);
+	return status;
+}
+
+/*
+ * The frame being read, once per READ callback.  Stereo bugs get the caller on the left and the far end on
+ * the right; a mono bug on both streams gets them mixed, as the core does.  A buffer too small for the
+ * frame loses it.
+ */
+switch_status_t switch_core_media_bug_read(switch_media_bug_t *bug, switch_frame_t *frame, switch_bool_t fill)
+{
+	uint32_t channels = (bug->flags & SMBF_STEREO) ? 2 : 1;
+	uint32_t bytes = bug->samples * channels * sizeof(int16_t);
+	int16_t *out = frame->data;
+	uint32_t i;
+
+	(void) fill;
+	if (!bug->pending) return SWITCH_STATUS_FALSE;
+	bug->pending = 0;
+	if (frame->buflen < bytes) return SWITCH_STATUS_FALSE;
+
+	if (channels == 2) {
+		for (i = 0; i < bug->samples; i++) {
+			out[i * 2] = bug->read[i];
+			out[i * 2 + 1] = bug->write[i];
+		}
+	}
+	else if ((bug->flags & SMBF_READ_STREAM) && (bug->flags & SMBF_WRITE_STREAM)) {
+		for (i = 0; i < bug->samples; i++) {
+			int32_t v = bug->read[i] + bug->write[i];
+			out[i] = (int16_t) (v > 32767 ? 32767 : v < -32768 ? -32768 : v);
+		}
+	}
+	else {
+		memcpy(out, (bug->flags & SMBF_READ_STREAM) ? bug->read : bug->write, bytes);
+	}
+	frame->datalen = bytes;
+	frame->samples = bug->samples;
+	frame->rate = bug->session->impl.actual_samples_per_second;
+	frame->channels = channels;
+	frame->flags = 0;
+	return SWITCH_STATUS_SUCCESS;
+}
+
+switch_status_t switch_core_media_bug_flush(switch_media_bug_t *bug)
+{
+	bug->pending = 0;
+	return SWITCH_STATUS_SUCCESS;
+}
+
+void *switch_core_media_bug_get_user_data(switch_media_bug_t *bug)
+{
+	return bug->user_data;
+}
+
+switch_core_session_t *switch_core_media_bug_get_session(switch_media_bug_t *bug)
+{
+	return bug->session;
+}
+
+/* events are built as the module builds them, then counted and dropped */
+
+switch_status_t switch_event_reserve_subclass(const char *subclass_name)
+{
+	(void) subclass_name;
+	return SWITCH_STATUS_SUCCESS;
+}
+
+switch_status_t switch_event_free_subclass(const char *subclass_name)
+{
+	(void) subclass_name;
+	return SWITCH_STATUS_SUCCESS;
+}
+
+switch_status_t switch_event_create_subclass(switch_event_t **event, switch_event_types_t event_id, const char *subclass_name)
+{
+	if (!(*event = calloc(1, sizeof(**event)))) return SWITCH_STATUS_MEMERR;
+	(*event)->event_id = event_id;
+	if (subclass_name) (*event)->subclass_name = strdup(subclass_name);
+	return SWITCH_STATUS_SUCCESS;
+}
+
+switch_status_t switch_event_add_header_string(switch_event_t *event, switch_stack_t stack, const char *header_name,
+	const char *data)
+{
+	switch_event_header_t *header = calloc(1, sizeof(*header));
+
+	if (!header) return SWITCH_STATUS_MEMERR;
+	header->name = strdup(header_name);
+	header->value = strdup(data ? data : "");
+	if (stack == SWITCH_STACK_TOP) {
+		header->next = event->headers;
+		event->headers = header;
+		if (!event->last_header) event->last_header = header;
+	}
+	else {
+		if (event->last_header) event->last_header->next = header;
+		else event->headers = header;
+		event->last_header = header;
+	}
+	return SWITCH_STATUS_SUCCESS;
+}
+
+switch_status_t switch_event_add_header(switch_event_t *event, switch_stack_t stack, const char *header_name,
+	const char *fmt, ...)
+{
+	char *data = NULL;
+	switch_status_t status;
+	va_list ap;
+	int ret;
+
+	va_start(ap, fmt);
+	ret = vasprintf(&data, fmt, ap);
+	va_end(ap);
+	if (ret < 0) return SWITCH_STATUS_MEMERR;
+	status = switch_event_add_header_string(event, stack, header_name, data);
+	free(data);
+	return status;
+}
+
+switch_status_t switch_event_add_body(switch_event_t *event, const char *fmt, ...)
+{
+	va_list ap;
+	int ret;
+
+	free(event->body);
+	event->body = NULL;
+	va_start(ap, fmt);
+	ret = vasprintf(&event->body, fmt, ap);
+	va_end(ap);
+	if (ret < 0) {
+		event->body = NULL;
+		return SWITCH_STATUS_MEMERR;
+	}
+	return SWITCH_STATUS_SUCCESS;
+}
+
+void switch_event_destroy(switch_event_t **event)
+{
+	switch_event_header_t *header, *next;
+
+	if (!event || !*event) return;
+	for (header = (*event)->headers; header; header = next) {
+		next = header->next;
+		free(header->name);
+		free(header->value);
+		free(header);
+	}
+	free((*event)->subclass_name);
+	free((*event)->body);
+	free(*event);
+	*event = NULL;
+}
+
+switch_status_t switch_event_fire(switch_event_t **event)
+{
+	if (log_level >= SWITCH_LOG_DEBUG) {
+		fprintf(stderr, "event %s: %s\n", (*event)->subclass_name ? (*event)->subclass_name : "",
+			(*event)->body ? (*event)->body : "");
+	}
+	__atomic_add_fetch(&events_fired, 1, __ATOMIC_RELAXED);
+	switch_event_destroy(event);
+	return SWITCH_STATUS_SUCCESS;
+}
+
+uint64_t harness_events_fired(void)
+{
+	return __atomic_load_n(&events_fired, __ATOMIC_RELAXED);
+}
+
+void switch_channel_event_set_data(switch_channel_t *channel, switch_event_t *event)
+{
+	switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Channel-Name", channel->name);
+	switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Unique-ID", channel->session->uuid);
+}
+
+/* logging */
+
+void harness_set_log_level(switch_log_level_t level)
+{
+	log_level = level;
+}
+
+void switch_log_printf(switch_text_channel_t channel, const char *file, const char *func, int line,
+	const char *userdata, switch_log_level_t level, const char *fmt, ...)
+{
+	static const char *names[] = { "CONSOLE", "ALERT", "CRIT", "ERR", "WARNING", "NOTICE", "INFO", "DEBUG" };
+	char msg[2048];
+	va_list ap;
+
+	(void) channel;
+	(void) func;
+	(void) userdata;
+	if (level > log_level) return;
+	va_start(ap, fmt);
+	vsnprintf(msg, sizeof(msg), fmt, ap);
+	va_end(ap);
+	fprintf(stderr, "[%s] %s:%d %s", level <= SWITCH_LOG_DEBUG ? names[level] : "DEBUG", file, line, msg);
+}
+
+/* mutexes, atomics, time */
+
+struct switch_mutex {
+	pthread_mutex_t m;
+	int pooled;
+};
+
+switch_status_t switch_mutex_init(switch_mutex_t **lock, unsigned int flags, switch_memory_pool_t *pool)
+{
+	pthread_mutexattr_t attr;
+	switch_mutex_t *mutex = pool ? pool_alloc(pool, sizeof(*mutex)) : calloc(1, sizeof(*mutex));
+
+	if (!mutex) return SWITCH_STATUS_MEMERR;
+	mutex->pooled = pool != NULL;
+	pthread_mutexattr_init(&attr);
+	if (flags & SWITCH_MUTEX_NESTED) pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&mutex->m, &attr);
+	pthread_mutexattr_destroy(&attr);
+	*lock = mutex;
+	return SWITCH_STATUS_SUCCESS;
+}
+
+switch_status_t switch_mutex_destroy(switch_mutex_t *lock)
+{
+	pthread_mutex_destroy(&lock->m);
+	if (!lock->pooled) free(lock);
+	return SWITCH_STATUS_SUCCESS;
+}
+
+switch_status_t switch_mutex_lock(switch_mutex_t *lock)
+{
+	return pthread_mutex_lock(&lock->m) ? SWITCH_STATUS_FALSE : SWITCH_STATUS_SUCCESS;
+}
+
+switch_status_t switch_mutex_unlock(switch_mutex_t *lock)
+{
+	return pthread_mutex_unlock(&lock->m) ? SWITCH_STATUS_FALSE : SWITCH_STATUS_SUCCESS;
+}
+
+switch_status_t switch_mutex_trylock(switch_mutex_t *lock)
+{
+	return pthread_mutex_trylock(&lock->m) ? SWITCH_STATUS_FALSE : SWITCH_STATUS_SUCCESS;
+}
+
+uint32_t switch_atomic_read(volatile switch_atomic_t *mem)
+{
+	return __atomic_load_n(mem, __ATOMIC_SEQ_CST);
+}
+
+void switch_atomic_set(volatile switch_atomic_t *mem, uint32_t val)
+{
+	__atomic_store_n(mem, val, __ATOMIC_SEQ_CST);
+}
+
+void switch_atomic_add(volatile switch_atomic_t *mem, uint32_t val)
+{
+	__atomic_add_fetch(mem, val, __ATOMIC_SEQ_CST);
+}
+
+void switch_atomic_inc(volatile switch_atomic_t *mem)
+{
+	__atomic_add_fetch(mem, 1, __ATOMIC_SEQ_CST);
+}
+
+int switch_atomic_dec(volatile switch_atomic_t *mem)
+{
+	return __atomic_sub_fetch(mem, 1, __ATOMIC_SEQ_CST) != 0;
+}
+
+switch_time_t switch_micro_time_now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (switch_time_t) tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+/* strings */
+
+int switch_true(const char *expr)
+{
+	if (!expr) return SWITCH_FALSE;
+	if (!strcasecmp(expr, "yes") || !strcasecmp(expr, "on") || !strcasecmp(expr, "true") || !strcasecmp(expr, "t") ||
+		!strcasecmp(expr, "enabled") || !strcasecmp(expr, "active") || !strcasecmp(expr, "allow")) {
+		return SWITCH_TRUE;
+	}
+	return atoi(expr) != 0 ? SWITCH_TRUE : SWITCH_FALSE;
+}
+
+/* runs of spaces count as one separator; the last element gets the rest of the string */
+unsigned int switch_separate_string(char *buf, char delim, char **array, unsigned int arraylen)
+{
+	unsigned int count = 0;
+	char *p = buf;
+
+	if (!buf || !array || !arraylen) return 0;
+	memset(array, 0, arraylen * sizeof(*array));
+	while (*p) {
+		if (delim == ' ') {
+			while (*p == ' ') p++;
+			if (!*p) break;
+		}
+		array[count++] = p;
+		if (count == arraylen) break;
+		while (*p && *p != delim) p++;
+		if (*p) *p++ = '\0';
+	}
+	return count;
+}
+
+/* loadable modules and api commands */
+
+static switch_memory_pool_t *module_pool;
+static switch_loadable_module_interface_t *module_interface;
+
+switch_loadable_module_interface_t *switch_loadable_module_create_module_interface(switch_memory_pool_t *pool, const char *name)
+{
+	switch_loadable_module_interface_t *mod = pool_alloc(pool, sizeof(*mod));
+
+	if (mod) {
+		mod->module_name = name;
+		mod->pool = pool;
+		module_interface = mod;
+	}
+	return mod;
+}
+
+void *switch_loadable_module_create_interface(switch_loadable_module_interface_t *mod, switch_module_interface_name_t iname)
+{
+	switch_api_interface_t *api;
+
+	if (iname != SWITCH_API_INTERFACE) {
+		fprintf(stderr, "frame_harness: the module asked for an interface the harness does not provide (%d)\n", iname);
+		exit(1);
+	}
+	if ((api = pool_alloc(mod->pool, sizeof(*api)))) {
+		api->next = mod->api_interface;
+		mod->api_interface = api;
+	}
+	return api;
+}
+
+switch_status_t switch_api_execute(const char *cmd, const char *arg, switch_core_session_t *session, switch_stream_handle_t *stream)
+{
+	switch_api_interface_t *api;
+
+	if (!module_interface) return SWITCH_STATUS_FALSE;
+	for (api = module_interface->api_interface; api; api = api->next) {
+		if (!strcasecmp(api->interface_name, cmd)) return api->function(arg, session, stream);
+	}
+	stream->write_function(stream, "-ERR %s Command not found!\n", cmd);
+	return SWITCH_STATUS_FALSE;
+}
+
+switch_status_t switch_stream_write(switch_stream_handle_t *handle, const char *fmt, ...)
+{
+	va_list ap;
+	int need;
+
+	va_start(ap, fmt);
+	need = vsnprintf(NULL, 0, fmt, ap);
+	va_end(ap);
+	if (need < 0) return SWITCH_STATUS_FALSE;
+	if (handle->data_len + need + 1 > handle->data_size) {
+		size_t size = handle->data_size ? handle->data_size : 1024;
+		void *data;
+		while (handle->data_len + need + 1 > size) size += handle->alloc_chunk ? handle->alloc_chunk : 1024;
+		if (!(data = realloc(handle->data, size))) return SWITCH_STATUS_MEMERR;
+		handle->data = data;
+		handle->data_size = handle->alloc_len = size;
+	}
+	va_start(ap, fmt);
+	vsnprintf((char *) handle->data + handle->data_len, need + 1, fmt, ap);
+	va_end(ap);
+	handle->data_len += need;
+	handle->end = (char *) handle->data + handle->data_len;
+	return SWITCH_STATUS_SUCCESS;
+}
+
+void switch_console_set_complete(const char *string)
+{
+	(void) string;
+}
+
+switch_status_t harness_module_load(void)
+{
+	switch_loadable_module_interface_t *mod = NULL;
+
+	if (!(module_pool = pool_create())) return SWITCH_STATUS_MEMERR;
+	return harness_module->load(&mod, module_pool);
+}
+
+void harness_module_shutdown(void)
+{
+	if (harness_module->shutdown) harness_module->shutdown();
+}
+
+const char *harness_module_name(void)
+{
+	return module_interface ? module_interface->module_name : "";
+}
@@ -0,0 +1,131 @@
+/*
+ * switch_vad.c -- the energy path of FreeSWITCH's src/switch_vad.c, for frame_harness.
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "switch_vad.h"
+
+struct switch_vad_s {
+	int channels;
+	int sample_rate;
+	int debug;
+	int divisor;
+	int thresh;
+	int voice_samples_thresh;
+	int silence_samples_thresh;
+	int voice_samples;
+	int silence_samples;
+	switch_vad_state_t vad_state;
+};
+
+const char *switch_vad_state2str(switch_vad_state_t state)
+{
+	switch (state) {
+	case SWITCH_VAD_STATE_NONE: return "none";
+	case SWITCH_VAD_STATE_START_TALKING: return "start_talking";
+	case SWITCH_VAD_STATE_TALKING: return "talking";
+	case SWITCH_VAD_STATE_STOP_TALKING: return "stop_talking";
+	default: return "error";
+	}
+}
+
+void switch_vad_reset(switch_vad_t *vad)
+{
+	vad->vad_state = SWITCH_VAD_STATE_NONE;
+	vad->voice_samples = 0;
+	vad->silence_samples = 0;
+}
+
+switch_vad_t *switch_vad_init(int sample_rate, int channels)
+{
+	switch_vad_t *vad = calloc(1, sizeof(*vad));
+
+	if (!vad) return NULL;
+	vad->sample_rate = sample_rate ? sample_rate : 8000;
+	vad->channels = channels;
+	vad->silence_samples_thresh = 500 * vad->sample_rate / 1000;
+	vad->voice_samples_thresh = 200 * vad->sample_rate / 1000;
+	vad->thresh = 100;
+	vad->divisor = vad->sample_rate / 8000;
+	if (vad->divisor <= 0) vad->divisor = 1;
+	switch_vad_reset(vad);
+	return vad;
+}
+
+/* without libfvad there is no mode to set; freeswitch reports that the same way */
+int switch_vad_set_mode(switch_vad_t *vad, int mode)
+{
+	(void) vad;
+	(void) mode;
+	return 0;
+}
+
+void switch_vad_set_param(switch_vad_t *vad, const char *key, int val)
+{
+	if (!key) return;
+
+	if (!strcmp(key, "hangover_len")) {
+		/* deprecated, silence_ms instead */
+		vad->silence_samples_thresh = val * 10 * vad->sample_rate / 1000;
+	}
+	else if (!strcmp(key, "thresh")) {
+		vad->thresh = val;
+	}
+	else if (!strcmp(key, "debug")) {
+		vad->debug = val;
+	}
+	else if (!strcmp(key, "voice_ms")) {
+		vad->voice_samples_thresh = val * vad->sample_rate / 1000;
+	}
+	else if (!strcmp(key, "silence_ms")) {
+		vad->silence_samples_thresh = val * vad->sample_rate / 1000;
+	}
+}
+
+switch_vad_state_t switch_vad_process(switch_vad_t *vad, int16_t *data, unsigned int samples)
+{
+	int energy = 0, j = 0;
+	unsigned int count;
+	int score;
+
+	if (vad->vad_state == SWITCH_VAD_STATE_STOP_TALKING) vad->vad_state = SWITCH_VAD_STATE_NONE;
+	else if (vad->vad_state == SWITCH_VAD_STATE_START_TALKING) vad->vad_state = SWITCH_VAD_STATE_TALKING;
+
+	for (count = 0; count < samples; count++) {
+		energy += abs(data[j]);
+		j += vad->channels;
+	}
+	score = (uint32_t) (energy / (samples / vad->divisor));
+
+	if (score >= vad->thresh) {
+		vad->silence_samples = 0;
+		vad->voice_samples += samples;
+	}
+	else {
+		vad->silence_samples += samples;
+		vad->voice_samples = 0;
+	}
+
+	if (vad->vad_state == SWITCH_VAD_STATE_TALKING && vad->silence_samples > vad->silence_samples_thresh) {
+		vad->vad_state = SWITCH_VAD_STATE_STOP_TALKING;
+	}
+	else if (vad->vad_state == SWITCH_VAD_STATE_NONE && vad->voice_samples > vad->voice_samples_thresh) {
+		vad->vad_state = SWITCH_VAD_STATE_START_TALKING;
+	}
+	return vad->vad_state;
+}
+
+switch_vad_state_t switch_vad_get_state(switch_vad_t *vad)
+{
+	return vad->vad_state;
+}
+
+void switch_vad_destroy(switch_vad_t **vad)
+{
+	if (vad && *vad) {
+		free(*vad);
+		*vad = NULL;
+	}
+}
@@ -0,0 +1,37 @@
+/*
+ * switch_vad.h -- the switch_vad API, for frame_harness.
+ *
+ * switch_vad.c behind it is the per-sample energy path of FreeSWITCH's src/switch_vad.c, which is what
+ * switch_vad_process runs when FreeSWITCH is built without libfvad.
+ */
+#ifndef __HARNESS_SWITCH_VAD_H__
+#define __HARNESS_SWITCH_VAD_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct switch_vad_s switch_vad_t;
+
+typedef enum {
+	SWITCH_VAD_STATE_NONE,
+	SWITCH_VAD_STATE_START_TALKING,
+	SWITCH_VAD_STATE_TALKING,
+	SWITCH_VAD_STATE_STOP_TALKING,
+	SWITCH_VAD_STATE_ERROR
+} switch_vad_state_t;
+
+switch_vad_t *switch_vad_init(int sample_rate, int channels);
+int switch_vad_set_mode(switch_vad_t *vad, int mode);
+void switch_vad_set_param(switch_vad_t *vad, const char *key, int val);
+switch_vad_state_t switch_vad_process(switch_vad_t *vad, int16_t *data, unsigned int samples);
+switch_vad_state_t switch_vad_get_state(switch_vad_t *vad);
+void switch_vad_reset(switch_vad_t *vad);
+void switch_vad_destroy(switch_vad_t **vad);
+const char *switch_vad_state2str(switch_vad_state_t state);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
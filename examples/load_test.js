@@ -0,0 +1,154 @@
+/**
+ * Ramps up synthetic sessions on a freeswitch and reports what one of the modules costs per stream.
+ *
+ * Each session is a pair of endpoints on the media server with RTP looped between them: a prerecorded
+ * file plays endlessly into one, and the module under test is started on the other, so its media bug
+ * sees real frames at real-time rate.  No SIP or call generator is needed.
+ *
+ * While ramping, and every --interval seconds after, it prints the module's "<module>_metrics latency"
+ * report; "frame" is the media thread's time per frame callback.  The ramp stops at --sessions, or
+ * earlier once the frame p99 exceeds --max-frame-ms; the number reached is the sustained concurrency.
+ * If --pid names the local freeswitch process, its CPU use, threads and memory per session (from its
+ * RSS growth) are reported as well.
+ *
+ * node load_test.js --module audio_fork --sessions 200 --rate 10 \
+ *   --start 'uuid_audio_fork {uuid} start ws://127.0.0.1:3001 mono 16k {}' --pid $(pidof freeswitch)
+ *
+ * To measure a module without a media server, harness/frame_harness.cpp links its frame callbacks against
+ * a switch_* shim and drives the same API commands offline.
+ */
+const Srf = require('drachtio-srf');
+const srf = new Srf();
+const Mrf = require('drachtio-fsmrf');
+const mrf = new Mrf(srf);
+const fs = require('fs');
+const config = require('config');
+const argv = require('minimist')(process.argv.slice(2), {
+  default: {
+    module: 'audio_fork',
+    sessions: 100,
+    rate: 5,
+    duration: 60,
+    interval: 10,
+    file: 'ivr/ivr-welcome_to_freeswitch.wav',
+    start: 'uuid_audio_fork {uuid} start ws://127.0.0.1:3001 mono 16k {}',
+    stop: '',
+    'max-frame-ms': 20
+  }
+});
+
+const sessions = [];
+let baseline;
+let lastCpu;
+
+mrf.connect(config.get('freeswitch'))
+  .then((ms) => run(ms))
+  .catch((err) => {
+    console.log(err, 'Error connecting to freeswitch');
+    process.exit(1);
+  });
+
+async function run(ms) {
+  baseline = proc();
+  lastCpu = baseline && {ticks: baseline.ticks, at: Date.now()};
+  console.log(`ramping to ${argv.sessions} ${argv.module} sessions at ${argv.rate}/sec`);
+
+  let lastReport = Date.now();
+  while (sessions.length < argv.sessions) {
+    try {
+      sessions.push(await createSession(ms));
+    } catch (err) {
+      console.log(`failed to create session ${sessions.length + 1}: ${err.message}`);
+      break;
+    }
+    await sleep(1000 / argv.rate);
+
+    if (Date.now() - lastReport >= argv.interval * 1000) {
+      lastReport = Date.now();
+      const latency = await report(ms);
+      if (latency && latency.frame.p99 > argv['max-frame-ms']) {
+        console.log(`frame p99 ${latency.frame.p99}ms exceeds ${argv['max-frame-ms']}ms, stopping the ramp`);
+        break;
+      }
+    }
+  }
+
+  console.log(`holding ${sessions.length} sessions for ${argv.duration} seconds`);
+  const timer = setInterval(() => report(ms), argv.interval * 1000);
+  await sleep(argv.duration * 1000);
+  clearInterval(timer);
+  await report(ms);
+  console.log(`sustained ${sessions.length} concurrent sessions`);
+
+  for (const s of sessions) await destroySession(ms, s);
+  ms.disconnect();
+  process.exit(0);
+}
+
+async function createSession(ms) {
+  const listener = await ms.createEndpoint();
+  const speaker = await ms.createEndpoint({remoteSdp: listener.local.sdp});
+  await listener.modify(speaker.local.sdp);
+
+  speaker.execute('endless_playback', argv.file).catch(() => {});
+  const res = await ms.api(argv.start.replace('{uuid}', listener.uuid));
+  if (/^-ERR/.test(res)) throw new Error(res.trim());
+  return {listener, speaker};
+}
+
+async function destroySession(ms, {listener, speaker}) {
+  if (argv.stop) await ms.api(argv.stop.replace('{uuid}', listener.uuid)).catch(() => {});
+  listener.destroy();
+  speaker.destroy();
+}
+
+async function report(ms) {
+  const res = await ms.api(`${argv.module}_metrics latency`);
+  let latency;
+  try {
+    latency = JSON.parse(res);
+  } catch (err) {
+    console.log(`unexpected response to ${argv.module}_metrics: ${res}`);
+    return;
+  }
+
+  const {frame, connect, firstInterim, firstFinal} = latency;
+  let line = `sessions=${sessions.length} frame p50=${frame.p50 || 0}ms p99=${frame.p99 || 0}ms ` +
+    `connect p50=${connect.p50 || 0}ms p99=${connect.p99 || 0}ms ` +
+    `firstInterim p50=${firstInterim.p50 || 0}ms firstFinal p50=${firstFinal.p50 || 0}ms`;
+  const now = proc();
+  if (now && baseline) {
+    // clock ticks are 1/100 sec on linux, so ticks * 1000 / elapsed ms is percent of one core
+    const cpu = (now.ticks - lastCpu.ticks) * 1000 / (Date.now() - lastCpu.at);
+    lastCpu = {ticks: now.ticks, at: Date.now()};
+    line += ` cpu=${cpu.toFixed(1)}% threads=${now.threads}`;
+    if (sessions.length) {
+      line += ` memory/session=${Math.round((now.rss - baseline.rss) / sessions.length)}kB` +
+        ` threads/session=${((now.threads - baseline.threads) / sessions.length).toFixed(2)}`;
+    }
+  }
+  console.log(line);
+  return latency;
+}
+
+// resident set size (kB), thread count and cpu time (clock ticks) of the freeswitch process, if --pid was given
+function proc() {
+  if (!argv.pid) return;
+  try {
+    const status = fs.readFileSync(`/proc/${argv.pid}/status`, 'utf8');
+    const stat = fs.readFileSync(`/proc/${argv.pid}/stat`, 'utf8');
+    // utime and stime are the 12th and 13th fields after the parenthesized command name
+    const fields = stat.slice(stat.lastIndexOf(')') + 2).split(' ');
+    return {
+      rss: parseInt(/VmRSS:\s+(\d+)/.exec(status)[1]),
+      threads: parseInt(/Threads:\s+(\d+)/.exec(status)[1]),
+      ticks: parseInt(fields[11]) + parseInt(fields[12])
+    };
+  } catch (err) {
+    return;
+  }
+}
+
+function sleep(ms) {
+  return new Promise((resolve) => setTimeout(resolve, ms));
+}
@@ -0,0 +1,221 @@
+/**
+ * A local stand-in for the websocket speech services used by mod_audio_fork, mod_deepgram_transcribe,
+ * mod_ibm_transcribe, mod_jambonz_transcribe and mod_assemblyai_transcribe, for benchmarking their
+ * AudioPipe without external services.
+ *
+ * It accepts the vendor's handshake (the audio.drachtio.org subprotocol, Basic, Token or Bearer
+ * authorization), consumes audio at a configurable rate and answers with transcripts shaped like the
+ * vendor's, with controllable latency, errors and disconnects.  A scenario presets those knobs:
+ *
+ *   steady  - interim results every --interim ms and a final every --final ms (the default)
+ *   slow    - reads audio at half real-time and delays every result by 1.5 seconds
+ *   flaky   - drops the connection without a close frame after --disconnect-after seconds
+ *   errors  - sends the vendor's error message after --error-after seconds, then closes
+ *   reject  - fails every handshake with a 401
+ *
+ * node mock_asr_server.js --vendor deepgram --port 3002 --scenario flaky --cert cert.pem --key key.pem
+ *
+ * mod_jambonz_transcribe (JAMBONZ_STT_URL) and mod_audio_fork take a ws:// url directly.  The other
+ * modules connect over TLS to their vendor's host, so point that name at this server (e.g. in
+ * /etc/hosts), run it with --cert/--key and add the certificate to the system's trusted CAs.
+ */
+const fs = require('fs');
+const http = require('http');
+const https = require('https');
+const crypto = require('crypto');
+const WebSocket = require('ws');
+const argv = require('minimist')(process.argv.slice(2), {
+  default: {
+    vendor: 'fork',
+    port: 3002,
+    scenario: 'steady',
+    interim: 500,
+    final: 3000
+  }
+});
+
+const scenarios = {
+  steady: {},
+  slow: {rate: 0.5, latency: 1500},
+  flaky: {'disconnect-after': 10},
+  errors: {'error-after': 5},
+  reject: {reject: true}
+};
+if (!scenarios[argv.scenario]) throw new Error(`unknown scenario ${argv.scenario}`);
+const opts = Object.assign({latency: 0, rate: 0, 'disconnect-after': 0, 'error-after': 0},
+  scenarios[argv.scenario], argv);
+
+const vendors = {
+  fork: {
+    protocol: 'audio.drachtio.org',
+    result: (text, isFinal) => JSON.stringify({type: 'transcription', data: {text, is_final: isFinal}}),
+    error: (reason) => JSON.stringify({type: 'error', data: {reason}})
+  },
+  deepgram: {
+    auth: 'Token',
+    result: (text, isFinal, start, duration) => JSON.stringify({
+      type: 'Results', channel_index: [0, 1], duration, start, is_final: isFinal, speech_final: isFinal,
+      channel: {alternatives: [{transcript: text, confidence: 0.98, words: []}]}
+    }),
+    error: (reason) => JSON.stringify({type: 'Error', description: reason})
+  },
+  ibm: {
+    // watson pretty-prints its messages, and the module matches on that spacing
+    onStart: () => JSON.stringify({state: 'listening'}, null, 2),
+    result: (text, isFinal) => JSON.stringify({
+      result_index: 0, results: [{final: isFinal, alternatives: [{transcript: text, confidence: 0.98}]}]
+    }, null, 2),
+    error: (reason) => JSON.stringify({error: reason}, null, 2)
+  },
+  jambonz: {
+    auth: 'Bearer',
+    result: (text, isFinal) => JSON.stringify({
+      type: 'transcription', is_final: isFinal, alternatives: [{transcript: text, confidence: 0.98}], channel: 1
+    }),
+    error: (reason) => JSON.stringify({type: 'error', error: reason})
+  },
+  assemblyai: {
+    auth: '',
+    onConnect: () => JSON.stringify({
+      message_type: 'SessionBegins', session_id: crypto.randomUUID ? crypto.randomUUID() : `${Date.now()}`,
+      expires_at: new Date(Date.now() + 3600 * 1000).toISOString()
+    }),
+    result: (text, isFinal, start, duration) => JSON.stringify({
+      message_type: isFinal ? 'FinalTranscript' : 'PartialTranscript', audio_start: Math.round(start * 1000),
+      audio_end: Math.round((start + duration) * 1000), confidence: 0.98, text, words: [],
+      created: new Date().toISOString()
+    }),
+    error: (reason) => JSON.stringify({error: reason})
+  }
+};
+const vendor = vendors[argv.vendor];
+if (!vendor) throw new Error(`unknown vendor ${argv.vendor}`);
+
+const WORDS = 'the quick brown fox jumps over the lazy dog'.split(' ');
+const totals = {connections: 0, active: 0, bytes: 0, results: 0};
+
+const server = argv.cert ?
+  https.createServer({cert: fs.readFileSync(argv.cert), key: fs.readFileSync(argv.key)}) :
+  http.createServer();
+const wss = new WebSocket.Server({
+  server,
+  verifyClient: ({req}, done) => {
+    if (opts.reject || !authorized(req)) return done(false, 401, 'Unauthorized');
+    done(true);
+  },
+  handleProtocols: (protocols) => vendor.protocol || protocols[0] || false
+});
+
+server.listen(argv.port, () => {
+  console.log(`mock ${argv.vendor} server (${argv.scenario}) listening on port ${argv.port}` +
+    `${argv.cert ? ' with TLS' : ''}`);
+});
+
+setInterval(() => {
+  console.log(`connections: ${totals.active} active, ${totals.connections} total; ` +
+    `received ${totals.bytes} bytes; sent ${totals.results} results`);
+}, 10000).unref();
+
+function authorized(req) {
+  const header = req.headers.authorization;
+  if (argv.vendor === 'fork') {
+    if (!argv.username) return true;
+    const expected = Buffer.from(`${argv.username}:${argv.password || ''}`).toString('base64');
+    return header === `Basic ${expected}`;
+  }
+  if (!argv['api-key']) return true;
+  return header === (vendor.auth ? `${vendor.auth} ${argv['api-key']}` : argv['api-key']);
+}
+
+wss.on('connection', (ws, req) => {
+  const url = new URL(req.url, 'http://localhost');
+  const sampleRate = parseInt(url.searchParams.get('sample_rate') || url.searchParams.get('rate')) ||
+    argv['sample-rate'] || 8000;
+  const bytesPerSec = sampleRate * 2;
+  const conn = {bytes: 0, started: Date.now(), words: 0, lastFinal: 0, timers: new Set()};
+
+  totals.connections++;
+  totals.active++;
+  console.log(`connection from ${req.socket.remoteAddress} for ${req.url}`);
+
+  const send = (msg) => {
+    const timer = setTimeout(() => {
+      conn.timers.delete(timer);
+      if (ws.readyState !== WebSocket.OPEN) return;
+      ws.send(msg);
+      totals.results++;
+    }, opts.latency);
+    conn.timers.add(timer);
+  };
+
+  if (vendor.onConnect) send(vendor.onConnect());
+
+  conn.timers.add(setInterval(() => {
+    // audio time received so far, which is what the results describe
+    const secs = conn.bytes / bytesPerSec;
+    if (secs <= conn.lastFinal) return;
+    conn.words++;
+    const text = Array.from({length: conn.words}, (v, i) => WORDS[i % WORDS.length]).join(' ');
+    const isFinal = (secs - conn.lastFinal) * 1000 >= opts.final;
+    send(vendor.result(text, isFinal, conn.lastFinal, secs - conn.lastFinal));
+    if (isFinal) {
+      conn.lastFinal = secs;
+      conn.words = 0;
+    }
+  }, opts.interim));
+
+  if (opts['error-after']) {
+    conn.timers.add(setTimeout(() => {
+      if (ws.readyState !== WebSocket.OPEN) return;
+      ws.send(vendor.error('mock error'));
+      ws.close(1011, 'mock error');
+    }, opts['error-after'] * 1000));
+  }
+  if (opts['disconnect-after']) {
+    conn.timers.add(setTimeout(() => ws.terminate(), opts['disconnect-after'] * 1000));
+  }
+
+  ws.on('message', (message, isBinary) => {
+    const text = typeof message === 'string' ? message : (isBinary === false ? message.toString() : null);
+    if (text === null) return consume(ws, conn, message.length, bytesPerSec);
+
+    let json;
+    try {
+      json = JSON.parse(text);
+    } catch (err) {
+      return;
+    }
+    if (json.audio_data) return consume(ws, conn, Buffer.from(json.audio_data, 'base64').length, bytesPerSec);
+    if (vendor.onStart && json.action === 'start') send(vendor.onStart());
+    if (json.action === 'stop' || json.type === 'stop' || json.terminate_session) {
+      if (argv.vendor === 'assemblyai') send(JSON.stringify({message_type: 'SessionTerminated'}));
+      conn.timers.add(setTimeout(() => ws.close(1000), opts.latency + 10));
+    }
+  });
+
+  ws.on('close', (code) => {
+    conn.timers.forEach((t) => clearTimeout(t));
+    totals.active--;
+    const secs = (Date.now() - conn.started) / 1000;
+    console.log(`connection closed (${code}) after ${secs.toFixed(1)}s, received ${conn.bytes} bytes ` +
+      `(${(conn.bytes / bytesPerSec).toFixed(1)}s of audio)`);
+  });
+});
+
+// count the audio, and with --rate pause the socket whenever it is ahead of rate x real-time
+function consume(ws, conn, len, bytesPerSec) {
+  conn.bytes += len;
+  totals.bytes += len;
+  if (!opts.rate) return;
+
+  const due = conn.started + (conn.bytes / (bytesPerSec * opts.rate)) * 1000;
+  const wait = due - Date.now();
+  if (wait > 0 && ws._socket && !conn.paused) {
+    conn.paused = true;
+    ws._socket.pause();
+    setTimeout(() => {
+      conn.paused = false;
+      if (ws._socket) ws._socket.resume();
+    }, wait);
+  }
+}
@@ -0,0 +1,201 @@
+/**
+ * A loopback gRPC server implementing the streaming recognizers used by mod_google_transcribe,
+ * mod_nuance_transcribe, mod_nvidia_transcribe, mod_soniox_transcribe and mod_cobalt_transcribe, with
+ * synthetic results, injectable latency and status codes, for load testing their GStreamer classes.
+ *
+ * The services are loaded from the same .proto trees the modules were built from; pass each root with
+ * --protos (repeatable), e.g. a googleapis checkout and the vendor proto directories.
+ *
+ * node mock_grpc_recognizer.js --vendor google --port 50051 --protos ~/googleapis \
+ *   --cert cert.pem --key key.pem --fail-after 305 --code 11 \
+ *   --details 'Exceeded maximum allowed stream duration of 305 seconds.'
+ *
+ * Options:
+ *   --interim <ms>     interval between interim results (default 500)
+ *   --final <ms>       audio time after which a result is final (default 3000)
+ *   --latency <ms>     delay added to every response (default 0)
+ *   --fail-after <s>   end each stream with --code/--details after this many seconds of audio
+ *   --code <n>         grpc status code for --fail-after (default 11, OUT_OF_RANGE)
+ *   --sample-rate <hz> rate used to turn received bytes into audio time (default 8000)
+ *
+ * nvidia (NVIDIA_RIVA_URI), nuance (NUANCE_KRYPTON_ENDPOINT) and cobalt (the hostport argument) use
+ * plaintext channels and can be pointed straight at this server.  google (GOOGLE_SPEECH_TO_TEXT_URI)
+ * and soniox connect over TLS: run this with --cert/--key and start freeswitch with
+ * GRPC_DEFAULT_SSL_ROOTS_FILE_PATH set to the certificate (soniox also needs api.soniox.com mapped
+ * to this host).  The server prints stream counts and its own CPU and memory every 10 seconds; use
+ * load_test.js to drive the streams and measure the freeswitch side.
+ */
+const fs = require('fs');
+const path = require('path');
+const grpc = require('@grpc/grpc-js');
+const protoLoader = require('@grpc/proto-loader');
+const argv = require('minimist')(process.argv.slice(2), {
+  default: {
+    vendor: 'google',
+    port: 50051,
+    interim: 500,
+    final: 3000,
+    latency: 0,
+    'fail-after': 0,
+    code: 11,
+    details: 'Exceeded maximum allowed stream duration of 305 seconds.',
+    'sample-rate': 8000
+  }
+});
+
+const WORDS = 'the quick brown fox jumps over the lazy dog'.split(' ');
+
+const vendors = {
+  google: {
+    proto: 'google/cloud/speech/v1p1beta1/cloud_speech.proto',
+    service: 'google.cloud.speech.v1p1beta1.Speech',
+    method: 'StreamingRecognize',
+    audio: (req) => req.audio_content,
+    result: (text, isFinal) => ({
+      results: [{alternatives: [{transcript: text, confidence: isFinal ? 0.98 : 0}], is_final: isFinal,
+        stability: isFinal ? 0 : 0.9}]
+    })
+  },
+  nvidia: {
+    proto: 'riva/proto/riva_asr.proto',
+    service: 'nvidia.riva.asr.RivaSpeechRecognition',
+    method: 'StreamingRecognize',
+    audio: (req) => req.audio_content,
+    result: (text, isFinal, secs) => ({
+      results: [{alternatives: [{transcript: text, confidence: 0.98}], is_final: isFinal,
+        stability: isFinal ? 1 : 0.9, channel_tag: 1, audio_processed: secs}]
+    })
+  },
+  nuance: {
+    proto: 'nuance/asr/v1/recognizer.proto',
+    service: 'nuance.asr.v1.Recognizer',
+    method: 'Recognize',
+    audio: (req) => req.audio,
+    onStart: () => ({status: {code: 100, message: 'Continue', details: 'recognition started'}}),
+    result: (text, isFinal, secs, start) => ({
+      result: {result_type: isFinal ? 'FINAL' : 'PARTIAL', abs_start_ms: Math.round(start * 1000),
+        abs_end_ms: Math.round(secs * 1000), hypotheses: [{formatted_text: text,
+          minimally_formatted_text: text, confidence: 0.98, average_confidence: 0.98}]}
+    })
+  },
+  soniox: {
+    proto: 'soniox/speech_service.proto',
+    service: 'soniox.speech_service.SpeechService',
+    method: 'TranscribeStream',
+    audio: (req) => req.audio,
+    result: (text, isFinal, secs, start) => {
+      const words = text.split(' ');
+      const duration = Math.round((secs - start) * 1000 / words.length);
+      return {
+        result: {words: words.map((w, i) => ({text: w, start_ms: Math.round(start * 1000) + i * duration,
+          duration_ms: duration, is_final: isFinal, confidence: 0.98})),
+        final_proc_time_ms: isFinal ? Math.round(secs * 1000) : 0, total_proc_time_ms: Math.round(secs * 1000)}
+      };
+    }
+  },
+  cobalt: {
+    proto: 'cobaltspeech/transcribe/v5/transcribe.proto',
+    service: 'cobaltspeech.transcribe.v5.TranscribeService',
+    method: 'StreamingRecognize',
+    audio: (req) => req.audio && req.audio.data,
+    result: (text, isFinal, secs, start) => ({
+      result: {alternatives: [{transcript_formatted: text, transcript_raw: text, confidence: 0.98,
+        start_time_ms: Math.round(start * 1000), duration_ms: Math.round((secs - start) * 1000)}],
+      is_partial: !isFinal, audio_channel: 0}
+    }),
+    unary: {
+      Version: (call, cb) => cb(null, {version: 'mock'}),
+      ListModels: (call, cb) => cb(null, {models: [{id: 'mock', name: 'mock'}]}),
+      CompileContext: (call, cb) => cb(null, {context: {data: Buffer.from('mock')}})
+    }
+  }
+};
+const vendor = vendors[argv.vendor];
+if (!vendor) throw new Error(`unknown vendor ${argv.vendor}`);
+
+const includeDirs = [].concat(argv.protos || []).map((p) => path.resolve(p));
+const protoFile = includeDirs.map((d) => path.join(d, vendor.proto)).find((f) => fs.existsSync(f));
+if (!protoFile) throw new Error(`${vendor.proto} not found under --protos ${includeDirs.join(', ')}`);
+
+const definition = protoLoader.loadSync(protoFile, {keepCase: true, longs: Number, enums: String,
+  defaults: true, oneofs: true, includeDirs});
+const service = vendor.service.split('.').reduce((o, n) => o[n], grpc.loadPackageDefinition(definition));
+
+const totals = {streams: 0, active: 0, bytes: 0, results: 0};
+
+function streamingRecognize(call) {
+  const bytesPerSec = argv['sample-rate'] * 2;
+  const stream = {bytes: 0, words: 0, lastFinal: 0, ended: false, timers: new Set()};
+
+  totals.streams++;
+  totals.active++;
+
+  const send = (msg) => {
+    const timer = setTimeout(() => {
+      stream.timers.delete(timer);
+      if (stream.ended) return;
+      call.write(msg);
+      totals.results++;
+    }, argv.latency);
+    stream.timers.add(timer);
+  };
+
+  const end = (status) => {
+    if (stream.ended) return;
+    stream.ended = true;
+    stream.timers.forEach((t) => clearTimeout(t));
+    totals.active--;
+    if (status) call.emit('error', status);
+    else call.end();
+  };
+
+  if (vendor.onStart) send(vendor.onStart());
+
+  stream.timers.add(setInterval(() => {
+    const secs = stream.bytes / bytesPerSec;
+    if (secs <= stream.lastFinal) return;
+    stream.words++;
+    const text = Array.from({length: stream.words}, (v, i) => WORDS[i % WORDS.length]).join(' ');
+    const isFinal = (secs - stream.lastFinal) * 1000 >= argv.final;
+    send(vendor.result(text, isFinal, secs, stream.lastFinal));
+    if (isFinal) {
+      stream.lastFinal = secs;
+      stream.words = 0;
+    }
+  }, argv.interim));
+
+  call.on('data', (req) => {
+    const audio = vendor.audio(req);
+    if (!audio || !audio.length) return;
+    stream.bytes += audio.length;
+    totals.bytes += audio.length;
+    if (argv['fail-after'] && stream.bytes / bytesPerSec >= argv['fail-after']) {
+      end({code: argv.code, details: argv.details});
+    }
+  });
+  call.on('end', () => setTimeout(() => end(), argv.latency));
+  call.on('cancelled', () => end());
+  call.on('error', () => end());
+}
+
+const server = new grpc.Server();
+server.addService(service.service, Object.assign({[vendor.method]: streamingRecognize}, vendor.unary || {}));
+
+const creds = argv.cert ?
+  grpc.ServerCredentials.createSsl(null, [{cert_chain: fs.readFileSync(argv.cert),
+    private_key: fs.readFileSync(argv.key)}]) :
+  grpc.ServerCredentials.createInsecure();
+server.bindAsync(`0.0.0.0:${argv.port}`, creds, (err, port) => {
+  if (err) throw err;
+  server.start();
+  console.log(`mock ${argv.vendor} recognizer listening on port ${port}${argv.cert ? ' with TLS' : ''}`);
+});
+
+let lastCpu = process.cpuUsage();
+setInterval(() => {
+  const cpu = process.cpuUsage(lastCpu);
+  lastCpu = process.cpuUsage();
+  console.log(`streams: ${totals.active} active, ${totals.streams} total; received ${totals.bytes} bytes; ` +
+    `sent ${totals.results} results; cpu ${((cpu.user + cpu.system) / 100000).toFixed(1)}%, ` +
+    `rss ${Math.round(process.memoryUsage().rss / 1024 / 1024)}MB`);
+}, 10000).unref();
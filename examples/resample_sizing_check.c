@@ -0,0 +1,194 @@
+/**
+ * Checks, and times, resample_write(): the helper mod_audio_fork (lws_glue.cpp) and the deepgram, ibm,
+ * jambonz and assemblyai glue call to resample media bug frames straight into the AudioPipe ring buffer.
+ * Every module carries the same resample_write.h; this builds against mod_audio_fork's copy.
+ *
+ * With SMBF_STEREO a frame's samples count is per channel while its datalen covers every channel, and
+ * speex_resampler_process_interleaved_int takes and returns lengths in samples per channel.  The helper sizes
+ * everything from one bytes-per-sample value (sizeof(int16_t) * channels).  This runs synthetic mono and
+ * stereo frames at 8, 16 and 48 kHz through it into a ring buffer region with a guard area behind it, for
+ * every output rate the modules ask for and for space left from plenty down to a few bytes, and fails if a
+ * write passes the space available, is not whole samples, or input is dropped while there was room for it.
+ * It also reports what the previous arithmetic (capacity available >> 1, advance out_len << channels) would
+ * have written.
+ *
+ * It then times the helper on the conversions the modules make, into a region with room for every frame,
+ * and reports the cost per 20 ms frame and how many streams one core could resample at that cost.
+ *
+ * Against speexdsp at SWITCH_RESAMPLE_QUALITY (2), as the modules run it:
+ *
+ * cc -O2 -I../modules/mod_audio_fork resample_sizing_check.c -lspeexdsp -o resample_sizing_check
+ * ./resample_sizing_check [seconds of audio per timing, default 60]
+ *
+ * Where speexdsp is not installed, resample_standin/ has a stand-in with the same interleaved length
+ * contract; the sizing checks are as strict, but the timings are then the stand-in's, not speex's:
+ *
+ * cc -O2 -I../modules/mod_audio_fork -Iresample_standin resample_sizing_check.c -o resample_sizing_check
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "resample_write.h"
+
+#define FRAME_MS (20)
+#define MAX_CHANNELS (2)
+#define QUALITY (2)
+#define REGION_BYTES (8192)
+#define GUARD_BYTES (4096)
+#define GUARD (0x5a)
+
+#ifdef RESAMPLE_STANDIN
+#define RESAMPLER "stand-in (linear interpolation)"
+#else
+#define RESAMPLER "speexdsp, quality 2"
+#endif
+
+static int16_t *make_frame(uint32_t rate, uint32_t channels)
+{
+	uint32_t samples = rate * FRAME_MS / 1000, i;
+	int16_t *frame = malloc(sizeof(int16_t) * samples * channels);
+
+	if (!frame) return NULL;
+	for (i = 0; i < samples * channels; i++) frame[i] = (int16_t) (i * 37);
+	return frame;
+}
+
+static int check(uint32_t in_rate, uint32_t out_rate, uint32_t channels, size_t available)
+{
+	static uint8_t region[REGION_BYTES + GUARD_BYTES];
+	const size_t bytes_per_sample = sizeof(int16_t) * channels;
+	size_t datalen = in_rate * FRAME_MS / 1000 * bytes_per_sample;	/* frame.datalen, every channel */
+	size_t advance, written, dropped = 0;
+	SpeexResamplerState *resampler;
+	int16_t *frame;
+	int err = 0, failed = 0;
+
+	if (!(frame = make_frame(in_rate, channels))) return 1;
+	if (!(resampler = speex_resampler_init(channels, in_rate, out_rate, QUALITY, &err))) {
+		printf("FAIL %u -> %u Hz x%u: speex_resampler_init error %d\n", in_rate, out_rate, channels, err);
+		free(frame);
+		return 1;
+	}
+	memset(region, GUARD, sizeof(region));
+
+	advance = resample_write(resampler, channels, frame, datalen, region, available, &dropped);
+
+	for (written = sizeof(region); written > 0 && region[written - 1] == GUARD; written--);
+	if (written > available || advance > available) {
+		printf("FAIL %u -> %u Hz x%u, %zu bytes available: wrote %zu, advanced %zu\n",
+			in_rate, out_rate, channels, available, written, advance);
+		failed = 1;
+	}
+	else if (advance < written || advance % bytes_per_sample) {
+		printf("FAIL %u -> %u Hz x%u, %zu bytes available: wrote %zu but advanced %zu\n",
+			in_rate, out_rate, channels, available, written, advance);
+		failed = 1;
+	}
+	else if (dropped % bytes_per_sample || dropped > datalen) {
+		printf("FAIL %u -> %u Hz x%u, %zu bytes available: dropped %zu of a %zu byte frame\n",
+			in_rate, out_rate, channels, available, dropped, datalen);
+		failed = 1;
+	}
+	else if (dropped && advance + bytes_per_sample <= available) {
+		printf("FAIL %u -> %u Hz x%u, %zu bytes available: %zu bytes dropped with room left\n",
+			in_rate, out_rate, channels, available, dropped);
+		failed = 1;
+	}
+	speex_resampler_destroy(resampler);
+	free(frame);
+	return failed;
+}
+
+/* bytes the previous arithmetic would have written: capacity available >> 1 samples per channel */
+static size_t old_written(uint32_t in_rate, uint32_t out_rate, uint32_t channels, size_t available)
+{
+	uint32_t samples = in_rate * FRAME_MS / 1000;
+	uint64_t out = (uint64_t) samples * out_rate / in_rate;
+	uint64_t cap = available >> 1;
+
+	return (size_t) ((out < cap ? out : cap) << channels);
+}
+
+static double now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* ns per frame through resample_write, or -1 */
+static double time_stream(uint32_t in_rate, uint32_t out_rate, uint32_t channels, uint32_t frames)
+{
+	static uint8_t region[REGION_BYTES];
+	const size_t datalen = in_rate * FRAME_MS / 1000 * sizeof(int16_t) * channels;
+	SpeexResamplerState *resampler;
+	int16_t *frame;
+	size_t dropped = 0, total = 0;
+	double start, elapsed;
+	uint32_t i;
+	int err = 0;
+
+	if (!(frame = make_frame(in_rate, channels))) return -1;
+	if (!(resampler = speex_resampler_init(channels, in_rate, out_rate, QUALITY, &err))) {
+		free(frame);
+		return -1;
+	}
+	start = now_ns();
+	for (i = 0; i < frames; i++) {
+		total += resample_write(resampler, channels, frame, datalen, region, sizeof(region), &dropped);
+		if (dropped) break;
+	}
+	elapsed = (now_ns() - start) / frames;
+	speex_resampler_destroy(resampler);
+	free(frame);
+	if (dropped || total == 0) return -1;
+	return elapsed;
+}
+
+int main(int argc, char **argv)
+{
+	static const uint32_t in_rates[] = { 8000, 16000, 48000 };
+	static const uint32_t out_rates[] = { 8000, 16000, 24000, 48000 };
+	static const size_t space[] = { REGION_BYTES, 3840, 1921, 640, 322, 17, 4, 3, 2, 1 };
+	static const uint32_t timed[][2] = { { 8000, 16000 }, { 16000, 8000 }, { 48000, 8000 }, { 48000, 16000 }, { 8000, 24000 } };
+	uint32_t seconds = argc > 1 ? (uint32_t) atoi(argv[1]) : 60;
+	unsigned int failures = 0, runs = 0, old_overruns = 0;
+	size_t r, o, s;
+	uint32_t channels;
+
+	for (channels = 1; channels <= MAX_CHANNELS; channels++) {
+		for (r = 0; r < sizeof(in_rates) / sizeof(in_rates[0]); r++) {
+			for (o = 0; o < sizeof(out_rates) / sizeof(out_rates[0]); o++) {
+				if (in_rates[r] == out_rates[o]) continue;	/* no resampler is created for these */
+				for (s = 0; s < sizeof(space) / sizeof(space[0]); s++) {
+					failures += check(in_rates[r], out_rates[o], channels, space[s]);
+					if (old_written(in_rates[r], out_rates[o], channels, space[s]) > space[s]) old_overruns++;
+					runs++;
+				}
+			}
+		}
+	}
+	printf("resampler: %s\n", RESAMPLER);
+	printf("%u cases, %u failures; the previous sizing would have overrun the space available in %u\n",
+		runs, failures, old_overruns);
+
+	if (seconds == 0) seconds = 60;
+	printf("\n%-22s  %10s  %14s\n", "", "ns/frame", "streams/core");
+	for (channels = 1; channels <= MAX_CHANNELS; channels++) {
+		for (r = 0; r < sizeof(timed) / sizeof(timed[0]); r++) {
+			double ns = time_stream(timed[r][0], timed[r][1], channels, seconds * 1000 / FRAME_MS);
+			if (ns < 0) {
+				printf("%5u -> %5u Hz %s  failed\n", timed[r][0], timed[r][1], channels == 1 ? "mono  " : "stereo");
+				failures++;
+				continue;
+			}
+			printf("%5u -> %5u Hz %s  %10.1f  %14.0f\n", timed[r][0], timed[r][1], channels == 1 ? "mono  " : "stereo",
+				ns, FRAME_MS * 1e6 / ns);
+		}
+	}
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,82 @@
+/*
+ * A stand-in for speexdsp's resampler, for building resample_sizing_check.c and resampler_pool_bench.cpp
+ * where speexdsp is not installed.  It keeps speex's interleaved length contract: *in_len and *out_len are samples per channel
+ * and are updated to what was used, and it stops when either input or output runs out.  The audio is a
+ * linear interpolation, so only the sizing it exercises, not its cost, says anything about speex.
+ */
+#ifndef __RESAMPLE_STANDIN_SPEEX_RESAMPLER_H__
+#define __RESAMPLE_STANDIN_SPEEX_RESAMPLER_H__
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#define RESAMPLE_STANDIN (1)
+#define RESAMPLER_ERR_SUCCESS (0)
+#define RESAMPLER_ERR_ALLOC_FAILED (1)
+
+typedef int16_t spx_int16_t;
+typedef uint32_t spx_uint32_t;
+
+typedef struct SpeexResamplerState_ {
+	spx_uint32_t channels;
+	spx_uint32_t in_rate;
+	spx_uint32_t out_rate;
+} SpeexResamplerState;
+
+static inline SpeexResamplerState *speex_resampler_init(spx_uint32_t nb_channels, spx_uint32_t in_rate, spx_uint32_t out_rate,
+	int quality, int *err)
+{
+	SpeexResamplerState *st = (SpeexResamplerState *) calloc(1, sizeof(*st));
+
+	(void) quality;
+	if (err) *err = st ? RESAMPLER_ERR_SUCCESS : RESAMPLER_ERR_ALLOC_FAILED;
+	if (st) {
+		st->channels = nb_channels;
+		st->in_rate = in_rate;
+		st->out_rate = out_rate;
+	}
+	return st;
+}
+
+static inline void speex_resampler_destroy(SpeexResamplerState *st)
+{
+	free(st);
+}
+
+/* the stand-in keeps no history between calls */
+static inline int speex_resampler_reset_mem(SpeexResamplerState *st)
+{
+	(void) st;
+	return RESAMPLER_ERR_SUCCESS;
+}
+
+static inline int speex_resampler_process_interleaved_int(SpeexResamplerState *st, const spx_int16_t *in, spx_uint32_t *in_len,
+	spx_int16_t *out, spx_uint32_t *out_len)
+{
+	const spx_uint32_t channels = st->channels, in_rate = st->in_rate, out_rate = st->out_rate;
+	spx_uint32_t produced = 0, consumed = 0, c;
+
+	while (produced < *out_len) {
+		uint64_t pos = (uint64_t) produced * in_rate;
+		spx_uint32_t i = (spx_uint32_t) (pos / out_rate);
+		if (i >= *in_len) break;
+		for (c = 0; c < channels; c++) {
+			int32_t a = in[i * channels + c];
+			int32_t b = i + 1 < *in_len ? in[(i + 1) * channels + c] : a;
+			out[produced * channels + c] = (spx_int16_t) (a + (b - a) * (int64_t) (pos % out_rate) / out_rate);
+		}
+		consumed = i + 1;
+		produced++;
+	}
+	if (produced == *out_len && consumed < *in_len) {
+		/* output ran out: input up to the next output sample is still owed */
+		consumed = (spx_uint32_t) (((uint64_t) produced * in_rate + out_rate - 1) / out_rate);
+		if (consumed > *in_len) consumed = *in_len;
+	}
+	else consumed = *in_len;
+	*in_len = consumed;
+	*out_len = produced;
+	return RESAMPLER_ERR_SUCCESS;
+}
+
+#endif
@@ -0,0 +1,131 @@
+/**
+ * Times what the modules' resampler_pool saves: for each conversion the modules make, the cost of a fresh
+ * speex_resampler_init + speex_resampler_destroy (what every call paid before the pool) against a pooled
+ * acquire + release, next to the cost of resampling one 20 ms frame so the saving can be weighed against a
+ * call's media work.  It also reports the resident memory each idle pooled state holds, since every state
+ * keeps its own filter table.  Every module carries the same resampler_pool.hpp; this builds against
+ * mod_audio_fork's copy:
+ *
+ * c++ -O2 -std=c++11 -I../modules/mod_audio_fork resampler_pool_bench.cpp -lspeexdsp -o resampler_pool_bench
+ * ./resampler_pool_bench [iterations per timing, default 20000]
+ *
+ * It also builds with -Iresample_standin where speexdsp is not installed, but the stand-in has no filter
+ * table, so its numbers say nothing about speex.
+ */
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <unistd.h>
+
+#include "resampler_pool.hpp"
+
+#define FRAME_MS (20)
+#define QUALITY (2)
+
+#ifdef RESAMPLE_STANDIN
+#define RESAMPLER "stand-in (no filter table)"
+#else
+#define RESAMPLER "speexdsp, quality 2"
+#endif
+
+namespace {
+
+  typedef std::chrono::steady_clock Clock;
+
+  double nsSince(Clock::time_point start, unsigned int n) {
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / n;
+  }
+
+  size_t rssBytes() {
+    long pages = 0, resident = 0;
+    FILE* fp = fopen("/proc/self/statm", "r");
+    if (fp) {
+      if (fscanf(fp, "%ld %ld", &pages, &resident) != 2) resident = 0;
+      fclose(fp);
+    }
+    return (size_t) resident * sysconf(_SC_PAGESIZE);
+  }
+
+  double timeInit(spx_uint32_t channels, spx_uint32_t in, spx_uint32_t out, unsigned int n) {
+    int err = 0;
+    Clock::time_point start = Clock::now();
+    for (unsigned int i = 0; i < n; i++) {
+      SpeexResamplerState* st = speex_resampler_init(channels, in, out, QUALITY, &err);
+      if (!st) return -1;
+      speex_resampler_destroy(st);
+    }
+    return nsSince(start, n);
+  }
+
+  double timePool(spx_uint32_t channels, spx_uint32_t in, spx_uint32_t out, unsigned int n) {
+    int err = 0;
+    resampler_pool::release(resampler_pool::acquire(channels, in, out, QUALITY, &err));
+    Clock::time_point start = Clock::now();
+    for (unsigned int i = 0; i < n; i++) {
+      SpeexResamplerState* st = resampler_pool::acquire(channels, in, out, QUALITY, &err);
+      if (!st) return -1;
+      resampler_pool::release(st);
+    }
+    return nsSince(start, n);
+  }
+
+  double timeFrame(spx_uint32_t channels, spx_uint32_t in, spx_uint32_t out, unsigned int n) {
+    std::vector<spx_int16_t> frame(in * FRAME_MS / 1000 * channels), resampled(out * FRAME_MS / 1000 * channels * 2);
+    int err = 0;
+    SpeexResamplerState* st = resampler_pool::acquire(channels, in, out, QUALITY, &err);
+    if (!st) return -1;
+    for (size_t i = 0; i < frame.size(); i++) frame[i] = (spx_int16_t) ((i * 37) & 0x3fff);
+    Clock::time_point start = Clock::now();
+    for (unsigned int i = 0; i < n; i++) {
+      spx_uint32_t in_len = frame.size() / channels, out_len = resampled.size() / channels;
+      speex_resampler_process_interleaved_int(st, &frame[0], &in_len, &resampled[0], &out_len);
+    }
+    double ns = nsSince(start, n);
+    resampler_pool::release(st);
+    return ns;
+  }
+
+  // resident bytes per idle state, from holding `count` of them at once
+  double idleBytes(spx_uint32_t channels, spx_uint32_t in, spx_uint32_t out, unsigned int count) {
+    std::vector<SpeexResamplerState*> held;
+    int err = 0;
+    size_t before = rssBytes();
+    for (unsigned int i = 0; i < count; i++) {
+      SpeexResamplerState* st = resampler_pool::acquire(channels, in, out, QUALITY, &err);
+      if (st) held.push_back(st);
+    }
+    size_t after = rssBytes();
+    for (auto st : held) resampler_pool::release(st);
+    return held.empty() || after < before ? 0 : (double) (after - before) / held.size();
+  }
+}
+
+int main(int argc, char** argv) {
+  static const spx_uint32_t conversions[][2] = { {8000, 16000}, {16000, 8000}, {48000, 8000}, {48000, 16000}, {8000, 24000} };
+  unsigned int n = argc > 1 ? (unsigned int) atoi(argv[1]) : 20000;
+
+  if (n == 0) n = 20000;
+  printf("resampler: %s\n", RESAMPLER);
+  printf("%-22s  %12s  %12s  %8s  %12s  %14s\n", "", "init+destroy", "acquire+rel", "saved", "frame", "idle state");
+  printf("%-22s  %12s  %12s  %8s  %12s  %14s\n", "", "ns", "ns", "frames", "ns", "KB resident");
+  for (spx_uint32_t channels = 1; channels <= 2; channels++) {
+    for (size_t c = 0; c < sizeof(conversions) / sizeof(conversions[0]); c++) {
+      spx_uint32_t in = conversions[c][0], out = conversions[c][1];
+      double init = timeInit(channels, in, out, n);
+      double pooled = timePool(channels, in, out, n);
+      double frame = timeFrame(channels, in, out, n);
+      double idle = idleBytes(channels, in, out, resampler_pool::MAX_IDLE_PER_KEY);
+      if (init < 0 || pooled < 0 || frame < 0) {
+        fprintf(stderr, "unable to create a resampler for %u -> %u Hz x%u\n", in, out, channels);
+        return 1;
+      }
+      // "saved frames": how many frames of resampling the avoided init+destroy is worth
+      printf("%5u -> %5u Hz %s  %12.0f  %12.0f  %8.1f  %12.0f  %14.1f\n", in, out, channels == 1 ? "mono  " : "stereo",
+        init, pooled, (init - pooled) / frame, frame, idle / 1024.0);
+    }
+  }
+  return 0;
+}
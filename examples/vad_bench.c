@@ -0,0 +1,258 @@
+/**
+ * Times the voice activity detectors mod_simple_vad can run, outside of freeswitch, and reports the cost
+ * per 20 ms frame, mono and stereo, at 8, 16 and 48 kHz:
+ *
+ *   kernel      the built-in kernel (modules/mod_simple_vad/vad_kernel.c), one per channel
+ *   switch_vad  the native engine the module used before it, switch_vad_process on every frame, one per
+ *               channel (stereo strides through the interleaved frame as switch_vad does with channels=2)
+ *
+ * The input is synthetic: white noise with a 400 Hz tone switched on for one second in every three, so
+ * both detectors move through all of their talking states while they are timed.
+ *
+ * The kernel has no dependencies, so by default the bench builds on its own.  The switch_vad column is
+ * then a copy of the per-sample energy path from freeswitch's src/switch_vad.c, which is what
+ * switch_vad_process runs when freeswitch is built without libfvad:
+ *
+ * cc -O2 -I../modules/mod_simple_vad vad_bench.c ../modules/mod_simple_vad/vad_kernel.c -lm -o vad_bench
+ * ./vad_bench [seconds of audio per run, default 600]
+ *
+ * On a media server, build against libfreeswitch instead to time the real switch_vad (including libfvad
+ * when freeswitch has it):
+ *
+ * cc -O2 -DHAVE_SWITCH_VAD -I../modules/mod_simple_vad -I/usr/local/freeswitch/include/freeswitch \
+ *   vad_bench.c ../modules/mod_simple_vad/vad_kernel.c -L/usr/local/freeswitch/lib -lfreeswitch -lm -o vad_bench
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+
+#include "vad_kernel.h"
+
+#define FRAME_MS (20)
+#define MODE (2)
+#define VOICE_MS (200)
+#define SILENCE_MS (500)
+
+#ifdef HAVE_SWITCH_VAD
+#include <switch.h>
+#include <switch_vad.h>
+
+typedef switch_vad_t baseline_t;
+
+static baseline_t *baseline_init(uint32_t rate, uint32_t channels)
+{
+	switch_vad_t *vad = switch_vad_init(rate, channels);
+
+	if (vad) {
+		switch_vad_set_mode(vad, MODE);
+		switch_vad_set_param(vad, "voice_ms", VOICE_MS);
+		switch_vad_set_param(vad, "silence_ms", SILENCE_MS);
+	}
+	return vad;
+}
+
+static int baseline_process(baseline_t *vad, int16_t *data, uint32_t samples)
+{
+	return (int) switch_vad_process(vad, data, samples);
+}
+
+static void baseline_destroy(baseline_t *vad)
+{
+	switch_vad_destroy(&vad);
+}
+
+#define BASELINE "switch_vad"
+#else
+/* the energy path of freeswitch's switch_vad.c (no libfvad); states are numbered as switch_vad_state_t */
+typedef struct {
+	int channels;
+	int divisor;
+	int thresh;
+	int voice_samples_thresh;
+	int silence_samples_thresh;
+	int voice_samples;
+	int silence_samples;
+	int state;
+} baseline_t;
+
+static baseline_t *baseline_init(uint32_t rate, uint32_t channels)
+{
+	baseline_t *vad = calloc(1, sizeof(*vad));
+
+	if (!vad) return NULL;
+	vad->channels = channels;
+	vad->divisor = rate / 8000 > 0 ? rate / 8000 : 1;
+	vad->thresh = 100;
+	vad->voice_samples_thresh = VOICE_MS * rate / 1000;
+	vad->silence_samples_thresh = SILENCE_MS * rate / 1000;
+	return vad;
+}
+
+static int baseline_process(baseline_t *vad, int16_t *data, uint32_t samples)
+{
+	int energy = 0, j = 0;
+	uint32_t count;
+	int score;
+
+	if (vad->state == VAD_KERNEL_STATE_STOP_TALKING) vad->state = VAD_KERNEL_STATE_NONE;
+	else if (vad->state == VAD_KERNEL_STATE_START_TALKING) vad->state = VAD_KERNEL_STATE_TALKING;
+
+	for (count = 0; count < samples; count++) {
+		energy += abs(data[j]);
+		j += vad->channels;
+	}
+	score = (uint32_t) (energy / (samples / vad->divisor));
+
+	if (score >= vad->thresh) {
+		vad->silence_samples = 0;
+		vad->voice_samples += samples;
+	}
+	else {
+		vad->silence_samples += samples;
+		vad->voice_samples = 0;
+	}
+
+	if (vad->state == VAD_KERNEL_STATE_TALKING && vad->silence_samples > vad->silence_samples_thresh) {
+		vad->state = VAD_KERNEL_STATE_STOP_TALKING;
+	}
+	else if (vad->state == VAD_KERNEL_STATE_NONE && vad->voice_samples > vad->voice_samples_thresh) {
+		vad->state = VAD_KERNEL_STATE_START_TALKING;
+	}
+	return vad->state;
+}
+
+static void baseline_destroy(baseline_t *vad)
+{
+	free(vad);
+}
+
+#define BASELINE "switch_vad (energy path)"
+#endif
+
+static double now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* interleaved audio; the same signal on every channel */
+static int16_t *make_audio(uint32_t rate, uint32_t channels, uint32_t samples)
+{
+	int16_t *audio = malloc(sizeof(int16_t) * samples * channels);
+	uint32_t i, c;
+
+	if (!audio) return NULL;
+	srand(1);
+	for (i = 0; i < samples; i++) {
+		double v = (rand() / (double) RAND_MAX - 0.5) * 40.0;
+		if ((i / rate) % 3 == 1) v += 8000.0 * sin(2.0 * M_PI * 400.0 * i / rate);
+		for (c = 0; c < channels; c++) audio[i * channels + c] = (int16_t) v;
+	}
+	return audio;
+}
+
+/* ns per frame for the kernel, or -1 */
+static double time_kernel(const int16_t *audio, uint32_t rate, uint32_t channels, uint32_t frames, uint32_t *transitions)
+{
+	vad_kernel_t k[VAD_KERNEL_MAX_CHANNELS];
+	vad_kernel_state_t states[VAD_KERNEL_MAX_CHANNELS];
+	vad_kernel_state_t last = VAD_KERNEL_STATE_NONE;
+	uint32_t frame = rate * FRAME_MS / 1000;
+	uint32_t i, c;
+	double start;
+
+	for (c = 0; c < channels; c++) {
+		if (vad_kernel_init(&k[c], rate, MODE, VOICE_MS, SILENCE_MS) != 0) return -1;
+	}
+	*transitions = 0;
+	start = now_ns();
+	for (i = 0; i < frames; i++) {
+		const int16_t *data = audio + (i % (3000 / FRAME_MS)) * frame * channels;
+		if (channels == 1) states[0] = vad_kernel_process(&k[0], data, frame);
+		else vad_kernel_process_interleaved(k, channels, data, frame, states);
+		if (states[0] != last) {
+			(*transitions)++;
+			last = states[0];
+		}
+	}
+	return (now_ns() - start) / frames;
+}
+
+/* ns per frame for the native engine, or -1 */
+static double time_baseline(int16_t *audio, uint32_t rate, uint32_t channels, uint32_t frames, uint32_t *transitions)
+{
+	baseline_t *vad[VAD_KERNEL_MAX_CHANNELS] = { NULL };
+	uint32_t frame = rate * FRAME_MS / 1000;
+	uint32_t i, c;
+	int state = VAD_KERNEL_STATE_NONE, last = VAD_KERNEL_STATE_NONE;
+	double start, elapsed = -1;
+
+	for (c = 0; c < channels; c++) {
+		if (!(vad[c] = baseline_init(rate, channels))) goto done;
+	}
+	*transitions = 0;
+	start = now_ns();
+	for (i = 0; i < frames; i++) {
+		int16_t *data = audio + (i % (3000 / FRAME_MS)) * frame * channels;
+		for (c = 0; c < channels; c++) {
+			int s = baseline_process(vad[c], data + c, frame);
+			if (c == 0) state = s;
+		}
+		if (state != last) {
+			(*transitions)++;
+			last = state;
+		}
+	}
+	elapsed = (now_ns() - start) / frames;
+
+done:
+	for (c = 0; c < channels; c++) {
+		if (vad[c]) baseline_destroy(vad[c]);
+	}
+	return elapsed;
+}
+
+static int run(uint32_t rate, uint32_t channels, uint32_t seconds)
+{
+	uint32_t frames = seconds * 1000 / FRAME_MS;
+	uint32_t kernel_transitions = 0, baseline_transitions = 0;
+	double kernel_ns, baseline_ns;
+	int16_t *audio;
+
+	/* one three-second cycle of the signal, repeated for the length of the run */
+	if (!(audio = make_audio(rate, channels, rate * 3))) return -1;
+	kernel_ns = time_kernel(audio, rate, channels, frames, &kernel_transitions);
+	baseline_ns = time_baseline(audio, rate, channels, frames, &baseline_transitions);
+	free(audio);
+	if (kernel_ns < 0 || baseline_ns < 0) return -1;
+
+	printf("%5u Hz %s  %8u frames  %8.1f %8.1f  %6.2fx  %5u %5u\n",
+		rate, channels == 1 ? "mono  " : "stereo", frames, kernel_ns, baseline_ns, kernel_ns / baseline_ns,
+		kernel_transitions, baseline_transitions);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	static const uint32_t rates[] = { 8000, 16000, 48000 };
+	uint32_t seconds = argc > 1 ? (uint32_t) atoi(argv[1]) : 600;
+	uint32_t r, channels;
+
+	if (seconds == 0) seconds = 600;
+	printf("baseline: %s\n", BASELINE);
+	printf("%-15s  %15s  %17s  %7s  %11s\n", "", "", "ns/frame", "", "state changes");
+	printf("%-15s  %15s  %8s %8s  %7s  %5s %5s\n", "", "", "kernel", "baseline", "k/base", "kernel", "base");
+	for (channels = 1; channels <= VAD_KERNEL_MAX_CHANNELS; channels++) {
+		for (r = 0; r < sizeof(rates) / sizeof(rates[0]); r++) {
+			if (run(rates[r], channels, seconds) != 0) {
+				fprintf(stderr, "unable to initialize the detectors at %u Hz\n", rates[r]);
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
@@ -14,9 +14,12 @@
 #include <regex>
 
 #include "mod_assemblyai_transcribe.h"
+#include "resampler_pool.hpp"
+#include "resample_write.h"
 #include "simple_buffer.h"
 #include "parser.hpp"
 #include "audio_pipe.hpp"
+#include "stream_metrics.hpp"
 
 #define RTP_PACKETIZATION_PERIOD 20
 #define FRAME_SIZE_8000  320 /*which means each 20ms frame as 320 bytes at 8 khz (1 channel only)*/
@@ -53,7 +56,7 @@ namespace {
         tech_pvt->pAudioPipe = nullptr;
       }
       if (tech_pvt->resampler) {
-          speex_resampler_destroy(tech_pvt->resampler);
+          resampler_pool::release(tech_pvt->resampler);
           tech_pvt->resampler = NULL;
       }
 
@@ -114,6 +117,7 @@ namespace {
           switch (event) {
             case assemblyai::AudioPipe::CONNECT_SUCCESS:
               switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_INFO, "connection successful\n");
+              stream_metrics::mark_connected(*tech_pvt);
               tech_pvt->responseHandler(session, TRANSCRIBE_EVENT_CONNECT_SUCCESS, NULL, tech_pvt->bugname, finished);
             break;
             case assemblyai::AudioPipe::CONNECT_FAIL:
@@ -122,6 +126,7 @@ namespace {
               std::stringstream json;
               json << "{\"reason\":\"" << message << "\"}";
               tech_pvt->pAudioPipe = nullptr;
+              stream_metrics::instance().error("connect_failed");
               tech_pvt->responseHandler(session, TRANSCRIBE_EVENT_CONNECT_FAIL, (char *) json.str().c_str(), tech_pvt->bugname, finished);
               switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_NOTICE, "connection failed: %s\n", message);
             }
@@ -129,6 +134,7 @@ namespace {
             case assemblyai::AudioPipe::CONNECTION_DROPPED:
               // first thing: we can no longer access the AudioPipe
               tech_pvt->pAudioPipe = nullptr;
+              stream_metrics::instance().error("dropped");
               tech_pvt->responseHandler(session, TRANSCRIBE_EVENT_DISCONNECT, NULL, tech_pvt->bugname, finished);
               switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "connection dropped from far end\n");
             break;
@@ -141,6 +147,7 @@ namespace {
             {
               switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "assemblyai message: %s\n", message);
               if (strstr(message,  "\"error\":")) {
+                stream_metrics::instance().error("vendor_error");
                 tech_pvt->responseHandler(session, TRANSCRIBE_EVENT_ERROR, message, tech_pvt->bugname, finished);
               }
               if (strstr(message,  "\"message_type\":\"SessionBegins\"")) {
@@ -156,6 +163,7 @@ namespace {
                   switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "discarding empty partial transcript from assemblyai\n");
                   break;
                 }
+                stream_metrics::mark_result(*tech_pvt, nullptr != strstr(message,  "\"message_type\":\"FinalTranscript\""));
                 tech_pvt->responseHandler(session, TRANSCRIBE_EVENT_RESULTS, message, tech_pvt->bugname, finished);
               }
             }
@@ -181,6 +189,7 @@ namespace {
     switch_core_session_get_read_impl(session, &read_impl);
   
     memset(tech_pvt, 0, sizeof(private_t));
+    stream_metrics::mark_init(*tech_pvt);
   
     std::string path;
     constructPath(session, path, desiredSampling, channels, lang, interim);
@@ -218,7 +227,7 @@ namespace {
 
     if (desiredSampling != sampling) {
       switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "(%u) resampling from %u to %u\n", tech_pvt->id, sampling, desiredSampling);
-      tech_pvt->resampler = speex_resampler_init(channels, sampling, desiredSampling, SWITCH_RESAMPLE_QUALITY, &err);
+      tech_pvt->resampler = resampler_pool::acquire(channels, sampling, desiredSampling, SWITCH_RESAMPLE_QUALITY, &err);
       if (0 != err) {
         switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "Error initializing resampler: %s.\n", speex_resampler_strerror(err));
         return SWITCH_STATUS_FALSE;
@@ -255,6 +264,7 @@ extern "C" {
  
     int logs = LLL_ERR | LLL_WARN | LLL_NOTICE || LLL_INFO | LLL_PARSER | LLL_HEADER | LLL_EXT | LLL_CLIENT  | LLL_LATENCY | LLL_DEBUG ;
     
+    stream_metrics::instance().init("assemblyai_transcribe");
     assemblyai::AudioPipe::initialize(nServiceThreads, logs, lws_logger);
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "AudioPipe::initialize completed\n");
 
@@ -273,6 +283,7 @@ extern "C" {
   switch_status_t aai_transcribe_cleanup() {
     bool cleanup = false;
     cleanup = assemblyai::AudioPipe::deinitialize();
+    stream_metrics::instance().shutdown();
     if (cleanup == true) {
         return SWITCH_STATUS_SUCCESS;
     }
@@ -301,6 +312,8 @@ extern "C" {
 
     assemblyai::AudioPipe *pAudioPipe = static_cast<assemblyai::AudioPipe *>(tech_pvt->pAudioPipe);
     switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "connecting now\n");
+    stream_metrics::instance().streamStarted();
+    stream_metrics::mark_connect_start(*tech_pvt);
     pAudioPipe->connect();
     switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "connection in progress\n");
     return SWITCH_STATUS_SUCCESS;
@@ -332,6 +345,7 @@ extern "C" {
       reaper(tech_pvt);
     }
     destroy_tech_pvt(tech_pvt);
+    stream_metrics::instance().streamEnded();
     switch_mutex_unlock(tech_pvt->mutex);
     switch_mutex_destroy(tech_pvt->mutex);
     tech_pvt->mutex = nullptr;
@@ -340,8 +354,10 @@ extern "C" {
   }
 	
 	switch_bool_t aai_transcribe_frame(switch_core_session_t *session, switch_media_bug_t *bug) {
+    stream_metrics::FrameTimer timer;
     private_t* tech_pvt = (private_t*) switch_core_media_bug_get_user_data(bug);
     size_t inuse = 0;
+    size_t bytes = 0;
     bool dirty = false;
     char *p = (char *) "{\"msg\": \"buffer overrun\"}";
 
@@ -374,6 +390,7 @@ extern "C" {
             }
             switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "(%u) dropping packets!\n", 
               tech_pvt->id);
+            if (frame.datalen) stream_metrics::instance().framesDropped(pAudioPipe->binaryBufferedBytes() / frame.datalen);
             pAudioPipe->binaryWritePtrResetToZero();
 
             frame.data = pAudioPipe->binaryWritePtr();
@@ -383,7 +400,9 @@ extern "C" {
           switch_status_t rv = switch_core_media_bug_read(bug, &frame, SWITCH_TRUE);
           if (rv != SWITCH_STATUS_SUCCESS) break;
           if (frame.datalen) {
+            media_clock_advance(session, tech_pvt, frame.samples);
             pAudioPipe->binaryWritePtrAdd(frame.datalen);
+            bytes += frame.datalen;
             frame.buflen = available = pAudioPipe->binarySpaceAvailable();
             frame.data = pAudioPipe->binaryWritePtr();
             dirty = true;
@@ -397,23 +416,21 @@ extern "C" {
         frame.buflen = SWITCH_RECOMMENDED_BUFFER_SIZE;
         while (switch_core_media_bug_read(bug, &frame, SWITCH_TRUE) == SWITCH_STATUS_SUCCESS) {
           if (frame.datalen) {
-            spx_uint32_t out_len = available >> 1;  // space for samples which are 2 bytes
-            spx_uint32_t in_len = frame.samples;
-
-            speex_resampler_process_interleaved_int(tech_pvt->resampler, 
-              (const spx_int16_t *) frame.data, 
-              (spx_uint32_t *) &in_len, 
-              (spx_int16_t *) ((char *) pAudioPipe->binaryWritePtr()),
-              &out_len);
-
-            if (out_len > 0) {
-              // bytes written = num samples * 2 * num channels
-              size_t bytes_written = out_len << tech_pvt->channels;
-              pAudioPipe->binaryWritePtrAdd(bytes_written);
+            media_clock_advance(session, tech_pvt, frame.samples);
+            // resample straight into the ring buffer
+            size_t dropped = 0;
+            size_t written = resample_write(tech_pvt->resampler, tech_pvt->channels, frame.data, frame.datalen,
+              pAudioPipe->binaryWritePtr(), available, &dropped);
+
+            if (written > 0) {
+              pAudioPipe->binaryWritePtrAdd(written);
+              bytes += written;
               available = pAudioPipe->binarySpaceAvailable();
               dirty = true;
             }
-            if (available < pAudioPipe->binaryMinSpace()) {
+            // out of space: either some of this frame could not be resampled, or the next one may not fit
+            if (dropped > 0 || available < pAudioPipe->binaryMinSpace()) {
+              if (dropped > 0) stream_metrics::instance().framesDropped(1);
               if (!tech_pvt->buffer_overrun_notified) {
                 tech_pvt->buffer_overrun_notified = 1;
                 switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "(%u) dropping packets!\n", 
@@ -428,7 +445,27 @@ extern "C" {
 
       pAudioPipe->unlockAudioBuffer();
       switch_mutex_unlock(tech_pvt->mutex);
+      if (bytes) {
+        stream_metrics::mark_audio_sent(*tech_pvt);
+        stream_metrics::instance().bytesSent(bytes);
+      }
     }
     return SWITCH_TRUE;
   }
+
+  switch_status_t aai_transcribe_metrics(switch_stream_handle_t *stream) {
+    std::string text;
+
+    stream_metrics::instance().render(text);
+    stream->write_function(stream, "%s", text.c_str());
+    return SWITCH_STATUS_SUCCESS;
+  }
+
+  switch_status_t aai_transcribe_latency(switch_stream_handle_t *stream) {
+    std::string text;
+
+    stream_metrics::instance().latency(text);
+    stream->write_function(stream, "%s", text.c_str());
+    return SWITCH_STATUS_SUCCESS;
+  }
 }
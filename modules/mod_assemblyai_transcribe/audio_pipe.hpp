@@ -2,6 +2,7 @@
 #define __AAI_AUDIO_PIPE_HPP__
 
 #include <string>
+#include <vector>
 #include <list>
 #include <mutex>
 #include <future>
@@ -67,7 +68,10 @@ public:
     m_audio_buffer_write_offset += len;
   }
   void binaryWritePtrResetToZero(void) {
-    m_audio_buffer_write_offset = 0;
+    m_audio_buffer_write_offset = LWS_PRE;
+  }
+  size_t binaryBufferedBytes(void) {
+    return m_audio_buffer_write_offset - LWS_PRE;
   }
   void lockAudioBuffer(void) {
     m_audio_mutex.lock();
@@ -107,6 +111,7 @@ private:
   static AudioPipe* findAndRemovePendingConnect(struct lws *wsi);
   static AudioPipe* findPendingConnect(struct lws *wsi);
   static void addPendingConnect(AudioPipe* ap);
+  static void setResolved(AudioPipe* ap, const std::vector<std::string>& v6, const std::vector<std::string>& v4);
   static void addPendingDisconnect(AudioPipe* ap);
   static void addPendingWrite(AudioPipe* ap);
   static void processPendingConnects(lws_per_vhost_data *vhd);
@@ -114,6 +119,8 @@ private:
   static void processPendingWrites(void);
   
   bool connect_client(struct lws_per_vhost_data *vhd);
+  void connect_attempt(int n);
+  bool connect_fallback(struct lws *wsi);
 
   LwsState_t m_state;
   std::string m_uuid;
@@ -125,6 +132,12 @@ private:
   std::mutex m_audio_mutex;
   int m_sslFlags;
   struct lws *m_wsi;
+  // resolved addresses for the preferred and the other address family, and the connection attempt to each;
+  // the first to connect becomes m_wsi
+  std::string m_address[2];
+  struct lws *m_attempt[2];
+  bool m_resolved;
+  bool m_fallbackStarted;
   uint8_t *m_audio_buffer;
   size_t m_audio_buffer_max_len;
   size_t m_audio_buffer_write_offset;
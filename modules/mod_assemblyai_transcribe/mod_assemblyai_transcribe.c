@@ -14,6 +14,18 @@ SWITCH_MODULE_DEFINITION(mod_assemblyai_transcribe, mod_assemblyai_transcribe_lo
 
 static switch_status_t do_stop(switch_core_session_t *session, char* bugname);
 
+/* offset of the end of the audio a assemblyai transcript: its audio_end, in ms; -1 if it has none */
+static int64_t result_audio_ms(const char* json) {
+	int64_t audio_ms = -1;
+	cJSON* jMessage = cJSON_Parse(json);
+	if (jMessage) {
+		cJSON* jAudioEnd = cJSON_GetObjectItem(jMessage, "audio_end");
+		if (cJSON_IsNumber(jAudioEnd)) audio_ms = (int64_t) jAudioEnd->valuedouble;
+		cJSON_Delete(jMessage);
+	}
+	return audio_ms;
+}
+
 static void responseHandler(switch_core_session_t* session, 
 	const char* eventName, const char * json, const char* bugname, int finished) {
 	switch_event_t *event;
@@ -28,6 +40,7 @@ static void responseHandler(switch_core_session_t* session,
 	}
 	if (json) switch_event_add_body(event, "%s", json);
 	if (bugname) switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "media-bugname", bugname);
+	media_clock_stamp(session, bugname, event, json && 0 == strcmp(eventName, TRANSCRIBE_EVENT_RESULTS) ? result_audio_ms(json) : -1);
 	switch_event_fire(&event);
 }
 
@@ -171,6 +184,14 @@ SWITCH_STANDARD_API(aai_transcribe_function)
 }
 
 
+#define METRICS_API_SYNTAX "[latency]"
+SWITCH_STANDARD_API(metrics_function)
+{
+	if (!zstr(cmd) && 0 == strcasecmp(cmd, "latency")) aai_transcribe_latency(stream);
+	else aai_transcribe_metrics(stream);
+	return SWITCH_STATUS_SUCCESS;
+}
+
 SWITCH_MODULE_LOAD_FUNCTION(mod_assemblyai_transcribe_load)
 {
 	switch_api_interface_t *api_interface;
@@ -193,6 +214,7 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_assemblyai_transcribe_load)
 	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "Deepgram Speech Transcription API successfully loaded\n");
 
 	SWITCH_ADD_API(api_interface, "uuid_assemblyai_transcribe", "Deepgram Speech Transcription API", aai_transcribe_function, TRANSCRIBE_API_SYNTAX);
+	SWITCH_ADD_API(api_interface, "assemblyai_transcribe_metrics", "AssemblyAI Speech Transcription metrics in prometheus text format", metrics_function, METRICS_API_SYNTAX);
 	switch_console_set_complete("add uuid_assemblyai_transcribe start lang-code [interim|final] [stereo|mono]");
 	switch_console_set_complete("add uuid_assemblyai_transcribe stop ");
 
@@ -43,8 +43,51 @@ struct private_data {
   unsigned int id;
   int buffer_overrun_notified:1;
   int is_finished:1;
+	/* media clock, see media_clock_advance */
+	switch_time_t media_start;
+	uint64_t media_samples;
+	uint32_t media_rate;
+	/* stream latency marks, see stream_metrics.hpp */
+	int64_t mark_init;
+	int64_t mark_connect_start;
+	int64_t mark_connected;
+	int64_t mark_first_audio;
+	int64_t mark_first_interim;
+	int64_t mark_first_final;
 };
 
 typedef struct private_data private_t;
 
+/* media clock: advanced by the media thread for every frame read from the bug, used to stamp events */
+static inline void media_clock_advance(switch_core_session_t *session, private_t *p, uint32_t samples) {
+	if (!p->media_start) {
+		switch_codec_implementation_t read_impl = { 0 };
+		switch_core_session_get_read_impl(session, &read_impl);
+		p->media_rate = read_impl.samples_per_second;
+		p->media_start = switch_micro_time_now();
+	}
+	p->media_samples += samples;
+}
+
+/* adds media-time-ms (offset of the audio the event refers to, or -1 for the latest audio read) and event-time
+  (wall clock, usecs); given an offset, also processing-latency-ms (event-time minus the time that audio arrived).
+  The media clock starts with the first frame sent to the recognizer, so its result offsets need no adjustment;
+  pass -1 when the recognizer gives none, since the latest audio read says nothing about its latency */
+static inline void media_clock_stamp(switch_core_session_t *session, const char *bugname, switch_event_t *event, int64_t audio_ms) {
+	switch_channel_t *channel = switch_core_session_get_channel(session);
+	switch_media_bug_t *bug = (switch_media_bug_t *) switch_channel_get_private(channel, bugname ? bugname : MY_BUG_NAME);
+	private_t *p = bug ? (private_t *) switch_core_media_bug_get_user_data(bug) : NULL;
+	switch_time_t now = switch_micro_time_now();
+	int latency = audio_ms >= 0;
+
+	if (!p || !p->media_start || !p->media_rate) return;
+	if (!latency) audio_ms = (int64_t) (p->media_samples * 1000 / p->media_rate);
+	switch_event_add_header(event, SWITCH_STACK_BOTTOM, "media-time-ms", "%" SWITCH_INT64_T_FMT, audio_ms);
+	switch_event_add_header(event, SWITCH_STACK_BOTTOM, "event-time", "%" SWITCH_TIME_T_FMT, now);
+	if (latency) {
+		switch_event_add_header(event, SWITCH_STACK_BOTTOM, "processing-latency-ms", "%" SWITCH_INT64_T_FMT,
+			(int64_t) ((now - p->media_start) / 1000) - audio_ms);
+	}
+}
+
 #endif
\ No newline at end of file
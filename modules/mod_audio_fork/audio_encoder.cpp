@@ -0,0 +1,193 @@
+#include "audio_encoder.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <strings.h>
+
+#define OPUS_DEFAULT_BITRATE (32000)
+#define OPUS_MAX_PACKET (4000)            /* recommended maximum packet size for opus_encode */
+#define FLAC_DEFAULT_COMPRESSION (5)
+#define FLAC_PENDING_SIZE (64 * 1024)     /* encoder output held until the next frame is written */
+
+bool AudioEncoder::parse(const char* spec, Codec_t& codec, int& param) {
+  const char* colon = strchr(spec, ':');
+  size_t len = colon ? (size_t) (colon - spec) : strlen(spec);
+
+  param = colon ? ::atoi(colon + 1) : 0;
+  if (len == 3 && 0 == strncasecmp(spec, "l16", len)) {
+    codec = CODEC_L16;
+    return true;
+  }
+  if (len == 4 && 0 == strncasecmp(spec, "opus", len)) {
+    codec = CODEC_OPUS;
+    if (0 == param) param = OPUS_DEFAULT_BITRATE;
+    return param >= 6000 && param <= 510000;
+  }
+  if (len == 4 && 0 == strncasecmp(spec, "flac", len)) {
+    codec = CODEC_FLAC;
+    if (!colon) param = FLAC_DEFAULT_COMPRESSION;
+    return param >= 0 && param <= 8;
+  }
+  return false;
+}
+
+AudioEncoder::AudioEncoder(Codec_t codec, uint32_t sampleRate, uint32_t channels, int param) :
+  m_codec(codec), m_sampleRate(sampleRate), m_channels(channels), m_param(param),
+  m_frameSamples(sampleRate / 50), m_opus(nullptr), m_opusFill(0), m_flac(nullptr), m_flacPendingLen(0),
+  m_samplesIn(0), m_bytesOut(0), m_encodeUsecs(0) {
+}
+
+AudioEncoder::~AudioEncoder() {
+  if (m_opus) opus_encoder_destroy(m_opus);
+  if (m_flac) {
+    FLAC__stream_encoder_finish(m_flac);
+    FLAC__stream_encoder_delete(m_flac);
+  }
+}
+
+const char* AudioEncoder::getName(void) {
+  switch (m_codec) {
+    case CODEC_OPUS: return "opus";
+    case CODEC_FLAC: return "flac";
+    default: return "l16";
+  }
+}
+
+bool AudioEncoder::init(std::string& err) {
+  if (m_codec == CODEC_OPUS) {
+    int rc;
+
+    // opus only encodes at these rates
+    if (m_sampleRate != 8000 && m_sampleRate != 12000 && m_sampleRate != 16000 &&
+      m_sampleRate != 24000 && m_sampleRate != 48000) {
+      err = "opus does not support a sample rate of " + std::to_string(m_sampleRate);
+      return false;
+    }
+    m_opus = opus_encoder_create(m_sampleRate, m_channels, OPUS_APPLICATION_VOIP, &rc);
+    if (rc != OPUS_OK) {
+      err = std::string("opus_encoder_create failed: ") + opus_strerror(rc);
+      m_opus = nullptr;
+      return false;
+    }
+    opus_encoder_ctl(m_opus, OPUS_SET_BITRATE(m_param));
+    opus_encoder_ctl(m_opus, OPUS_SET_SIGNAL(OPUS_SIGNAL_VOICE));
+    m_opusFrame.resize(m_frameSamples * m_channels);
+    return true;
+  }
+  if (m_codec == CODEC_FLAC) {
+    FLAC__StreamEncoderInitStatus status;
+
+    m_flac = FLAC__stream_encoder_new();
+    if (!m_flac) {
+      err = "FLAC__stream_encoder_new failed";
+      return false;
+    }
+    m_flacPending.resize(FLAC_PENDING_SIZE);
+    m_flacPcm.resize(m_frameSamples * m_channels * 8);
+
+    // one flac frame per 20 ms, so compression adds no more latency than the bug itself
+    FLAC__stream_encoder_set_channels(m_flac, m_channels);
+    FLAC__stream_encoder_set_bits_per_sample(m_flac, 16);
+    FLAC__stream_encoder_set_sample_rate(m_flac, m_sampleRate);
+    FLAC__stream_encoder_set_compression_level(m_flac, m_param);
+    FLAC__stream_encoder_set_blocksize(m_flac, m_frameSamples);
+    FLAC__stream_encoder_set_streamable_subset(m_flac, true);
+    status = FLAC__stream_encoder_init_stream(m_flac, flac_write_callback, nullptr, nullptr, nullptr, this);
+    if (status != FLAC__STREAM_ENCODER_INIT_STATUS_OK) {
+      err = std::string("FLAC__stream_encoder_init_stream failed: ") + FLAC__StreamEncoderInitStatusString[status];
+      return false;
+    }
+    return true;
+  }
+  return true;
+}
+
+int AudioEncoder::encode(const int16_t* pcm, uint32_t samples, uint8_t* out, size_t outLen) {
+  auto start = std::chrono::steady_clock::now();
+  int written;
+
+  switch (m_codec) {
+    case CODEC_OPUS:
+      written = encodeOpus(pcm, samples, out, outLen);
+      break;
+    case CODEC_FLAC:
+      written = encodeFlac(pcm, samples, out, outLen);
+      break;
+    default:
+      {
+        size_t bytes = samples * m_channels * sizeof(int16_t);
+        if (bytes > outLen) return -1;
+        memcpy(out, pcm, bytes);
+        written = (int) bytes;
+      }
+      break;
+  }
+
+  m_samplesIn += samples;
+  if (written > 0) m_bytesOut += written;
+  m_encodeUsecs += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+  return written;
+}
+
+int AudioEncoder::encodeOpus(const int16_t* pcm, uint32_t samples, uint8_t* out, size_t outLen) {
+  size_t written = 0;
+  bool overrun = false;
+
+  while (samples > 0) {
+    uint32_t take = std::min(samples, m_frameSamples - m_opusFill);
+
+    memcpy(&m_opusFrame[m_opusFill * m_channels], pcm, take * m_channels * sizeof(int16_t));
+    m_opusFill += take;
+    pcm += take * m_channels;
+    samples -= take;
+
+    if (m_opusFill == m_frameSamples) {
+      m_opusFill = 0;
+      if (overrun || outLen - written < 3) {
+        overrun = true;
+        continue;
+      }
+
+      opus_int32 maxBytes = (opus_int32) std::min(outLen - written - 2, (size_t) OPUS_MAX_PACKET);
+      opus_int32 len = opus_encode(m_opus, &m_opusFrame[0], m_frameSamples, out + written + 2, maxBytes);
+      if (len < 0) {
+        overrun = true;
+        continue;
+      }
+      out[written] = (uint8_t) (len >> 8);
+      out[written + 1] = (uint8_t) (len & 0xff);
+      written += 2 + len;
+    }
+  }
+  return overrun ? -1 : (int) written;
+}
+
+int AudioEncoder::encodeFlac(const int16_t* pcm, uint32_t samples, uint8_t* out, size_t outLen) {
+  uint32_t total = samples * m_channels;
+
+  if (m_flacPcm.size() < total) m_flacPcm.resize(total);
+  for (uint32_t i = 0; i < total; i++) m_flacPcm[i] = pcm[i];
+
+  // the write callback appends whatever frames this completes (and, the first time, the stream header)
+  FLAC__stream_encoder_process_interleaved(m_flac, &m_flacPcm[0], samples);
+
+  size_t len = m_flacPendingLen;
+  m_flacPendingLen = 0;
+  if (len > outLen) return -1;
+  memcpy(out, &m_flacPending[0], len);
+  return (int) len;
+}
+
+FLAC__StreamEncoderWriteStatus AudioEncoder::flac_write_callback(const FLAC__StreamEncoder *encoder,
+  const FLAC__byte buffer[], size_t bytes, uint32_t samples, uint32_t current_frame, void *client_data) {
+  AudioEncoder* enc = static_cast<AudioEncoder*>(client_data);
+
+  // if the audio buffer has been full for a while the frame is dropped; decoders resync on the next frame
+  if (enc->m_flacPendingLen + bytes <= enc->m_flacPending.size()) {
+    memcpy(&enc->m_flacPending[enc->m_flacPendingLen], buffer, bytes);
+    enc->m_flacPendingLen += bytes;
+  }
+  return FLAC__STREAM_ENCODER_WRITE_STATUS_OK;
+}
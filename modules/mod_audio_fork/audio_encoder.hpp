@@ -0,0 +1,88 @@
+#ifndef __AUDIO_ENCODER_HPP__
+#define __AUDIO_ENCODER_HPP__
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include <opus/opus.h>
+#include <FLAC/stream_encoder.h>
+
+/**
+ * Optional compression of the forked audio, done on the media thread before the audio is written
+ * into the AudioPipe buffer.  All state, including scratch buffers, is allocated when the encoder
+ * is created so that encoding a frame does not allocate.
+ *
+ * Wire format of the binary websocket frames:
+ * - l16:  raw 16-bit little-endian PCM, as before
+ * - opus: a sequence of 20 ms opus packets, each preceded by its length as a 2-byte big-endian integer
+ * - flac: a continuous FLAC stream (fLaC marker and STREAMINFO first, one frame per 20 ms after that);
+ *         concatenating the binary frames gives a playable .flac file
+ */
+class AudioEncoder {
+public:
+  enum Codec_t {
+    CODEC_L16,
+    CODEC_OPUS,
+    CODEC_FLAC
+  };
+
+  // parses "l16", "opus", "opus:<bitrate>", "flac" or "flac:<compression level>"
+  static bool parse(const char* spec, Codec_t& codec, int& param);
+
+  AudioEncoder(Codec_t codec, uint32_t sampleRate, uint32_t channels, int param);
+  ~AudioEncoder();
+
+  // returns false (and sets the reason) if the encoder could not be created for this rate/channels
+  bool init(std::string& err);
+
+  /**
+   * encode interleaved PCM (samples per channel) into out; returns the number of bytes written,
+   * or -1 if out did not have room for all of the encoded audio (the excess is dropped)
+   */
+  int encode(const int16_t* pcm, uint32_t samples, uint8_t* out, size_t outLen);
+
+  Codec_t getCodec(void) { return m_codec; }
+  const char* getName(void);
+  uint32_t getSampleRate(void) { return m_sampleRate; }
+  uint32_t getChannels(void) { return m_channels; }
+  int getParam(void) { return m_param; }
+
+  // totals for logging the bandwidth saved against the cpu spent
+  uint64_t getSamplesIn(void) { return m_samplesIn; }
+  uint64_t getBytesOut(void) { return m_bytesOut; }
+  uint64_t getEncodeUsecs(void) { return m_encodeUsecs; }
+
+  // no default constructor or copying
+  AudioEncoder() = delete;
+  AudioEncoder(const AudioEncoder&) = delete;
+  void operator=(const AudioEncoder&) = delete;
+
+private:
+  static FLAC__StreamEncoderWriteStatus flac_write_callback(const FLAC__StreamEncoder *encoder,
+    const FLAC__byte buffer[], size_t bytes, uint32_t samples, uint32_t current_frame, void *client_data);
+
+  int encodeOpus(const int16_t* pcm, uint32_t samples, uint8_t* out, size_t outLen);
+  int encodeFlac(const int16_t* pcm, uint32_t samples, uint8_t* out, size_t outLen);
+
+  Codec_t m_codec;
+  uint32_t m_sampleRate;
+  uint32_t m_channels;
+  int m_param;
+  uint32_t m_frameSamples;          // samples per channel in 20 ms
+
+  OpusEncoder* m_opus;
+  std::vector<int16_t> m_opusFrame; // pcm accumulated towards the next 20 ms opus packet
+  uint32_t m_opusFill;
+
+  FLAC__StreamEncoder* m_flac;
+  std::vector<FLAC__int32> m_flacPcm;
+  std::vector<uint8_t> m_flacPending; // encoder output not yet copied to the audio buffer
+  size_t m_flacPendingLen;
+
+  uint64_t m_samplesIn;
+  uint64_t m_bytesOut;
+  uint64_t m_encodeUsecs;
+};
+
+#endif
@@ -1,11 +1,22 @@
 #include "audio_pipe.hpp"
+#include "dns_cache.hpp"
+#include "stream_metrics.hpp"
 
 #include <cassert>
+#include <algorithm>
+#include <chrono>
 #include <iostream>
+#include <random>
 
 /* discard incoming text messages over the socket that are longer than this */
 #define MAX_RECV_BUF_SIZE (65 * 1024 * 10)
 #define RECV_BUF_REALLOC_SIZE (8 * 1024)
+#define HAPPY_EYEBALLS_DELAY_MS (250)
+/* tls client sessions each service context keeps for resumption, one per server */
+#define TLS_SESSION_CACHE_MAX (64)
+/* backoff between reconnect attempts doubles from the minimum up to the maximum */
+#define RECONNECT_BACKOFF_MIN_MS (250u)
+#define RECONNECT_BACKOFF_MAX_MS (8000u)
 
 
 namespace {
@@ -14,6 +25,20 @@ namespace {
 
   static const char *requestedTcpKeepaliveSecs = std::getenv("MOD_AUDIO_FORK_TCP_KEEPALIVE_SECS");
   static int nTcpKeepaliveSecs = requestedTcpKeepaliveSecs ? ::atoi(requestedTcpKeepaliveSecs) : 55;
+
+  /* buffer occupancy (percent) above which time is accumulated as "over high water" */
+  static const char *requestedHighWaterPct = std::getenv("MOD_AUDIO_FORK_BUFFER_HIGH_WATER_PCT");
+  static int nHighWaterPct = requestedHighWaterPct && ::atoi(requestedHighWaterPct) > 0 && ::atoi(requestedHighWaterPct) <= 100 ?
+    ::atoi(requestedHighWaterPct) : 75;
+
+  static int64_t now_usecs(void) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  static void atomic_max(std::atomic<uint64_t>& a, uint64_t value) {
+    uint64_t prev = a.load();
+    while (prev < value && !a.compare_exchange_weak(prev, value));
+  }
 }
 
 // remove once we update to lws with this helper
@@ -75,12 +100,25 @@ int AudioPipe::lws_callback(struct lws *wsi,
       processPendingDisconnects(vhd);
       processPendingWrites();
       break;
+    case LWS_CALLBACK_TIMER:
+      {
+        // the first address has not connected yet, race the other address family against it
+        AudioPipe* ap = findPendingConnect(wsi);
+        if (ap && !ap->m_fallbackStarted && !ap->m_address[1].empty()) ap->connect_attempt(1);
+      }
+      break;
+
     case LWS_CALLBACK_CLIENT_CONNECTION_ERROR:
       {
-        AudioPipe* ap = findAndRemovePendingConnect(wsi);
+        AudioPipe* ap = findPendingConnect(wsi);
         int rc = lws_http_client_http_response(wsi);
         lwsl_err("AudioPipe::lws_service_thread LWS_CALLBACK_CLIENT_CONNECTION_ERROR: %s, response status %d\n", in ? (char *)in : "(null)", rc); 
-        if (ap) {
+        if (ap && ap->connect_fallback(wsi)) break;
+        ap = findAndRemovePendingConnect(wsi);
+        if (ap && ap->m_reconnecting) {
+          ap->reconnect_failed(in ? (char *) in : "(null)");
+        }
+        else if (ap) {
           ap->m_state = LWS_CLIENT_FAILED;
           ap->m_callback(ap->m_uuid.c_str(), ap->m_bugname.c_str(), AudioPipe::CONNECT_FAIL, (char *) in);
         }
@@ -94,13 +132,21 @@ int AudioPipe::lws_callback(struct lws *wsi,
       {
         AudioPipe* ap = findAndRemovePendingConnect(wsi);
         if (ap) {
+          struct lws* other = ap->m_attempt[wsi == ap->m_attempt[0] ? 1 : 0];
+          ap->m_attempt[0] = ap->m_attempt[1] = nullptr;
+          if (other) lws_set_timeout(other, PENDING_TIMEOUT_USER_OK, LWS_TO_KILL_ASYNC);
+          ap->m_wsi = wsi;
+#if defined(LWS_WITH_TLS_SESSIONS)
+          if (lws_is_ssl(wsi)) stream_metrics::instance().tlsHandshake(lws_tls_session_is_reused(wsi));
+#endif
           *ppAp = ap;
           ap->m_vhd = vhd;
           ap->m_state = LWS_CLIENT_CONNECTED;
-          ap->m_callback(ap->m_uuid.c_str(), ap->m_bugname.c_str(), AudioPipe::CONNECT_SUCCESS, NULL);
+          if (ap->m_reconnecting) ap->reconnected();
+          else ap->m_callback(ap->m_uuid.c_str(), ap->m_bugname.c_str(), AudioPipe::CONNECT_SUCCESS, NULL);
         }
         else {
-          lwsl_err("AudioPipe::lws_service_thread LWS_CALLBACK_CLIENT_ESTABLISHED %s unable to find wsi %p..\n", ap->m_uuid.c_str(), wsi); 
+          lwsl_err("AudioPipe::lws_service_thread LWS_CALLBACK_CLIENT_ESTABLISHED unable to find wsi %p..\n", wsi); 
         }
       }      
       break;
@@ -108,9 +154,14 @@ int AudioPipe::lws_callback(struct lws *wsi,
       {
         AudioPipe* ap = *ppAp;
         if (!ap) {
-          lwsl_err("AudioPipe::lws_service_thread LWS_CALLBACK_CLIENT_CLOSED %s unable to find wsi %p..\n", ap->m_uuid.c_str(), wsi); 
+          lwsl_err("AudioPipe::lws_service_thread LWS_CALLBACK_CLIENT_CLOSED unable to find wsi %p..\n", wsi); 
           return 0;
         }
+        *ppAp = NULL;
+        if (ap->reconnect_after_drop()) {
+          // closed by far end, but the pipe lives on to reconnect
+          break;
+        }
         if (ap->m_state == LWS_CLIENT_DISCONNECTING) {
           // closed by us
           ap->m_callback(ap->m_uuid.c_str(), ap->m_bugname.c_str(), AudioPipe::CONNECTION_CLOSED_GRACEFULLY, NULL);
@@ -125,7 +176,6 @@ int AudioPipe::lws_callback(struct lws *wsi,
         //NB: after receiving any of the events above, any holder of a 
         //pointer or reference to this object must treat is as no longer valid
 
-        *ppAp = NULL;
         delete ap;
       }
       break;
@@ -134,7 +184,7 @@ int AudioPipe::lws_callback(struct lws *wsi,
       {
         AudioPipe* ap = *ppAp;
         if (!ap) {
-          lwsl_err("AudioPipe::lws_service_thread LWS_CALLBACK_CLIENT_RECEIVE %s unable to find wsi %p..\n", ap->m_uuid.c_str(), wsi); 
+          lwsl_err("AudioPipe::lws_service_thread LWS_CALLBACK_CLIENT_RECEIVE unable to find wsi %p..\n", wsi); 
           return 0;
         }
 
@@ -193,7 +243,7 @@ int AudioPipe::lws_callback(struct lws *wsi,
       {
         AudioPipe* ap = *ppAp;
         if (!ap) {
-          lwsl_err("AudioPipe::lws_service_thread LWS_CALLBACK_CLIENT_WRITEABLE %s unable to find wsi %p..\n", ap->m_uuid.c_str(), wsi); 
+          lwsl_err("AudioPipe::lws_service_thread LWS_CALLBACK_CLIENT_WRITEABLE unable to find wsi %p..\n", wsi); 
           return 0;
         }
 
@@ -231,6 +281,24 @@ int AudioPipe::lws_callback(struct lws *wsi,
           return -1;
         }
 
+        // audio replayed after a reconnect goes ahead of anything newer, as many whole writes as fit in one frame
+        if (!ap->m_replayPending.empty()) {
+          std::vector<uint8_t> buf(LWS_PRE);
+          while (!ap->m_replayPending.empty() && 
+            (buf.size() == LWS_PRE || buf.size() + ap->m_replayPending.front().length() <= ap->m_audio_buffer_max_len)) {
+            buf.insert(buf.end(), ap->m_replayPending.front().begin(), ap->m_replayPending.front().end());
+            ap->m_replayPending.pop_front();
+          }
+          size_t datalen = buf.size() - LWS_PRE;
+          int sent = lws_write(wsi, buf.data() + LWS_PRE, datalen, LWS_WRITE_BINARY);
+          if (sent < datalen) {
+            lwsl_err("AudioPipe::lws_service_thread LWS_CALLBACK_CLIENT_WRITEABLE %s attemped to replay %lu only sent %d wsi %p..\n", 
+              ap->m_uuid.c_str(), datalen, sent, wsi); 
+          }
+          lws_callback_on_writable(wsi);
+          return 0;
+        }
+
         // check for audio packets
         {
           std::lock_guard<std::mutex> lk(ap->m_audio_mutex);
@@ -242,6 +310,8 @@ int AudioPipe::lws_callback(struct lws *wsi,
                 ap->m_uuid.c_str(), datalen, sent, wsi); 
             }
             ap->m_audio_buffer_write_offset = LWS_PRE;
+            ap->m_audio_buffer_frames = 0;
+            ap->updateOccupancy();
           }
         }
 
@@ -280,25 +350,49 @@ std::list<AudioPipe*> AudioPipe::pendingConnects;
 std::list<AudioPipe*> AudioPipe::pendingDisconnects;
 std::list<AudioPipe*> AudioPipe::pendingWrites;
 AudioPipe::log_emit_function AudioPipe::logger;
+std::atomic<uint64_t> AudioPipe::totalStreams(0);
+std::atomic<uint64_t> AudioPipe::totalActiveStreams(0);
+std::atomic<uint64_t> AudioPipe::totalOverruns(0);
+std::atomic<uint64_t> AudioPipe::totalFramesDropped(0);
+std::atomic<uint64_t> AudioPipe::totalBytesDropped(0);
+std::atomic<uint64_t> AudioPipe::totalMaxOccupancyPct(0);
+std::atomic<uint64_t> AudioPipe::totalUsecsOverHighWater(0);
 std::mutex AudioPipe::mapMutex;
 std::unordered_map<std::thread::id, bool> AudioPipe::stopFlags;
 std::queue<std::thread::id> AudioPipe::threadIds;
 
 void AudioPipe::processPendingConnects(lws_per_vhost_data *vhd) {
-  std::list<AudioPipe*> connects;
+  std::list<AudioPipe*> connects, unresolved;
   {
     std::lock_guard<std::mutex> guard(mutex_connects);
-    for (auto it = pendingConnects.begin(); it != pendingConnects.end(); ++it) {
-      if ((*it)->m_state == LWS_CLIENT_IDLE) {
-        connects.push_back(*it);
-        (*it)->m_state = LWS_CLIENT_CONNECTING;
+    for (auto it = pendingConnects.begin(); it != pendingConnects.end();) {
+      AudioPipe* ap = *it;
+      if (ap->m_state == LWS_CLIENT_IDLE && ap->m_resolved && ap->m_address[0].empty()) {
+        unresolved.push_back(ap);
+        it = pendingConnects.erase(it);
+        continue;
+      }
+      if (ap->m_state == LWS_CLIENT_IDLE && ap->m_resolved) {
+        connects.push_back(ap);
+        ap->m_state = LWS_CLIENT_CONNECTING;
       }
+      ++it;
     }
   }
   for (auto it = connects.begin(); it != connects.end(); ++it) {
     AudioPipe* ap = *it;
     ap->connect_client(vhd);   
   }
+  for (auto it = unresolved.begin(); it != unresolved.end(); ++it) {
+    AudioPipe* ap = *it;
+    if (ap->m_reconnecting) {
+      ap->reconnect_failed("unable to resolve host");
+    }
+    else {
+      ap->m_state = LWS_CLIENT_FAILED;
+      ap->m_callback(ap->m_uuid.c_str(), ap->m_bugname.c_str(), AudioPipe::CONNECT_FAIL, (char *) "unable to resolve host");
+    }
+  }
 }
 
 void AudioPipe::processPendingDisconnects(lws_per_vhost_data *vhd) {
@@ -339,11 +433,11 @@ AudioPipe* AudioPipe::findAndRemovePendingConnect(struct lws *wsi) {
   for (auto it = pendingConnects.begin(); it != pendingConnects.end() && !ap; ++it) {
     int state = (*it)->m_state;
 
-    if ((*it)->m_wsi == nullptr)
+    if ((state == LWS_CLIENT_CONNECTING) && !(*it)->m_attempt[0] && !(*it)->m_attempt[1])
       toRemove.push_back(*it);
 
     if ((state == LWS_CLIENT_CONNECTING) &&
-      (*it)->m_wsi == wsi) ap = *it;
+      ((*it)->m_attempt[0] == wsi || (*it)->m_attempt[1] == wsi)) ap = *it;
   }
 
   for (auto it = toRemove.begin(); it != toRemove.end(); ++it)
@@ -363,7 +457,7 @@ AudioPipe* AudioPipe::findPendingConnect(struct lws *wsi) {
   for (auto it = pendingConnects.begin(); it != pendingConnects.end() && !ap; ++it) {
     int state = (*it)->m_state;
     if ((state == LWS_CLIENT_CONNECTING) &&
-      (*it)->m_wsi == wsi) ap = *it;
+      ((*it)->m_attempt[0] == wsi || (*it)->m_attempt[1] == wsi)) ap = *it;
   }
   return ap;
 }
@@ -375,6 +469,23 @@ void AudioPipe::addPendingConnect(AudioPipe* ap) {
     lwsl_notice("%s after adding connect there are %lu pending connects\n", 
       ap->m_uuid.c_str(), pendingConnects.size());
   }
+  // resolve off the service threads; the connect is picked up once the addresses are known
+  dns_cache::instance().resolve(ap->m_host, [ap](const std::vector<std::string>& v6, const std::vector<std::string>& v4) {
+    setResolved(ap, v6, v4);
+  });
+}
+void AudioPipe::setResolved(AudioPipe* ap, const std::vector<std::string>& v6, const std::vector<std::string>& v4) {
+  {
+    // the pipe may have gone while its name was being resolved
+    std::lock_guard<std::mutex> guard(mutex_connects);
+    if (std::find(pendingConnects.begin(), pendingConnects.end(), ap) == pendingConnects.end()) return;
+
+    // ipv6 first, with the first ipv4 address as the fallback
+    ap->m_address[0] = !v6.empty() ? v6[0] : (!v4.empty() ? v4[0] : "");
+    ap->m_address[1] = !v6.empty() && !v4.empty() ? v4[0] : "";
+    ap->m_resolved = true;
+    if (v6.empty() && v4.empty()) lwsl_notice("%s unable to resolve %s\n", ap->m_uuid.c_str(), ap->m_host.c_str());
+  }
   lws_cancel_service(contexts[nchild++ % numContexts]);
 }
 void AudioPipe::addPendingDisconnect(AudioPipe* ap) {
@@ -421,6 +532,10 @@ bool AudioPipe::lws_service_thread(unsigned int nServiceThread) {
   info.keepalive_timeout = 5;           // seconds to allow remote client to hold on to an idle HTTP/1.1 connection 
   info.timeout_secs_ah_idle = 10;       // secs to allow a client to hold an ah without using it
   info.retry_and_idle_policy = &retry;
+#if defined(LWS_WITH_TLS_SESSIONS)
+  // later connections to a server resume the session of an earlier one instead of a full handshake
+  info.tls_session_cache_max = TLS_SESSION_CACHE_MAX;
+#endif
 
   lwsl_notice("AudioPipe::lws_service_thread creating context in service thread %d.\n", nServiceThread);
 
@@ -463,6 +578,8 @@ void AudioPipe::initialize(const char* protocol, unsigned int nThreads, int logl
 
 bool AudioPipe::deinitialize() {
   lwsl_notice("AudioPipe::deinitialize\n"); 
+  // resolved names are handed back through the lws contexts, so the resolver must be gone before they are destroyed
+  dns_cache::instance().shutdown();
   std::lock_guard<std::mutex> lock(mapMutex);
   if (!threadIds.empty()) {
       std::thread::id id = threadIds.front();
@@ -503,8 +620,28 @@ AudioPipe::AudioPipe(const char* uuid, const char* host, unsigned int port, cons
   }
 
   m_audio_buffer = new uint8_t[m_audio_buffer_max_len];
+  m_attempt[0] = m_attempt[1] = nullptr;
+  m_resolved = m_fallbackStarted = false;
+
+  memset(&m_reconnectTimer, 0, sizeof(m_reconnectTimer));
+  m_reconnecting = m_closeRequested = false;
+  m_reconnectMax = m_reconnectAttempts = 0;
+  m_replayStart = m_replayLen = 0;
+  m_replay_mark = LWS_PRE;
+  m_replayUsecs = 0;
+
+  m_audio_buffer_frames = 0;
+  m_audio_buffer_high_water = (m_audio_buffer_max_len - LWS_PRE) * nHighWaterPct / 100;
+  m_overruns = m_framesDropped = m_bytesDropped = m_maxBuffered = m_usecsOverHighWater = 0;
+  m_overHighWaterSince = 0;
+  totalStreams++;
+  totalActiveStreams++;
 }
 AudioPipe::~AudioPipe() {
+  int64_t since = m_overHighWaterSince.exchange(0);
+  if (since) totalUsecsOverHighWater += now_usecs() - since;
+  totalActiveStreams--;
+
   if (m_audio_buffer) delete [] m_audio_buffer;
   if (m_recv_buf) delete [] m_recv_buf;
 }
@@ -517,26 +654,50 @@ bool AudioPipe::connect_client(struct lws_per_vhost_data *vhd) {
   assert(m_audio_buffer != nullptr);
   assert(m_vhd == nullptr);
 
+  m_state = LWS_CLIENT_CONNECTING;
+  m_vhd = vhd;
+
+  // the preferred address family goes first; the other joins in if it has not connected in time
+  connect_attempt(0);
+  if (m_attempt[0] && !m_address[1].empty()) lws_set_timer_usecs(m_attempt[0], HAPPY_EYEBALLS_DELAY_MS * 1000);
+
+  return nullptr != m_attempt[0] || m_fallbackStarted;
+}
+
+void AudioPipe::connect_attempt(int n) {
   struct lws_client_connect_info i;
 
   memset(&i, 0, sizeof(i));
-  i.context = vhd->context;
+  i.context = m_vhd->context;
   i.port = m_port;
-  i.address = m_host.c_str();
+  // connect to the resolved address (by name if there is none) but present the name for sni and certificate checks
+  i.address = m_address[n].c_str();
   i.path = m_path.c_str();
-  i.host = i.address;
-  i.origin = i.address;
+  i.host = m_host.c_str();
+  i.origin = m_host.c_str();
   i.ssl_connection = m_sslFlags;
   i.protocol = protocolName.c_str();
-  i.pwsi = &(m_wsi);
+  i.pwsi = &(m_attempt[n]);
 
-  m_state = LWS_CLIENT_CONNECTING;
-  m_vhd = vhd;
+  if (n == 1) m_fallbackStarted = true;
+  m_attempt[n] = lws_client_connect_via_info(&i);
+  lwsl_notice("%s attempting connection to %s, wsi is %p\n", m_uuid.c_str(), i.address, m_attempt[n]);
+}
 
-  m_wsi = lws_client_connect_via_info(&i);
-  lwsl_notice("%s attempting connection, wsi is %p\n", m_uuid.c_str(), m_wsi);
+// an attempt failed: returns true if another attempt is still, or now, under way
+bool AudioPipe::connect_fallback(struct lws *wsi) {
+  int other = (wsi == m_attempt[0]) ? 1 : 0;
 
-  return nullptr != m_wsi;
+  if (m_attempt[other]) {
+    m_attempt[1 - other] = nullptr;
+    return true;
+  }
+  if (m_fallbackStarted || m_address[1].empty()) return false;
+
+  connect_attempt(1);
+  if (!m_attempt[1]) return false;
+  m_attempt[0] = nullptr;
+  return true;
 }
 
 void AudioPipe::bufferForSending(const char* text) {
@@ -549,16 +710,251 @@ void AudioPipe::bufferForSending(const char* text) {
 }
 
 void AudioPipe::unlockAudioBuffer() {
-  if (m_audio_buffer_write_offset > LWS_PRE) addPendingWrite(this);
+  keepForReplay();
+  if (m_reconnecting && !m_replay.empty()) {
+    // while reconnecting the replay ring holds the audio, there is no need to buffer it twice
+    m_audio_buffer_write_offset = m_replay_mark = LWS_PRE;
+    m_audio_buffer_frames = 0;
+  }
+  updateOccupancy();
+  if (m_audio_buffer_write_offset > LWS_PRE && m_state == LWS_CLIENT_CONNECTED) addPendingWrite(this);
   m_audio_mutex.unlock();
 }
 
+void AudioPipe::binaryWritePtrResetToZero(void) {
+  size_t buffered = m_audio_buffer_write_offset - LWS_PRE;
+
+  keepForReplay();
+  updateOccupancy();
+  m_overruns++;
+  m_framesDropped += m_audio_buffer_frames;
+  m_bytesDropped += buffered;
+  totalOverruns++;
+  totalFramesDropped += m_audio_buffer_frames;
+  totalBytesDropped += buffered;
+
+  m_audio_buffer_write_offset = m_replay_mark = LWS_PRE;
+  m_audio_buffer_frames = 0;
+}
+
+void AudioPipe::binaryFrameDropped(size_t len) {
+  m_overruns++;
+  m_framesDropped++;
+  m_bytesDropped += len;
+  totalOverruns++;
+  totalFramesDropped++;
+  totalBytesDropped += len;
+}
+
+/* must be called with the audio mutex held, after anything that changes the write offset */
+void AudioPipe::updateOccupancy(void) {
+  size_t buffered = m_audio_buffer_write_offset - LWS_PRE;
+
+  if (buffered > m_maxBuffered) {
+    m_maxBuffered = buffered;
+    atomic_max(totalMaxOccupancyPct, buffered * 100 / (m_audio_buffer_max_len - LWS_PRE));
+  }
+
+  if (buffered >= m_audio_buffer_high_water) {
+    if (!m_overHighWaterSince) m_overHighWaterSince = now_usecs();
+  }
+  else if (m_overHighWaterSince) {
+    int64_t usecs = now_usecs() - m_overHighWaterSince.exchange(0);
+    m_usecsOverHighWater += usecs;
+    totalUsecsOverHighWater += usecs;
+  }
+}
+
+void AudioPipe::getBufferStats(BufferStats_t& stats) {
+  int64_t since = m_overHighWaterSince;
+  uint64_t usecs = m_usecsOverHighWater + (since ? now_usecs() - since : 0);
+
+  memset(&stats, 0, sizeof(stats));
+  stats.overruns = m_overruns;
+  stats.framesDropped = m_framesDropped;
+  stats.bytesDropped = m_bytesDropped;
+  stats.bufferSize = m_audio_buffer_max_len - LWS_PRE;
+  {
+    std::lock_guard<std::mutex> lk(m_audio_mutex);
+    stats.buffered = m_audio_buffer_write_offset - LWS_PRE;
+  }
+  stats.maxBuffered = m_maxBuffered;
+  stats.maxOccupancyPct = stats.maxBuffered * 100 / stats.bufferSize;
+  stats.msOverHighWater = usecs / 1000;
+}
+
+void AudioPipe::getTotalBufferStats(BufferStats_t& stats) {
+  memset(&stats, 0, sizeof(stats));
+  stats.streams = totalStreams;
+  stats.activeStreams = totalActiveStreams;
+  stats.overruns = totalOverruns;
+  stats.framesDropped = totalFramesDropped;
+  stats.bytesDropped = totalBytesDropped;
+  stats.maxOccupancyPct = totalMaxOccupancyPct;
+  stats.msOverHighWater = totalUsecsOverHighWater / 1000;
+}
+
+int AudioPipe::getHighWaterPct(void) {
+  return nHighWaterPct;
+}
+
 void AudioPipe::close() {
+  std::lock_guard<std::mutex> lk(m_reconnect_mutex);
+  if (m_reconnecting) {
+    // the service thread deletes the pipe once the reconnect in progress ends
+    m_closeRequested = true;
+    return;
+  }
   if (m_state != LWS_CLIENT_CONNECTED) return;
   addPendingDisconnect(this);
 }
 
 void AudioPipe::do_graceful_shutdown() {
   m_gracefulShutdown = true;
-  addPendingWrite(this);
+  if (m_state == LWS_CLIENT_CONNECTED) addPendingWrite(this);
+}
+
+void AudioPipe::setReconnect(unsigned int maxAttempts, unsigned int replaySecs, size_t replayBytes, const char* initialMetadata) {
+  m_reconnectMax = maxAttempts;
+  m_initialMetadata = initialMetadata ? initialMetadata : "";
+  m_replayUsecs = (int64_t) replaySecs * 1000000;
+  m_replay.assign(maxAttempts && replaySecs ? replayBytes : 0, 0);
+}
+
+/* must be called with the audio mutex held: copies what was written since the mark into the replay ring */
+void AudioPipe::keepForReplay(void) {
+  size_t size = m_replay.size();
+  size_t len = m_audio_buffer_write_offset - m_replay_mark;
+
+  if (0 == size || m_audio_buffer_write_offset <= m_replay_mark) return;
+  m_replay_mark = m_audio_buffer_write_offset;
+  if (len > size) return;
+
+  // make room, and age out what is older than the replay window
+  int64_t now = now_usecs();
+  while (!m_replayChunks.empty() && (m_replayLen + len > size || m_replayChunks.front().first < now - m_replayUsecs)) {
+    m_replayStart = (m_replayStart + m_replayChunks.front().second) % size;
+    m_replayLen -= m_replayChunks.front().second;
+    m_replayChunks.pop_front();
+  }
+
+  size_t at = (m_replayStart + m_replayLen) % size;
+  size_t first = std::min(len, size - at);
+  memcpy(&m_replay[at], m_audio_buffer + m_replay_mark - len, first);
+  memcpy(&m_replay[0], m_audio_buffer + m_replay_mark - len + first, len - first);
+  m_replayLen += len;
+  m_replayChunks.push_back(std::make_pair(now, len));
+}
+
+/* on the service thread, when the far end has closed a connected pipe: returns false if it is not to reconnect */
+bool AudioPipe::reconnect_after_drop(void) {
+  {
+    std::lock_guard<std::mutex> lk(m_reconnect_mutex);
+    if (m_state != LWS_CLIENT_CONNECTED || 0 == m_reconnectMax) return false;
+    m_reconnecting = true;
+    m_state = LWS_CLIENT_DISCONNECTED;
+  }
+  lwsl_notice("%s socket closed by far end, reconnecting\n", m_uuid.c_str());
+  m_wsi = nullptr;
+  m_callback(m_uuid.c_str(), m_bugname.c_str(), AudioPipe::RECONNECTING, NULL);
+  schedule_reconnect(m_vhd->context);
+  return true;
+}
+
+void AudioPipe::schedule_reconnect(struct lws_context *context) {
+  static thread_local std::minstd_rand rng(std::random_device{}());
+  unsigned int backoff = std::min(RECONNECT_BACKOFF_MAX_MS, RECONNECT_BACKOFF_MIN_MS << std::min(m_reconnectAttempts, 16u));
+
+  // half the backoff plus a random share of the other half, so pipes dropped together do not retry together
+  unsigned int delay = backoff / 2 + std::uniform_int_distribution<unsigned int>(0, backoff / 2)(rng);
+  m_reconnectAttempts++;
+  lwsl_notice("%s reconnect attempt %u of %u in %u ms\n", m_uuid.c_str(), m_reconnectAttempts, m_reconnectMax, delay);
+
+  m_reconnectTimer.ap = this;
+  lws_sul_schedule(context, 0, &m_reconnectTimer.sul, reconnect_timer, (int64_t) delay * LWS_US_PER_MS);
+}
+
+void AudioPipe::reconnect_timer(lws_sorted_usec_list_t *sul) {
+  AudioPipe* ap = reinterpret_cast<ReconnectTimer *>(sul)->ap;
+  bool closed;
+  {
+    std::lock_guard<std::mutex> lk(ap->m_reconnect_mutex);
+    closed = ap->m_closeRequested;
+  }
+  if (closed) {
+    lwsl_notice("%s closed while waiting to reconnect\n", ap->m_uuid.c_str());
+    delete ap;
+    return;
+  }
+
+  // start over as a new connection, resolving the host again in case it has moved
+  ap->m_vhd = nullptr;
+  ap->m_attempt[0] = ap->m_attempt[1] = nullptr;
+  ap->m_resolved = ap->m_fallbackStarted = false;
+  ap->m_state = LWS_CLIENT_IDLE;
+  addPendingConnect(ap);
+}
+
+/* on the service thread, once a reconnect attempt has been established */
+void AudioPipe::reconnected(void) {
+  bool closed;
+  {
+    std::lock_guard<std::mutex> lk(m_reconnect_mutex);
+    closed = m_closeRequested;
+    if (closed) m_state = LWS_CLIENT_DISCONNECTING;
+  }
+  if (closed) {
+    // the session ended while we were reconnecting: close, and the pipe is deleted when that completes
+    lws_callback_on_writable(m_wsi);
+    return;
+  }
+
+  lwsl_notice("%s reconnected after %u attempts\n", m_uuid.c_str(), m_reconnectAttempts);
+  m_reconnectAttempts = 0;
+  {
+    std::lock_guard<std::mutex> lk(m_text_mutex);
+    m_metadata = m_initialMetadata;
+  }
+  {
+    std::lock_guard<std::mutex> lk(m_audio_mutex);
+    size_t size = m_replay.size();
+    size_t at = m_replayStart;
+
+    // the audio buffered while the connection was down is in the replay ring too, so send the ring instead
+    m_replayPending.clear();
+    for (auto it = m_replayChunks.begin(); it != m_replayChunks.end(); ++it) {
+      size_t first = std::min(it->second, size - at);
+      std::string chunk((const char *) &m_replay[at], first);
+      chunk.append((const char *) &m_replay[0], it->second - first);
+      m_replayPending.push_back(chunk);
+      at = (at + it->second) % size;
+    }
+    if (size) {
+      m_audio_buffer_write_offset = LWS_PRE;
+      m_audio_buffer_frames = 0;
+    }
+    m_reconnecting = false;
+  }
+  m_callback(m_uuid.c_str(), m_bugname.c_str(), AudioPipe::RECONNECTED, NULL);
+  lws_callback_on_writable(m_wsi);
+}
+
+/* on the service thread, when a reconnect attempt could not connect */
+void AudioPipe::reconnect_failed(const char* reason) {
+  bool closed;
+  {
+    std::lock_guard<std::mutex> lk(m_reconnect_mutex);
+    closed = m_closeRequested;
+  }
+  if (!closed && m_reconnectAttempts < m_reconnectMax) {
+    lwsl_notice("%s reconnect attempt %u failed: %s\n", m_uuid.c_str(), m_reconnectAttempts, reason);
+    m_state = LWS_CLIENT_DISCONNECTED;
+    schedule_reconnect(m_vhd->context);
+    return;
+  }
+
+  lwsl_notice("%s giving up reconnecting after %u attempts\n", m_uuid.c_str(), m_reconnectAttempts);
+  m_state = LWS_CLIENT_DISCONNECTED;
+  if (!closed) m_callback(m_uuid.c_str(), m_bugname.c_str(), AudioPipe::CONNECTION_DROPPED, NULL);
+  delete this;
 }
@@ -2,11 +2,14 @@
 #define __AUDIO_PIPE_HPP__
 
 #include <string>
+#include <vector>
 #include <list>
+#include <deque>
 #include <mutex>
 #include <queue>
 #include <unordered_map>
 #include <thread>
+#include <atomic>
 
 #include <libwebsockets.h>
 
@@ -25,7 +28,22 @@ public:
     CONNECT_FAIL,
     CONNECTION_DROPPED,
     CONNECTION_CLOSED_GRACEFULLY,
-    MESSAGE
+    MESSAGE,
+    RECONNECTING,
+    RECONNECTED
+  };
+  // audio buffer usage: dropped audio, peak occupancy and time spent above the high-water mark
+  struct BufferStats_t {
+    uint64_t overruns;            // times audio was dropped because the buffer was full
+    uint64_t framesDropped;
+    uint64_t bytesDropped;
+    uint64_t maxOccupancyPct;
+    uint64_t msOverHighWater;
+    size_t bufferSize;            // per stream only
+    size_t buffered;              // per stream only
+    size_t maxBuffered;           // per stream only
+    uint64_t streams;             // totals only
+    uint64_t activeStreams;       // totals only
   };
   typedef void (*log_emit_function)(int level, const char *line);
   typedef void (*notifyHandler_t)(const char *sessionId, const char* bugname, NotifyEvent_t event, const char* message);
@@ -39,6 +57,8 @@ public:
   static void initialize(const char* protocolName, unsigned int nThreads, int loglevel, log_emit_function logger);
   static bool deinitialize();
   static bool lws_service_thread(unsigned int nServiceThread);
+  static void getTotalBufferStats(BufferStats_t& stats);
+  static int getHighWaterPct(void);
 
   // constructor
   AudioPipe(const char* uuid, const char* host, unsigned int port, const char* path, int sslFlags, 
@@ -47,6 +67,16 @@ public:
 
   LwsState_t getLwsState(void) { return m_state; }
   void connect(void);
+  /**
+   * Opt-in: when the far end drops the connection, reconnect up to maxAttempts times with exponential
+   * backoff and jitter instead of giving up.  On reconnecting the initial metadata is sent again,
+   * followed by the last replaySecs of audio (kept in a ring of replayBytes).  Call before connect().
+   */
+  void setReconnect(unsigned int maxAttempts, unsigned int replaySecs, size_t replayBytes, const char* initialMetadata);
+  // whether to write audio: when connected, and while reconnecting so that it can be replayed
+  bool acceptsAudio(void) {
+    return m_state == LWS_CLIENT_CONNECTED || m_reconnecting;
+  }
   void bufferForSending(const char* text);
   size_t binarySpaceAvailable(void) {
     return m_audio_buffer_max_len - m_audio_buffer_write_offset;
@@ -59,12 +89,19 @@ public:
   }
   void binaryWritePtrAdd(size_t len) {
     m_audio_buffer_write_offset += len;
+    m_audio_buffer_frames++;
   }
-  void binaryWritePtrResetToZero(void) {
-    m_audio_buffer_write_offset = 0;
+  // discards everything buffered to make room, counting it as dropped
+  void binaryWritePtrResetToZero(void);
+  // a frame, or the part of one, that could not be written for lack of room
+  void binaryFrameDropped(size_t len);
+  size_t binaryFramesBuffered(void) {
+    return m_audio_buffer_frames;
   }
+  void getBufferStats(BufferStats_t& stats);
   void lockAudioBuffer(void) {
     m_audio_mutex.lock();
+    m_replay_mark = m_audio_buffer_write_offset;
   }
   void unlockAudioBuffer(void) ;
   bool hasBasicAuth(void) {
@@ -103,6 +140,14 @@ private:
   static std::list<AudioPipe*> pendingWrites;
   static log_emit_function logger;
 
+  static std::atomic<uint64_t> totalStreams;
+  static std::atomic<uint64_t> totalActiveStreams;
+  static std::atomic<uint64_t> totalOverruns;
+  static std::atomic<uint64_t> totalFramesDropped;
+  static std::atomic<uint64_t> totalBytesDropped;
+  static std::atomic<uint64_t> totalMaxOccupancyPct;
+  static std::atomic<uint64_t> totalUsecsOverHighWater;
+
   static std::mutex mapMutex;
   static std::unordered_map<std::thread::id, bool> stopFlags;
   static std::queue<std::thread::id> threadIds;
@@ -110,13 +155,23 @@ private:
   static AudioPipe* findAndRemovePendingConnect(struct lws *wsi);
   static AudioPipe* findPendingConnect(struct lws *wsi);
   static void addPendingConnect(AudioPipe* ap);
+  static void setResolved(AudioPipe* ap, const std::vector<std::string>& v6, const std::vector<std::string>& v4);
   static void addPendingDisconnect(AudioPipe* ap);
   static void addPendingWrite(AudioPipe* ap);
   static void processPendingConnects(lws_per_vhost_data *vhd);
   static void processPendingDisconnects(lws_per_vhost_data *vhd);
   static void processPendingWrites(void);
+  static void reconnect_timer(lws_sorted_usec_list_t *sul);
   
   bool connect_client(struct lws_per_vhost_data *vhd);
+  void connect_attempt(int n);
+  bool connect_fallback(struct lws *wsi);
+  void updateOccupancy(void);
+  bool reconnect_after_drop(void);
+  void schedule_reconnect(struct lws_context *context);
+  void reconnected(void);
+  void reconnect_failed(const char* reason);
+  void keepForReplay(void);
 
   LwsState_t m_state;
   std::string m_uuid;
@@ -129,10 +184,43 @@ private:
   std::mutex m_audio_mutex;
   int m_sslFlags;
   struct lws *m_wsi;
+  // resolved addresses for the preferred and the other address family, and the connection attempt to each;
+  // the first to connect becomes m_wsi
+  std::string m_address[2];
+  struct lws *m_attempt[2];
+  bool m_resolved;
+  bool m_fallbackStarted;
   uint8_t *m_audio_buffer;
   size_t m_audio_buffer_max_len;
   size_t m_audio_buffer_write_offset;
   size_t m_audio_buffer_min_freespace;
+  size_t m_audio_buffer_frames;
+  size_t m_audio_buffer_high_water;
+  std::atomic<uint64_t> m_overruns;
+  std::atomic<uint64_t> m_framesDropped;
+  std::atomic<uint64_t> m_bytesDropped;
+  std::atomic<uint64_t> m_maxBuffered;
+  std::atomic<uint64_t> m_usecsOverHighWater;
+  std::atomic<int64_t> m_overHighWaterSince;   // steady clock usecs, 0 when below the mark
+  // reconnecting after a drop, see setReconnect
+  struct ReconnectTimer {
+    lws_sorted_usec_list_t sul;   // first, so the timer callback can get back to the pipe
+    AudioPipe* ap;
+  } m_reconnectTimer;
+  std::mutex m_reconnect_mutex;
+  std::atomic<bool> m_reconnecting;
+  bool m_closeRequested;
+  unsigned int m_reconnectMax;
+  unsigned int m_reconnectAttempts;
+  std::string m_initialMetadata;
+  // the last m_replayUsecs of audio written, as whole writes in a ring of m_replay.size() bytes
+  std::vector<uint8_t> m_replay;
+  size_t m_replayStart;
+  size_t m_replayLen;
+  std::deque<std::pair<int64_t, size_t> > m_replayChunks;   // (time written, bytes), oldest first
+  int64_t m_replayUsecs;
+  size_t m_replay_mark;                                      // write offset when the buffer was locked
+  std::deque<std::string> m_replayPending;                   // replayed audio still to send after reconnecting
   uint8_t* m_recv_buf;
   uint8_t* m_recv_buf_ptr;
   size_t m_recv_buf_len;
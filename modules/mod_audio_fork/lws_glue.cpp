@@ -16,7 +16,11 @@
 #include "base64.hpp"
 #include "parser.hpp"
 #include "mod_audio_fork.h"
+#include "resampler_pool.hpp"
+#include "resample_write.h"
 #include "audio_pipe.hpp"
+#include "audio_encoder.hpp"
+#include "stream_metrics.hpp"
 
 #define RTP_PACKETIZATION_PERIOD 20
 #define FRAME_SIZE_8000  320 /*which means each 20ms frame as 320 bytes at 8 khz (1 channel only)*/
@@ -167,6 +171,7 @@ namespace {
           switch (event) {
             case AudioPipe::CONNECT_SUCCESS:
               switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_INFO, "connection successful\n");
+              stream_metrics::mark_connected(*tech_pvt);
               tech_pvt->responseHandler(session, EVENT_CONNECT_SUCCESS, NULL);
               if (strlen(tech_pvt->initialMetadata) > 0) {
                 switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "sending initial metadata %s\n", tech_pvt->initialMetadata);
@@ -174,12 +179,22 @@ namespace {
                 pAudioPipe->bufferForSending(tech_pvt->initialMetadata);
               }
             break;
+            case AudioPipe::RECONNECTING:
+              switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_NOTICE, "connection dropped from far end, reconnecting\n");
+              tech_pvt->responseHandler(session, EVENT_RECONNECTING, NULL);
+            break;
+            case AudioPipe::RECONNECTED:
+              switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_INFO, "reconnected\n");
+              stream_metrics::instance().reconnect();
+              tech_pvt->responseHandler(session, EVENT_RECONNECTED, NULL);
+            break;
             case AudioPipe::CONNECT_FAIL:
             {
               // first thing: we can no longer access the AudioPipe
               std::stringstream json;
               json << "{\"reason\":\"" << message << "\"}";
               tech_pvt->pAudioPipe = nullptr;
+              stream_metrics::instance().error("connect_failed");
               tech_pvt->responseHandler(session, EVENT_CONNECT_FAIL, (char *) json.str().c_str());
               switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_NOTICE, "connection failed: %s\n", message);
             }
@@ -187,6 +202,7 @@ namespace {
             case AudioPipe::CONNECTION_DROPPED:
               // first thing: we can no longer access the AudioPipe
               tech_pvt->pAudioPipe = nullptr;
+              stream_metrics::instance().error("dropped");
               tech_pvt->responseHandler(session, EVENT_DISCONNECT, NULL);
               switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_NOTICE, "connection dropped from far end\n");
             break;
@@ -196,6 +212,7 @@ namespace {
               switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "connection closed gracefully\n");
             break;
             case AudioPipe::MESSAGE:
+              stream_metrics::mark_result(*tech_pvt, false);
               processIncomingMessage(tech_pvt, session, message);
             break;
           }
@@ -204,9 +221,46 @@ namespace {
       switch_core_session_rwunlock(session);
     }
   }
+  /* add the codec to the initial metadata (or send it as the initial metadata, if there was none) */
+  void advertise_encoding(private_t *tech_pvt, switch_core_session_t *session, AudioEncoder* encoder, const char* metadata) {
+    cJSON* json = metadata ? cJSON_Parse(metadata) : cJSON_CreateObject();
+    if (!json || json->type != cJSON_Object) {
+      switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_WARNING, 
+        "(%u) metadata is not a JSON object, audio encoding %s will not be advertised\n", tech_pvt->id, encoder->getName());
+      if (json) cJSON_Delete(json);
+      return;
+    }
+    cJSON* jFormat = cJSON_CreateObject();
+    cJSON_AddStringToObject(jFormat, "encoding", encoder->getName());
+    cJSON_AddNumberToObject(jFormat, "sampleRate", encoder->getSampleRate());
+    cJSON_AddNumberToObject(jFormat, "channels", encoder->getChannels());
+    if (encoder->getCodec() == AudioEncoder::CODEC_OPUS) cJSON_AddNumberToObject(jFormat, "bitrate", encoder->getParam());
+    cJSON_AddItemToObject(json, "audioFormat", jFormat);
+
+    char* str = cJSON_PrintUnformatted(json);
+    strncpy(tech_pvt->initialMetadata, str, MAX_METADATA_LEN - 1);
+    free(str);
+    cJSON_Delete(json);
+  }
+
+  void log_encoder_stats(private_t* tech_pvt) {
+    AudioEncoder* encoder = static_cast<AudioEncoder *>(tech_pvt->pEncoder);
+    uint64_t samples = encoder->getSamplesIn();
+    if (0 == samples) return;
+
+    double secs = (double) samples / encoder->getSampleRate();
+    double kbps = encoder->getBytesOut() * 8 / secs / 1000;
+    double l16kbps = encoder->getSampleRate() * encoder->getChannels() * 16 / 1000.0;
+    double usecsPerFrame = encoder->getEncodeUsecs() / (secs * 50);
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, 
+      "%s (%u) %s: %.1f secs of audio sent at %.1f kbps vs %.1f kbps as L16 (%.0f%%), encoding took %.1f usecs per 20 ms (%.2f%% of a core)\n",
+      tech_pvt->sessionId, tech_pvt->id, encoder->getName(), secs, kbps, l16kbps, 100 * kbps / l16kbps, 
+      usecsPerFrame, usecsPerFrame / 200);
+  }
+
   switch_status_t fork_data_init(private_t *tech_pvt, switch_core_session_t *session, char * host, 
     unsigned int port, char* path, int sslFlags, int sampling, int desiredSampling, int channels, 
-    char *bugname, char* metadata, responseHandler_t responseHandler) {
+    char *bugname, char* metadata, const char* encoding, responseHandler_t responseHandler) {
 
     const char* username = nullptr;
     const char* password = nullptr;
@@ -221,6 +275,7 @@ namespace {
     }
 
     memset(tech_pvt, 0, sizeof(private_t));
+    stream_metrics::mark_init(*tech_pvt);
   
     strncpy(tech_pvt->sessionId, switch_core_session_get_uuid(session), MAX_SESSION_ID);
     strncpy(tech_pvt->host, host, MAX_WS_URL_LEN);
@@ -236,6 +291,29 @@ namespace {
     tech_pvt->graceful_shutdown = 0;
     strncpy(tech_pvt->bugname, bugname, MAX_BUG_LEN);
     if (metadata) strncpy(tech_pvt->initialMetadata, metadata, MAX_METADATA_LEN);
+
+    if (encoding) {
+      AudioEncoder::Codec_t codec;
+      int param;
+      std::string err;
+
+      if (!AudioEncoder::parse(encoding, codec, param)) {
+        switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "invalid audio encoding: %s\n", encoding);
+        return SWITCH_STATUS_FALSE;
+      }
+      if (codec != AudioEncoder::CODEC_L16) {
+        AudioEncoder* encoder = new AudioEncoder(codec, desiredSampling, channels, param);
+        if (!encoder->init(err)) {
+          switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "Error initializing audio encoder: %s\n", err.c_str());
+          delete encoder;
+          return SWITCH_STATUS_FALSE;
+        }
+        tech_pvt->pEncoder = static_cast<void *>(encoder);
+        advertise_encoding(tech_pvt, session, encoder, metadata);
+        switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_INFO, "(%u) encoding audio as %s (%d), L16 would be %d kbps\n",
+          tech_pvt->id, encoder->getName(), param, desiredSampling * channels * 16 / 1000);
+      }
+    }
     
     size_t buflen = LWS_PRE + (FRAME_SIZE_8000 * desiredSampling / 8000 * channels * 1000 / RTP_PACKETIZATION_PERIOD * nAudioBufferSecs);
 
@@ -248,11 +326,27 @@ namespace {
 
     tech_pvt->pAudioPipe = static_cast<void *>(ap);
 
+    const char* reconnectAttempts = switch_channel_get_variable(channel, "MOD_AUDIO_FORK_RECONNECT_ATTEMPTS");
+    if (reconnectAttempts && ::atoi(reconnectAttempts) > 0) {
+      const char* replaySecs = switch_channel_get_variable(channel, "MOD_AUDIO_FORK_RECONNECT_REPLAY_SECS");
+      unsigned int secs = std::max(0, std::min(replaySecs ? ::atoi(replaySecs) : 5, 30));
+      AudioEncoder* encoder = static_cast<AudioEncoder *>(tech_pvt->pEncoder);
+      if (encoder && encoder->getCodec() == AudioEncoder::CODEC_FLAC) {
+        // a flac stream cannot be picked up midway by a new connection
+        switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_WARNING, "(%u) reconnect is not supported with flac encoding\n", tech_pvt->id);
+      }
+      else {
+        ap->setReconnect(::atoi(reconnectAttempts), secs, desiredSampling * channels * sizeof(int16_t) * secs, tech_pvt->initialMetadata);
+        switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "(%u) reconnecting up to %s times, replaying %u secs\n", 
+          tech_pvt->id, reconnectAttempts, secs);
+      }
+    }
+
     switch_mutex_init(&tech_pvt->mutex, SWITCH_MUTEX_NESTED, switch_core_session_get_pool(session));
 
     if (desiredSampling != sampling) {
       switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "(%u) resampling from %u to %u\n", tech_pvt->id, sampling, desiredSampling);
-      tech_pvt->resampler = speex_resampler_init(channels, sampling, desiredSampling, SWITCH_RESAMPLE_QUALITY, &err);
+      tech_pvt->resampler = resampler_pool::acquire(channels, sampling, desiredSampling, SWITCH_RESAMPLE_QUALITY, &err);
       if (0 != err) {
         switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "Error initializing resampler: %s.\n", speex_resampler_strerror(err));
         return SWITCH_STATUS_FALSE;
@@ -270,9 +364,14 @@ namespace {
   void destroy_tech_pvt(private_t* tech_pvt) {
     switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "%s (%u) destroy_tech_pvt\n", tech_pvt->sessionId, tech_pvt->id);
     if (tech_pvt->resampler) {
-      speex_resampler_destroy(tech_pvt->resampler);
+      resampler_pool::release(tech_pvt->resampler);
       tech_pvt->resampler = nullptr;
     }
+    if (tech_pvt->pEncoder) {
+      log_encoder_stats(tech_pvt);
+      delete static_cast<AudioEncoder *>(tech_pvt->pEncoder);
+      tech_pvt->pEncoder = nullptr;
+    }
     if (tech_pvt->mutex) {
       switch_mutex_destroy(tech_pvt->mutex);
       tech_pvt->mutex = nullptr;
@@ -373,6 +472,8 @@ extern "C" {
     switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_audio_fork: sub-protocol:              %s\n", mySubProtocolName);
     switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_audio_fork: lws service threads:       %d\n", nServiceThreads);
  
+    stream_metrics::instance().init("audio_fork");
+
     int logs = LLL_ERR | LLL_WARN | LLL_NOTICE ;
      //LLL_INFO | LLL_PARSER | LLL_HEADER | LLL_EXT | LLL_CLIENT  | LLL_LATENCY | LLL_DEBUG ;
     AudioPipe::initialize(mySubProtocolName, nServiceThreads, logs, lws_logger);
@@ -382,6 +483,7 @@ extern "C" {
   switch_status_t fork_cleanup() {
     bool cleanup = false;
     cleanup = AudioPipe::deinitialize();
+    stream_metrics::instance().shutdown();
     if (cleanup == true) {
         return SWITCH_STATUS_SUCCESS;
     }
@@ -399,6 +501,7 @@ extern "C" {
               int channels,
               char *bugname,
               char* metadata, 
+              const char* encoding,
               void **ppUserData)
   {    	
     int err;
@@ -410,7 +513,7 @@ extern "C" {
       return SWITCH_STATUS_FALSE;
     }
     if (SWITCH_STATUS_SUCCESS != fork_data_init(tech_pvt, session, host, port, path, sslFlags, samples_per_second, sampling, channels, 
-      bugname, metadata, responseHandler)) {
+      bugname, metadata, encoding, responseHandler)) {
       destroy_tech_pvt(tech_pvt);
       return SWITCH_STATUS_FALSE;
     }
@@ -422,6 +525,8 @@ extern "C" {
    switch_status_t fork_session_connect(void **ppUserData) {
     private_t *tech_pvt = static_cast<private_t *>(*ppUserData);
     AudioPipe *pAudioPipe = static_cast<AudioPipe*>(tech_pvt->pAudioPipe);
+    stream_metrics::instance().streamStarted();
+    stream_metrics::mark_connect_start(*tech_pvt);
     pAudioPipe->connect();
     return SWITCH_STATUS_SUCCESS;
   }
@@ -468,6 +573,7 @@ extern "C" {
     if (pAudioPipe) pAudioPipe->close();
 
     destroy_tech_pvt(tech_pvt);
+    stream_metrics::instance().streamEnded();
     switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_INFO, "(%u) fork_session_cleanup: connection closed\n", id);
     return SWITCH_STATUS_SUCCESS;
   }
@@ -523,9 +629,90 @@ extern "C" {
     return SWITCH_STATUS_SUCCESS;
   }
 
+  switch_status_t fork_session_stats(switch_core_session_t *session, char *bugname, switch_stream_handle_t *stream) {
+    switch_channel_t *channel = switch_core_session_get_channel(session);
+    switch_media_bug_t *bug = (switch_media_bug_t*) switch_channel_get_private(channel, bugname);
+    AudioPipe::BufferStats_t stats;
+    bool found = false;
+    if (!bug) {
+      switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "fork_session_stats failed because no bug\n");
+      return SWITCH_STATUS_FALSE;
+    }
+    private_t* tech_pvt = (private_t*) switch_core_media_bug_get_user_data(bug);
+
+    if (!tech_pvt) return SWITCH_STATUS_FALSE;
+
+    switch_mutex_lock(tech_pvt->mutex);
+    AudioPipe *pAudioPipe = static_cast<AudioPipe *>(tech_pvt->pAudioPipe);
+    if (pAudioPipe) {
+      pAudioPipe->getBufferStats(stats);
+      found = true;
+    }
+    switch_mutex_unlock(tech_pvt->mutex);
+    if (!found) return SWITCH_STATUS_FALSE;
+
+    cJSON* json = cJSON_CreateObject();
+    cJSON_AddStringToObject(json, "bugname", bugname);
+    cJSON_AddNumberToObject(json, "bufferSize", stats.bufferSize);
+    cJSON_AddNumberToObject(json, "bufferedBytes", stats.buffered);
+    cJSON_AddNumberToObject(json, "maxBufferedBytes", stats.maxBuffered);
+    cJSON_AddNumberToObject(json, "maxOccupancyPct", stats.maxOccupancyPct);
+    cJSON_AddNumberToObject(json, "highWaterPct", AudioPipe::getHighWaterPct());
+    cJSON_AddNumberToObject(json, "msOverHighWater", stats.msOverHighWater);
+    cJSON_AddNumberToObject(json, "overruns", stats.overruns);
+    cJSON_AddNumberToObject(json, "framesDropped", stats.framesDropped);
+    cJSON_AddNumberToObject(json, "bytesDropped", stats.bytesDropped);
+    char* jsonString = cJSON_PrintUnformatted(json);
+    stream->write_function(stream, "%s\n", jsonString);
+    free(jsonString);
+    cJSON_Delete(json);
+
+    return SWITCH_STATUS_SUCCESS;
+  }
+
+  switch_status_t fork_metrics(switch_stream_handle_t *stream) {
+    std::string text;
+
+    stream_metrics::instance().render(text);
+    stream->write_function(stream, "%s", text.c_str());
+    return SWITCH_STATUS_SUCCESS;
+  }
+
+  switch_status_t fork_latency(switch_stream_handle_t *stream) {
+    std::string text;
+
+    stream_metrics::instance().latency(text);
+    stream->write_function(stream, "%s", text.c_str());
+    return SWITCH_STATUS_SUCCESS;
+  }
+
+  switch_status_t fork_stats(switch_stream_handle_t *stream) {
+    AudioPipe::BufferStats_t stats;
+
+    AudioPipe::getTotalBufferStats(stats);
+
+    cJSON* json = cJSON_CreateObject();
+    cJSON_AddNumberToObject(json, "streams", stats.streams);
+    cJSON_AddNumberToObject(json, "activeStreams", stats.activeStreams);
+    cJSON_AddNumberToObject(json, "maxOccupancyPct", stats.maxOccupancyPct);
+    cJSON_AddNumberToObject(json, "highWaterPct", AudioPipe::getHighWaterPct());
+    cJSON_AddNumberToObject(json, "msOverHighWater", stats.msOverHighWater);
+    cJSON_AddNumberToObject(json, "overruns", stats.overruns);
+    cJSON_AddNumberToObject(json, "framesDropped", stats.framesDropped);
+    cJSON_AddNumberToObject(json, "bytesDropped", stats.bytesDropped);
+    char* jsonString = cJSON_PrintUnformatted(json);
+    stream->write_function(stream, "%s\n", jsonString);
+    free(jsonString);
+    cJSON_Delete(json);
+
+    return SWITCH_STATUS_SUCCESS;
+  }
+
   switch_bool_t fork_frame(switch_core_session_t *session, switch_media_bug_t *bug) {
+    stream_metrics::FrameTimer timer;
     private_t* tech_pvt = (private_t*) switch_core_media_bug_get_user_data(bug);
     size_t inuse = 0;
+    size_t bytes = 0;
     bool dirty = false;
     char *p = (char *) "{\"msg\": \"buffer overrun\"}";
 
@@ -537,14 +724,14 @@ extern "C" {
         return SWITCH_TRUE;
       }
       AudioPipe *pAudioPipe = static_cast<AudioPipe *>(tech_pvt->pAudioPipe);
-      if (pAudioPipe->getLwsState() != AudioPipe::LWS_CLIENT_CONNECTED) {
+      if (!pAudioPipe->acceptsAudio()) {
         switch_mutex_unlock(tech_pvt->mutex);
         return SWITCH_TRUE;
       }
 
       pAudioPipe->lockAudioBuffer();
       size_t available = pAudioPipe->binarySpaceAvailable();
-      if (NULL == tech_pvt->resampler) {
+      if (NULL == tech_pvt->resampler && NULL == tech_pvt->pEncoder) {
         switch_frame_t frame = { 0 };
         frame.data = pAudioPipe->binaryWritePtr();
         frame.buflen = available;
@@ -558,6 +745,7 @@ extern "C" {
             }
             switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "(%u) dropping packets!\n", 
               tech_pvt->id);
+            stream_metrics::instance().framesDropped(pAudioPipe->binaryFramesBuffered());
             pAudioPipe->binaryWritePtrResetToZero();
 
             frame.data = pAudioPipe->binaryWritePtr();
@@ -568,6 +756,7 @@ extern "C" {
           if (rv != SWITCH_STATUS_SUCCESS) break;
           if (frame.datalen) {
             pAudioPipe->binaryWritePtrAdd(frame.datalen);
+            bytes += frame.datalen;
             frame.buflen = available = pAudioPipe->binarySpaceAvailable();
             frame.data = pAudioPipe->binaryWritePtr();
             dirty = true;
@@ -581,23 +770,56 @@ extern "C" {
         frame.buflen = SWITCH_RECOMMENDED_BUFFER_SIZE;
         while (switch_core_media_bug_read(bug, &frame, SWITCH_TRUE) == SWITCH_STATUS_SUCCESS) {
           if (frame.datalen) {
-            spx_uint32_t out_len = available >> 1;  // space for samples which are 2 bytes
-            spx_uint32_t in_len = frame.samples;
-
-            speex_resampler_process_interleaved_int(tech_pvt->resampler, 
-              (const spx_int16_t *) frame.data, 
-              (spx_uint32_t *) &in_len, 
-              (spx_int16_t *) ((char *) pAudioPipe->binaryWritePtr()),
-              &out_len);
-
-            if (out_len > 0) {
-              // bytes written = num samples * 2 * num channels
-              size_t bytes_written = out_len << tech_pvt->channels;
-              pAudioPipe->binaryWritePtrAdd(bytes_written);
-              available = pAudioPipe->binarySpaceAvailable();
-              dirty = true;
+            bool overrun = false;
+
+            if (NULL == tech_pvt->pEncoder) {
+              // resample straight into the ring buffer
+              size_t dropped = 0;
+              size_t written = resample_write(tech_pvt->resampler, tech_pvt->channels, frame.data, frame.datalen,
+                pAudioPipe->binaryWritePtr(), available, &dropped);
+
+              if (written > 0) {
+                pAudioPipe->binaryWritePtrAdd(written);
+                bytes += written;
+                available = pAudioPipe->binarySpaceAvailable();
+                dirty = true;
+              }
+              if (dropped > 0) {
+                pAudioPipe->binaryFrameDropped(dropped);
+                stream_metrics::instance().framesDropped(1);
+                overrun = true;
+              }
             }
-            if (available < pAudioPipe->binaryMinSpace()) {
+            else {
+              // resample (if needed) into scratch, then encode into the ring buffer
+              AudioEncoder* encoder = static_cast<AudioEncoder *>(tech_pvt->pEncoder);
+              const size_t bytesPerSample = sizeof(spx_int16_t) * tech_pvt->channels;
+              spx_uint32_t in_len = frame.datalen / bytesPerSample;
+              spx_int16_t resampled[SWITCH_RECOMMENDED_BUFFER_SIZE];
+              const spx_int16_t* pcm = (const spx_int16_t *) frame.data;
+
+              if (tech_pvt->resampler) {
+                size_t dropped = 0;
+                in_len = resample_write(tech_pvt->resampler, tech_pvt->channels, frame.data, frame.datalen,
+                  resampled, sizeof(resampled), &dropped) / bytesPerSample;
+                pcm = resampled;
+              }
+
+              int encoded = encoder->encode(pcm, in_len, (uint8_t *) pAudioPipe->binaryWritePtr(), available);
+              if (encoded > 0) {
+                pAudioPipe->binaryWritePtrAdd(encoded);
+                bytes += encoded;
+                available = pAudioPipe->binarySpaceAvailable();
+                dirty = true;
+              }
+              if (encoded < 0) {
+                pAudioPipe->binaryFrameDropped(in_len * bytesPerSample);
+                stream_metrics::instance().framesDropped(1);
+                overrun = true;
+              }
+            }
+            // out of space: either some of this frame could not be written, or the next one may not fit
+            if (overrun || available < pAudioPipe->binaryMinSpace()) {
               if (!tech_pvt->buffer_overrun_notified) {
                 tech_pvt->buffer_overrun_notified = 1;
                 switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "(%u) dropping packets!\n", 
@@ -612,6 +834,10 @@ extern "C" {
 
       pAudioPipe->unlockAudioBuffer();
       switch_mutex_unlock(tech_pvt->mutex);
+      if (bytes) {
+        stream_metrics::mark_audio_sent(*tech_pvt);
+        stream_metrics::instance().bytesSent(bytes);
+      }
     }
     return SWITCH_TRUE;
   }
@@ -9,11 +9,15 @@ switch_status_t fork_init();
 switch_status_t fork_cleanup();
 switch_status_t fork_session_init(switch_core_session_t *session, responseHandler_t responseHandler,
 		uint32_t samples_per_second, char *host, unsigned int port, char* path, int sampling, int sslFlags, int channels, 
-    char *bugname, char* metadata, void **ppUserData);
+    char *bugname, char* metadata, const char* encoding, void **ppUserData);
 switch_status_t fork_session_cleanup(switch_core_session_t *session, char *bugname, char* text, int channelIsClosing);
 switch_status_t fork_session_pauseresume(switch_core_session_t *session, char *bugname, int pause);
 switch_status_t fork_session_graceful_shutdown(switch_core_session_t *session, char *bugname);
 switch_status_t fork_session_send_text(switch_core_session_t *session, char *bugname, char* text);
+switch_status_t fork_session_stats(switch_core_session_t *session, char *bugname, switch_stream_handle_t *stream);
+switch_status_t fork_stats(switch_stream_handle_t *stream);
+switch_status_t fork_metrics(switch_stream_handle_t *stream);
+switch_status_t fork_latency(switch_stream_handle_t *stream);
 switch_bool_t fork_frame(switch_core_session_t *session, switch_media_bug_t *bug);
 switch_status_t fork_service_threads();
 switch_status_t fork_session_connect(void **ppUserData);
@@ -60,7 +60,8 @@ static switch_status_t start_capture(switch_core_session_t *session,
         int sampling,
         int sslFlags,
 	      char* bugname, 
-        char* metadata)
+        char* metadata,
+        const char* encoding)
 {
 	switch_channel_t *channel = switch_core_session_get_channel(session);
 	switch_media_bug_t *bug;
@@ -88,7 +89,7 @@ static switch_status_t start_capture(switch_core_session_t *session,
 
 	switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "calling fork_session_init.\n");
 	if (SWITCH_STATUS_FALSE == fork_session_init(session, responseHandler, read_codec->implementation->actual_samples_per_second, 
-		host, port, path, sampling, sslFlags, channels, bugname, metadata, &pUserData)) {
+		host, port, path, sampling, sslFlags, channels, bugname, metadata, encoding, &pUserData)) {
 		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "Error initializing mod_audio_fork session.\n");
 		return SWITCH_STATUS_FALSE;
 	}
@@ -159,16 +160,28 @@ static switch_status_t send_text(switch_core_session_t *session, char* bugname,
   return status;
 }
 
-#define FORK_API_SYNTAX "<uuid> [start | stop | send_text | pause | resume | graceful-shutdown ] [wss-url | path] [mono | mixed | stereo] [8000 | 16000 | 24000 | 32000 | 64000] [bugname] [metadata]"
+#define FORK_API_SYNTAX "<uuid> [start | stop | send_text | pause | resume | graceful-shutdown | stats ] [wss-url | path] [mono | mixed | stereo] [8000 | 16000 | 24000 | 32000 | 64000] [encoding=l16|opus[:bitrate]|flac[:level]] [bugname] [metadata]"
 SWITCH_STANDARD_API(fork_function)
 {
-	char *mycmd = NULL, *argv[7] = { 0 };
+	char *mycmd = NULL, *argv[8] = { 0 };
 	int argc = 0;
 	switch_status_t status = SWITCH_STATUS_FALSE;
   char *bugname = MY_BUG_NAME;
+  const char *encoding = NULL;
 
 	if (!zstr(cmd) && (mycmd = strdup(cmd))) {
-		argc = switch_separate_string(mycmd, ' ', argv, (sizeof(argv) / sizeof(argv[0])));
+		argc = switch_separate_string(mycmd, ' ', argv, (sizeof(argv) / sizeof(argv[0])) - 1);
+
+		/* start accepts an optional encoding=<codec> after the sampling rate, ahead of bugname and metadata */
+		if (argc > 5 && !strcasecmp(argv[1], "start") && !strncasecmp(argv[5], "encoding=", 9)) {
+			int i;
+			free(mycmd);
+			mycmd = strdup(cmd);
+			argc = switch_separate_string(mycmd, ' ', argv, (sizeof(argv) / sizeof(argv[0])));
+			encoding = argv[5] + 9;
+			for (i = 5; i < argc - 1; i++) argv[i] = argv[i + 1];
+			argv[--argc] = NULL;
+		}
 	}
 	assert(cmd);
 	switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "mod_audio_fork cmd: %s\n", cmd);
@@ -207,6 +220,13 @@ SWITCH_STANDARD_API(fork_function)
 			else if (!strcasecmp(argv[1], "graceful-shutdown")) {
         if (argc > 2) bugname = argv[2];
 				status = do_graceful_shutdown(lsession, bugname);
+      }
+			else if (!strcasecmp(argv[1], "stats")) {
+        if (argc > 2) bugname = argv[2];
+				if (SWITCH_STATUS_SUCCESS == fork_session_stats(lsession, bugname, stream)) {
+					switch_core_session_rwunlock(lsession);
+					goto done;
+				}
       }
       else if (!strcasecmp(argv[1], "send_text")) {
         char * text = 0;
@@ -233,6 +253,7 @@ SWITCH_STANDARD_API(fork_function)
         int sampling = 8000;
       	switch_media_bug_flag_t flags = SMBF_READ_STREAM ;
         char *metadata = NULL;
+        if (!encoding) encoding = switch_channel_get_variable(channel, "MOD_AUDIO_FORK_ENCODING");
         if( argc > 6) {
           bugname = argv[5];
           metadata = argv[6];
@@ -268,7 +289,7 @@ SWITCH_STANDARD_API(fork_function)
 				else if (sampling % 8000 != 0) {
           switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "invalid sample rate: %s\n", argv[4]);					
 				}
-        status = start_capture(lsession, flags, host, port, path, sampling, sslFlags, bugname, metadata);
+        status = start_capture(lsession, flags, host, port, path, sampling, sslFlags, bugname, metadata, encoding);
 			}
       else {
         switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "unsupported mod_audio_fork cmd: %s\n", argv[1]);
@@ -292,6 +313,20 @@ SWITCH_STANDARD_API(fork_function)
 	return SWITCH_STATUS_SUCCESS;
 }
 
+#define FORK_STATS_API_SYNTAX ""
+SWITCH_STANDARD_API(fork_stats_function)
+{
+	fork_stats(stream);
+	return SWITCH_STATUS_SUCCESS;
+}
+
+#define FORK_METRICS_API_SYNTAX "[latency]"
+SWITCH_STANDARD_API(fork_metrics_function)
+{
+	if (!zstr(cmd) && 0 == strcasecmp(cmd, "latency")) fork_latency(stream);
+	else fork_metrics(stream);
+	return SWITCH_STATUS_SUCCESS;
+}
 
 SWITCH_MODULE_LOAD_FUNCTION(mod_audio_fork_load)
 {
@@ -318,6 +353,9 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_audio_fork_load)
 	switch_console_set_complete("add uuid_audio_fork start wss-url metadata");
 	switch_console_set_complete("add uuid_audio_fork start wss-url");
 	switch_console_set_complete("add uuid_audio_fork stop");
+	switch_console_set_complete("add uuid_audio_fork stats");
+	SWITCH_ADD_API(api_interface, "audio_fork_stats", "audio_fork buffer statistics", fork_stats_function, FORK_STATS_API_SYNTAX);
+	SWITCH_ADD_API(api_interface, "audio_fork_metrics", "audio_fork metrics in prometheus text format", fork_metrics_function, FORK_METRICS_API_SYNTAX);
 
 	fork_init();
 
@@ -21,6 +21,8 @@
 #define EVENT_ERROR           "mod_audio_fork::error"
 #define EVENT_CONNECT_SUCCESS "mod_audio_fork::connect"
 #define EVENT_CONNECT_FAIL    "mod_audio_fork::connect_failed"
+#define EVENT_RECONNECTING    "mod_audio_fork::reconnecting"
+#define EVENT_RECONNECTED     "mod_audio_fork::reconnected"
 #define EVENT_BUFFER_OVERRUN  "mod_audio_fork::buffer_overrun"
 #define EVENT_JSON            "mod_audio_fork::json"
 
@@ -40,6 +42,7 @@ struct private_data {
   SpeexResamplerState *resampler;
   responseHandler_t responseHandler;
   void *pAudioPipe;
+  void *pEncoder;
   int ws_state;
   char host[MAX_WS_URL_LEN];
   unsigned int port;
@@ -52,6 +55,13 @@ struct private_data {
   int audio_paused:1;
   int graceful_shutdown:1;
   char initialMetadata[8192];
+  /* stream latency marks, see stream_metrics.hpp */
+  int64_t mark_init;
+  int64_t mark_connect_start;
+  int64_t mark_connected;
+  int64_t mark_first_audio;
+  int64_t mark_first_interim;
+  int64_t mark_first_final;
 };
 
 typedef struct private_data private_t;
@@ -24,7 +24,9 @@
 #include <aws/lexv2-runtime/model/StartConversationRequest.h>
 
 #include "mod_aws_lex.h"
+#include "resampler_pool.hpp"
 #include "parser.h"
+#include "stream_metrics.hpp"
 
 using namespace Aws;
 using namespace Aws::Utils;
@@ -178,6 +180,7 @@ public:
 	m_bot(bot), m_alias(alias), m_region(region), m_sessionId(sessionId), m_finished(false), m_finishing(false), m_packets(0),
 	m_pStream(nullptr), m_bPlayDone(false), m_bDiscardAudio(false)
 	{
+		stream_metrics::mark_init(m_marks);
 		Aws::String key(awsAccessKeyId);
 		Aws::String secret(awsSecretAccessKey);
 		Aws::String awsLocale(locale);
@@ -228,6 +231,7 @@ public:
 				char* data = cJSON_PrintUnformatted(json);
 
 				responseHandler(psession, AWS_LEX_EVENT_TRANSCRIPTION, const_cast<char *>(data));
+				gotResult(false);
 
 				free(data);
 				cJSON_Delete(json);
@@ -294,6 +298,7 @@ public:
 				char* data = cJSON_PrintUnformatted(json);
 
 				responseHandler(psession, AWS_LEX_EVENT_INTENT, data);
+				gotResult(true);
 
 				free(data);
 				cJSON_Delete(json);
@@ -303,6 +308,7 @@ public:
 
     m_handler.SetOnErrorCallback([this, errorHandler](const Aws::Client::AWSError<LexRuntimeV2Errors>& err)
     {
+			stream_metrics::instance().error(err.GetExceptionName().c_str());
 			switch_core_session_t* psession = switch_core_session_locate(m_sessionId.c_str());
 			if (psession) {
 				cJSON* json = lex2Json(err);
@@ -339,6 +345,7 @@ public:
 				Aws::Map<Aws::String, Aws::String> sessionAttributes;
 
 				m_pStream = &stream;
+				stream_metrics::mark_connected(m_marks);
 				
 				// check channel vars for lex session attributes
 				bool bargein = false;
@@ -414,6 +421,7 @@ public:
 				const LexRuntimeV2Error& err = outcome.GetError();
 				auto message = err.GetMessage();
 				auto exception = err.GetExceptionName();
+				stream_metrics::instance().error(exception.c_str());
 				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "GStreamer %p stream got error response %s : %s\n", this, message.c_str(), exception.c_str());
 			}
 
@@ -423,9 +431,14 @@ public:
     };
 
  		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "GStreamer %p starting conversation\n", this);
+		stream_metrics::mark_connect_start(m_marks);
 		m_client->StartConversationAsync(m_request, OnStreamReady, OnResponseCallback, nullptr/*context*/);
 	}
 
+	void gotResult(bool isFinal) {
+		stream_metrics::mark_result(m_marks, isFinal);
+	}
+
 	~GStreamer() {
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "GStreamer::~GStreamer wrote %d packets %p\n", m_packets, this);		
 	}
@@ -454,6 +467,7 @@ public:
 			return false;
 		}
 		//m_fOutgoingAudio.write((const char*) data, datalen);
+		stream_metrics::mark_audio_sent(m_marks);
 		Aws::Utils::ByteBuffer audio((const unsigned char *) data, datalen);
 		AudioInputEvent audioInputEvent;
 		audioInputEvent.SetAudioChunk(audio);
@@ -533,6 +547,7 @@ private:
 	//std::ofstream m_fOutgoingAudio;
 	bool m_bPlayDone;
 	bool m_bDiscardAudio;
+	stream_metrics::Marks m_marks;
 };
 
 static void *SWITCH_THREAD_FUNC lex_thread(switch_thread_t *thread, void *obj) {
@@ -547,11 +562,13 @@ static void *SWITCH_THREAD_FUNC lex_thread(switch_thread_t *thread, void *obj) {
 		return nullptr;
 	}
 	cb->streamer = pStreamer;
+	stream_metrics::instance().streamStarted();
 
 	pStreamer->processData();
 	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "lex_thread: stopping cb %p\n", (void *) cb);
 	delete pStreamer;
 	cb->streamer = nullptr;
+	stream_metrics::instance().streamEnded();
 	return NULL;
 }
 
@@ -563,7 +580,7 @@ static void killcb(struct cap_cb* cb) {
 			cb->streamer = NULL;
 		}
 		if (cb->resampler) {
-				speex_resampler_destroy(cb->resampler);
+				resampler_pool::release(cb->resampler);
 				cb->resampler = NULL;
 		}
 	}
@@ -597,6 +614,7 @@ extern "C" {
 		}
 
     Aws::InitAPI(options);
+		stream_metrics::instance().init("aws_lex");
 
 
 
@@ -613,6 +631,7 @@ extern "C" {
 		}
 	
     Aws::ShutdownAPI(options);
+		stream_metrics::instance().shutdown();
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_aws_lex: shutdown API complete");
 
 		return SWITCH_STATUS_SUCCESS;
@@ -675,7 +694,7 @@ extern "C" {
 		strncpy(cb->region, region, MAX_REGION);
 		if (intent) strncpy(cb->intent, intent, MAX_INTENT);
 		if (metadata) strncpy(cb->metadata, metadata, MAX_METADATA);
-		cb->resampler = speex_resampler_init(1, 8000, /*16000*/ 8000, SWITCH_RESAMPLE_QUALITY, &err);
+		cb->resampler = resampler_pool::acquire(1, 8000, /*16000*/ 8000, SWITCH_RESAMPLE_QUALITY, &err);
 		if (0 != err) {
 			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "%s: Error initializing resampler: %s.\n", 
 						switch_channel_get_name(channel), speex_resampler_strerror(err));
@@ -785,6 +804,7 @@ extern "C" {
 	}
 	
 	switch_bool_t aws_lex_frame(switch_media_bug_t *bug, void* user_data) {
+		stream_metrics::FrameTimer timer;
 		switch_core_session_t *session = switch_core_media_bug_get_session(bug);
 		uint8_t data[SWITCH_RECOMMENDED_BUFFER_SIZE];
 		switch_frame_t frame = {};
@@ -801,11 +821,11 @@ extern "C" {
 						spx_int16_t out[SWITCH_RECOMMENDED_BUFFER_SIZE];
 						spx_uint32_t out_len = SWITCH_RECOMMENDED_BUFFER_SIZE;
 						spx_uint32_t in_len = frame.samples;
-						size_t written;
 						
 						speex_resampler_process_interleaved_int(cb->resampler, (const spx_int16_t *) frame.data, (spx_uint32_t *) &in_len, &out[0], &out_len);
 						
-						streamer->write( &out[0], sizeof(spx_int16_t) * out_len);
+						if (streamer->write( &out[0], sizeof(spx_int16_t) * out_len)) stream_metrics::instance().bytesSent(sizeof(spx_int16_t) * out_len);
+						else stream_metrics::instance().framesDropped(1);
 					}
 				}
 			}
@@ -826,4 +846,19 @@ extern "C" {
 		killcb(cb);
 	}
 
-}
\ No newline at end of file
+	switch_status_t aws_lex_metrics(switch_stream_handle_t *stream) {
+		std::string text;
+
+		stream_metrics::instance().render(text);
+		stream->write_function(stream, "%s", text.c_str());
+		return SWITCH_STATUS_SUCCESS;
+	}
+
+	switch_status_t aws_lex_latency(switch_stream_handle_t *stream) {
+		std::string text;
+
+		stream_metrics::instance().latency(text);
+		stream->write_function(stream, "%s", text.c_str());
+		return SWITCH_STATUS_SUCCESS;
+	}
+}
@@ -9,6 +9,8 @@ switch_status_t aws_lex_session_stop(switch_core_session_t *session, int channel
 switch_status_t aws_lex_session_dtmf(switch_core_session_t *session, char* dtmf);
 switch_status_t aws_lex_session_play_done(switch_core_session_t *session);
 switch_bool_t aws_lex_frame(switch_media_bug_t *bug, void* user_data);
+switch_status_t aws_lex_metrics(switch_stream_handle_t *stream);
+switch_status_t aws_lex_latency(switch_stream_handle_t *stream);
 
 void destroyChannelUserData(struct cap_cb* cb);
 #endif
\ No newline at end of file
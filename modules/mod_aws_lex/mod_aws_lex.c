@@ -299,6 +299,14 @@ SWITCH_STANDARD_API(aws_lex_api_stop_function)
 
 
 /* Macro expands to: switch_status_t mod_lex_load(switch_loadable_module_interface_t **module_interface, switch_memory_pool_t *pool) */
+#define METRICS_API_SYNTAX "[latency]"
+SWITCH_STANDARD_API(metrics_function)
+{
+	if (!zstr(cmd) && 0 == strcasecmp(cmd, "latency")) aws_lex_latency(stream);
+	else aws_lex_metrics(stream);
+	return SWITCH_STATUS_SUCCESS;
+}
+
 SWITCH_MODULE_LOAD_FUNCTION(mod_aws_lex_load)
 {
 	switch_api_interface_t *api_interface;
@@ -346,6 +354,7 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_aws_lex_load)
 	SWITCH_ADD_API(api_interface, "aws_lex_dtmf", "Send a dtmf entry to lex", aws_lex_api_dtmf_function, LEX_API_DTMF_SYNTAX);
 	SWITCH_ADD_API(api_interface, "aws_lex_play_done", "Notify lex that a play completed", aws_lex_api_play_done_function, LEX_API_PLAY_DONE_SYNTAX);
 	SWITCH_ADD_API(api_interface, "aws_lex_stop", "Terminate a aws lex", aws_lex_api_stop_function, LEX_API_STOP_SYNTAX);
+	SWITCH_ADD_API(api_interface, "aws_lex_metrics", "AWS Lex metrics in prometheus text format", metrics_function, METRICS_API_SYNTAX);
 
 	switch_console_set_complete("add aws_lex_stop");
 	switch_console_set_complete("add aws_lex_play_done");
@@ -0,0 +1,107 @@
+#ifndef __RESAMPLER_POOL_HPP__
+#define __RESAMPLER_POOL_HPP__
+
+#include <mutex>
+#include <tuple>
+#include <unordered_map>
+#include <map>
+#include <vector>
+
+#include <speex/speex_resampler.h>
+
+/**
+ * A pool of speex resampler states, keyed by channels, rates and quality.
+ *
+ * speex_resampler_init allocates a state and fills that state's own sinc filter table for the rate pair
+ * and quality; speexdsp does not share tables between states.  Rather than destroying a session's
+ * resampler when the session ends, release() resets its history and keeps it, and acquire() hands it to
+ * the next session with the same key, so a call that finds an idle state skips the allocation and the
+ * table fill.  Every pooled state still has its own table: tables are built about as many times as the
+ * peak number of concurrent sessions per key, and stay resident while idle.  Filtering a frame costs
+ * the same either way.  A resampler is only ever used by one session at a time.
+ * examples/resampler_pool_bench.cpp times acquire/release against init/destroy.
+ *
+ * Each module carries a copy of this file inside its own namespace, aliased to resampler_pool, so that
+ * the pool (a static local of an inline function) is not one object shared by every loaded module.
+ */
+namespace aws_lex {
+namespace resampler_pool {
+
+  // idle resamplers kept per (channels, rates, quality); any beyond this are destroyed on release
+  static const size_t MAX_IDLE_PER_KEY = 256;
+
+  typedef std::tuple<spx_uint32_t, spx_uint32_t, spx_uint32_t, int> Key;
+
+  class Pool {
+  public:
+    ~Pool() {
+      for (auto& it : m_idle) {
+        for (auto st : it.second) speex_resampler_destroy(st);
+      }
+    }
+
+    SpeexResamplerState* acquire(spx_uint32_t channels, spx_uint32_t in_rate, spx_uint32_t out_rate, int quality, int* err) {
+      Key key(channels, in_rate, out_rate, quality);
+      SpeexResamplerState* st = nullptr;
+      {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        auto it = m_idle.find(key);
+        if (it != m_idle.end() && !it->second.empty()) {
+          st = it->second.back();
+          it->second.pop_back();
+          m_inUse[st] = key;
+          *err = RESAMPLER_ERR_SUCCESS;
+          return st;
+        }
+      }
+      st = speex_resampler_init(channels, in_rate, out_rate, quality, err);
+      if (st) {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        m_inUse[st] = key;
+      }
+      return st;
+    }
+
+    void release(SpeexResamplerState* st) {
+      if (!st) return;
+      {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        auto it = m_inUse.find(st);
+        if (it != m_inUse.end()) {
+          auto& idle = m_idle[it->second];
+          m_inUse.erase(it);
+          if (idle.size() < MAX_IDLE_PER_KEY) {
+            speex_resampler_reset_mem(st);
+            idle.push_back(st);
+            return;
+          }
+        }
+      }
+      speex_resampler_destroy(st);
+    }
+
+  private:
+    std::mutex m_mutex;
+    std::map<Key, std::vector<SpeexResamplerState*> > m_idle;
+    std::unordered_map<SpeexResamplerState*, Key> m_inUse;
+  };
+
+  inline Pool& instance() {
+    static Pool pool;
+    return pool;
+  }
+
+  /* drop-in replacements for speex_resampler_init / speex_resampler_destroy */
+  inline SpeexResamplerState* acquire(spx_uint32_t channels, spx_uint32_t in_rate, spx_uint32_t out_rate, int quality, int* err) {
+    return instance().acquire(channels, in_rate, out_rate, quality, err);
+  }
+
+  inline void release(SpeexResamplerState* st) {
+    instance().release(st);
+  }
+}
+}
+
+namespace resampler_pool = aws_lex::resampler_pool;
+
+#endif
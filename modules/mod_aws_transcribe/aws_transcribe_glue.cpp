@@ -21,7 +21,9 @@
 #include <aws/transcribestreaming/model/StartStreamTranscriptionRequest.h>
 
 #include "mod_aws_transcribe.h"
+#include "resampler_pool.hpp"
 #include "simple_buffer.h"
+#include "stream_metrics.hpp"
 
 #define BUFFER_SECS (3)
 #define CHUNKSIZE (320)
@@ -51,8 +53,9 @@ public:
 		const char* awsSecretAccessKey,
 		responseHandler_t responseHandler
   ) : m_sessionId(sessionId), m_bugname(bugname), m_finished(false), m_interim(interim), m_finishing(false), m_connected(false), m_connecting(false),
-	 		m_packets(0), m_responseHandler(responseHandler), m_pStream(nullptr), 
+	 		m_packets(0), m_responseHandler(responseHandler), m_pStream(nullptr),
 			m_audioBuffer(320 * (samples_per_second == 8000 ? 1 : 2), 15) {
+		stream_metrics::mark_init(m_marks);
 		Aws::String key(awsAccessKeyId);
 		Aws::String secret(awsSecretAccessKey);
 		Aws::Client::ClientConfiguration config;
@@ -116,6 +119,7 @@ public:
 	void connect() {
 		if (m_connecting) return;
 		m_connecting = true;
+		stream_metrics::mark_connect_start(m_marks);
 
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "GStreamer:connect %p connecting to aws speech..\n", this);
 
@@ -127,6 +131,7 @@ public:
 
 				m_pStream = &stream;
 				m_connected = true;
+				stream_metrics::mark_connected(m_marks);
 
 
 				// send any buffered audio
@@ -157,6 +162,7 @@ public:
 					const TranscribeStreamingServiceError& err = outcome.GetError();
 					auto message = err.GetMessage();
 					auto exception = err.GetExceptionName();
+					stream_metrics::instance().error(exception.c_str());
 					cJSON* json = cJSON_CreateObject();
 					cJSON_AddStringToObject(json, "type", "error");
 					cJSON_AddStringToObject(json, "error", message.c_str());
@@ -203,6 +209,7 @@ public:
 
 		std::lock_guard<std::mutex> lk(m_mutex);
 
+		stream_metrics::mark_audio_sent(m_marks);
 		const auto beg = static_cast<const unsigned char*>(data);
 		const auto end = beg + datalen;
 		Aws::Vector<unsigned char> bits { beg, end };
@@ -247,7 +254,7 @@ public:
 						int count = 0;
 						std::ostringstream t1;
 						if (!isFinal && !r.GetIsPartial()) isFinal = true;
-						t1 << "{\"is_final\": " << (r.GetIsPartial() ? "false" : "true") << ", \"alternatives\": [";
+						t1 << "{\"is_final\": " << (r.GetIsPartial() ? "false" : "true") << ", \"end_time\": " << r.GetEndTime() << ", \"alternatives\": [";
 						for (auto&& alt : r.GetAlternatives()) {
 							std::ostringstream t2;
 							if (count++ == 0) t2 << "{\"transcript\": \"" << alt.GetTranscript() << "\"}";
@@ -258,6 +265,9 @@ public:
 						s << t1.str();
 					}
 					s << "]";
+					if (0 != s.str().compare("[]")) {
+						stream_metrics::mark_result(m_marks, isFinal);
+					}
 					if (0 != s.str().compare("[]") && (isFinal || m_interim)) {
 						switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "GStreamer::writing transcript %p: %s\n", this, s.str().c_str() );
 						m_responseHandler(psession, s.str().c_str(), m_bugname.c_str());
@@ -310,6 +320,7 @@ private:
 	bool m_connected;
 	bool m_connecting;
 	uint32_t m_packets;
+	stream_metrics::Marks m_marks;
 	std::mutex m_mutex;
 	std::condition_variable m_cond;
 	std::deque< Aws::Vector<unsigned char> > m_deqAudio;
@@ -344,7 +355,7 @@ static void killcb(struct cap_cb* cb) {
 			cb->streamer = nullptr;
 		}
 		if (cb->resampler) {
-				speex_resampler_destroy(cb->resampler);
+				resampler_pool::release(cb->resampler);
 				cb->resampler = nullptr;
 		}
 		if (cb->vad) {
@@ -377,6 +388,7 @@ extern "C" {
            ALLOC_TAG, Aws::Utils::Logging::LogLevel::Trace, "aws_sdk_transcribe"));
 */
     Aws::InitAPI(options);
+		stream_metrics::instance().init("aws_transcribe");
 
 		return SWITCH_STATUS_SUCCESS;
 	}
@@ -388,6 +400,7 @@ extern "C" {
 		Aws::Utils::Logging::ShutdownAWSLogging();
 		*/
     Aws::ShutdownAPI(options);
+		stream_metrics::instance().shutdown();
 
 		return SWITCH_STATUS_SUCCESS;
 	}
@@ -451,7 +464,7 @@ extern "C" {
 		cb->samples_per_second = sampleRate;
 		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "sample rate of rtp stream is %d\n", samples_per_second);
 		if (sampleRate != 8000) {
-			cb->resampler = speex_resampler_init(1, sampleRate, 16000, SWITCH_RESAMPLE_QUALITY, &err);
+			cb->resampler = resampler_pool::acquire(1, sampleRate, 16000, SWITCH_RESAMPLE_QUALITY, &err);
 			if (0 != err) {
 				switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "%s: Error initializing resampler: %s.\n", 
 							switch_channel_get_name(channel), speex_resampler_strerror(err));
@@ -495,6 +508,7 @@ extern "C" {
 		switch_threadattr_create(&thd_attr, pool);
 		switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
 		switch_thread_create(&cb->thread, thd_attr, aws_transcribe_thread, cb, pool);
+		stream_metrics::instance().streamStarted();
 
 		*ppUserData = cb;
 	
@@ -526,6 +540,7 @@ extern "C" {
 			}
 			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "aws_transcribe_session_stop: bugname - %s; going to kill callback\n", bugname);
 			killcb(cb);
+			stream_metrics::instance().streamEnded();
 			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "aws_transcribe_session_stop: bugname - %s; killed callback\n", bugname);
 
 			switch_channel_set_private(channel, bugname, NULL);
@@ -546,6 +561,7 @@ extern "C" {
 	}
 	
 	switch_bool_t aws_transcribe_frame(switch_media_bug_t *bug, void* user_data) {
+		stream_metrics::FrameTimer timer;
 		switch_core_session_t *session = switch_core_media_bug_get_session(bug);
 		uint8_t data[SWITCH_RECOMMENDED_BUFFER_SIZE];
 		switch_frame_t frame = {};
@@ -559,10 +575,12 @@ extern "C" {
 			if (streamer) {
 				while (switch_core_media_bug_read(bug, &frame, SWITCH_TRUE) == SWITCH_STATUS_SUCCESS && !switch_test_flag((&frame), SFF_CNG)) {
 					if (frame.datalen) {
+						media_clock_advance(session, cb, frame.samples);
 						spx_int16_t out[SWITCH_RECOMMENDED_BUFFER_SIZE];
 						spx_uint32_t out_len = SWITCH_RECOMMENDED_BUFFER_SIZE;
 						spx_uint32_t in_len = frame.samples;
-						size_t written;
+						size_t len;
+						bool ok;
 
 						if (cb->vad && !streamer->isConnecting()) {
 							switch_vad_state_t state = switch_vad_process(cb->vad, (int16_t*) frame.data, frame.samples);
@@ -575,11 +593,18 @@ extern "C" {
 
 						if (cb->resampler) {
 							speex_resampler_process_interleaved_int(cb->resampler, (const spx_int16_t *) frame.data, (spx_uint32_t *) &in_len, &out[0], &out_len);						
-							streamer->write( &out[0], sizeof(spx_int16_t) * out_len);
+							len = sizeof(spx_int16_t) * out_len;
+							ok = streamer->write( &out[0], len);
 						}
 						else {
-							streamer->write( frame.data, sizeof(spx_int16_t) * frame.samples);
+							len = sizeof(spx_int16_t) * frame.samples;
+							ok = streamer->write( frame.data, len);
+						}
+						if (ok) {
+							media_clock_stream_start(cb, frame.samples);
+							stream_metrics::instance().bytesSent(len);
 						}
+						else stream_metrics::instance().framesDropped(1);
 					}
 				}
 			}
@@ -591,4 +616,20 @@ extern "C" {
 		}
 		return SWITCH_TRUE;
 	}
-}
\ No newline at end of file
+
+	switch_status_t aws_transcribe_metrics(switch_stream_handle_t *stream) {
+		std::string text;
+
+		stream_metrics::instance().render(text);
+		stream->write_function(stream, "%s", text.c_str());
+		return SWITCH_STATUS_SUCCESS;
+	}
+
+	switch_status_t aws_transcribe_latency(switch_stream_handle_t *stream) {
+		std::string text;
+
+		stream_metrics::instance().latency(text);
+		stream->write_function(stream, "%s", text.c_str());
+		return SWITCH_STATUS_SUCCESS;
+	}
+}
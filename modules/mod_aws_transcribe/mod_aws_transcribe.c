@@ -14,9 +14,25 @@ SWITCH_MODULE_DEFINITION(mod_aws_transcribe, mod_aws_transcribe_load, mod_aws_tr
 
 static switch_status_t do_stop(switch_core_session_t *session, char* bugname);
 
+/* offset of the end of the audio a aws transcript: the latest end_time of its results, in seconds; -1 if it has none */
+static int64_t result_audio_ms(const char* json) {
+	int64_t audio_ms = -1;
+	cJSON* jMessage = cJSON_Parse(json);
+	if (jMessage) {
+		cJSON* jResult;
+		cJSON_ArrayForEach(jResult, jMessage) {
+			cJSON* jEnd = cJSON_GetObjectItem(jResult, "end_time");
+			if (cJSON_IsNumber(jEnd) && (int64_t) (jEnd->valuedouble * 1000) > audio_ms) audio_ms = (int64_t) (jEnd->valuedouble * 1000);
+		}
+		cJSON_Delete(jMessage);
+	}
+	return audio_ms;
+}
+
 static void responseHandler(switch_core_session_t* session, const char * json, const char* bugname) {
 	switch_event_t *event;
 	switch_channel_t *channel = switch_core_session_get_channel(session);
+	int64_t audio_ms = -1;
 
 	if (0 == strcmp("vad_detected", json)) {
 		switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, TRANSCRIBE_EVENT_VAD_DETECTED);
@@ -56,8 +72,10 @@ static void responseHandler(switch_core_session_t* session, const char * json, c
 		switch_channel_event_set_data(channel, event);
 		switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "transcription-vendor", "aws");
 		switch_event_add_body(event, "%s", json);
+		if (!error) audio_ms = result_audio_ms(json);
 	}
 	if (bugname) switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "media-bugname", bugname);
+	media_clock_stamp(session, bugname, event, audio_ms);
 	switch_event_fire(&event);
 }
 
@@ -200,6 +218,14 @@ SWITCH_STANDARD_API(aws_transcribe_function)
 }
 
 
+#define METRICS_API_SYNTAX "[latency]"
+SWITCH_STANDARD_API(metrics_function)
+{
+	if (!zstr(cmd) && 0 == strcasecmp(cmd, "latency")) aws_transcribe_latency(stream);
+	else aws_transcribe_metrics(stream);
+	return SWITCH_STATUS_SUCCESS;
+}
+
 SWITCH_MODULE_LOAD_FUNCTION(mod_aws_transcribe_load)
 {
 	switch_api_interface_t *api_interface;
@@ -222,6 +248,7 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_aws_transcribe_load)
 	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "AWS Speech Transcription API successfully loaded\n");
 
 	SWITCH_ADD_API(api_interface, "uuid_aws_transcribe", "AWS Speech Transcription API", aws_transcribe_function, TRANSCRIBE_API_SYNTAX);
+	SWITCH_ADD_API(api_interface, "aws_transcribe_metrics", "AWS Speech Transcription metrics in prometheus text format", metrics_function, METRICS_API_SYNTAX);
 	switch_console_set_complete("add uuid_aws_transcribe start lang-code [interim|final] [stereo|mono]");
 	switch_console_set_complete("add uuid_aws_transcribe stop ");
 
@@ -15,7 +15,9 @@
 #include <speechapi_cxx.h>
 
 #include "mod_azure_transcribe.h"
+#include "resampler_pool.hpp"
 #include "simple_buffer.h"
+#include "stream_metrics.hpp"
 
 #define CHUNKSIZE (320)
 #define DEFAULT_SPEECH_TIMEOUT "180000"
@@ -48,6 +50,7 @@ public:
   ) : m_sessionId(sessionId), m_bugname(bugname), m_finished(false), m_stopped(false), m_interim(interim), 
 	 m_connected(false), m_connecting(false), m_audioBuffer(320 * (samples_per_second == 8000 ? 1 : 2), 15),
 	m_responseHandler(responseHandler) {
+		stream_metrics::mark_init(m_marks);
 
 		switch_core_session_t* psession = switch_core_session_locate(sessionId);
 		if (!psession) throw std::invalid_argument( "session id no longer active" );
@@ -195,6 +198,7 @@ public:
 				switch (reason) {
 					case ResultReason::RecognizingSpeech:
 					case ResultReason::RecognizedSpeech:
+						stream_metrics::mark_result(m_marks, reason == ResultReason::RecognizedSpeech);
 						// note: interim results don't have "RecognitionStatus": "Success"
 						responseHandler(psession, TRANSCRIBE_EVENT_RESULTS, json.c_str(), m_bugname.c_str(), m_finished);
 					break;
@@ -220,6 +224,7 @@ public:
         auto result = args.Result;
         auto details = args.ErrorDetails;
         auto code = args.ErrorCode;
+        stream_metrics::instance().error((int) code);
         cJSON* json = cJSON_CreateObject();
         cJSON_AddStringToObject(json, "type", "error");
         cJSON_AddStringToObject(json, "error", details.c_str());
@@ -249,11 +254,13 @@ public:
 	void connect() {
 		if (m_connecting) return;
 		m_connecting = true;
+		stream_metrics::mark_connect_start(m_marks);
 
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "GStreamer:connect %p connecting to azure speech..\n", this);
 
 		auto onSessionStarted = [this](const SessionEventArgs& args) {
 			m_connected = true;
+			stream_metrics::mark_connected(m_marks);
 			switch_core_session_t* psession = switch_core_session_locate(m_sessionId.c_str());
 			if (psession) {
 				auto sessionId = args.SessionId;
@@ -291,6 +298,7 @@ public:
       return true;
     }
 
+    stream_metrics::mark_audio_sent(m_marks);
     m_pushStream->Write(static_cast<uint8_t*>(data), datalen);
 		return true;
 	}
@@ -324,6 +332,7 @@ private:
 	bool m_connected;
 	bool m_connecting;
 	bool m_stopped;
+	stream_metrics::Marks m_marks;
 	SimpleBuffer m_audioBuffer;
 };
 
@@ -346,7 +355,7 @@ static void killcb(struct cap_cb* cb) {
 			cb->streamer = NULL;
 		}
 		if (cb->resampler) {
-				speex_resampler_destroy(cb->resampler);
+				resampler_pool::release(cb->resampler);
 				cb->resampler = NULL;
 		}
 		if (cb->vad) {
@@ -367,10 +376,12 @@ extern "C" {
 		else {
 			hasDefaultCredentials = true;
 		}
+		stream_metrics::instance().init("azure_transcribe");
 		return SWITCH_STATUS_SUCCESS;
 	}
 	
 	switch_status_t azure_transcribe_cleanup() {
+		stream_metrics::instance().shutdown();
 		return SWITCH_STATUS_SUCCESS;
 	}
 
@@ -422,7 +433,7 @@ extern "C" {
 
 		/* determine if we need to resample the audio to 16-bit 8khz */
 		if (sampleRate != 8000) {
-			cb->resampler = speex_resampler_init(1, sampleRate, 8000, SWITCH_RESAMPLE_QUALITY, &err);
+			cb->resampler = resampler_pool::acquire(1, sampleRate, 8000, SWITCH_RESAMPLE_QUALITY, &err);
 			if (0 != err) {
 				switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "%s: Error initializing resampler: %s.\n", 
 							switch_channel_get_name(channel), speex_resampler_strerror(err));
@@ -468,6 +479,7 @@ extern "C" {
 			streamer = new GStreamer(sessionId, bugname, channels, lang, interim, sampleRate, cb->region, subscriptionKey, responseHandler);
 			cb->streamer = streamer;
 			if (!cb->vad) streamer->connect();
+			stream_metrics::instance().streamStarted();
 		} catch (std::exception& e) {
 			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "%s: Error initializing gstreamer: %s.\n", 
 				switch_channel_get_name(channel), e.what());
@@ -499,6 +511,7 @@ extern "C" {
 			GStreamer* streamer = (GStreamer *) cb->streamer;
 			if (streamer) reaper(cb);
 			killcb(cb);
+			stream_metrics::instance().streamEnded();
 			switch_mutex_unlock(cb->mutex);
 			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "azure_transcribe_session_stop: unlocked session\n");
 
@@ -510,6 +523,7 @@ extern "C" {
 	}
 	
 	switch_bool_t azure_transcribe_frame(switch_media_bug_t *bug, void* user_data) {
+		stream_metrics::FrameTimer timer;
 		switch_core_session_t *session = switch_core_media_bug_get_session(bug);
 		uint8_t data[SWITCH_RECOMMENDED_BUFFER_SIZE];
 		switch_frame_t frame = {};
@@ -523,6 +537,10 @@ extern "C" {
 			if (streamer) {
 				while (switch_core_media_bug_read(bug, &frame, SWITCH_TRUE) == SWITCH_STATUS_SUCCESS && !switch_test_flag((&frame), SFF_CNG)) {
 					if (frame.datalen) {
+						size_t len;
+						bool ok;
+
+						media_clock_advance(session, cb, frame.samples);
 						if (cb->vad && !streamer->isConnecting()) {
 							switch_vad_state_t state = switch_vad_process(cb->vad, (int16_t*) frame.data, frame.samples);
 							if (state == SWITCH_VAD_STATE_START_TALKING) {
@@ -536,7 +554,6 @@ extern "C" {
 							spx_int16_t out[SWITCH_RECOMMENDED_BUFFER_SIZE];
 							spx_uint32_t out_len = SWITCH_RECOMMENDED_BUFFER_SIZE;
 							spx_uint32_t in_len = frame.samples;
-							size_t written;
 						
 							speex_resampler_process_interleaved_int(
 								cb->resampler,
@@ -544,11 +561,18 @@ extern "C" {
 								(spx_uint32_t *) &in_len, 
 								&out[0],
 								&out_len);
-							streamer->write( &out[0], sizeof(spx_int16_t) * out_len);
+							len = sizeof(spx_int16_t) * out_len;
+							ok = streamer->write( &out[0], len);
 						}
 						else {
-							streamer->write( frame.data, frame.datalen);
+							len = frame.datalen;
+							ok = streamer->write( frame.data, len);
+						}
+						if (ok) {
+							media_clock_stream_start(cb, frame.samples);
+							stream_metrics::instance().bytesSent(len);
 						}
+						else stream_metrics::instance().framesDropped(1);
 					}
 				}
 			}
@@ -556,4 +580,20 @@ extern "C" {
 		}
 		return SWITCH_TRUE;
 	}
+
+	switch_status_t azure_transcribe_metrics(switch_stream_handle_t *stream) {
+		std::string text;
+
+		stream_metrics::instance().render(text);
+		stream->write_function(stream, "%s", text.c_str());
+		return SWITCH_STATUS_SUCCESS;
+	}
+
+	switch_status_t azure_transcribe_latency(switch_stream_handle_t *stream) {
+		std::string text;
+
+		stream_metrics::instance().latency(text);
+		stream->write_function(stream, "%s", text.c_str());
+		return SWITCH_STATUS_SUCCESS;
+	}
 }
@@ -14,6 +14,21 @@ SWITCH_MODULE_DEFINITION(mod_azure_transcribe, mod_azure_transcribe_load, mod_az
 
 static switch_status_t do_stop(switch_core_session_t *session, char* bugname);
 
+/* offset of the end of the audio a azure result: its Offset plus Duration, in 100 ns ticks; -1 if it has none */
+static int64_t result_audio_ms(const char* json) {
+	int64_t audio_ms = -1;
+	cJSON* jMessage = cJSON_Parse(json);
+	if (jMessage) {
+		cJSON* jOffset = cJSON_GetObjectItem(jMessage, "Offset");
+		cJSON* jDuration = cJSON_GetObjectItem(jMessage, "Duration");
+		if (cJSON_IsNumber(jOffset) && cJSON_IsNumber(jDuration)) {
+			audio_ms = (int64_t) ((jOffset->valuedouble + jDuration->valuedouble) / 10000);
+		}
+		cJSON_Delete(jMessage);
+	}
+	return audio_ms;
+}
+
 static void responseHandler(switch_core_session_t* session, const char* eventName, const char * json, const char* bugname, int finished) {
 	switch_event_t *event;
 	switch_channel_t *channel = switch_core_session_get_channel(session);
@@ -27,6 +42,7 @@ static void responseHandler(switch_core_session_t* session, const char* eventNam
 	}
 	if (json) switch_event_add_body(event, "%s", json);
 	if (bugname) switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "media-bugname", bugname);
+	media_clock_stamp(session, bugname, event, json && 0 == strcmp(eventName, TRANSCRIBE_EVENT_RESULTS) ? result_audio_ms(json) : -1);
 	switch_event_fire(&event);
 }
 
@@ -171,6 +187,14 @@ SWITCH_STANDARD_API(azure_transcribe_function)
 }
 
 
+#define METRICS_API_SYNTAX "[latency]"
+SWITCH_STANDARD_API(metrics_function)
+{
+	if (!zstr(cmd) && 0 == strcasecmp(cmd, "latency")) azure_transcribe_latency(stream);
+	else azure_transcribe_metrics(stream);
+	return SWITCH_STATUS_SUCCESS;
+}
+
 SWITCH_MODULE_LOAD_FUNCTION(mod_azure_transcribe_load)
 {
 	switch_api_interface_t *api_interface;
@@ -205,6 +229,7 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_azure_transcribe_load)
 	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "azure Speech Transcription API successfully loaded\n");
 
 	SWITCH_ADD_API(api_interface, "uuid_azure_transcribe", "azure Speech Transcription API", azure_transcribe_function, TRANSCRIBE_API_SYNTAX);
+	SWITCH_ADD_API(api_interface, "azure_transcribe_metrics", "Azure Speech Transcription metrics in prometheus text format", metrics_function, METRICS_API_SYNTAX);
 	switch_console_set_complete("add uuid_azure_transcribe start lang-code [interim|final] [stereo|mono] [bugname]");
 	switch_console_set_complete("add uuid_azure_transcribe stop ");
 
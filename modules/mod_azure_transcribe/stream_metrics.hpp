@@ -0,0 +1,519 @@
+#ifndef __STREAM_METRICS_HPP__
+#define __STREAM_METRICS_HPP__
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/**
+ * Counters and latency histograms for a module's streams, rendered in the Prometheus text exposition
+ * format.  Everything updated from the media, read and service threads is a relaxed atomic, so
+ * recording a metric never takes a lock (error codes claim their slot with a short spin, see
+ * ErrorCounts); rendering reads each value once and may be a sample or two behind a concurrent update.
+ *
+ * Each module keeps its own registry (labelled module="<name>") and exposes it with a "<name>_metrics"
+ * API command.  The copy in each module is inside that module's own namespace, aliased to
+ * stream_metrics: were the copies to share one, the registry (a static local of an inline function)
+ * would be a single object across every loaded module.  If <NAME>_METRICS_PORT is set in the
+ * environment the same text is also served over HTTP on 127.0.0.1:<port> for scraping.
+ *
+ * Stream latency is also kept at high resolution: each stream marks session init, connect start,
+ * connect complete, first audio sent and first interim and final result (see mark_init and friends
+ * below), and the intervals between them go into HDR histograms that "<name>_metrics latency" reports
+ * as percentiles in JSON.
+ */
+namespace azure_transcribe {
+namespace stream_metrics {
+
+  inline int64_t now_usecs(void) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  // upper bounds of the latency buckets, in milliseconds
+  static const uint32_t BUCKETS_MS[] = { 10, 25, 50, 100, 250, 500, 1000, 2500, 5000, 10000 };
+  static const size_t NUM_BUCKETS = sizeof(BUCKETS_MS) / sizeof(BUCKETS_MS[0]);
+
+  class Histogram {
+  public:
+    Histogram() : m_sumUsecs(0) {
+      for (size_t i = 0; i <= NUM_BUCKETS; i++) m_buckets[i] = 0;
+    }
+
+    void observe(int64_t usecs) {
+      size_t i = 0;
+      if (usecs < 0) usecs = 0;
+      while (i < NUM_BUCKETS && usecs > (int64_t) BUCKETS_MS[i] * 1000) i++;
+      m_buckets[i].fetch_add(1, std::memory_order_relaxed);
+      m_sumUsecs.fetch_add(usecs, std::memory_order_relaxed);
+    }
+
+    void render(std::string& out, const char* name, const char* help, const char* module) {
+      char line[256];
+      uint64_t cumulative = 0;
+
+      snprintf(line, sizeof(line), "# HELP %s %s\n# TYPE %s histogram\n", name, help, name);
+      out.append(line);
+      for (size_t i = 0; i < NUM_BUCKETS; i++) {
+        cumulative += m_buckets[i].load(std::memory_order_relaxed);
+        snprintf(line, sizeof(line), "%s_bucket{module=\"%s\",le=\"%g\"} %llu\n", name, module,
+          BUCKETS_MS[i] / 1000.0, (unsigned long long) cumulative);
+        out.append(line);
+      }
+      cumulative += m_buckets[NUM_BUCKETS].load(std::memory_order_relaxed);
+      snprintf(line, sizeof(line), "%s_bucket{module=\"%s\",le=\"+Inf\"} %llu\n%s_sum{module=\"%s\"} %.6f\n%s_count{module=\"%s\"} %llu\n",
+        name, module, (unsigned long long) cumulative,
+        name, module, m_sumUsecs.load(std::memory_order_relaxed) / 1000000.0,
+        name, module, (unsigned long long) cumulative);
+      out.append(line);
+    }
+
+  private:
+    std::atomic<uint64_t> m_buckets[NUM_BUCKETS + 1];
+    std::atomic<uint64_t> m_sumUsecs;
+  };
+
+  /**
+   * A high dynamic range histogram of microsecond values: exact below 128us, and above that 64 linear
+   * sub-buckets per power of two, so any recorded value is reported to within 1.6% from 1us up to
+   * ~19 hours without configuring bucket bounds.
+   */
+  class HdrHistogram {
+  public:
+    static const int SUB_BUCKET_BITS = 7;
+    static const size_t SUB_BUCKET_HALF = 1 << (SUB_BUCKET_BITS - 1);
+    static const int MAX_BITS = 36;
+    static const size_t NUM_COUNTS = (MAX_BITS - SUB_BUCKET_BITS + 1) * SUB_BUCKET_HALF + SUB_BUCKET_HALF * 2;
+
+    HdrHistogram() : m_count(0), m_sum(0), m_min(INT64_MAX), m_max(0) {
+      for (size_t i = 0; i < NUM_COUNTS; i++) m_counts[i] = 0;
+    }
+
+    void record(int64_t usecs) {
+      uint64_t v = usecs < 0 ? 0 : (uint64_t) usecs;
+      if (v >= (1ULL << MAX_BITS)) v = (1ULL << MAX_BITS) - 1;
+      m_counts[index(v)].fetch_add(1, std::memory_order_relaxed);
+      m_count.fetch_add(1, std::memory_order_relaxed);
+      m_sum.fetch_add(v, std::memory_order_relaxed);
+
+      int64_t cur = m_min.load(std::memory_order_relaxed);
+      while ((int64_t) v < cur && !m_min.compare_exchange_weak(cur, v, std::memory_order_relaxed)) ;
+      cur = m_max.load(std::memory_order_relaxed);
+      while ((int64_t) v > cur && !m_max.compare_exchange_weak(cur, v, std::memory_order_relaxed)) ;
+    }
+
+    // the value at or below which pct percent of the recorded values fall
+    int64_t percentile(double pct) {
+      uint64_t count = m_count.load(std::memory_order_relaxed);
+      if (0 == count) return 0;
+
+      uint64_t target = (uint64_t) (pct / 100.0 * count + 0.5);
+      uint64_t seen = 0;
+      if (target < 1) target = 1;
+      for (size_t i = 0; i < NUM_COUNTS; i++) {
+        seen += m_counts[i].load(std::memory_order_relaxed);
+        if (seen >= target) return std::min(highest(i), m_max.load(std::memory_order_relaxed));
+      }
+      return m_max.load(std::memory_order_relaxed);
+    }
+
+    // {"count":n,"min":..,"p50":..,...,"max":..} with times in milliseconds
+    void renderJson(std::string& out) {
+      static const double PCTS[] = { 50.0, 90.0, 99.0, 99.9 };
+      static const char* NAMES[] = { "p50", "p90", "p99", "p999" };
+      uint64_t count = m_count.load(std::memory_order_relaxed);
+      char buf[96];
+
+      snprintf(buf, sizeof(buf), "{\"count\":%llu", (unsigned long long) count);
+      out.append(buf);
+      if (count) {
+        snprintf(buf, sizeof(buf), ",\"min\":%.3f", m_min.load(std::memory_order_relaxed) / 1000.0);
+        out.append(buf);
+        for (size_t i = 0; i < sizeof(PCTS) / sizeof(PCTS[0]); i++) {
+          snprintf(buf, sizeof(buf), ",\"%s\":%.3f", NAMES[i], percentile(PCTS[i]) / 1000.0);
+          out.append(buf);
+        }
+        snprintf(buf, sizeof(buf), ",\"max\":%.3f,\"mean\":%.3f", m_max.load(std::memory_order_relaxed) / 1000.0,
+          (double) m_sum.load(std::memory_order_relaxed) / count / 1000.0);
+        out.append(buf);
+      }
+      out.append("}");
+    }
+
+  private:
+    static size_t index(uint64_t v) {
+      if (v < SUB_BUCKET_HALF * 2) return (size_t) v;
+      int shift = (63 - __builtin_clzll(v)) - (SUB_BUCKET_BITS - 1);
+      return (size_t) (shift * SUB_BUCKET_HALF + (v >> shift));
+    }
+
+    // the highest value that would be recorded at index i
+    static int64_t highest(size_t i) {
+      if (i < SUB_BUCKET_HALF * 2) return (int64_t) i;
+      int shift = (int) (i / SUB_BUCKET_HALF) - 1;
+      uint64_t sub = i - shift * SUB_BUCKET_HALF;
+      return (int64_t) ((sub << shift) + (1ULL << shift) - 1);
+    }
+
+    std::atomic<uint64_t> m_counts[NUM_COUNTS];
+    std::atomic<uint64_t> m_count;
+    std::atomic<uint64_t> m_sum;
+    std::atomic<int64_t> m_min;
+    std::atomic<int64_t> m_max;
+  };
+
+  /**
+   * vendor error counts keyed by a short code (grpc status, http status, or a fixed reason).  Slots are
+   * spin-claimed in order: a compare-and-swap picks the slot for a new code, and a thread that meets a
+   * slot still being claimed yields until its code is written, so concurrent first sightings of a code
+   * agree on one slot.  Once a code has its slot, counting it is a single atomic add.  Codes beyond the
+   * table are counted as "other".
+   */
+  class ErrorCounts {
+  public:
+    static const size_t MAX_CODES = 32;
+    static const size_t MAX_CODE_LEN = 32;
+
+    ErrorCounts() : m_other(0) {
+      for (size_t i = 0; i < MAX_CODES; i++) {
+        m_slots[i].state = SLOT_EMPTY;
+        m_slots[i].count = 0;
+        m_slots[i].code[0] = '\0';
+      }
+    }
+
+    void add(const char* code) {
+      for (size_t i = 0; i < MAX_CODES; i++) {
+        Slot& slot = m_slots[i];
+        int state = slot.state.load(std::memory_order_acquire);
+        if (state == SLOT_EMPTY) {
+          if (slot.state.compare_exchange_strong(state, SLOT_CLAIMED, std::memory_order_acq_rel)) {
+            strncpy(slot.code, code, MAX_CODE_LEN - 1);
+            slot.code[MAX_CODE_LEN - 1] = '\0';
+            slot.count.fetch_add(1, std::memory_order_relaxed);
+            slot.state.store(SLOT_READY, std::memory_order_release);
+            return;
+          }
+        }
+        while ((state = slot.state.load(std::memory_order_acquire)) == SLOT_CLAIMED) std::this_thread::yield();
+        if (0 == strncmp(slot.code, code, MAX_CODE_LEN - 1)) {
+          slot.count.fetch_add(1, std::memory_order_relaxed);
+          return;
+        }
+      }
+      m_other.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void add(int code) {
+      char buf[16];
+      snprintf(buf, sizeof(buf), "%d", code);
+      add(buf);
+    }
+
+    void render(std::string& out, const char* name, const char* help, const char* module) {
+      char line[256];
+
+      snprintf(line, sizeof(line), "# HELP %s %s\n# TYPE %s counter\n", name, help, name);
+      out.append(line);
+      for (size_t i = 0; i < MAX_CODES; i++) {
+        Slot& slot = m_slots[i];
+        if (slot.state.load(std::memory_order_acquire) != SLOT_READY) break;
+        snprintf(line, sizeof(line), "%s{module=\"%s\",code=\"%s\"} %llu\n", name, module, slot.code,
+          (unsigned long long) slot.count.load(std::memory_order_relaxed));
+        out.append(line);
+      }
+      if (m_other.load(std::memory_order_relaxed)) {
+        snprintf(line, sizeof(line), "%s{module=\"%s\",code=\"other\"} %llu\n", name, module,
+          (unsigned long long) m_other.load(std::memory_order_relaxed));
+        out.append(line);
+      }
+    }
+
+  private:
+    enum { SLOT_EMPTY, SLOT_CLAIMED, SLOT_READY };
+    struct Slot {
+      std::atomic<int> state;
+      std::atomic<uint64_t> count;
+      char code[MAX_CODE_LEN];
+    };
+    Slot m_slots[MAX_CODES];
+    std::atomic<uint64_t> m_other;
+  };
+
+  class Registry {
+  public:
+    Registry() : m_module("unknown"), m_active(0), m_total(0), m_results(0), m_finalResults(0), m_reconnects(0),
+      m_tlsHandshakes(0), m_tlsResumed(0), m_bytesSent(0), m_framesDropped(0), m_listenFd(-1), m_stopHttp(false) {}
+
+    ~Registry() {
+      stopHttp();
+    }
+
+    // called once at module load
+    void init(const char* module) {
+      std::string var(module);
+      m_module = module;
+      for (auto& c : var) c = toupper(c);
+      var += "_METRICS_PORT";
+      const char* port = std::getenv(var.c_str());
+      if (port && ::atoi(port) > 0) startHttp(::atoi(port));
+    }
+
+    // called once at module unload
+    void shutdown(void) {
+      stopHttp();
+    }
+
+    void streamStarted(void) {
+      m_total.fetch_add(1, std::memory_order_relaxed);
+      m_active.fetch_add(1, std::memory_order_relaxed);
+    }
+    void streamEnded(void) { m_active.fetch_sub(1, std::memory_order_relaxed); }
+
+    // usecs from starting the connection (or the streaming call) to it being ready
+    void connected(int64_t usecs) {
+      m_connect.observe(usecs);
+      m_hdrConnect.record(usecs);
+    }
+
+    // usecs from the first audio of the stream to the first result returned for it
+    void firstResult(int64_t usecs) { m_firstResult.observe(usecs); }
+
+    // the remaining intervals of the stream timeline, which only feed the latency report
+    void ready(int64_t usecs) { m_hdrReady.record(usecs); }
+    void firstAudio(int64_t usecs) { m_hdrFirstAudio.record(usecs); }
+    void firstInterim(int64_t usecs) { m_hdrFirstInterim.record(usecs); }
+    void firstFinal(int64_t usecs) { m_hdrFirstFinal.record(usecs); }
+    // usecs the media thread spent in one frame callback, see FrameTimer
+    void frameProcessed(int64_t usecs) { m_hdrFrame.record(usecs); }
+
+    void result(bool isFinal) {
+      m_results.fetch_add(1, std::memory_order_relaxed);
+      if (isFinal) m_finalResults.fetch_add(1, std::memory_order_relaxed);
+    }
+    void reconnect(void) { m_reconnects.fetch_add(1, std::memory_order_relaxed); }
+    // a tls connection was established, either with a full handshake or by resuming a cached session
+    void tlsHandshake(bool resumed) {
+      m_tlsHandshakes.fetch_add(1, std::memory_order_relaxed);
+      if (resumed) m_tlsResumed.fetch_add(1, std::memory_order_relaxed);
+    }
+    void bytesSent(uint64_t bytes) { m_bytesSent.fetch_add(bytes, std::memory_order_relaxed); }
+    void framesDropped(uint64_t frames) { m_framesDropped.fetch_add(frames, std::memory_order_relaxed); }
+    void error(const char* code) { m_errors.add(code); }
+    void error(int code) { m_errors.add(code); }
+
+    void render(std::string& out) {
+      const char* module = m_module.c_str();
+
+      counter(out, "freeswitch_stream_active", "gauge", "Streams currently open to the vendor.", m_active.load());
+      counter(out, "freeswitch_stream_started_total", "counter", "Streams started.", m_total.load());
+      m_connect.render(out, "freeswitch_stream_connect_seconds", "Time from starting a vendor connection to it being ready.", module);
+      m_firstResult.render(out, "freeswitch_stream_first_result_seconds", "Time from the first audio of a stream to its first result.", module);
+      counter(out, "freeswitch_stream_results_total", "counter", "Results (interim and final) returned by the vendor.", m_results.load());
+      counter(out, "freeswitch_stream_final_results_total", "counter", "Final results returned by the vendor.", m_finalResults.load());
+      counter(out, "freeswitch_stream_reconnects_total", "counter", "Vendor streams restarted within a session.", m_reconnects.load());
+      counter(out, "freeswitch_stream_tls_handshakes_total", "counter", "TLS connections established to the vendor.", m_tlsHandshakes.load());
+      counter(out, "freeswitch_stream_tls_resumed_total", "counter", "TLS connections that resumed a cached session instead of a full handshake.", m_tlsResumed.load());
+      counter(out, "freeswitch_stream_bytes_sent_total", "counter", "Audio bytes handed to the vendor connection.", m_bytesSent.load());
+      counter(out, "freeswitch_stream_frames_dropped_total", "counter", "Audio frames dropped because the vendor connection could not keep up.", m_framesDropped.load());
+      m_errors.render(out, "freeswitch_stream_errors_total", "Vendor errors, by status code.", module);
+    }
+
+    void latency(std::string& out) {
+      out.append("{\"module\":\"" + m_module + "\",\"units\":\"ms\",\"connect\":");
+      m_hdrConnect.renderJson(out);
+      out.append(",\"ready\":");
+      m_hdrReady.renderJson(out);
+      out.append(",\"firstAudio\":");
+      m_hdrFirstAudio.renderJson(out);
+      out.append(",\"firstInterim\":");
+      m_hdrFirstInterim.renderJson(out);
+      out.append(",\"firstFinal\":");
+      m_hdrFirstFinal.renderJson(out);
+      out.append(",\"frame\":");
+      m_hdrFrame.renderJson(out);
+      out.append("}");
+    }
+
+  private:
+    void counter(std::string& out, const char* name, const char* type, const char* help, uint64_t value) {
+      char line[256];
+      snprintf(line, sizeof(line), "# HELP %s %s\n# TYPE %s %s\n%s{module=\"%s\"} %llu\n", name, help, name, type,
+        name, m_module.c_str(), (unsigned long long) value);
+      out.append(line);
+    }
+
+    /* a minimal HTTP/1.0 responder: every request, whatever its path, gets the current metrics */
+    void startHttp(int port) {
+      struct sockaddr_in addr;
+      int on = 1;
+
+      if (m_listenFd >= 0 || m_httpThread.joinable()) return;
+      m_listenFd = ::socket(AF_INET, SOCK_STREAM, 0);
+      if (m_listenFd < 0) return;
+      setsockopt(m_listenFd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+      memset(&addr, 0, sizeof(addr));
+      addr.sin_family = AF_INET;
+      addr.sin_port = htons(port);
+      addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+      if (::bind(m_listenFd, (struct sockaddr *) &addr, sizeof(addr)) < 0 || ::listen(m_listenFd, 8) < 0) {
+        ::close(m_listenFd);
+        m_listenFd = -1;
+        return;
+      }
+      m_stopHttp = false;
+      m_httpThread = std::thread(&Registry::serveHttp, this);
+    }
+
+    void stopHttp(void) {
+      if (m_listenFd < 0) return;
+      m_stopHttp = true;
+      if (m_httpThread.joinable()) m_httpThread.join();
+      ::close(m_listenFd);
+      m_listenFd = -1;
+    }
+
+    void serveHttp(void) {
+      while (!m_stopHttp) {
+        struct pollfd pfd = { m_listenFd, POLLIN, 0 };
+        if (::poll(&pfd, 1, 500) <= 0) continue;
+
+        int fd = ::accept(m_listenFd, nullptr, nullptr);
+        if (fd < 0) continue;
+
+        // read (and ignore) the request; the scraper only ever asks for one thing
+        char req[1024];
+        struct pollfd rfd = { fd, POLLIN, 0 };
+        if (::poll(&rfd, 1, 1000) > 0) (void) ::recv(fd, req, sizeof(req), 0);
+
+        std::string body, response;
+        render(body);
+        response = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " +
+          std::to_string(body.length()) + "\r\nConnection: close\r\n\r\n" + body;
+        size_t sent = 0;
+        while (sent < response.length()) {
+          ssize_t n = ::send(fd, response.data() + sent, response.length() - sent, MSG_NOSIGNAL);
+          if (n <= 0) break;
+          sent += n;
+        }
+        ::close(fd);
+      }
+    }
+
+    std::string m_module;
+    std::atomic<uint64_t> m_active;
+    std::atomic<uint64_t> m_total;
+    std::atomic<uint64_t> m_results;
+    std::atomic<uint64_t> m_finalResults;
+    std::atomic<uint64_t> m_reconnects;
+    std::atomic<uint64_t> m_tlsHandshakes;
+    std::atomic<uint64_t> m_tlsResumed;
+    std::atomic<uint64_t> m_bytesSent;
+    std::atomic<uint64_t> m_framesDropped;
+    Histogram m_connect;
+    Histogram m_firstResult;
+    ErrorCounts m_errors;
+    HdrHistogram m_hdrConnect;
+    HdrHistogram m_hdrReady;
+    HdrHistogram m_hdrFirstAudio;
+    HdrHistogram m_hdrFirstInterim;
+    HdrHistogram m_hdrFirstFinal;
+    HdrHistogram m_hdrFrame;
+
+    int m_listenFd;
+    std::atomic<bool> m_stopHttp;
+    std::thread m_httpThread;
+  };
+
+  inline Registry& instance() {
+    static Registry registry;
+    return registry;
+  }
+
+  /**
+   * Marks on a stream's timeline, in now_usecs() time.  They are templates over the owner so the C
+   * per-session structs can carry the same int64_t mark_* fields as Marks, which C++ owners embed.
+   *
+   *   connect:      mark_connect_start -> mark_connected
+   *   ready:        mark_init -> mark_connected
+   *   firstAudio:   mark_init -> first audio handed to the connection
+   *   firstInterim: first audio (or connect, if audio was queued before it) -> first interim result
+   *   firstFinal:   the same, to the first final result
+   */
+  struct Marks {
+    Marks() : mark_init(0), mark_connect_start(0), mark_connected(0), mark_first_audio(0),
+      mark_first_interim(0), mark_first_final(0) {}
+
+    int64_t mark_init;
+    int64_t mark_connect_start;
+    int64_t mark_connected;
+    int64_t mark_first_audio;
+    int64_t mark_first_interim;
+    int64_t mark_first_final;
+  };
+
+  template <typename T> inline void mark_init(T& s) {
+    s.mark_init = now_usecs();
+  }
+
+  template <typename T> inline void mark_connect_start(T& s) {
+    s.mark_connect_start = now_usecs();
+  }
+
+  template <typename T> inline void mark_connected(T& s) {
+    int64_t now = now_usecs();
+    s.mark_connected = now;
+    instance().connected(now - s.mark_connect_start);
+    if (s.mark_init) instance().ready(now - s.mark_init);
+  }
+
+  template <typename T> inline void mark_audio_sent(T& s) {
+    if (s.mark_first_audio) return;
+    s.mark_first_audio = now_usecs();
+    if (s.mark_init) instance().firstAudio(s.mark_first_audio - s.mark_init);
+  }
+
+  template <typename T> inline void mark_result(T& s, bool isFinal) {
+    int64_t& mark = isFinal ? s.mark_first_final : s.mark_first_interim;
+    bool first = !s.mark_first_interim && !s.mark_first_final;
+
+    instance().result(isFinal);
+    if (mark || !s.mark_first_audio) return;
+    mark = now_usecs();
+
+    int64_t usecs = mark - std::max(s.mark_first_audio, s.mark_connected);
+    if (first) instance().firstResult(usecs);
+    if (isFinal) instance().firstFinal(usecs);
+    else instance().firstInterim(usecs);
+  }
+
+  /**
+   * Times a media bug frame callback, i.e. the media thread's cost per frame, into the "frame"
+   * latency histogram; declare one at the top of the callback.
+   */
+  class FrameTimer {
+  public:
+    FrameTimer() : m_start(now_usecs()) {}
+    ~FrameTimer() { instance().frameProcessed(now_usecs() - m_start); }
+
+  private:
+    int64_t m_start;
+  };
+
+}
+}
+
+namespace stream_metrics = azure_transcribe::stream_metrics;
+
+#endif
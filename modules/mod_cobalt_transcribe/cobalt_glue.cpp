@@ -14,7 +14,9 @@
 namespace cobalt_asr = cobaltspeech::transcribe::v5;
 
 #include "mod_cobalt_transcribe.h"
+#include "resampler_pool.hpp"
 #include "simple_buffer.h"
+#include "stream_metrics.hpp"
 
 #define CHUNKSIZE (320)
 #define DEFAULT_CONTEXT_TOKEN "unk:default"
@@ -373,6 +375,7 @@ static void *SWITCH_THREAD_FUNC grpc_read_thread(switch_thread_t *thread, void *
     }
     if (response.has_error()) {
       switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "grpc_read_thread: error: %s\n", response.error().message().c_str()) ;
+      stream_metrics::instance().error("vendor_error");
     }
     if (!response.has_result()) {
       switch_core_session_rwunlock(session);
@@ -382,6 +385,7 @@ static void *SWITCH_THREAD_FUNC grpc_read_thread(switch_thread_t *thread, void *
     const auto& result = response.result();
     auto is_final = !result.is_partial();
     auto audio_channel = result.audio_channel();
+    stream_metrics::mark_result(*cb, is_final);
 
     cJSON * jResult = cJSON_CreateObject();
     cJSON * jAlternatives = cJSON_CreateArray();
@@ -445,6 +449,7 @@ static void *SWITCH_THREAD_FUNC grpc_read_thread(switch_thread_t *thread, void *
     switch_core_session_t* session = switch_core_session_locate(cb->sessionId);
     if (session) {
       grpc::Status status = streamer->finish();
+      if (!status.ok()) stream_metrics::instance().error(status.error_code());
       switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "grpc_read_thread: finish() status %s (%d)\n", status.error_message().c_str(), status.error_code()) ;
       switch_core_session_rwunlock(session);
     }
@@ -582,10 +587,12 @@ extern "C" {
 
 
     switch_status_t cobalt_speech_init() {
+      stream_metrics::instance().init("cobalt_transcribe");
       return SWITCH_STATUS_SUCCESS;
     }
 
     switch_status_t cobalt_speech_cleanup() {
+      stream_metrics::instance().shutdown();
       return SWITCH_STATUS_SUCCESS;
     }
     switch_status_t cobalt_speech_session_init(switch_core_session_t *session, responseHandler_t responseHandler, char* hostport,
@@ -598,6 +605,7 @@ extern "C" {
       int err;
 
       cb =(struct cap_cb *) switch_core_session_alloc(session, sizeof(*cb));
+      stream_metrics::mark_init(*cb);
       strncpy(cb->sessionId, switch_core_session_get_uuid(session), MAX_SESSION_ID);
       strncpy(cb->bugname, bugname, MAX_BUG_LEN);
       cb->end_of_utterance = 0;
@@ -605,7 +613,7 @@ extern "C" {
       switch_mutex_init(&cb->mutex, SWITCH_MUTEX_NESTED, switch_core_session_get_pool(session));
       if (sampleRate != 8000) {
           switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "cobalt_speech_session_init:  initializing resampler\n");
-          cb->resampler = speex_resampler_init(channels, sampleRate, 8000, SWITCH_RESAMPLE_QUALITY, &err);
+          cb->resampler = resampler_pool::acquire(channels, sampleRate, 8000, SWITCH_RESAMPLE_QUALITY, &err);
         if (0 != err) {
            switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "%s: Error initializing resampler: %s.\n",
                                  switch_channel_get_name(channel), speex_resampler_strerror(err));
@@ -659,8 +667,11 @@ extern "C" {
 
       if (!cb->vad) {
         switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "cobalt_speech_session_init:  no vad so connecting to cobalt immediately\n");
+        stream_metrics::mark_connect_start(*cb);
         streamer->connect();
+        stream_metrics::mark_connected(*cb);
       }
+      stream_metrics::instance().streamStarted();
 
       // create the read thread
       switch_threadattr_t *thd_attr = NULL;
@@ -703,9 +714,10 @@ extern "C" {
           delete streamer;
           cb->streamer = NULL;
         }
+        stream_metrics::instance().streamEnded();
 
         if (cb->resampler) {
-          speex_resampler_destroy(cb->resampler);
+          resampler_pool::release(cb->resampler);
         }
         if (cb->vad) {
           switch_vad_destroy(&cb->vad);
@@ -728,6 +740,7 @@ extern "C" {
     }
 
     switch_bool_t cobalt_speech_frame(switch_media_bug_t *bug, void* user_data) {
+    	stream_metrics::FrameTimer timer;
     	switch_core_session_t *session = switch_core_media_bug_get_session(bug);
     	struct cap_cb *cb = (struct cap_cb *) user_data;
 		  if (cb->streamer && !cb->end_of_utterance) {
@@ -740,11 +753,17 @@ extern "C" {
         if (switch_mutex_trylock(cb->mutex) == SWITCH_STATUS_SUCCESS) {
           while (switch_core_media_bug_read(bug, &frame, SWITCH_TRUE) == SWITCH_STATUS_SUCCESS && !switch_test_flag((&frame), SFF_CNG)) {
             if (frame.datalen) {
+              size_t len;
+              bool ok;
+
+              media_clock_advance(session, cb, frame.samples);
               if (cb->vad && !streamer->isConnected()) {
                 switch_vad_state_t state = switch_vad_process(cb->vad, (int16_t*) frame.data, frame.samples);
                 if (state == SWITCH_VAD_STATE_START_TALKING) {
                   switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_INFO, "detected speech, connect to google speech now\n");
+                  stream_metrics::mark_connect_start(*cb);
                   streamer->connect();
+                  stream_metrics::mark_connected(*cb);
                   cb->responseHandler(session, "vad_detected", cb->bugname, NULL);
                 }
               }
@@ -753,18 +772,25 @@ extern "C" {
                 spx_int16_t out[SWITCH_RECOMMENDED_BUFFER_SIZE];
                 spx_uint32_t out_len = SWITCH_RECOMMENDED_BUFFER_SIZE;
                 spx_uint32_t in_len = frame.samples;
-                size_t written;
 
                 speex_resampler_process_interleaved_int(cb->resampler,
                   (const spx_int16_t *) frame.data,
                   (spx_uint32_t *) &in_len,
                   &out[0],
                   &out_len);
-                streamer->write( &out[0], sizeof(spx_int16_t) * out_len);
+                len = sizeof(spx_int16_t) * out_len;
+                ok = streamer->write( &out[0], len);
               }
               else {
-                streamer->write( frame.data, sizeof(spx_int16_t) * frame.samples);
+                len = sizeof(spx_int16_t) * frame.samples;
+                ok = streamer->write( frame.data, len);
+              }
+              if (ok) {
+                media_clock_stream_start(cb, frame.samples);
+                stream_metrics::mark_audio_sent(*cb);
+                stream_metrics::instance().bytesSent(len);
               }
+              else stream_metrics::instance().framesDropped(1);
             }
           }
           switch_mutex_unlock(cb->mutex);
@@ -772,4 +798,20 @@ extern "C" {
       }
       return SWITCH_TRUE;
     }
+
+    switch_status_t cobalt_speech_metrics(switch_stream_handle_t *stream) {
+      std::string text;
+
+      stream_metrics::instance().render(text);
+      stream->write_function(stream, "%s", text.c_str());
+      return SWITCH_STATUS_SUCCESS;
+    }
+
+    switch_status_t cobalt_speech_latency(switch_stream_handle_t *stream) {
+      std::string text;
+
+      stream_metrics::instance().latency(text);
+      stream->write_function(stream, "%s", text.c_str());
+      return SWITCH_STATUS_SUCCESS;
+    }
 }
@@ -10,5 +10,7 @@ switch_bool_t cobalt_speech_frame(switch_media_bug_t *bug, void* user_data);
 switch_status_t cobalt_speech_list_models(switch_core_session_t *session, char* hostport);
 switch_status_t cobalt_speech_get_version(switch_core_session_t *session, char* hostport);
 switch_status_t cobalt_speech_compile_context(switch_core_session_t *session, char* hostport, char* model, char* token, char* phrases);
+switch_status_t cobalt_speech_metrics(switch_stream_handle_t *stream);
+switch_status_t cobalt_speech_latency(switch_stream_handle_t *stream);
 
 #endif
\ No newline at end of file
@@ -20,10 +20,27 @@ SWITCH_MODULE_DEFINITION(mod_cobalt_transcribe, mod_transcribe_load, mod_transcr
 
 static switch_status_t do_stop(switch_core_session_t *session, char* bugname);
 
+/* offset of the end of the audio a cobalt result: the start_time_ms plus duration_ms of its first alternative; -1 if it has none */
+static int64_t result_audio_ms(const char* json) {
+	int64_t audio_ms = -1;
+	cJSON* jMessage = cJSON_Parse(json);
+	if (jMessage) {
+		cJSON* jAlt = cJSON_GetArrayItem(cJSON_GetObjectItem(jMessage, "alternatives"), 0);
+		cJSON* jStart = jAlt ? cJSON_GetObjectItem(jAlt, "start_time_ms") : NULL;
+		cJSON* jDuration = jAlt ? cJSON_GetObjectItem(jAlt, "duration_ms") : NULL;
+		if (cJSON_IsNumber(jStart) && cJSON_IsNumber(jDuration)) {
+			audio_ms = (int64_t) (jStart->valuedouble + jDuration->valuedouble);
+		}
+		cJSON_Delete(jMessage);
+	}
+	return audio_ms;
+}
+
 static void responseHandler(switch_core_session_t* session, const char * json, const char* bugname, 
 	const char* details) {
 	switch_event_t *event;
 	switch_channel_t *channel = switch_core_session_get_channel(session);
+	int64_t audio_ms = -1;
 
 	if (0 == strcmp("vad_detected", json)) {
 		switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, TRANSCRIBE_EVENT_VAD_DETECTED);
@@ -43,8 +60,10 @@ static void responseHandler(switch_core_session_t* session, const char * json, c
 		switch_channel_event_set_data(channel, event);
 		switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "transcription-vendor", "cobalt");
 		switch_event_add_body(event, "%s", json);
+		audio_ms = result_audio_ms(json);
 	}
 	if (bugname) switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "media-bugname", bugname);
+	media_clock_stamp(session, bugname, event, audio_ms);
 	switch_event_fire(&event);
 }
 
@@ -297,6 +316,14 @@ SWITCH_STANDARD_API(compile_context_function)
 	return SWITCH_STATUS_SUCCESS;
 }
 
+#define METRICS_API_SYNTAX "[latency]"
+SWITCH_STANDARD_API(metrics_function)
+{
+	if (!zstr(cmd) && 0 == strcasecmp(cmd, "latency")) cobalt_speech_latency(stream);
+	else cobalt_speech_metrics(stream);
+	return SWITCH_STATUS_SUCCESS;
+}
+
 SWITCH_MODULE_LOAD_FUNCTION(mod_transcribe_load)
 {
 	switch_api_interface_t *api_interface;
@@ -346,6 +373,7 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_transcribe_load)
 	switch_console_set_complete("add uuid_cobalt_compile_context hostport token phrases");
 
 	SWITCH_ADD_API(api_interface, "uuid_cobalt_get_version", "Soniox Speech Transcription API", version_function, TRANSCRIBE_API_VERSION_SYNTAX);
+	SWITCH_ADD_API(api_interface, "cobalt_transcribe_metrics", "Cobalt Speech Transcription metrics in prometheus text format", metrics_function, METRICS_API_SYNTAX);
 	switch_console_set_complete("add uuid_cobalt_get_version hostport");
 
 	/* indicate that the module should continue to be loaded */
@@ -34,6 +34,60 @@ struct cap_cb {
 	int end_of_utterance;
 	switch_vad_t * vad;
 	uint32_t samples_per_second;
+	/* media clock, see media_clock_advance */
+	switch_time_t media_start;
+	uint64_t media_samples;
+	uint32_t media_rate;
+	uint64_t stream_start_samples;	/* media_samples when audio was first sent to the recognizer */
+	int stream_started;
+	/* stream latency marks, see stream_metrics.hpp */
+	int64_t mark_init;
+	int64_t mark_connect_start;
+	int64_t mark_connected;
+	int64_t mark_first_audio;
+	int64_t mark_first_interim;
+	int64_t mark_first_final;
 };
 
+/* media clock: advanced by the media thread for every frame read from the bug, used to stamp events */
+static inline void media_clock_advance(switch_core_session_t *session, struct cap_cb *p, uint32_t samples) {
+	if (!p->media_start) {
+		switch_codec_implementation_t read_impl = { 0 };
+		switch_core_session_get_read_impl(session, &read_impl);
+		p->media_rate = read_impl.samples_per_second;
+		p->media_start = switch_micro_time_now();
+	}
+	p->media_samples += samples;
+}
+
+/* media clock: called for every frame sent to the recognizer, to note where its own timeline begins */
+static inline void media_clock_stream_start(struct cap_cb *p, uint32_t samples) {
+	if (!p->stream_started) {
+		p->stream_started = 1;
+		p->stream_start_samples = p->media_samples - samples;
+	}
+}
+
+/* adds media-time-ms (offset of the audio the event refers to: audio_ms is relative to the first audio sent to
+  the recognizer, as its result offsets are, or -1 for the latest audio read) and event-time (wall clock, usecs);
+  given an offset, also processing-latency-ms (event-time minus the time that audio arrived).  Pass -1 when the
+  recognizer gives no offset, since the latest audio read says nothing about its latency */
+static inline void media_clock_stamp(switch_core_session_t *session, const char *bugname, switch_event_t *event, int64_t audio_ms) {
+	switch_channel_t *channel = switch_core_session_get_channel(session);
+	switch_media_bug_t *bug = (switch_media_bug_t *) switch_channel_get_private(channel, bugname ? bugname : MY_BUG_NAME);
+	struct cap_cb *p = bug ? (struct cap_cb *) switch_core_media_bug_get_user_data(bug) : NULL;
+	switch_time_t now = switch_micro_time_now();
+	int latency = audio_ms >= 0;
+
+	if (!p || !p->media_start || !p->media_rate) return;
+	if (!latency) audio_ms = (int64_t) (p->media_samples * 1000 / p->media_rate);
+	else audio_ms += (int64_t) (p->stream_start_samples * 1000 / p->media_rate);
+	switch_event_add_header(event, SWITCH_STACK_BOTTOM, "media-time-ms", "%" SWITCH_INT64_T_FMT, audio_ms);
+	switch_event_add_header(event, SWITCH_STACK_BOTTOM, "event-time", "%" SWITCH_TIME_T_FMT, now);
+	if (latency) {
+		switch_event_add_header(event, SWITCH_STACK_BOTTOM, "processing-latency-ms", "%" SWITCH_INT64_T_FMT,
+			(int64_t) ((now - p->media_start) / 1000) - audio_ms);
+	}
+}
+
 #endif
\ No newline at end of file
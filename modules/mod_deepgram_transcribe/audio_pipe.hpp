@@ -2,12 +2,15 @@
 #define __DG_AUDIO_PIPE_HPP__
 
 #include <string>
+#include <vector>
 #include <list>
 #include <mutex>
 #include <future>
 #include <queue>
 #include <unordered_map>
 #include <thread>
+#include <chrono>
+#include <condition_variable>
 
 #include <libwebsockets.h>
 
@@ -43,6 +46,13 @@ public:
   static bool deinitialize();
   static bool lws_service_thread(unsigned int nServiceThread);
 
+  // warm standby connections: for each host, path and key that sessions have asked for within the last ttlSecs,
+  // keep up to size connected pipes waiting; idle pipes are sent keepalive every keepaliveSecs and closed after ttlSecs
+  static void initializePool(unsigned int size, unsigned int ttlSecs, const char* keepalive, unsigned int keepaliveSecs);
+  // a connected pipe from the pool, now belonging to this session, or nullptr if none is waiting
+  static AudioPipe* claim(const char* uuid, const char* host, unsigned int port, const char* path, 
+    size_t bufLen, size_t minFreespace, const char* apiKey, notifyHandler_t callback);
+
   // constructor
   AudioPipe(const char* uuid, const char* host, unsigned int port, const char* path, 
     size_t bufLen, size_t minFreespace, const char* apiKey, notifyHandler_t callback);
@@ -67,7 +77,10 @@ public:
     m_audio_buffer_write_offset += len;
   }
   void binaryWritePtrResetToZero(void) {
-    m_audio_buffer_write_offset = 0;
+    m_audio_buffer_write_offset = LWS_PRE;
+  }
+  size_t binaryBufferedBytes(void) {
+    return m_audio_buffer_write_offset - LWS_PRE;
   }
   void lockAudioBuffer(void) {
     m_audio_mutex.lock();
@@ -104,9 +117,33 @@ private:
   static std::unordered_map<std::thread::id, bool> stopFlags;
   static std::queue<std::thread::id> threadIds;
 
+  struct PoolDemand {
+    std::string host;
+    unsigned int port;
+    std::string path;
+    std::string apiKey;
+    size_t bufLen;
+    size_t minFreespace;
+    notifyHandler_t callback;
+    std::chrono::steady_clock::time_point lastClaim;
+    std::list<AudioPipe*> pipes;
+  };
+  static std::mutex mutex_pool;
+  static std::unordered_map<std::string, PoolDemand> pool;
+  static std::list<AudioPipe*> poolClosing;
+  static unsigned int poolSize;
+  static unsigned int poolTtlSecs;
+  static std::string poolKeepalive;
+  static unsigned int poolKeepaliveSecs;
+  static bool poolStop;
+  static std::condition_variable poolCv;
+  static std::thread poolThread;
+  static void poolMaintenance(void);
+
   static AudioPipe* findAndRemovePendingConnect(struct lws *wsi);
   static AudioPipe* findPendingConnect(struct lws *wsi);
   static void addPendingConnect(AudioPipe* ap);
+  static void setResolved(AudioPipe* ap, const std::vector<std::string>& v6, const std::vector<std::string>& v4);
   static void addPendingDisconnect(AudioPipe* ap);
   static void addPendingWrite(AudioPipe* ap);
   static void processPendingConnects(lws_per_vhost_data *vhd);
@@ -114,9 +151,14 @@ private:
   static void processPendingWrites(void);
   
   bool connect_client(struct lws_per_vhost_data *vhd);
+  void connect_attempt(int n);
+  bool connect_fallback(struct lws *wsi);
+  void notify(NotifyEvent_t event, const char* message);
+  void adopt(const char* uuid, size_t bufLen, size_t minFreespace);
 
   LwsState_t m_state;
   std::string m_uuid;
+  std::mutex m_uuid_mutex;
   std::string m_host;
   unsigned int m_port;
   std::string m_path;
@@ -125,6 +167,12 @@ private:
   std::mutex m_audio_mutex;
   int m_sslFlags;
   struct lws *m_wsi;
+  // resolved addresses for the preferred and the other address family, and the connection attempt to each;
+  // the first to connect becomes m_wsi
+  std::string m_address[2];
+  struct lws *m_attempt[2];
+  bool m_resolved;
+  bool m_fallbackStarted;
   uint8_t *m_audio_buffer;
   size_t m_audio_buffer_max_len;
   size_t m_audio_buffer_write_offset;
@@ -140,6 +188,8 @@ private:
   bool m_finished;
   std::string m_bugname;
   std::promise<void> m_promise;
+  std::chrono::steady_clock::time_point m_pooledAt;
+  std::chrono::steady_clock::time_point m_keepaliveAt;
 };
 
 } // namespace deepgram
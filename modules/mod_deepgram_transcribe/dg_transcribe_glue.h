@@ -7,5 +7,7 @@ switch_status_t dg_transcribe_session_init(switch_core_session_t *session, respo
 		uint32_t samples_per_second, uint32_t channels, char* lang, int interim, char* bugname, void **ppUserData);
 switch_status_t dg_transcribe_session_stop(switch_core_session_t *session, int channelIsClosing, char* bugname);
 switch_bool_t dg_transcribe_frame(switch_core_session_t *session, switch_media_bug_t *bug);
+switch_status_t dg_transcribe_metrics(switch_stream_handle_t *stream);
+switch_status_t dg_transcribe_latency(switch_stream_handle_t *stream);
 
 #endif
\ No newline at end of file
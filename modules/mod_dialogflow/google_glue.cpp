@@ -17,7 +17,9 @@
 #include "google/cloud/dialogflow/v2beta1/session.grpc.pb.h"
 
 #include "mod_dialogflow.h"
+#include "resampler_pool.hpp"
 #include "parser.h"
+#include "stream_metrics.hpp"
 
 using google::cloud::dialogflow::v2beta1::Sessions;
 using google::cloud::dialogflow::v2beta1::StreamingDetectIntentRequest;
@@ -119,6 +121,8 @@ public:
 		switch_channel_t* channel = switch_core_session_get_channel(session);
 		std::vector<std::string> tokens;
 		const char delim = ':';
+
+		stream_metrics::mark_init(m_marks);
 		tokenize(projectId, delim, tokens);
 		int idx = 0;
 		for (auto &s: tokens) {
@@ -246,8 +250,10 @@ public:
             sentimentAnalysisConfig->set_analyze_query_text_sentiment(m_sentimentAnalysis);
         }
 
+		stream_metrics::mark_connect_start(m_marks);
 		m_streamer = m_stub->StreamingDetectIntent(m_context.get());
 		m_streamer->Write(*m_request);
+		stream_metrics::mark_connected(m_marks);
 	}
 	bool write(void* data, uint32_t datalen) {
 		if (m_finished) {
@@ -260,6 +266,7 @@ public:
 		m_request->set_input_audio(data, datalen);
 
 		m_packets++;
+		stream_metrics::mark_audio_sent(m_marks);
     return m_streamer->Write(*m_request);
 
 	}
@@ -283,6 +290,10 @@ public:
 		return m_finished;
 	}
 
+	void gotResult(bool isFinal) {
+		stream_metrics::mark_result(m_marks, isFinal);
+	}
+
     bool isAnyOutputAudioConfigChanged() {
         return m_speakingRate|| m_pitch || m_volume || !m_voiceName.empty() || !m_voiceGender.empty() || !m_effects.empty();
     }
@@ -307,6 +318,7 @@ private:
 	bool m_sentimentAnalysis;
 	bool m_finished;
 	uint32_t m_packets;
+	stream_metrics::Marks m_marks;
 };
 
 static void killcb(struct cap_cb* cb) {
@@ -317,7 +329,7 @@ static void killcb(struct cap_cb* cb) {
 			cb->streamer = NULL;
 		}
 		if (cb->resampler) {
-				speex_resampler_destroy(cb->resampler);
+				resampler_pool::release(cb->resampler);
 				cb->resampler = NULL;
 		}
 	}
@@ -344,6 +356,7 @@ static void *SWITCH_THREAD_FUNC grpc_read_thread(switch_thread_t *thread, void *
 				char* json = cJSON_PrintUnformatted(jResponse);
 				const char* type = DIALOGFLOW_EVENT_TRANSCRIPTION;
 
+				streamer->gotResult(response.has_query_result() || response.recognition_result().is_final());
 				if (response.has_query_result()) type = DIALOGFLOW_EVENT_INTENT;
 				else {
 					const StreamingRecognitionResult_MessageType& o = response.recognition_result().message_type();
@@ -412,6 +425,7 @@ static void *SWITCH_THREAD_FUNC grpc_read_thread(switch_thread_t *thread, void *
 		grpc::Status status = streamer->finish();
 		if (!status.ok()) {
 			std::ostringstream s;
+			stream_metrics::instance().error(status.error_code());
 			s << "{\"msg\": \"" << status.error_message() << "\", \"code\": " << status.error_code();
 			if (status.error_details().length() > 0) {
 				s << ", \"details\": \"" << status.error_details() << "\"";
@@ -438,10 +452,12 @@ extern "C" {
 		else {
 			hasDefaultCredentials = true;
 		}
+		stream_metrics::instance().init("dialogflow");
 		return SWITCH_STATUS_SUCCESS;
 	}
 	
 	switch_status_t google_dialogflow_cleanup() {
+		stream_metrics::instance().shutdown();
 		return SWITCH_STATUS_SUCCESS;
 	}
 
@@ -484,7 +500,7 @@ extern "C" {
 		strncpy(cb->lang, lang, MAX_LANG);
 		strncpy(cb->projectId, lang, MAX_PROJECT_ID);
 		cb->streamer = new GStreamer(session, lang, projectId, event, text);
-		cb->resampler = speex_resampler_init(1, 8000, 16000, SWITCH_RESAMPLE_QUALITY, &err);
+		cb->resampler = resampler_pool::acquire(1, 8000, 16000, SWITCH_RESAMPLE_QUALITY, &err);
 		if (0 != err) {
 			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "%s: Error initializing resampler: %s.\n", 
 						switch_channel_get_name(channel), speex_resampler_strerror(err));
@@ -500,6 +516,7 @@ extern "C" {
 		//switch_threadattr_detach_set(thd_attr, 1);
 		switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
 		switch_thread_create(&cb->thread, thd_attr, grpc_read_thread, cb, pool);
+		stream_metrics::instance().streamStarted();
 
 		*ppUserData = cb;
 	
@@ -536,6 +553,7 @@ extern "C" {
 				switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_INFO, "google_dialogflow_session_cleanup: read thread completed\n");
 			}
 			killcb(cb);
+			stream_metrics::instance().streamEnded();
 
 			switch_channel_set_private(channel, MY_BUG_NAME, NULL);
 			if (!channelIsClosing) switch_core_media_bug_remove(session, &bug);
@@ -551,6 +569,7 @@ extern "C" {
 	}
 	
 	switch_bool_t google_dialogflow_frame(switch_media_bug_t *bug, void* user_data) {
+		stream_metrics::FrameTimer timer;
 		switch_core_session_t *session = switch_core_media_bug_get_session(bug);
 		uint8_t data[SWITCH_RECOMMENDED_BUFFER_SIZE];
 		switch_frame_t frame = {};
@@ -567,11 +586,11 @@ extern "C" {
 						spx_int16_t out[SWITCH_RECOMMENDED_BUFFER_SIZE];
 						spx_uint32_t out_len = SWITCH_RECOMMENDED_BUFFER_SIZE;
 						spx_uint32_t in_len = frame.samples;
-						size_t written;
 						
 						speex_resampler_process_interleaved_int(cb->resampler, (const spx_int16_t *) frame.data, (spx_uint32_t *) &in_len, &out[0], &out_len);
 						
-						streamer->write( &out[0], sizeof(spx_int16_t) * out_len);
+						if (streamer->write( &out[0], sizeof(spx_int16_t) * out_len)) stream_metrics::instance().bytesSent(sizeof(spx_int16_t) * out_len);
+						else stream_metrics::instance().framesDropped(1);
 					}
 				}
 			}
@@ -592,4 +611,19 @@ extern "C" {
 		killcb(cb);
 	}
 
+	switch_status_t google_dialogflow_metrics(switch_stream_handle_t *stream) {
+		std::string text;
+
+		stream_metrics::instance().render(text);
+		stream->write_function(stream, "%s", text.c_str());
+		return SWITCH_STATUS_SUCCESS;
+	}
+
+	switch_status_t google_dialogflow_latency(switch_stream_handle_t *stream) {
+		std::string text;
+
+		stream_metrics::instance().latency(text);
+		stream->write_function(stream, "%s", text.c_str());
+		return SWITCH_STATUS_SUCCESS;
+	}
 }
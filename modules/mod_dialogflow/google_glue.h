@@ -7,6 +7,8 @@ switch_status_t google_dialogflow_session_init(switch_core_session_t *session, r
 		uint32_t samples_per_second, char* lang, char* projectId, char* welcomeEvent, char *text, struct cap_cb **cb);
 switch_status_t google_dialogflow_session_stop(switch_core_session_t *session, int channelIsClosing);
 switch_bool_t google_dialogflow_frame(switch_media_bug_t *bug, void* user_data);
+switch_status_t google_dialogflow_metrics(switch_stream_handle_t *stream);
+switch_status_t google_dialogflow_latency(switch_stream_handle_t *stream);
 
 void destroyChannelUserData(struct cap_cb* cb);
 #endif
\ No newline at end of file
@@ -225,6 +225,14 @@ SWITCH_STANDARD_API(dialogflow_api_stop_function)
 
 
 /* Macro expands to: switch_status_t mod_dialogflow_load(switch_loadable_module_interface_t **module_interface, switch_memory_pool_t *pool) */
+#define METRICS_API_SYNTAX "[latency]"
+SWITCH_STANDARD_API(metrics_function)
+{
+	if (!zstr(cmd) && 0 == strcasecmp(cmd, "latency")) google_dialogflow_latency(stream);
+	else google_dialogflow_metrics(stream);
+	return SWITCH_STATUS_SUCCESS;
+}
+
 SWITCH_MODULE_LOAD_FUNCTION(mod_dialogflow_load)
 {
 	switch_api_interface_t *api_interface;
@@ -266,6 +274,7 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_dialogflow_load)
 
 	SWITCH_ADD_API(api_interface, "dialogflow_start", "Start a google dialogflow", dialogflow_api_start_function, DIALOGFLOW_API_START_SYNTAX);
 	SWITCH_ADD_API(api_interface, "dialogflow_stop", "Terminate a google dialogflow", dialogflow_api_stop_function, DIALOGFLOW_API_STOP_SYNTAX);
+	SWITCH_ADD_API(api_interface, "dialogflow_metrics", "Google Dialogflow metrics in prometheus text format", metrics_function, METRICS_API_SYNTAX);
 
 	switch_console_set_complete("add dialogflow_stop");
 	switch_console_set_complete("add dialogflow_start project lang");
@@ -1,6 +1,10 @@
 #include <cstdlib>
 #include <algorithm>
 #include <future>
+#include <chrono>
+#include <list>
+#include <mutex>
+#include <unordered_map>
 
 #include <switch.h>
 #include <switch_json.h>
@@ -11,7 +15,9 @@
 #include <switch_json.h>
 
 #include "mod_google_transcribe.h"
+#include "resampler_pool.hpp"
 #include "simple_buffer.h"
+#include "stream_metrics.hpp"
 
 using google::cloud::speech::v1p1beta1::RecognitionConfig;
 using google::cloud::speech::v1p1beta1::Speech;
@@ -55,6 +61,74 @@ namespace {
       return 1; //The strings are same
    return 0; //not matched
   }
+
+  static const char *requestedPoolSize = std::getenv("GOOGLE_TRANSCRIBE_POOL_SIZE");
+  static unsigned int nPoolSize = std::max(0, std::min(requestedPoolSize ? ::atoi(requestedPoolSize) : 0, 100));
+  static const char *requestedPoolTtlSecs = std::getenv("GOOGLE_TRANSCRIBE_POOL_TTL_SECS");
+  static unsigned int nPoolTtlSecs = std::max(1, requestedPoolTtlSecs ? ::atoi(requestedPoolTtlSecs) : 300);
+
+  struct PooledChannel {
+    std::shared_ptr<grpc::Channel> channel;
+    std::chrono::steady_clock::time_point created;
+  };
+  static std::mutex poolMutex;
+  static std::unordered_map<std::string, std::list<PooledChannel> > channelPool;
+
+  std::shared_ptr<grpc::Channel> createChannel(const char* uri, const char* credentials) {
+    if (credentials) {
+      auto channelCreds = grpc::SslCredentials(grpc::SslCredentialsOptions());
+      auto callCreds = grpc::ServiceAccountJWTAccessCredentials(credentials);
+      auto creds = grpc::CompositeChannelCredentials(channelCreds, callCreds);
+      return grpc::CreateChannel(uri, creds);
+    }
+    return grpc::CreateChannel(uri, grpc::GoogleDefaultCredentials());
+  }
+
+  /* with GOOGLE_TRANSCRIBE_POOL_SIZE set, hand out channels that were created (and asked to connect) ahead of time,
+    so a stream starts without waiting on dns, tcp, tls and http/2 setup; each claim tops the pool for that endpoint
+    back up, and channels that have waited longer than GOOGLE_TRANSCRIBE_POOL_TTL_SECS are discarded.  Creating a
+    channel loads credentials, so that is done outside the pool lock and never holds up another session's claim */
+  std::shared_ptr<grpc::Channel> claimChannel(const char* uri, const char* credentials) {
+    std::shared_ptr<grpc::Channel> channel;
+    size_t missing;
+    if (!nPoolSize) return createChannel(uri, credentials);
+
+    auto now = std::chrono::steady_clock::now();
+    std::string key = std::string(uri) + " " + (credentials ? credentials : "");
+    {
+      std::lock_guard<std::mutex> lock(poolMutex);
+      auto& channels = channelPool[key];
+      while (!channels.empty()) {
+        PooledChannel pooled = channels.front();
+        channels.pop_front();
+        if (now - pooled.created < std::chrono::seconds(nPoolTtlSecs) &&
+          GRPC_CHANNEL_SHUTDOWN != pooled.channel->GetState(false)) {
+          channel = pooled.channel;
+          break;
+        }
+      }
+      missing = nPoolSize - channels.size();
+    }
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "claimChannel: %s warm channel for %s\n", channel ? "using a" : "no", uri);
+    if (!channel) channel = createChannel(uri, credentials);
+
+    std::list<PooledChannel> fresh;
+    while (fresh.size() < missing) {
+      PooledChannel pooled = { createChannel(uri, credentials), std::chrono::steady_clock::now() };
+      pooled.channel->GetState(true);
+      fresh.push_back(pooled);
+    }
+    if (!fresh.empty()) {
+      // claims racing with this one may have refilled the pool already
+      std::lock_guard<std::mutex> lock(poolMutex);
+      auto& channels = channelPool[key];
+      while (!fresh.empty() && channels.size() < nPoolSize) {
+        channels.push_back(fresh.front());
+        fresh.pop_front();
+      }
+    }
+    return channel;
+  }
 }
 class GStreamer;
 
@@ -62,6 +136,7 @@ class GStreamer {
 public:
 	GStreamer(
     switch_core_session_t *session, 
+    struct cap_cb *cb,
     uint32_t channels, 
     char* lang, 
     int interim, 
@@ -75,8 +150,8 @@ public:
     int punctuation, 
     const char* model, 
     int enhanced, 
-		const char* hints) : m_session(session), m_writesDone(false), m_connected(false), 
-      m_audioBuffer(CHUNKSIZE, 15) {
+		const char* hints) : m_session(session), m_cb(cb), m_writesDone(false), m_connected(false), m_retired(false),
+      m_offsetMs(0), m_overlapMs(0), m_audioBuffer(CHUNKSIZE, 15) {
   
     const char* var;
     const char* google_uri;
@@ -85,16 +160,7 @@ public:
     if (!(google_uri = switch_channel_get_variable(channel, "GOOGLE_SPEECH_TO_TEXT_URI"))) {
       google_uri = "speech.googleapis.com";
     }
-		if (var = switch_channel_get_variable(channel, "GOOGLE_APPLICATION_CREDENTIALS")) {
-			auto channelCreds = grpc::SslCredentials(grpc::SslCredentialsOptions());
-			auto callCreds = grpc::ServiceAccountJWTAccessCredentials(var);
-			auto creds = grpc::CompositeChannelCredentials(channelCreds, callCreds);
-			m_channel = grpc::CreateChannel(google_uri, creds);
-		}
-		else {
-			auto creds = grpc::GoogleDefaultCredentials();
-			m_channel = grpc::CreateChannel(google_uri, creds);
-		}
+		m_channel = claimChannel(google_uri, switch_channel_get_variable(channel, "GOOGLE_APPLICATION_CREDENTIALS"));
 
   	m_stub = Speech::NewStub(m_channel);
   		
@@ -278,8 +344,18 @@ public:
       if (case_insensitive_match("other_outdoor_device", var)) metadata->set_recording_device_type(RecognitionMetadata_RecordingDeviceType_OTHER_OUTDOOR_DEVICE);
       if (case_insensitive_match("other_indoor_device", var)) metadata->set_recording_device_type(RecognitionMetadata_RecordingDeviceType_OTHER_INDOOR_DEVICE);
     }
+
+    // audio requests overwrite the config (they are a oneof), so keep a copy for rollover streams
+    m_config = m_request;
 	}
 
+  // a stream with the same config on the same channel, to take over from this one before google's duration limit.
+  // offsetMs rebases its result times onto the first stream, and results within the first overlapMs are dropped,
+  // since this stream and the one it replaces both hear that audio
+  GStreamer* rollover(int64_t offsetMs, int64_t overlapMs) {
+    return new GStreamer(*this, offsetMs, overlapMs);
+  }
+
 	~GStreamer() {
 		//switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(m_session), SWITCH_LOG_INFO, "GStreamer::~GStreamer - deleting channel and stub: %p\n", (void*)this);
 	}
@@ -362,23 +438,55 @@ public:
     return m_connected;
   }
 
+  void retire() {
+    m_retired = true;
+    writesDone();
+  }
+
+  bool isRetired() {
+    return m_retired;
+  }
+
+  struct cap_cb* getCallback() {
+    return m_cb;
+  }
+
+  int64_t getOffsetMs() {
+    return m_offsetMs;
+  }
+
+  int64_t getOverlapMs() {
+    return m_overlapMs;
+  }
+
 private:
+  GStreamer(const GStreamer& other, int64_t offsetMs, int64_t overlapMs) : m_session(other.m_session), m_cb(other.m_cb),
+    m_channel(other.m_channel), m_stub(Speech::NewStub(other.m_channel)), m_request(other.m_config), m_config(other.m_config),
+    m_writesDone(false), m_connected(false), m_retired(false), m_offsetMs(offsetMs), m_overlapMs(overlapMs),
+    m_audioBuffer(CHUNKSIZE, 15) {
+  }
+
 	switch_core_session_t* m_session;
+  struct cap_cb* m_cb;
   grpc::ClientContext m_context;
 	std::shared_ptr<grpc::Channel> m_channel;
 	std::unique_ptr<Speech::Stub> 	m_stub;
 	std::unique_ptr< grpc::ClientReaderWriterInterface<StreamingRecognizeRequest, StreamingRecognizeResponse> > m_streamer;
 	StreamingRecognizeRequest m_request;
+	StreamingRecognizeRequest m_config;
   bool m_writesDone;
   bool m_connected;
+  bool m_retired;
+  int64_t m_offsetMs;
+  int64_t m_overlapMs;
   std::promise<void> m_promise;
   SimpleBuffer m_audioBuffer;
 };
 
 static void *SWITCH_THREAD_FUNC grpc_read_thread(switch_thread_t *thread, void *obj) {
   static int count;
-	struct cap_cb *cb = (struct cap_cb *) obj;
-	GStreamer* streamer = (GStreamer *) cb->streamer;
+	GStreamer* streamer = (GStreamer *) obj;
+	struct cap_cb *cb = streamer->getCallback();
 
   bool connected = streamer->waitForConnect();
   if (!connected) {
@@ -399,6 +507,7 @@ static void *SWITCH_THREAD_FUNC grpc_read_thread(switch_thread_t *thread, void *
     if (response.has_error()) {
       Status status = response.error();
       switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "grpc_read_thread: error %s (%d)\n", status.message().c_str(), status.code()) ;
+      stream_metrics::instance().error(status.code());
       cJSON* json = cJSON_CreateObject();
       cJSON_AddStringToObject(json, "type", "error");
       cJSON_AddStringToObject(json, "error", status.message().c_str());
@@ -414,18 +523,22 @@ static void *SWITCH_THREAD_FUNC grpc_read_thread(switch_thread_t *thread, void *
     
     for (int r = 0; r < response.results_size(); ++r) {
       auto result = response.results(r);
+      auto duration = result.result_end_time();
+      int32_t seconds = duration.seconds();
+      int64_t nanos = duration.nanos();
+      int span = (int) trunc(seconds * 1000. + ((float) nanos / 1000000.));
+
+      // the stream we rolled over from has already transcribed the overlap
+      if (streamer->getOverlapMs() && span <= streamer->getOverlapMs()) continue;
+
+      stream_metrics::mark_result(*cb, result.is_final());
       cJSON * jResult = cJSON_CreateObject();
       cJSON * jAlternatives = cJSON_CreateArray();
       cJSON * jStability = cJSON_CreateNumber(result.stability());
       cJSON * jIsFinal = cJSON_CreateBool(result.is_final());
       cJSON * jLanguageCode = cJSON_CreateString(result.language_code().c_str());
       cJSON * jChannelTag = cJSON_CreateNumber(result.channel_tag());
-
-      auto duration = result.result_end_time();
-      int32_t seconds = duration.seconds();
-      int64_t nanos = duration.nanos();
-      int span = (int) trunc(seconds * 1000. + ((float) nanos / 1000000.));
-      cJSON * jResultEndTime = cJSON_CreateNumber(span);
+      cJSON * jResultEndTime = cJSON_CreateNumber(span + streamer->getOffsetMs());
 
       cJSON_AddItemToObject(jResult, "stability", jStability);
       cJSON_AddItemToObject(jResult, "is_final", jIsFinal);
@@ -450,10 +563,10 @@ static void *SWITCH_THREAD_FUNC grpc_read_thread(switch_thread_t *thread, void *
             cJSON* jWord = cJSON_CreateObject();
             cJSON_AddItemToObject(jWord, "word", cJSON_CreateString(words.word().c_str()));
             if (words.has_start_time()) {
-              cJSON_AddItemToObject(jWord, "start_time", cJSON_CreateNumber(words.start_time().seconds()));
+              cJSON_AddItemToObject(jWord, "start_time", cJSON_CreateNumber(words.start_time().seconds() + streamer->getOffsetMs() / 1000));
             }
             if (words.has_end_time()) {
-              cJSON_AddItemToObject(jWord, "end_time", cJSON_CreateNumber(words.end_time().seconds()));
+              cJSON_AddItemToObject(jWord, "end_time", cJSON_CreateNumber(words.end_time().seconds() + streamer->getOffsetMs() / 1000));
             }
             int speaker_tag = words.speaker_tag();
             if (speaker_tag > 0) {
@@ -496,7 +609,12 @@ static void *SWITCH_THREAD_FUNC grpc_read_thread(switch_thread_t *thread, void *
     switch_core_session_t* session = switch_core_session_locate(cb->sessionId);
     if (session) {
       grpc::Status status = streamer->finish();
-      if (11 == status.error_code()) {
+      if (!status.ok()) stream_metrics::instance().error(status.error_code());
+      if (streamer->isRetired()) {
+        // replaced by a rollover stream, which carries on the transcription
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "grpc_read_thread: retired stream finished\n");
+      }
+      else if (11 == status.error_code()) {
         if (std::string::npos != status.error_message().find("Exceeded maximum allowed stream duration")) {
           cb->responseHandler(session, "max_duration_exceeded", cb->bugname);
         }
@@ -511,9 +629,59 @@ static void *SWITCH_THREAD_FUNC grpc_read_thread(switch_thread_t *thread, void *
   return nullptr;
 }
 
+static void start_read_thread(switch_core_session_t *session, GStreamer* streamer, switch_thread_t** thread) {
+  switch_threadattr_t *thd_attr = NULL;
+  switch_memory_pool_t *pool = switch_core_session_get_pool(session);
+
+  switch_threadattr_create(&thd_attr, pool);
+  switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
+  switch_thread_create(thread, thd_attr, grpc_read_thread, streamer, pool);
+}
+
+// wait for the read thread of a stream that has been sent writesDone, then free the stream
+static void reap_stream(switch_core_session_t *session, void** streamer, switch_thread_t** thread) {
+  if (*streamer) {
+    switch_status_t st;
+    switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "reap_stream: GStreamer (%p) waiting for read thread to complete\n", *streamer);
+    if (*thread) switch_thread_join(&st, *thread);
+    delete (GStreamer *) *streamer;
+    *streamer = NULL;
+    *thread = NULL;
+  }
+}
+
+/* google ends a stream at 305 seconds of audio, so once the current one has had GOOGLE_SPEECH_ROLLOVER_SECS we open
+  the next on the same channel and send it audio as well; after the overlap window the next stream becomes current
+  and the old one is sent writesDone, returning its last results while the new one carries on */
+static void rollover(switch_core_session_t *session, struct cap_cb *cb, uint64_t start_samples) {
+  GStreamer* streamer = (GStreamer *) cb->streamer;
+
+  if (!cb->rollover_streamer) {
+    reap_stream(session, &cb->retired_streamer, &cb->retired_thread);
+    GStreamer* next = streamer->rollover((int64_t) ((start_samples - cb->stream_start_samples) * 1000 / cb->media_rate),
+      (int64_t) (cb->overlap_samples * 1000 / cb->media_rate));
+    switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "rollover: GStreamer (%p) opening stream %p\n", (void*)streamer, (void*)next);
+    next->connect();
+    cb->rollover_streamer = next;
+    start_read_thread(session, next, &cb->rollover_thread);
+  }
+  else {
+    switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "rollover: GStreamer (%p) handing over to %p\n", (void*)streamer, cb->rollover_streamer);
+    streamer->retire();
+    cb->retired_streamer = cb->streamer;
+    cb->retired_thread = cb->thread;
+    cb->streamer = cb->rollover_streamer;
+    cb->thread = cb->rollover_thread;
+    cb->rollover_streamer = NULL;
+    cb->rollover_thread = NULL;
+    stream_metrics::instance().reconnect();
+  }
+}
+
 extern "C" {
 
     switch_status_t google_speech_init() {
+      stream_metrics::instance().init("google_transcribe");
       const char* gcsServiceKeyFile = std::getenv("GOOGLE_APPLICATION_CREDENTIALS");
       if (gcsServiceKeyFile) {
         try {
@@ -528,6 +696,11 @@ extern "C" {
     }
 
     switch_status_t google_speech_cleanup() {
+      {
+        std::lock_guard<std::mutex> lock(poolMutex);
+        channelPool.clear();
+      }
+      stream_metrics::instance().shutdown();
       return SWITCH_STATUS_SUCCESS;
     }
     switch_status_t google_speech_session_init(switch_core_session_t *session, responseHandler_t responseHandler, 
@@ -542,6 +715,7 @@ extern "C" {
       int err;
 
       cb =(struct cap_cb *) switch_core_session_alloc(session, sizeof(*cb));
+      stream_metrics::mark_init(*cb);
       strncpy(cb->sessionId, switch_core_session_get_uuid(session), MAX_SESSION_ID);
       strncpy(cb->bugname, bugname, MAX_BUG_LEN);
       cb->got_end_of_utterance = 0;
@@ -552,7 +726,7 @@ extern "C" {
       
       switch_mutex_init(&cb->mutex, SWITCH_MUTEX_NESTED, switch_core_session_get_pool(session));
       if (sampleRate != to_rate) {
-          cb->resampler = speex_resampler_init(channels, sampleRate, to_rate, SWITCH_RESAMPLE_QUALITY, &err);
+          cb->resampler = resampler_pool::acquire(channels, sampleRate, to_rate, SWITCH_RESAMPLE_QUALITY, &err);
         if (0 != err) {
            switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "%s: Error initializing resampler: %s.\n",
                                  switch_channel_get_name(channel), speex_resampler_strerror(err));
@@ -563,6 +737,24 @@ extern "C" {
       }
       cb->responseHandler = responseHandler;
 
+      // roll over to a new stream before google's maximum stream duration, unless we stop after one utterance anyway
+      if (!single_utterance) {
+        const char* var;
+        int secs = 290;
+        int overlap_ms = 3000;
+
+        if (var = switch_channel_get_variable(channel, "GOOGLE_SPEECH_ROLLOVER_SECS")) {
+          secs = atoi(var);
+        }
+        if (var = switch_channel_get_variable(channel, "GOOGLE_SPEECH_ROLLOVER_OVERLAP_MS")) {
+          overlap_ms = std::max(atoi(var), 0);
+        }
+        if (secs > 0) {
+          cb->rollover_samples = (uint64_t) secs * sampleRate;
+          cb->overlap_samples = (uint64_t) overlap_ms * sampleRate / 1000;
+        }
+      }
+
       // allocate vad if we are delaying connecting to the recognizer until we detect speech
       if (switch_channel_var_true(channel, "START_RECOGNIZING_ON_VAD")) {
         cb->vad = switch_vad_init(sampleRate, channels);
@@ -594,7 +786,7 @@ extern "C" {
 
       GStreamer *streamer = NULL;
       try {
-        streamer = new GStreamer(session, channels, lang, interim, to_rate, sampleRate, single_utterance, separate_recognition, max_alternatives,
+        streamer = new GStreamer(session, cb, channels, lang, interim, to_rate, sampleRate, single_utterance, separate_recognition, max_alternatives,
          profanity_filter, word_time_offset, punctuation, model, enhanced, hints);
         cb->streamer = streamer;
       } catch (std::exception& e) {
@@ -603,15 +795,15 @@ extern "C" {
         return SWITCH_STATUS_FALSE;
       }
 
-      if (!cb->vad) streamer->connect();
+      stream_metrics::instance().streamStarted();
+      if (!cb->vad) {
+        stream_metrics::mark_connect_start(*cb);
+        streamer->connect();
+        stream_metrics::mark_connected(*cb);
+      }
 
       // create the read thread
-      switch_threadattr_t *thd_attr = NULL;
-      switch_memory_pool_t *pool = switch_core_session_get_pool(session);
-
-      switch_threadattr_create(&thd_attr, pool);
-      switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
-      switch_thread_create(&cb->thread, thd_attr, grpc_read_thread, cb, pool);
+      start_read_thread(session, streamer, &cb->thread);
 
       *ppUserData = cb;
       return SWITCH_STATUS_SUCCESS;
@@ -646,18 +838,17 @@ extern "C" {
 
         if (streamer) {
           streamer->writesDone();
+          if (cb->rollover_streamer) ((GStreamer *) cb->rollover_streamer)->writesDone();
 
-          switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "google_speech_session_cleanup: GStreamer (%p) waiting for read thread to complete\n", (void*)streamer);
-          switch_status_t st;
-          switch_thread_join(&st, cb->thread);
+          reap_stream(session, &cb->streamer, &cb->thread);
+          reap_stream(session, &cb->rollover_streamer, &cb->rollover_thread);
+          reap_stream(session, &cb->retired_streamer, &cb->retired_thread);
           switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "google_speech_session_cleanup:  GStreamer (%p) read thread completed\n", (void*)streamer);
-
-          delete streamer;
-          cb->streamer = NULL;
         }
+        stream_metrics::instance().streamEnded();
 
         if (cb->resampler) {
-          speex_resampler_destroy(cb->resampler);
+          resampler_pool::release(cb->resampler);
         }
         if (cb->vad) {
           switch_vad_destroy(&cb->vad);
@@ -680,6 +871,7 @@ extern "C" {
     }
 
     switch_bool_t google_speech_frame(switch_media_bug_t *bug, void* user_data) {
+    	stream_metrics::FrameTimer timer;
     	switch_core_session_t *session = switch_core_media_bug_get_session(bug);
     	struct cap_cb *cb = (struct cap_cb *) user_data;
 		  if (cb->streamer && (!cb->wants_single_utterance || !cb->got_end_of_utterance)) {
@@ -692,31 +884,53 @@ extern "C" {
         if (switch_mutex_trylock(cb->mutex) == SWITCH_STATUS_SUCCESS) {
           while (switch_core_media_bug_read(bug, &frame, SWITCH_TRUE) == SWITCH_STATUS_SUCCESS && !switch_test_flag((&frame), SFF_CNG)) {
             if (frame.datalen) {
+              size_t len;
+              bool ok;
+
+              media_clock_advance(session, cb, frame.samples);
               if (cb->vad && !streamer->isConnected()) {
                 switch_vad_state_t state = switch_vad_process(cb->vad, (int16_t*) frame.data, frame.samples);
                 if (state == SWITCH_VAD_STATE_START_TALKING) {
                   switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_INFO, "detected speech, connect to google speech now\n");
+                  stream_metrics::mark_connect_start(*cb);
                   streamer->connect();
+                  stream_metrics::mark_connected(*cb);
+                  cb->stream_start_samples = cb->media_samples - frame.samples;
                   cb->responseHandler(session, "vad_detected", cb->bugname);
                 }
               }
 
+              if (cb->rollover_samples && streamer->isConnected()) {
+                uint64_t start = cb->media_samples - frame.samples;
+                uint64_t streamed = start - cb->stream_start_samples - streamer->getOffsetMs() * cb->media_rate / 1000;
+                if (streamed >= cb->rollover_samples + (cb->rollover_streamer ? cb->overlap_samples : 0)) {
+                  rollover(session, cb, start);
+                  streamer = (GStreamer *) cb->streamer;
+                }
+              }
+
+              spx_int16_t out[SWITCH_RECOMMENDED_BUFFER_SIZE];
+              void* audio = frame.data;
+              len = sizeof(spx_int16_t) * frame.samples;
               if (cb->resampler) {
-                spx_int16_t out[SWITCH_RECOMMENDED_BUFFER_SIZE];
                 spx_uint32_t out_len = SWITCH_RECOMMENDED_BUFFER_SIZE;
                 spx_uint32_t in_len = frame.samples;
-                size_t written;
 
                 speex_resampler_process_interleaved_int(cb->resampler,
                   (const spx_int16_t *) frame.data,
                   (spx_uint32_t *) &in_len,
                   &out[0],
                   &out_len);
-                streamer->write( &out[0], sizeof(spx_int16_t) * out_len);
+                audio = &out[0];
+                len = sizeof(spx_int16_t) * out_len;
               }
-              else {
-                streamer->write( frame.data, sizeof(spx_int16_t) * frame.samples);
+              ok = streamer->write(audio, len);
+              if (cb->rollover_streamer) ((GStreamer *) cb->rollover_streamer)->write(audio, len);
+              if (ok) {
+                stream_metrics::mark_audio_sent(*cb);
+                stream_metrics::instance().bytesSent(len);
               }
+              else stream_metrics::instance().framesDropped(1);
             }
           }
           switch_mutex_unlock(cb->mutex);
@@ -724,4 +938,20 @@ extern "C" {
       }
       return SWITCH_TRUE;
     }
+
+    switch_status_t google_speech_metrics(switch_stream_handle_t *stream) {
+      std::string text;
+
+      stream_metrics::instance().render(text);
+      stream->write_function(stream, "%s", text.c_str());
+      return SWITCH_STATUS_SUCCESS;
+    }
+
+    switch_status_t google_speech_latency(switch_stream_handle_t *stream) {
+      std::string text;
+
+      stream_metrics::instance().latency(text);
+      stream->write_function(stream, "%s", text.c_str());
+      return SWITCH_STATUS_SUCCESS;
+    }
 }
@@ -9,5 +9,7 @@ switch_status_t google_speech_session_init(switch_core_session_t *session, respo
 		const char* hints, char* play_file, void **ppUserData);
 switch_status_t google_speech_session_cleanup(switch_core_session_t *session, int channelIsClosing, switch_media_bug_t *bug);
 switch_bool_t google_speech_frame(switch_media_bug_t *bug, void* user_data);
+switch_status_t google_speech_metrics(switch_stream_handle_t *stream);
+switch_status_t google_speech_latency(switch_stream_handle_t *stream);
 
 #endif
\ No newline at end of file
@@ -23,6 +23,7 @@ static switch_status_t do_stop(switch_core_session_t *session, char* bugname);
 static void responseHandler(switch_core_session_t* session, const char * json, const char* bugname) {
 	switch_event_t *event;
 	switch_channel_t *channel = switch_core_session_get_channel(session);
+	int64_t audio_ms = -1;
 
 	if (0 == strcmp("vad_detected", json)) {
 		switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, TRANSCRIBE_EVENT_VAD_DETECTED);
@@ -73,10 +74,12 @@ static void responseHandler(switch_core_session_t* session, const char * json, c
     cJSON* jMessage = cJSON_Parse(json);
     if (jMessage) {
       const char* type = cJSON_GetStringValue(cJSON_GetObjectItem(jMessage, "type"));
+      cJSON* jResultEndTime = cJSON_GetObjectItem(jMessage, "result_end_time");
       if (type && 0 == strcmp(type, "error")) {
         error = 1;
     		switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, TRANSCRIBE_EVENT_ERROR);
       }
+      if (jResultEndTime && cJSON_IsNumber(jResultEndTime)) audio_ms = (int64_t) jResultEndTime->valuedouble;
       cJSON_Delete(jMessage);
     }
     if (!error) {
@@ -88,6 +91,7 @@ static void responseHandler(switch_core_session_t* session, const char * json, c
 		switch_event_add_body(event, "%s", json);
 	}
 	if (bugname) switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "media-bugname", bugname);
+	media_clock_stamp(session, bugname, event, audio_ms);
 	switch_event_fire(&event);
 }
 
@@ -410,6 +414,14 @@ SWITCH_STANDARD_API(transcribe_function)
 	return SWITCH_STATUS_SUCCESS;
 }
 
+#define METRICS_API_SYNTAX "[latency]"
+SWITCH_STANDARD_API(metrics_function)
+{
+	if (!zstr(cmd) && 0 == strcasecmp(cmd, "latency")) google_speech_latency(stream);
+	else google_speech_metrics(stream);
+	return SWITCH_STATUS_SUCCESS;
+}
+
 SWITCH_MODULE_LOAD_FUNCTION(mod_transcribe_load)
 {
 	switch_api_interface_t *api_interface;
@@ -458,6 +470,7 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_transcribe_load)
 
 	SWITCH_ADD_API(api_interface, "uuid_google_transcribe", "Google Speech Transcription API", transcribe_function, TRANSCRIBE_API_SYNTAX);
 	SWITCH_ADD_API(api_interface, "uuid_google_transcribe2", "Google Speech Transcription API", transcribe2_function, TRANSCRIBE2_API_SYNTAX);
+	SWITCH_ADD_API(api_interface, "google_transcribe_metrics", "Google Speech Transcription metrics in prometheus text format", metrics_function, METRICS_API_SYNTAX);
 	switch_console_set_complete("add uuid_google_transcribe start lang-code");
 	switch_console_set_complete("add uuid_google_transcribe stop ");
 
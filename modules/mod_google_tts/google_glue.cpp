@@ -1,11 +1,21 @@
-#include <unordered_set>
+#include <unordered_map>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <future>
+#include <thread>
+#include <vector>
 #include <switch.h>
 #include <grpc++/grpc++.h>
 #include <sstream>
-#include <fstream>
 #include "google/cloud/texttospeech/v1/cloud_tts.grpc.pb.h"
 
 #include "mod_google_tts.h"
+#include "tts_cache.hpp"
+#include "worker_pool.hpp"
 
 using google::cloud::texttospeech::v1::TextToSpeech;
 using google::cloud::texttospeech::v1::SynthesizeSpeechRequest;
@@ -20,7 +30,368 @@ using google::cloud::texttospeech::v1::AudioEncoding;
 
 std::shared_ptr<grpc::ChannelCredentials> creds;
 
-static std::unordered_set<std::string> setVoices;
+/**
+ * voice catalog: voice name -> language code.  It is loaded from a local cache file at startup and refreshed
+ * from google in the background; each refresh publishes a new map, so lookups never wait on a lock.
+ */
+typedef std::unordered_map<std::string, std::string> voice_map_t;
+static std::shared_ptr<const voice_map_t> voices;
+static std::string voicesCacheFile;
+static int voicesRefreshSecs = 3600;
+static std::thread catalogThread;
+static std::mutex catalogMutex;
+static std::condition_variable catalogCond;
+static bool catalogStopping = false;
+
+#define VOICES_RETRY_SECS (60)
+#define VOICES_DEADLINE_SECS (10)
+
+/* the channel and stub are thread-safe, so one connection is shared by all sessions */
+static std::shared_ptr<grpc::Channel> channel;
+static std::unique_ptr<TextToSpeech::Stub> stub;
+
+static std::unique_ptr<TtsCache> cache;
+
+/* synthesis runs on a shared pool rather than the session thread; each request must complete within the deadline */
+static std::unique_ptr<WorkerPool> pool;
+static int deadlineMs = 10000;
+
+/* in streaming mode, long text is split at sentence boundaries and the pieces synthesized in parallel */
+static bool streaming = false;
+static size_t streamingChunkChars = 300;
+
+#define MAX_CHUNKS_IN_FLIGHT (3)
+
+/* a piece of a prompt to be synthesized */
+struct TtsChunk {
+	std::string text;
+	bool launched;
+	std::shared_future<TtsCache::audio_ptr> audio;
+};
+
+/* per speech handle state: chunks still to be played, and the audio currently being played out from memory */
+struct TtsState {
+	std::deque<TtsChunk> chunks;
+	TtsCache::audio_ptr audio;
+	size_t offset;
+	size_t end;
+
+	/* set when the chunks are abandoned (flush, close, new prompt) so queued work can be skipped */
+	std::shared_ptr<std::atomic<bool>> cancelled;
+
+	/**
+	 * voice and audio config used for every prompt on this handle, and the matching cache key prefix;
+	 * replaced (not modified) when a parameter changes since queued requests may still be using it
+	 */
+	std::shared_ptr<const SynthesizeSpeechRequest> request;
+	std::string keyPrefix;
+
+	void reset(void) {
+		if (cancelled) *cancelled = true;
+		cancelled = std::make_shared<std::atomic<bool>>(false);
+		chunks.clear();
+		audio.reset();
+	}
+};
+
+namespace {
+	size_t getEnvMegabytes(const char* name, size_t defaultMb) {
+		const char* val = std::getenv(name);
+		return (size_t) (val ? ::atoi(val) : defaultMb) * 1024 * 1024;
+	}
+
+	uint32_t le32(const char* p) {
+		const unsigned char* u = (const unsigned char *) p;
+		return u[0] | (u[1] << 8) | (u[2] << 16) | ((uint32_t) u[3] << 24);
+	}
+
+	uint16_t le16(const char* p) {
+		const unsigned char* u = (const unsigned char *) p;
+		return u[0] | (u[1] << 8);
+	}
+
+	/**
+	 * LINEAR16 responses are a wav file; locate the PCM samples in the data chunk.
+	 * If there is no RIFF header the content is taken to be raw PCM.
+	 */
+	bool parse_wav(const std::string& wav, int rate, size_t& offset, size_t& end) {
+		const char* p = wav.data();
+		size_t len = wav.size();
+		size_t pos = 12;
+
+		if (len < 12 || memcmp(p, "RIFF", 4) || memcmp(p + 8, "WAVE", 4)) {
+			offset = 0;
+			end = len & ~((size_t) 1);
+			return true;
+		}
+		while (pos + 8 <= len) {
+			uint32_t chunkLen = le32(p + pos + 4);
+			if (0 == memcmp(p + pos, "fmt ", 4) && chunkLen >= 16 && pos + 8 + 16 <= len) {
+				const char* fmt = p + pos + 8;
+				if (le16(fmt) != 1 || le16(fmt + 2) != 1 || le16(fmt + 14) != 16) {
+					switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, 
+						"google_speech_feed_tts: unsupported wav format %u, %u channels, %u bits\n", le16(fmt), le16(fmt + 2), le16(fmt + 14));
+					return false;
+				}
+				if (le32(fmt + 4) != (uint32_t) rate) {
+					switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, 
+						"google_speech_feed_tts: received audio at %u Hz, expected %d Hz\n", le32(fmt + 4), rate);
+				}
+			}
+			else if (0 == memcmp(p + pos, "data", 4)) {
+				offset = pos + 8;
+				end = std::min(len, offset + chunkLen);
+				end = offset + ((end - offset) & ~((size_t) 1));
+				return true;
+			}
+			pos += 8 + chunkLen + (chunkLen & 1);
+		}
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "google_speech_feed_tts: no data chunk in wav response\n");
+		return false;
+	}
+
+	/* split into sentences, then pack all but the first into chunks of up to maxChars so the first audio comes back quickly */
+	std::vector<std::string> split_text(const std::string& text, size_t maxChars) {
+		std::vector<std::string> sentences, chunks;
+		size_t start = 0;
+
+		for (size_t i = 0; i < text.size(); i++) {
+			size_t next = std::string::npos;
+			char c = text[i];
+			if ((c == '.' || c == '!' || c == '?') && (i + 1 == text.size() || isspace((unsigned char) text[i + 1]))) {
+				next = i + 1;
+			}
+			else if ((unsigned char) c == 0xE3 && text.compare(i, 3, "\xE3\x80\x82") == 0) next = i + 3;    /* 。 */
+			else if ((unsigned char) c == 0xEF && (text.compare(i, 3, "\xEF\xBC\x81") == 0 ||               /* ！ */
+				text.compare(i, 3, "\xEF\xBC\x9F") == 0)) next = i + 3;                                         /* ？ */
+			if (next != std::string::npos) {
+				while (next < text.size() && isspace((unsigned char) text[next])) next++;
+				sentences.push_back(text.substr(start, next - start));
+				start = next;
+				i = next - 1;
+			}
+		}
+		if (start < text.size()) sentences.push_back(text.substr(start));
+
+		for (size_t i = 0; i < sentences.size(); i++) {
+			if (i > 1 && chunks.back().size() + sentences[i].size() <= maxChars) chunks.back() += sentences[i];
+			else chunks.push_back(sentences[i]);
+		}
+		return chunks;
+	}
+
+	TtsCache::audio_ptr synthesize(const SynthesizeSpeechRequest& tmpl, const std::string& key, const std::string& text,
+		std::chrono::system_clock::time_point deadline) {
+		SynthesizeSpeechRequest request(tmpl);
+		SynthesizeSpeechResponse response;
+		grpc::ClientContext context;
+		auto input = request.mutable_input();
+		TtsCache::audio_ptr audio = cache->get(key);
+
+		if (audio) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "google_speech_feed_tts: cache hit for voice: %s: %s\n", 
+				request.voice().name().c_str(), text.c_str()); 
+			return audio;
+		}
+
+		if (text.compare(0, 6, "<speak") == 0) {
+			input->set_ssml(text);
+		}
+		else {
+			input->set_text(text);
+		}
+
+		if (std::chrono::system_clock::now() >= deadline) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, 
+				"google_speech_feed_tts: deadline expired waiting for a worker, not synthesizing: %s\n", text.c_str()); 
+			return nullptr;
+		}
+		context.set_deadline(deadline);
+
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "google_speech_feed_tts: synthesizing using voice: %s, language: %s: %s\n", 
+			request.voice().name().c_str(), request.voice().language_code().c_str(), text.c_str()); 
+
+		grpc::Status status = stub->SynthesizeSpeech(&context, request, &response);
+		if (!status.ok()) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, 
+				"google_speech_feed_tts: error synthesizing speech: %s: details: %s\n", 
+				status.error_message().c_str(), status.error_details().c_str()); 
+			return nullptr;
+		}
+
+		audio = std::make_shared<const std::string>(std::move(*response.mutable_audio_content()));
+		cache->put(key, audio);
+		return audio;
+	}
+
+	/* language code of a voice, from the catalog if we have it, else from the name (e.g. "en-US" from "en-US-Wavenet-A") */
+	std::string language_for_voice(const std::string& voice) {
+		auto catalog = std::atomic_load(&voices);
+		if (catalog) {
+			auto it = catalog->find(voice);
+			if (it != catalog->end() && !it->second.empty()) return it->second;
+		}
+		size_t dash = voice.find('-');
+		if (dash != std::string::npos) dash = voice.find('-', dash + 1);
+		return voice.substr(0, dash);
+	}
+
+	/* everything in the template that affects the synthesized audio */
+	std::string describe_request(const SynthesizeSpeechRequest& request) {
+		std::ostringstream s;
+		const auto& audio_config = request.audio_config();
+		s << request.voice().name() << '|' << request.voice().language_code() << '|' << audio_config.sample_rate_hertz() << '|' <<
+			audio_config.speaking_rate() << '|' << audio_config.pitch() << '|' << audio_config.volume_gain_db();
+		for (int i = 0; i < audio_config.effects_profile_id_size(); i++) {
+			s << '|' << audio_config.effects_profile_id(i);
+		}
+		return s.str();
+	}
+
+	void set_request(TtsState* state, const std::shared_ptr<SynthesizeSpeechRequest>& request) {
+		state->request = request;
+		state->keyPrefix = describe_request(*request);
+	}
+
+	void publish_voices(const std::shared_ptr<const voice_map_t>& map) {
+		std::atomic_store(&voices, map);
+	}
+
+	bool load_voices_file(const std::string& path) {
+		auto map = std::make_shared<voice_map_t>();
+		std::ifstream in(path);
+		std::string line;
+
+		while (std::getline(in, line)) {
+			size_t tab = line.find('\t');
+			if (tab == std::string::npos) continue;
+			(*map)[line.substr(0, tab)] = line.substr(tab + 1);
+		}
+		if (map->empty()) return false;
+		publish_voices(map);
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "google_tts: loaded %lu voices from %s\n", map->size(), path.c_str());
+		return true;
+	}
+
+	void save_voices_file(const std::string& path, const voice_map_t& map) {
+		std::string tmpPath = path + ".tmp";
+		{
+			std::ofstream out(tmpPath, std::ofstream::trunc);
+			for (auto& v : map) out << v.first << '\t' << v.second << '\n';
+			if (!out) {
+				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "google_tts: unable to write voice cache %s\n", tmpPath.c_str());
+				return;
+			}
+		}
+		rename(tmpPath.c_str(), path.c_str());
+	}
+
+	bool fetch_voices(void) {
+		ListVoicesRequest request;
+		ListVoicesResponse response;
+		grpc::ClientContext context;
+		auto map = std::make_shared<voice_map_t>();
+
+		context.set_deadline(std::chrono::system_clock::now() + std::chrono::seconds(VOICES_DEADLINE_SECS));
+		grpc::Status status = stub->ListVoices(&context, request, &response);
+		if (!status.ok()) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, 
+				"google_tts: error retrieving voices: %s\n", status.error_message().c_str());
+			return false;
+		}
+		for (int i = 0; i < response.voices_size(); i++) {
+			std::stringstream str;
+			const Voice& voice = response.voices(i);
+			(*map)[voice.name()] = voice.language_codes_size() > 0 ? voice.language_codes(0) : std::string();
+			for (int j = 0; j < voice.language_codes_size(); j++) {
+				if (j > 0) str << ", ";
+				str << voice.language_codes(j);
+			}
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "#%d Name: %s, Gender: %s, Hz: %d, languages: %s\n", 
+				i + 1, voice.name().c_str(), SsmlVoiceGender_Name(voice.ssml_gender()).c_str(), voice.natural_sample_rate_hertz(),
+				str.str().c_str());
+		}
+		if (map->empty()) return false;
+
+		publish_voices(map);
+		if (!voicesCacheFile.empty()) save_voices_file(voicesCacheFile, *map);
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "google_tts: Google has %lu available TTS voices\n", map->size());
+		return true;
+	}
+
+	void catalog_thread(void) {
+		std::unique_lock<std::mutex> lk(catalogMutex);
+		while (!catalogStopping) {
+			lk.unlock();
+			int wait = fetch_voices() ? voicesRefreshSecs : VOICES_RETRY_SECS;
+			lk.lock();
+			catalogCond.wait_for(lk, std::chrono::seconds(wait), [] { return catalogStopping; });
+		}
+	}
+
+	void launch(google_t* google, TtsChunk& chunk) {
+		TtsState* state = (TtsState *) google->tts;
+		auto promise = std::make_shared<std::promise<TtsCache::audio_ptr>>();
+		auto deadline = std::chrono::system_clock::now() + std::chrono::milliseconds(deadlineMs);
+		auto cancelled = state->cancelled;
+		auto request = state->request;
+		std::string text(chunk.text);
+		std::string key = TtsCache::makeKey(state->keyPrefix, text);
+
+		chunk.audio = promise->get_future().share();
+		chunk.launched = true;
+
+		// a hit in the memory cache is served right away, anything else goes to the worker pool
+		TtsCache::audio_ptr audio = cache->peek(key);
+		if (audio) {
+			promise->set_value(audio);
+			return;
+		}
+		bool queued = pool->submit([promise, cancelled, request, key, text, deadline]() {
+			promise->set_value(*cancelled ? nullptr : synthesize(*request, key, text, deadline));
+		});
+		if (!queued) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "google_speech_feed_tts: too many pending requests, dropping: %s\n", 
+				text.c_str());
+			promise->set_value(nullptr);
+		}
+	}
+
+	/**
+	 * make the next chunk the current audio; returns SWITCH_STATUS_MORE_DATA if it has not been synthesized yet
+	 * and SWITCH_STATUS_BREAK if there is nothing more to play
+	 */
+	switch_status_t next_chunk(google_t* google) {
+		TtsState* state = (TtsState *) google->tts;
+
+		state->audio.reset();
+		while (!state->chunks.empty()) {
+			TtsChunk& chunk = state->chunks.front();
+			TtsCache::audio_ptr audio;
+
+			// keep the following chunks synthesizing while this one plays
+			for (size_t i = 0; i < state->chunks.size() && i < MAX_CHUNKS_IN_FLIGHT; i++) {
+				if (!state->chunks[i].launched) launch(google, state->chunks[i]);
+			}
+
+			if (chunk.audio.wait_for(std::chrono::seconds(0)) != std::future_status::ready) return SWITCH_STATUS_MORE_DATA;
+			try {
+				audio = chunk.audio.get();
+			} catch (const std::future_error& e) {
+				// job was discarded at shutdown
+			}
+			if (audio && parse_wav(*audio, google->rate, state->offset, state->end)) {
+				state->audio = audio;
+				state->chunks.pop_front();
+				return SWITCH_STATUS_SUCCESS;
+			}
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "google_speech_feed_tts: skipping chunk that failed to synthesize: %s\n", 
+				chunk.text.c_str());
+			state->chunks.pop_front();
+		}
+		return SWITCH_STATUS_BREAK;
+	}
+}
 
 extern "C" {
 	switch_status_t google_speech_load() {
@@ -32,31 +403,44 @@ extern "C" {
 				return SWITCH_STATUS_FALSE;     
 			}
       creds = grpc::GoogleDefaultCredentials();
-			auto channel = grpc::CreateChannel("texttospeech.googleapis.com", creds);
-			auto stub = TextToSpeech::NewStub(channel);
-			ListVoicesRequest request;
-			ListVoicesResponse response;
-			grpc::ClientContext context;
-
-			grpc::Status status = stub->ListVoices(&context, request, &response);
-			if (!status.ok()) {
-				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, 
-					"Error retrieving voices: %s\n", status.error_message().c_str());
-				return SWITCH_STATUS_FALSE;
-			}
-			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "Google has %d available TTS voices:\n", response.voices_size());
-			for (int i = 0; i < response.voices_size(); i++) {
-				std::stringstream str;
-				Voice voice = response.voices(i);
-				setVoices.insert(voice.name());
-				for (int j = 0; j < voice.language_codes_size(); j++) {
-					if (j > 0) str << ", ";
-					str << voice.language_codes(j);
-				}
-				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "#%d Name: %s, Gender: %s, Hz: %d, languages: %s\n", 
-					i + 1, voice.name().c_str(), SsmlVoiceGender_Name(voice.ssml_gender()).c_str(), voice.natural_sample_rate_hertz(),
-					str.str().c_str());
+			channel = grpc::CreateChannel("texttospeech.googleapis.com", creds);
+			stub = TextToSpeech::NewStub(channel);
+			cache.reset(new TtsCache(getEnvMegabytes("GOOGLE_TTS_CACHE_MAX_MEMORY_MB", 32),
+				std::getenv("GOOGLE_TTS_CACHE_DIR"), getEnvMegabytes("GOOGLE_TTS_CACHE_MAX_DISK_MB", 512)));
+
+			unsigned int nThreads = 10;
+			size_t maxQueued = 500;
+			if (const char* val = std::getenv("GOOGLE_TTS_WORKER_THREADS")) {
+				nThreads = std::max(::atoi(val), 1);
+			}
+			if (const char* val = std::getenv("GOOGLE_TTS_MAX_PENDING_REQUESTS")) {
+				maxQueued = std::max(::atoi(val), 1);
+			}
+			if (const char* val = std::getenv("GOOGLE_TTS_DEADLINE_MS")) {
+				deadlineMs = std::max(::atoi(val), 1);
 			}
+			pool.reset(new WorkerPool(nThreads, maxQueued));
+
+			streaming = switch_true(std::getenv("GOOGLE_TTS_STREAMING"));
+			if (const char* val = std::getenv("GOOGLE_TTS_STREAMING_CHUNK_CHARS")) {
+				streamingChunkChars = std::max(::atoi(val), 1);
+			}
+
+			// start with the voices we saw last time, if any, and refresh from google in the background
+			if (const char* val = std::getenv("GOOGLE_TTS_VOICES_CACHE_FILE")) {
+				voicesCacheFile = val;
+			}
+			else {
+				voicesCacheFile = std::string(SWITCH_GLOBAL_dirs.cache_dir) + SWITCH_PATH_SEPARATOR + "google_tts_voices.txt";
+			}
+			if (const char* val = std::getenv("GOOGLE_TTS_VOICES_REFRESH_SECS")) {
+				voicesRefreshSecs = std::max(::atoi(val), VOICES_RETRY_SECS);
+			}
+			if (!load_voices_file(voicesCacheFile)) {
+				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "google_tts: no cached voice list, voices will not be validated until it is retrieved\n");
+			}
+			catalogStopping = false;
+			catalogThread = std::thread(catalog_thread);
 			return SWITCH_STATUS_SUCCESS;
 
 		} catch (const std::exception& e) {
@@ -69,57 +453,136 @@ extern "C" {
 
 	switch_status_t google_speech_open(google_t* google) {
 		std::string voice = google->voice_name;
-		if (setVoices.find(voice) == setVoices.end()) {
+		auto catalog = std::atomic_load(&voices);
+		if (catalog && catalog->find(voice) == catalog->end()) {
 			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, 
-				"google_speech_open: Invalid voice name '%s'; there are %ld voices available, and they were logged at INFO level when freeswitch started, so maybe go have a look..\n",
-				voice.c_str(), setVoices.size()); 
+				"google_speech_open: Invalid voice name '%s'; there are %lu voices available, they are logged at DEBUG level when retrieved\n",
+				voice.c_str(), catalog->size()); 
 			return SWITCH_STATUS_FALSE;
 		}
+		TtsState* state = new TtsState();
+		auto request = std::make_shared<SynthesizeSpeechRequest>();
+		request->mutable_voice()->set_name(voice);
+		request->mutable_voice()->set_language_code(language_for_voice(voice));
+		request->mutable_audio_config()->set_audio_encoding(AudioEncoding::LINEAR16);
+		request->mutable_audio_config()->set_sample_rate_hertz(google->rate);
+		set_request(state, request);
+		state->reset();
+		google->tts = state;
 		return SWITCH_STATUS_SUCCESS;
 	}
-	switch_status_t google_speech_feed_tts(google_t* google, char* text) {
-		char langCode[6];
-		SynthesizeSpeechRequest request;
-		SynthesizeSpeechResponse response;
-		grpc::ClientContext context;
-		auto input = request.mutable_input();
-		auto voice = request.mutable_voice();
-		auto audio_config = request.mutable_audio_config();
-		auto channel = grpc::CreateChannel("texttospeech.googleapis.com", creds);
-		auto stub = TextToSpeech::NewStub(channel);
+	void google_speech_text_param_tts(google_t* google, const char* param, const char* val) {
+		TtsState* state = (TtsState *) google->tts;
+		if (!state || !param || !val) return;
 
-		memset(langCode, '\0', 6);
-		strncpy(langCode, google->voice_name, 5);
+		auto request = std::make_shared<SynthesizeSpeechRequest>(*state->request);
+		auto voice = request->mutable_voice();
+		auto audio_config = request->mutable_audio_config();
 
-		if (strstr(text, "<speak") == text) {
-			input->set_ssml(text);
+		if (0 == strcasecmp(param, "voice")) {
+			auto catalog = std::atomic_load(&voices);
+			if (catalog && catalog->find(val) == catalog->end()) {
+				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "google_speech_text_param_tts: Invalid voice name '%s'\n", val);
+				return;
+			}
+			voice->set_name(val);
+			voice->set_language_code(language_for_voice(val));
+		}
+		else if (0 == strcasecmp(param, "language_code")) voice->set_language_code(val);
+		else if (0 == strcasecmp(param, "speaking_rate")) audio_config->set_speaking_rate(atof(val));
+		else if (0 == strcasecmp(param, "pitch")) audio_config->set_pitch(atof(val));
+		else if (0 == strcasecmp(param, "volume_gain_db")) audio_config->set_volume_gain_db(atof(val));
+		else if (0 == strcasecmp(param, "sample_rate")) audio_config->set_sample_rate_hertz(atoi(val));
+		else if (0 == strcasecmp(param, "effects_profile_id")) {
+			char *profiles[8] = { 0 };
+			char *copy = strdup(val);
+			int argc = switch_separate_string(copy, ',', profiles, 8);
+			audio_config->clear_effects_profile_id();
+			for (int i = 0; i < argc; i++) {
+				if (*profiles[i]) audio_config->add_effects_profile_id(profiles[i]);
+			}
+			free(copy);
 		}
 		else {
-			input->set_text(text);
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "google_speech_text_param_tts: ignoring unknown param %s\n", param);
+			return;
 		}
-		voice->set_name(google->voice_name);
-		voice->set_language_code(langCode);
-		audio_config->set_audio_encoding(AudioEncoding::LINEAR16);
-		audio_config->set_sample_rate_hertz(google->rate);
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "google_speech_text_param_tts: %s=%s\n", param, val);
+		set_request(state, request);
+	}
+	void google_speech_float_param_tts(google_t* google, const char* param, double val) {
+		char buf[64];
+		switch_snprintf(buf, sizeof(buf), "%f", val);
+		google_speech_text_param_tts(google, param, buf);
+	}
+	switch_status_t google_speech_close(google_t* google) {
+		TtsState* state = (TtsState *) google->tts;
+		if (state) state->reset();
+		delete state;
+		google->tts = nullptr;
+		return SWITCH_STATUS_SUCCESS;
+	}
+	switch_status_t google_speech_feed_tts(google_t* google, char* text) {
+		TtsState* state = (TtsState *) google->tts;
+		std::string str(text);
+		std::vector<std::string> pieces;
 
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "google_speech_feed_tts: synthesizing using voice: %s, language: %s: %s\n", 
-			google->voice_name, langCode, text); 
+		state->reset();
+		if (streaming && str.compare(0, 6, "<speak") != 0) pieces = split_text(str, streamingChunkChars);
+		else pieces.push_back(str);
 
-		grpc::Status status = stub->SynthesizeSpeech(&context, request, &response);
-		if (!status.ok()) {
-			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, 
-				"google_speech_feed_tts: error synthesizing speech: %s: details: %s\n", 
-				status.error_message().c_str(), status.error_details().c_str()); 
-			return SWITCH_STATUS_FALSE;
+		for (auto& piece : pieces) {
+			state->chunks.push_back(TtsChunk{piece, false, {}});
+		}
+		if (pieces.size() > 1) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "google_speech_feed_tts: streaming %lu chunks\n", pieces.size());
 		}
 
-		std::ofstream outfile(google->file, std::ofstream::binary);
-		outfile << response.audio_content();
-		outfile.close();
+		// does not wait for synthesis; speech_read_tts plays silence until the audio arrives
+		return next_chunk(google) == SWITCH_STATUS_BREAK ? SWITCH_STATUS_FALSE : SWITCH_STATUS_SUCCESS;
+	}
+	switch_status_t google_speech_read_tts(google_t* google, void* data, size_t* datalen) {
+		TtsState* state = (TtsState *) google->tts;
+		size_t len;
 
+		if (!state) {
+			*datalen = 0;
+			return SWITCH_STATUS_BREAK;
+		}
+		if (!state->audio || state->offset >= state->end) {
+			switch_status_t status = next_chunk(google);
+			if (status == SWITCH_STATUS_MORE_DATA) {
+				memset(data, 0, *datalen);
+				return SWITCH_STATUS_SUCCESS;
+			}
+			if (status != SWITCH_STATUS_SUCCESS) {
+				*datalen = 0;
+				return SWITCH_STATUS_BREAK;
+			}
+		}
+		len = std::min(*datalen, state->end - state->offset);
+		memcpy(data, state->audio->data() + state->offset, len);
+		state->offset += len;
+		*datalen = len;
 		return SWITCH_STATUS_SUCCESS;
 	}
+	void google_speech_flush_tts(google_t* google) {
+		TtsState* state = (TtsState *) google->tts;
+		if (state) state->reset();
+	}
 	switch_status_t google_speech_unload() {
+		if (catalogThread.joinable()) {
+			{
+				std::lock_guard<std::mutex> lk(catalogMutex);
+				catalogStopping = true;
+			}
+			catalogCond.notify_all();
+			catalogThread.join();
+		}
+		pool.reset();
+		cache.reset();
+		stub.reset();
+		channel.reset();
 		return SWITCH_STATUS_SUCCESS;
 	}
 
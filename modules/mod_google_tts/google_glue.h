@@ -3,7 +3,12 @@
 
 switch_status_t google_speech_load();
 switch_status_t google_speech_open(google_t* google);
+switch_status_t google_speech_close(google_t* google);
 switch_status_t google_speech_feed_tts(google_t* google, char* text);
+switch_status_t google_speech_read_tts(google_t* google, void* data, size_t* datalen);
+void google_speech_flush_tts(google_t* google);
+void google_speech_text_param_tts(google_t* google, const char* param, const char* val);
+void google_speech_float_param_tts(google_t* google, const char* param, double val);
 switch_status_t google_speech_unload();
 
 
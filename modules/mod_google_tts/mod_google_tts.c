@@ -6,8 +6,6 @@
 #include "mod_google_tts.h"
 #include "google_glue.h"
 
-#include <unistd.h>
-
 SWITCH_MODULE_LOAD_FUNCTION(mod_google_tts_load);
 SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_google_tts_shutdown);
 SWITCH_MODULE_DEFINITION(mod_google_tts, mod_google_tts_load, mod_google_tts_shutdown, NULL);
@@ -15,26 +13,14 @@ SWITCH_MODULE_DEFINITION(mod_google_tts, mod_google_tts_load, mod_google_tts_shu
 
 static switch_status_t speech_open(switch_speech_handle_t *sh, const char *voice_name, int rate, int channels, switch_speech_flag_t *flags)
 {	
-	switch_uuid_t uuid;
-	char uuid_str[SWITCH_UUID_FORMATTED_LENGTH + 1];
-	char outfile[512] = "";
 	google_t *google = switch_core_alloc(sh->memory_pool, sizeof(*google));
 
 	google->voice_name = switch_core_strdup(sh->memory_pool, voice_name);
 	google->rate = rate;
 
-	/* Construct temporary file name with a new UUID */
-	switch_uuid_get(&uuid);
-	switch_uuid_format(uuid_str, &uuid);
-	switch_snprintf(outfile, sizeof(outfile), "%s%s%s.tmp.wav", SWITCH_GLOBAL_dirs.temp_dir, SWITCH_PATH_SEPARATOR, uuid_str);
-	google->file = switch_core_strdup(sh->memory_pool, outfile);
-
-	google->fh = (switch_file_handle_t *) switch_core_alloc(sh->memory_pool, sizeof(switch_file_handle_t));
-
 	sh->private_info = google;
 
-	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "speech_open - created file %s for name %s, rate %d\n", 
-		google->file, google->voice_name, rate);
+	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "speech_open - name %s, rate %d\n", google->voice_name, rate);
 
 	return google_speech_open(google);
 
@@ -45,13 +31,9 @@ static switch_status_t speech_close(switch_speech_handle_t *sh, switch_speech_fl
 	google_t *google = (google_t *) sh->private_info;
 	assert(google != NULL);
 
-	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "speech_close - closing file %s\n", google->file);
-	if (switch_test_flag(google->fh, SWITCH_FILE_OPEN)) {
-		switch_core_file_close(google->fh);
-	}
-	unlink(google->file);
+	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "speech_close\n");
 
-	return SWITCH_STATUS_SUCCESS;
+	return google_speech_close(google);
 }
 
 static switch_status_t speech_feed_tts(switch_speech_handle_t *sh, char *text, switch_speech_flag_t *flags)
@@ -63,13 +45,6 @@ static switch_status_t speech_feed_tts(switch_speech_handle_t *sh, char *text, s
 		return SWITCH_STATUS_FALSE;
 	}
 
-	if (switch_core_file_open(google->fh, google->file, 0,	//number_of_channels,
-							  google->rate,	//samples_per_second,
-							  SWITCH_FILE_FLAG_READ | SWITCH_FILE_DATA_SHORT, NULL) != SWITCH_STATUS_SUCCESS) {
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Failed to open file: %s\n", google->file);
-		return SWITCH_STATUS_FALSE;
-	}
-
 	return SWITCH_STATUS_SUCCESS;
 }
 
@@ -80,52 +55,58 @@ static void speech_flush_tts(switch_speech_handle_t *sh)
 
 	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "speech_flush_tts\n");
 
-	if (google->fh != NULL && google->fh->file_interface != NULL) {
-		switch_core_file_close(google->fh);
-	}
+	google_speech_flush_tts(google);
 }
 
 static switch_status_t speech_read_tts(switch_speech_handle_t *sh, void *data, size_t *datalen, switch_speech_flag_t *flags)
 {
 	google_t *google = (google_t *) sh->private_info;
-	size_t my_datalen = *datalen / 2;
 
 	assert(google != NULL);
 
-	if (google->fh->file_interface == (void *)0) {
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "file [%s] has already been closed\n", google->file);
-		unlink(google->file);
-		return SWITCH_STATUS_FALSE;
-	}
+	return google_speech_read_tts(google, data, datalen);
+}
 
-	if (switch_core_file_read(google->fh, data, &my_datalen) != SWITCH_STATUS_SUCCESS) {
-		switch_core_file_close(google->fh);
-		unlink(google->file);
-		return SWITCH_STATUS_FALSE;
-	}
-	*datalen = my_datalen * 2;
-	if (datalen == 0) {
-		switch_core_file_close(google->fh);
-		unlink(google->file);
-		return SWITCH_STATUS_BREAK;
+/* audio is requested from google at this rate; if it differs from the channel rate the core resamples it */
+static void set_native_rate(switch_speech_handle_t *sh, google_t *google, int rate)
+{
+	if (rate > 0) {
+		google->rate = rate;
+		sh->native_rate = rate;
 	}
-	return SWITCH_STATUS_SUCCESS;
-
 }
 
 static void text_param_tts(switch_speech_handle_t *sh, char *param, const char *val)
 {
+	google_t *google = (google_t *) sh->private_info;
+	assert(google != NULL);
 
+	if (!strcasecmp(param, "sample_rate") && val) {
+		set_native_rate(sh, google, atoi(val));
+	}
+	google_speech_text_param_tts(google, param, val);
 }
 
 static void numeric_param_tts(switch_speech_handle_t *sh, char *param, int val)
 {
+	google_t *google = (google_t *) sh->private_info;
+	assert(google != NULL);
 
+	if (!strcasecmp(param, "sample_rate")) {
+		set_native_rate(sh, google, val);
+	}
+	google_speech_float_param_tts(google, param, (double) val);
 }
 
 static void float_param_tts(switch_speech_handle_t *sh, char *param, double val)
 {
+	google_t *google = (google_t *) sh->private_info;
+	assert(google != NULL);
 
+	if (!strcasecmp(param, "sample_rate")) {
+		set_native_rate(sh, google, (int) val);
+	}
+	google_speech_float_param_tts(google, param, val);
 }
 
 SWITCH_MODULE_LOAD_FUNCTION(mod_google_tts_load)
@@ -150,6 +131,7 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_google_tts_load)
 
 SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_google_tts_shutdown)
 {
+	google_speech_unload();
 
 	return SWITCH_STATUS_UNLOAD;
 }
@@ -6,8 +6,7 @@
 struct google_data {
 	char *voice_name;
 	int rate;
-	char *file;
-	switch_file_handle_t *fh;
+	void *tts;	/* audio being played out, owned by google_glue.cpp */
 };
 
 typedef struct google_data google_t;
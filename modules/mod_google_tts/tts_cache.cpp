@@ -0,0 +1,231 @@
+#include "tts_cache.hpp"
+
+#include <switch.h>
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define TTS_CACHE_MAGIC "GTTS"
+#define TTS_CACHE_SUFFIX ".tts"
+
+namespace {
+  /* FNV-1a; unlike std::hash this is stable across builds, which matters because it names files on disk */
+  uint64_t fnv1a(const std::string& s) {
+    uint64_t h = 14695981039346656037ULL;
+    for (unsigned char c : s) {
+      h ^= c;
+      h *= 1099511628211ULL;
+    }
+    return h;
+  }
+
+  std::string filenameForKey(const std::string& key) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%016llx" TTS_CACHE_SUFFIX, (unsigned long long) fnv1a(key));
+    return std::string(buf);
+  }
+}
+
+TtsCache::TtsCache(size_t maxMemoryBytes, const char* diskDir, size_t maxDiskBytes) :
+  m_maxMemoryBytes(maxMemoryBytes), m_memoryBytes(0), m_maxDiskBytes(maxDiskBytes), m_diskBytes(0) {
+
+  if (diskDir && *diskDir) {
+    m_diskDir = diskDir;
+    if (SWITCH_STATUS_SUCCESS != switch_dir_make_recursive(diskDir, SWITCH_DEFAULT_DIR_PERMS, NULL)) {
+      switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "TtsCache: unable to create cache directory %s, disk cache disabled\n", diskDir);
+      m_diskDir.clear();
+    }
+    else {
+      loadDiskIndex();
+    }
+  }
+  switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "TtsCache: memory tier %lu bytes, disk tier %s (%lu of %lu bytes in use)\n",
+    m_maxMemoryBytes, m_diskDir.empty() ? "disabled" : m_diskDir.c_str(), m_diskBytes, m_maxDiskBytes);
+}
+
+std::string TtsCache::makeKey(const std::string& config, const std::string& text) {
+  return config + '\n' + text;
+}
+
+TtsCache::audio_ptr TtsCache::get(const std::string& key) {
+  std::string filename;
+  {
+    std::lock_guard<std::mutex> lk(m_mutex);
+    auto it = m_memoryIndex.find(key);
+    if (it != m_memoryIndex.end()) {
+      m_memoryLru.splice(m_memoryLru.begin(), m_memoryLru, it->second);
+      return it->second->second;
+    }
+    if (m_diskDir.empty()) return nullptr;
+
+    filename = filenameForKey(key);
+    if (m_diskIndex.find(filename) == m_diskIndex.end()) return nullptr;
+  }
+
+  // file i/o is done without holding the lock
+  audio_ptr audio = readFromDisk(key, filename);
+
+  std::lock_guard<std::mutex> lk(m_mutex);
+  auto it = m_diskIndex.find(filename);
+  if (it == m_diskIndex.end()) return audio;
+  if (audio) {
+    m_diskLru.splice(m_diskLru.begin(), m_diskLru, it->second);
+    addToMemory(key, audio);
+  }
+  else {
+    // hash collision or unreadable file: drop it
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "TtsCache: discarding stale disk entry %s\n", filename.c_str());
+    removeFromDisk(it);
+  }
+  return audio;
+}
+
+/* memory tier only, so it is always cheap */
+TtsCache::audio_ptr TtsCache::peek(const std::string& key) {
+  std::lock_guard<std::mutex> lk(m_mutex);
+  auto it = m_memoryIndex.find(key);
+  if (it == m_memoryIndex.end()) return nullptr;
+  m_memoryLru.splice(m_memoryLru.begin(), m_memoryLru, it->second);
+  return it->second->second;
+}
+
+void TtsCache::put(const std::string& key, const audio_ptr& audio) {
+  if (!audio || audio->empty()) return;
+
+  {
+    std::lock_guard<std::mutex> lk(m_mutex);
+    addToMemory(key, audio);
+  }
+  if (!m_diskDir.empty()) writeToDisk(key, audio);
+}
+
+void TtsCache::addToMemory(const std::string& key, const audio_ptr& audio) {
+  if (audio->size() > m_maxMemoryBytes) return;
+
+  auto it = m_memoryIndex.find(key);
+  if (it != m_memoryIndex.end()) {
+    m_memoryBytes -= it->second->second->size();
+    m_memoryLru.erase(it->second);
+    m_memoryIndex.erase(it);
+  }
+
+  m_memoryLru.emplace_front(key, audio);
+  m_memoryIndex[key] = m_memoryLru.begin();
+  m_memoryBytes += audio->size();
+
+  while (m_memoryBytes > m_maxMemoryBytes && !m_memoryLru.empty()) {
+    auto& victim = m_memoryLru.back();
+    m_memoryBytes -= victim.second->size();
+    m_memoryIndex.erase(victim.first);
+    m_memoryLru.pop_back();
+  }
+}
+
+std::string TtsCache::diskPath(const std::string& filename) {
+  return m_diskDir + SWITCH_PATH_SEPARATOR + filename;
+}
+
+void TtsCache::loadDiskIndex(void) {
+  std::vector<std::pair<time_t, DiskEntry>> files;
+  DIR* dir = opendir(m_diskDir.c_str());
+  if (!dir) return;
+
+  struct dirent* ent;
+  while ((ent = readdir(dir)) != nullptr) {
+    std::string name(ent->d_name);
+    struct stat st;
+    if (name.size() <= strlen(TTS_CACHE_SUFFIX) ||
+      name.compare(name.size() - strlen(TTS_CACHE_SUFFIX), std::string::npos, TTS_CACHE_SUFFIX) != 0) continue;
+    if (0 != stat(diskPath(name).c_str(), &st) || !S_ISREG(st.st_mode)) continue;
+    files.emplace_back(st.st_atime, DiskEntry(name, st.st_size));
+  }
+  closedir(dir);
+
+  // most recently used first
+  std::sort(files.begin(), files.end(), [](const std::pair<time_t, DiskEntry>& a, const std::pair<time_t, DiskEntry>& b) {
+    return a.first > b.first;
+  });
+  for (auto& f : files) {
+    if (m_diskBytes + f.second.second > m_maxDiskBytes) {
+      unlink(diskPath(f.second.first).c_str());
+      continue;
+    }
+    m_diskLru.push_back(f.second);
+    m_diskIndex[f.second.first] = std::prev(m_diskLru.end());
+    m_diskBytes += f.second.second;
+  }
+}
+
+TtsCache::audio_ptr TtsCache::readFromDisk(const std::string& key, const std::string& filename) {
+  std::ifstream in(diskPath(filename), std::ifstream::binary);
+  char magic[4];
+  uint32_t keylen = 0;
+  if (in.read(magic, sizeof(magic)) && 0 == memcmp(magic, TTS_CACHE_MAGIC, sizeof(magic)) &&
+    in.read((char *) &keylen, sizeof(keylen)) && keylen == key.size()) {
+    std::string storedKey(keylen, '\0');
+    if (in.read(&storedKey[0], keylen) && storedKey == key) {
+      std::ostringstream audio;
+      audio << in.rdbuf();
+      if (!audio.str().empty()) return std::make_shared<const std::string>(audio.str());
+    }
+  }
+  return nullptr;
+}
+
+void TtsCache::removeFromDisk(std::unordered_map<std::string, std::list<DiskEntry>::iterator>::iterator it) {
+  unlink(diskPath(it->first).c_str());
+  m_diskBytes -= it->second->second;
+  m_diskLru.erase(it->second);
+  m_diskIndex.erase(it);
+}
+
+void TtsCache::writeToDisk(const std::string& key, const audio_ptr& audio) {
+  std::string filename = filenameForKey(key);
+  std::string path = diskPath(filename);
+  std::string tmpPath = path + ".tmp." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+  uint32_t keylen = key.size();
+  size_t size = sizeof(uint32_t) + sizeof(keylen) + keylen + audio->size();
+
+  if (size > m_maxDiskBytes) return;
+
+  {
+    std::ofstream out(tmpPath, std::ofstream::binary | std::ofstream::trunc);
+    out.write(TTS_CACHE_MAGIC, 4);
+    out.write((const char *) &keylen, sizeof(keylen));
+    out.write(key.data(), keylen);
+    out.write(audio->data(), audio->size());
+    if (!out) {
+      switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "TtsCache: error writing %s\n", tmpPath.c_str());
+      out.close();
+      unlink(tmpPath.c_str());
+      return;
+    }
+  }
+
+  std::lock_guard<std::mutex> lk(m_mutex);
+  if (0 != rename(tmpPath.c_str(), path.c_str())) {
+    unlink(tmpPath.c_str());
+    return;
+  }
+
+  auto it = m_diskIndex.find(filename);
+  if (it != m_diskIndex.end()) {
+    m_diskBytes -= it->second->second;
+    m_diskLru.erase(it->second);
+    m_diskIndex.erase(it);
+  }
+  m_diskLru.emplace_front(filename, size);
+  m_diskIndex[filename] = m_diskLru.begin();
+  m_diskBytes += size;
+
+  while (m_diskBytes > m_maxDiskBytes && !m_diskLru.empty()) {
+    removeFromDisk(m_diskIndex.find(m_diskLru.back().first));
+  }
+}
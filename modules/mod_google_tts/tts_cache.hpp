@@ -0,0 +1,65 @@
+#ifndef __TTS_CACHE_HPP__
+#define __TTS_CACHE_HPP__
+
+#include <string>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+/**
+ * LRU cache of synthesized audio, keyed by everything that affects the synthesis
+ * (voice and audio config, text/ssml).
+ *
+ * Entries live in a memory tier bounded by total bytes; if a cache directory is
+ * configured, entries are also written through to a disk tier (also LRU, bounded
+ * by total bytes) so that they survive a restart and can be promoted back into
+ * memory on demand.  All methods are thread-safe.
+ */
+class TtsCache {
+public:
+  typedef std::shared_ptr<const std::string> audio_ptr;
+
+  TtsCache(size_t maxMemoryBytes, const char* diskDir, size_t maxDiskBytes);
+  ~TtsCache() {}
+
+  static std::string makeKey(const std::string& config, const std::string& text);
+
+  audio_ptr get(const std::string& key);
+  audio_ptr peek(const std::string& key);
+  void put(const std::string& key, const audio_ptr& audio);
+
+  size_t getMemoryBytes(void) { return m_memoryBytes; }
+  size_t getDiskBytes(void) { return m_diskBytes; }
+
+  // no default constructor or copying
+  TtsCache() = delete;
+  TtsCache(const TtsCache&) = delete;
+  void operator=(const TtsCache&) = delete;
+
+private:
+  typedef std::pair<std::string, audio_ptr> MemoryEntry;
+  typedef std::pair<std::string, size_t> DiskEntry;
+
+  std::string diskPath(const std::string& filename);
+  void loadDiskIndex(void);
+  audio_ptr readFromDisk(const std::string& key, const std::string& filename);
+  void writeToDisk(const std::string& key, const audio_ptr& audio);
+  void removeFromDisk(std::unordered_map<std::string, std::list<DiskEntry>::iterator>::iterator it);
+  void addToMemory(const std::string& key, const audio_ptr& audio);
+
+  std::mutex m_mutex;
+
+  size_t m_maxMemoryBytes;
+  size_t m_memoryBytes;
+  std::list<MemoryEntry> m_memoryLru;
+  std::unordered_map<std::string, std::list<MemoryEntry>::iterator> m_memoryIndex;
+
+  std::string m_diskDir;
+  size_t m_maxDiskBytes;
+  size_t m_diskBytes;
+  std::list<DiskEntry> m_diskLru;
+  std::unordered_map<std::string, std::list<DiskEntry>::iterator> m_diskIndex;
+};
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef __WORKER_POOL_HPP__
+#define __WORKER_POOL_HPP__
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Fixed-size pool of threads shared by all sessions, with a bounded queue of jobs.
+ * Jobs still queued when the pool is destroyed are discarded without being run.
+ */
+class WorkerPool {
+public:
+  typedef std::function<void()> job_t;
+
+  WorkerPool(unsigned int nThreads, size_t maxQueued) : m_maxQueued(maxQueued), m_stopping(false) {
+    for (unsigned int i = 0; i < nThreads; i++) {
+      m_threads.emplace_back(&WorkerPool::run, this);
+    }
+  }
+
+  ~WorkerPool() {
+    {
+      std::lock_guard<std::mutex> lk(m_mutex);
+      m_stopping = true;
+      m_jobs.clear();
+    }
+    m_cond.notify_all();
+    for (auto& t : m_threads) t.join();
+  }
+
+  /* returns false if the queue is full */
+  bool submit(job_t job) {
+    {
+      std::lock_guard<std::mutex> lk(m_mutex);
+      if (m_stopping || m_jobs.size() >= m_maxQueued) return false;
+      m_jobs.push_back(std::move(job));
+    }
+    m_cond.notify_one();
+    return true;
+  }
+
+  size_t getNumQueued(void) {
+    std::lock_guard<std::mutex> lk(m_mutex);
+    return m_jobs.size();
+  }
+
+  // no default constructor or copying
+  WorkerPool() = delete;
+  WorkerPool(const WorkerPool&) = delete;
+  void operator=(const WorkerPool&) = delete;
+
+private:
+  void run(void) {
+    for (;;) {
+      job_t job;
+      {
+        std::unique_lock<std::mutex> lk(m_mutex);
+        m_cond.wait(lk, [this] { return m_stopping || !m_jobs.empty(); });
+        if (m_stopping) return;
+        job = std::move(m_jobs.front());
+        m_jobs.pop_front();
+      }
+      job();
+    }
+  }
+
+  std::mutex m_mutex;
+  std::condition_variable m_cond;
+  std::deque<job_t> m_jobs;
+  std::vector<std::thread> m_threads;
+  size_t m_maxQueued;
+  bool m_stopping;
+};
+
+#endif
@@ -1,12 +1,18 @@
 #include "audio_pipe.hpp"
+#include "dns_cache.hpp"
+#include "stream_metrics.hpp"
 
 #include <cassert>
+#include <algorithm>
 #include <sstream>
 #include <iostream>
 
 /* discard incoming text messages over the socket that are longer than this */
 #define MAX_RECV_BUF_SIZE (65 * 1024 * 10)
 #define RECV_BUF_REALLOC_SIZE (8 * 1024)
+#define HAPPY_EYEBALLS_DELAY_MS (250)
+/* tls client sessions each service context keeps for resumption, one per server */
+#define TLS_SESSION_CACHE_MAX (64)
 
 using namespace ibm;
 
@@ -41,11 +47,21 @@ int AudioPipe::lws_callback(struct lws *wsi,
       processPendingDisconnects(vhd);
       processPendingWrites();
       break;
+    case LWS_CALLBACK_TIMER:
+      {
+        // the first address has not connected yet, race the other address family against it
+        AudioPipe* ap = findPendingConnect(wsi);
+        if (ap && !ap->m_fallbackStarted && !ap->m_address[1].empty()) ap->connect_attempt(1);
+      }
+      break;
+
     case LWS_CALLBACK_CLIENT_CONNECTION_ERROR:
       {
-        AudioPipe* ap = findAndRemovePendingConnect(wsi);
+        AudioPipe* ap = findPendingConnect(wsi);
         int rc = lws_http_client_http_response(wsi);
         lwsl_err("AudioPipe::lws_service_thread LWS_CALLBACK_CLIENT_CONNECTION_ERROR: %s, response status %d\n", in ? (char *)in : "(null)", rc); 
+        if (ap && ap->connect_fallback(wsi)) break;
+        ap = findAndRemovePendingConnect(wsi);
         if (ap) {
           ap->m_state = LWS_CLIENT_FAILED;
           ap->m_callback(ap->m_uuid.c_str(), AudioPipe::CONNECT_FAIL, (char *) in, ap->isFinished(), ap->isInterimTranscriptsEnabled(), ap->getBugname().c_str());
@@ -61,6 +77,13 @@ int AudioPipe::lws_callback(struct lws *wsi,
         AudioPipe* ap = findAndRemovePendingConnect(wsi);
         if (ap) {
           std::ostringstream oss;
+          struct lws* other = ap->m_attempt[wsi == ap->m_attempt[0] ? 1 : 0];
+          ap->m_attempt[0] = ap->m_attempt[1] = nullptr;
+          if (other) lws_set_timeout(other, PENDING_TIMEOUT_USER_OK, LWS_TO_KILL_ASYNC);
+          ap->m_wsi = wsi;
+#if defined(LWS_WITH_TLS_SESSIONS)
+          if (lws_is_ssl(wsi)) stream_metrics::instance().tlsHandshake(lws_tls_session_is_reused(wsi));
+#endif
           *ppAp = ap;
           ap->m_vhd = vhd;
           ap->m_state = LWS_CLIENT_CONNECTED;
@@ -73,6 +96,7 @@ int AudioPipe::lws_callback(struct lws *wsi,
             oss << "{\"action\": \"start\",";
             oss << "\"content-type\": \"audio/l16;rate=16000\"";
             oss << ",\"interim_results\": true";
+            oss << ",\"timestamps\": true";
             oss << ",\"low_latency\": false";
             oss << "}";
 
@@ -82,7 +106,7 @@ int AudioPipe::lws_callback(struct lws *wsi,
 
         }
         else {
-          lwsl_err("AudioPipe::lws_service_thread LWS_CALLBACK_CLIENT_ESTABLISHED %s unable to find wsi %p..\n", ap->m_uuid.c_str(), wsi); 
+          lwsl_err("AudioPipe::lws_service_thread LWS_CALLBACK_CLIENT_ESTABLISHED unable to find wsi %p..\n", wsi); 
         }
       }      
       break;
@@ -90,7 +114,7 @@ int AudioPipe::lws_callback(struct lws *wsi,
       {
         AudioPipe* ap = *ppAp;
         if (!ap) {
-          lwsl_err("AudioPipe::lws_service_thread LWS_CALLBACK_CLIENT_CLOSED %s unable to find wsi %p..\n", ap->m_uuid.c_str(), wsi); 
+          lwsl_err("AudioPipe::lws_service_thread LWS_CALLBACK_CLIENT_CLOSED unable to find wsi %p..\n", wsi); 
           return 0;
         }
         if (ap->m_state == LWS_CLIENT_DISCONNECTING) {
@@ -119,7 +143,7 @@ int AudioPipe::lws_callback(struct lws *wsi,
       {
         AudioPipe* ap = *ppAp;
         if (!ap) {
-          lwsl_err("AudioPipe::lws_service_thread LWS_CALLBACK_CLIENT_RECEIVE %s unable to find wsi %p..\n", ap->m_uuid.c_str(), wsi); 
+          lwsl_err("AudioPipe::lws_service_thread LWS_CALLBACK_CLIENT_RECEIVE unable to find wsi %p..\n", wsi); 
           return 0;
         }
 
@@ -184,7 +208,7 @@ int AudioPipe::lws_callback(struct lws *wsi,
       {
         AudioPipe* ap = *ppAp;
         if (!ap) {
-          lwsl_err("AudioPipe::lws_service_thread LWS_CALLBACK_CLIENT_WRITEABLE %s unable to find wsi %p..\n", ap->m_uuid.c_str(), wsi); 
+          lwsl_err("AudioPipe::lws_service_thread LWS_CALLBACK_CLIENT_WRITEABLE unable to find wsi %p..\n", wsi); 
           return 0;
         }
 
@@ -269,20 +293,32 @@ std::unordered_map<std::thread::id, bool> AudioPipe::stopFlags;
 std::queue<std::thread::id> AudioPipe::threadIds;
 
 void AudioPipe::processPendingConnects(lws_per_vhost_data *vhd) {
-  std::list<AudioPipe*> connects;
+  std::list<AudioPipe*> connects, unresolved;
   {
     std::lock_guard<std::mutex> guard(mutex_connects);
-    for (auto it = pendingConnects.begin(); it != pendingConnects.end(); ++it) {
-      if ((*it)->m_state == LWS_CLIENT_IDLE) {
-        connects.push_back(*it);
-        (*it)->m_state = LWS_CLIENT_CONNECTING;
+    for (auto it = pendingConnects.begin(); it != pendingConnects.end();) {
+      AudioPipe* ap = *it;
+      if (ap->m_state == LWS_CLIENT_IDLE && ap->m_resolved && ap->m_address[0].empty()) {
+        unresolved.push_back(ap);
+        it = pendingConnects.erase(it);
+        continue;
+      }
+      if (ap->m_state == LWS_CLIENT_IDLE && ap->m_resolved) {
+        connects.push_back(ap);
+        ap->m_state = LWS_CLIENT_CONNECTING;
       }
+      ++it;
     }
   }
   for (auto it = connects.begin(); it != connects.end(); ++it) {
     AudioPipe* ap = *it;
     ap->connect_client(vhd);   
   }
+  for (auto it = unresolved.begin(); it != unresolved.end(); ++it) {
+    AudioPipe* ap = *it;
+    ap->m_state = LWS_CLIENT_FAILED;
+    ap->m_callback(ap->m_uuid.c_str(), AudioPipe::CONNECT_FAIL, (char *) "unable to resolve host", ap->isFinished(), ap->isInterimTranscriptsEnabled(), ap->getBugname().c_str());
+  }
 }
 
 void AudioPipe::processPendingDisconnects(lws_per_vhost_data *vhd) {
@@ -323,11 +359,11 @@ AudioPipe* AudioPipe::findAndRemovePendingConnect(struct lws *wsi) {
   for (auto it = pendingConnects.begin(); it != pendingConnects.end() && !ap; ++it) {
     int state = (*it)->m_state;
 
-    if ((*it)->m_wsi == nullptr)
+    if ((state == LWS_CLIENT_CONNECTING) && !(*it)->m_attempt[0] && !(*it)->m_attempt[1])
       toRemove.push_back(*it);
 
     if ((state == LWS_CLIENT_CONNECTING) &&
-      (*it)->m_wsi == wsi) ap = *it;
+      ((*it)->m_attempt[0] == wsi || (*it)->m_attempt[1] == wsi)) ap = *it;
   }
 
   for (auto it = toRemove.begin(); it != toRemove.end(); ++it)
@@ -347,7 +383,7 @@ AudioPipe* AudioPipe::findPendingConnect(struct lws *wsi) {
   for (auto it = pendingConnects.begin(); it != pendingConnects.end() && !ap; ++it) {
     int state = (*it)->m_state;
     if ((state == LWS_CLIENT_CONNECTING) &&
-      (*it)->m_wsi == wsi) ap = *it;
+      ((*it)->m_attempt[0] == wsi || (*it)->m_attempt[1] == wsi)) ap = *it;
   }
   return ap;
 }
@@ -359,6 +395,23 @@ void AudioPipe::addPendingConnect(AudioPipe* ap) {
     lwsl_debug("%s after adding connect there are %lu pending connects\n", 
       ap->m_uuid.c_str(), pendingConnects.size());
   }
+  // resolve off the service threads; the connect is picked up once the addresses are known
+  dns_cache::instance().resolve(ap->m_host, [ap](const std::vector<std::string>& v6, const std::vector<std::string>& v4) {
+    setResolved(ap, v6, v4);
+  });
+}
+void AudioPipe::setResolved(AudioPipe* ap, const std::vector<std::string>& v6, const std::vector<std::string>& v4) {
+  {
+    // the pipe may have gone while its name was being resolved
+    std::lock_guard<std::mutex> guard(mutex_connects);
+    if (std::find(pendingConnects.begin(), pendingConnects.end(), ap) == pendingConnects.end()) return;
+
+    // ipv6 first, with the first ipv4 address as the fallback
+    ap->m_address[0] = !v6.empty() ? v6[0] : (!v4.empty() ? v4[0] : "");
+    ap->m_address[1] = !v6.empty() && !v4.empty() ? v4[0] : "";
+    ap->m_resolved = true;
+    if (v6.empty() && v4.empty()) lwsl_notice("%s unable to resolve %s\n", ap->m_uuid.c_str(), ap->m_host.c_str());
+  }
   lws_cancel_service(contexts[nchild++ % numContexts]);
 }
 void AudioPipe::addPendingDisconnect(AudioPipe* ap) {
@@ -404,6 +457,10 @@ bool AudioPipe::lws_service_thread(unsigned int nServiceThread) {
   info.keepalive_timeout = 5;           // seconds to allow remote client to hold on to an idle HTTP/1.1 connection 
   info.timeout_secs_ah_idle = 10;       // secs to allow a client to hold an ah without using it
   info.retry_and_idle_policy = &retry;
+#if defined(LWS_WITH_TLS_SESSIONS)
+  // later connections to a server resume the session of an earlier one instead of a full handshake
+  info.tls_session_cache_max = TLS_SESSION_CACHE_MAX;
+#endif
 
   lwsl_notice("AudioPipe::lws_service_thread creating context in service thread %d.\n", nServiceThread);
   contexts[nServiceThread] = lws_create_context(&info);
@@ -444,6 +501,8 @@ void AudioPipe::initialize(unsigned int nThreads, int loglevel, log_emit_functio
 
 bool AudioPipe::deinitialize() {
   lwsl_notice("AudioPipe::deinitialize\n"); 
+  // resolved names are handed back through the lws contexts, so the resolver must be gone before they are destroyed
+  dns_cache::instance().shutdown();
   std::lock_guard<std::mutex> lock(mapMutex);
   if (!threadIds.empty()) {
       std::thread::id id = threadIds.front();
@@ -479,6 +538,8 @@ AudioPipe::AudioPipe(const char* uuid, const char* host, unsigned int port, cons
   m_state(LWS_CLIENT_IDLE), m_wsi(nullptr), m_vhd(nullptr), m_callback(callback) {
 
   m_audio_buffer = new uint8_t[m_audio_buffer_max_len];
+  m_attempt[0] = m_attempt[1] = nullptr;
+  m_resolved = m_fallbackStarted = false;
 }
 AudioPipe::~AudioPipe() {
   //std::cerr << "AudioPipe::~AudioPipe " << std::endl;
@@ -493,26 +554,51 @@ void AudioPipe::connect(void) {
 bool AudioPipe::connect_client(struct lws_per_vhost_data *vhd) {
   assert(m_audio_buffer != nullptr);
   assert(m_vhd == nullptr);
+
+  m_state = LWS_CLIENT_CONNECTING;
+  m_vhd = vhd;
+
+  // the preferred address family goes first; the other joins in if it has not connected in time
+  connect_attempt(0);
+  if (m_attempt[0] && !m_address[1].empty()) lws_set_timer_usecs(m_attempt[0], HAPPY_EYEBALLS_DELAY_MS * 1000);
+
+  return nullptr != m_attempt[0] || m_fallbackStarted;
+}
+
+void AudioPipe::connect_attempt(int n) {
   struct lws_client_connect_info i;
 
   memset(&i, 0, sizeof(i));
-  i.context = vhd->context;
+  i.context = m_vhd->context;
   i.port = m_port;
-  i.address = m_host.c_str();
+  // connect to the resolved address (by name if there is none) but present the name for sni and certificate checks
+  i.address = m_address[n].c_str();
   i.path = m_path.c_str();
-  i.host = i.address;
-  i.origin = i.address;
+  i.host = m_host.c_str();
+  i.origin = m_host.c_str();
   i.ssl_connection = LCCSCF_USE_SSL;
   //i.protocol = protocolName.c_str();
-  i.pwsi = &(m_wsi);
+  i.pwsi = &(m_attempt[n]);
 
-  m_state = LWS_CLIENT_CONNECTING;
-  m_vhd = vhd;
+  if (n == 1) m_fallbackStarted = true;
+  m_attempt[n] = lws_client_connect_via_info(&i);
+  lwsl_debug("%s attempting connection to %s, wsi is %p\n", m_uuid.c_str(), i.address, m_attempt[n]);
+}
 
-  m_wsi = lws_client_connect_via_info(&i);
-  lwsl_debug("%s attempting connection, wsi is %p\n", m_uuid.c_str(), m_wsi);
+// an attempt failed: returns true if another attempt is still, or now, under way
+bool AudioPipe::connect_fallback(struct lws *wsi) {
+  int other = (wsi == m_attempt[0]) ? 1 : 0;
 
-  return nullptr != m_wsi;
+  if (m_attempt[other]) {
+    m_attempt[1 - other] = nullptr;
+    return true;
+  }
+  if (m_fallbackStarted || m_address[1].empty()) return false;
+
+  connect_attempt(1);
+  if (!m_attempt[1]) return false;
+  m_attempt[0] = nullptr;
+  return true;
 }
 
 void AudioPipe::bufferForSending(const char* text) {
@@ -16,9 +16,12 @@
 #include <iostream>
 
 #include "mod_ibm_transcribe.h"
+#include "resampler_pool.hpp"
+#include "resample_write.h"
 #include "simple_buffer.h"
 #include "parser.hpp"
 #include "audio_pipe.hpp"
+#include "stream_metrics.hpp"
 
 #define RTP_PACKETIZATION_PERIOD 20
 #define FRAME_SIZE_8000  320 /*which means each 20ms frame as 320 bytes at 8 khz (1 channel only)*/
@@ -69,7 +72,7 @@ namespace {
         tech_pvt->pAudioPipe = nullptr;
       }
       if (tech_pvt->resampler) {
-          speex_resampler_destroy(tech_pvt->resampler);
+          resampler_pool::release(tech_pvt->resampler);
           tech_pvt->resampler = NULL;
       }
 
@@ -82,6 +85,24 @@ namespace {
     }
   }
 
+  /* offset of the end of the audio a watson result covers: the end time of its last word timestamp, in seconds; -1 if it has none */
+  static int64_t result_audio_ms(const char* json) {
+    int64_t audio_ms = -1;
+    cJSON* jMessage = cJSON_Parse(json);
+    if (jMessage) {
+      cJSON* jResult;
+      cJSON_ArrayForEach(jResult, cJSON_GetObjectItem(jMessage, "results")) {
+        cJSON* jAlt = cJSON_GetArrayItem(cJSON_GetObjectItem(jResult, "alternatives"), 0);
+        cJSON* jTimestamps = jAlt ? cJSON_GetObjectItem(jAlt, "timestamps") : nullptr;
+        int count = jTimestamps ? cJSON_GetArraySize(jTimestamps) : 0;
+        cJSON* jEnd = count ? cJSON_GetArrayItem(cJSON_GetArrayItem(jTimestamps, count - 1), 2) : nullptr;
+        if (cJSON_IsNumber(jEnd)) audio_ms = std::max(audio_ms, (int64_t) (jEnd->valuedouble * 1000));
+      }
+      cJSON_Delete(jMessage);
+    }
+    return audio_ms;
+  }
+
   static void responseHandler(switch_core_session_t* session, 
     const char* eventName, const char * json, const char* bugname, int finished) {
     switch_event_t *event;
@@ -96,6 +117,7 @@ namespace {
     }
     if (json) switch_event_add_body(event, "%s", json);
     if (bugname) switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "media-bugname", bugname);
+    media_clock_stamp(session, bugname, event, json && 0 == strcmp(eventName, TRANSCRIBE_EVENT_RESULTS) ? result_audio_ms(json) : -1);
     switch_event_fire(&event);
   }
 
@@ -162,6 +184,11 @@ namespace {
     return path;
   }
 
+  static private_t* findTechPvt(switch_channel_t *channel, const char* bugname) {
+    switch_media_bug_t *bug = (switch_media_bug_t*) switch_channel_get_private(channel, bugname);
+    return bug ? (private_t*) switch_core_media_bug_get_user_data(bug) : nullptr;
+  }
+
   static void eventCallback(const char* sessionId, ibm::AudioPipe::NotifyEvent_t event, const char* message, bool finished, bool wantsInterim, const char* bugname) {
     switch_core_session_t* session = switch_core_session_locate(sessionId);
     if (session) {
@@ -171,6 +198,10 @@ namespace {
       switch (event) {
         case ibm::AudioPipe::CONNECT_SUCCESS:
           switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_INFO, "connection successful\n");
+          {
+            private_t* tech_pvt = findTechPvt(channel, bugname);
+            if (tech_pvt) stream_metrics::mark_connected(*tech_pvt);
+          }
           responseHandler(session, TRANSCRIBE_EVENT_CONNECT_SUCCESS, NULL, bugname, finished);
         break;
         case ibm::AudioPipe::CONNECT_FAIL:
@@ -179,6 +210,7 @@ namespace {
           std::stringstream json;
           json << "{\"reason\":\"" << message << "\"}";
           releaseAudioPipe = true;
+          stream_metrics::instance().error("connect_failed");
           responseHandler(session, TRANSCRIBE_EVENT_CONNECT_FAIL, (char *) json.str().c_str(), bugname, finished);
           switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_NOTICE, "connection failed: %s\n", message);
         }
@@ -186,6 +218,7 @@ namespace {
         case ibm::AudioPipe::CONNECTION_DROPPED:
           // first thing: we can no longer access the AudioPipe
           releaseAudioPipe = true;
+          stream_metrics::instance().error("dropped");
           responseHandler(session, TRANSCRIBE_EVENT_DISCONNECT, NULL, bugname, finished);
           switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "connection dropped from far end\n");
         break;
@@ -199,12 +232,21 @@ namespace {
             switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "ibm service is listening\n");
           }
           else if (NULL != strstr(message, "\"final\": false")) {
+            private_t* tech_pvt = findTechPvt(channel, bugname);
+            if (tech_pvt) stream_metrics::mark_result(*tech_pvt, false);
+            else stream_metrics::instance().result(false);
             switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "got interim transcript: %s\n", message);
           }
           else if (NULL != strstr(message, "\"error\":")) {
+            stream_metrics::instance().error("vendor_error");
             responseHandler(session, TRANSCRIBE_EVENT_ERROR, message, bugname, finished);
           }
-          else responseHandler(session, TRANSCRIBE_EVENT_RESULTS, message, bugname, finished);
+          else {
+            private_t* tech_pvt = findTechPvt(channel, bugname);
+            if (tech_pvt) stream_metrics::mark_result(*tech_pvt, true);
+            else stream_metrics::instance().result(true);
+            responseHandler(session, TRANSCRIBE_EVENT_RESULTS, message, bugname, finished);
+          }
         break;
 
         default:
@@ -240,6 +282,7 @@ namespace {
     switch_core_session_get_read_impl(session, &read_impl);
   
     memset(tech_pvt, 0, sizeof(private_t));
+    stream_metrics::mark_init(*tech_pvt);
   
     std::ostringstream oss;
     oss << "api." << region << ".speech-to-text.watson.cloud.ibm.com";
@@ -277,7 +320,7 @@ namespace {
 
     if (desiredSampling != sampling) {
       switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "(%u) resampling from %u to %u\n", tech_pvt->id, sampling, desiredSampling);
-      tech_pvt->resampler = speex_resampler_init(channels, sampling, desiredSampling, SWITCH_RESAMPLE_QUALITY, &err);
+      tech_pvt->resampler = resampler_pool::acquire(channels, sampling, desiredSampling, SWITCH_RESAMPLE_QUALITY, &err);
       if (0 != err) {
         switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "Error initializing resampler: %s.\n", speex_resampler_strerror(err));
         return SWITCH_STATUS_FALSE;
@@ -314,6 +357,7 @@ extern "C" {
  
     int logs = LLL_ERR | LLL_WARN | LLL_NOTICE || LLL_INFO | LLL_PARSER | LLL_HEADER | LLL_EXT | LLL_CLIENT  | LLL_LATENCY | LLL_DEBUG ;
     
+    stream_metrics::instance().init("ibm_transcribe");
     ibm::AudioPipe::initialize(nServiceThreads, logs, lws_logger);
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "AudioPipe::initialize completed\n");
 
@@ -323,6 +367,7 @@ extern "C" {
   switch_status_t ibm_transcribe_cleanup() {
     bool cleanup = false;
     cleanup = ibm::AudioPipe::deinitialize();
+    stream_metrics::instance().shutdown();
     if (cleanup == true) {
         return SWITCH_STATUS_SUCCESS;
     }
@@ -350,6 +395,8 @@ extern "C" {
 
     ibm::AudioPipe *pAudioPipe = static_cast<ibm::AudioPipe *>(tech_pvt->pAudioPipe);
     switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "connecting now\n");
+    stream_metrics::instance().streamStarted();
+    stream_metrics::mark_connect_start(*tech_pvt);
     pAudioPipe->connect();
     switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "connection in progress\n");
     return SWITCH_STATUS_SUCCESS;
@@ -385,6 +432,7 @@ extern "C" {
       switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "(%u) ibm_transcribe_session_stop, null audiopipe\n", id);
     }
     destroy_tech_pvt(tech_pvt);
+    stream_metrics::instance().streamEnded();
     switch_mutex_unlock(tech_pvt->mutex);
     switch_mutex_destroy(tech_pvt->mutex);
     tech_pvt->mutex = nullptr;
@@ -393,8 +441,10 @@ extern "C" {
   }
 	
 	switch_bool_t ibm_transcribe_frame(switch_core_session_t *session, switch_media_bug_t *bug) {
+    stream_metrics::FrameTimer timer;
     private_t* tech_pvt = (private_t*) switch_core_media_bug_get_user_data(bug);
     size_t inuse = 0;
+    size_t bytes = 0;
     bool dirty = false;
     char *p = (char *) "{\"msg\": \"buffer overrun\"}";
 
@@ -427,6 +477,7 @@ extern "C" {
             }
             switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "(%u) dropping packets!\n", 
               tech_pvt->id);
+            if (frame.datalen) stream_metrics::instance().framesDropped(pAudioPipe->binaryBufferedBytes() / frame.datalen);
             pAudioPipe->binaryWritePtrResetToZero();
 
             frame.data = pAudioPipe->binaryWritePtr();
@@ -436,7 +487,9 @@ extern "C" {
           switch_status_t rv = switch_core_media_bug_read(bug, &frame, SWITCH_TRUE);
           if (rv != SWITCH_STATUS_SUCCESS) break;
           if (frame.datalen) {
+            media_clock_advance(session, tech_pvt, frame.samples);
             pAudioPipe->binaryWritePtrAdd(frame.datalen);
+            bytes += frame.datalen;
             frame.buflen = available = pAudioPipe->binarySpaceAvailable();
             frame.data = pAudioPipe->binaryWritePtr();
             dirty = true;
@@ -450,25 +503,21 @@ extern "C" {
         frame.buflen = SWITCH_RECOMMENDED_BUFFER_SIZE;
         while (switch_core_media_bug_read(bug, &frame, SWITCH_TRUE) == SWITCH_STATUS_SUCCESS) {
           if (frame.datalen) {
-            spx_uint32_t out_len = available >> 1;  // space for samples which are 2 bytes
-            spx_uint32_t in_len = frame.samples;
-
-            speex_resampler_process_interleaved_int(tech_pvt->resampler, 
-              (const spx_int16_t *) frame.data, 
-              (spx_uint32_t *) &in_len, 
-              (spx_int16_t *) ((char *) pAudioPipe->binaryWritePtr()),
-              &out_len);
-
-            if (out_len > 0) {
-              // bytes written = (num samples) * (2 bytes per sample) * (num channels)
-              size_t bytes_written = out_len * 2 * tech_pvt->channels;
-              //std::cerr << "read " << in_len << " samples, wrote " << out_len << " samples, wrote " << bytes_written << " bytes " << std::endl;
-              pAudioPipe->binaryWritePtrAdd(bytes_written);
+            media_clock_advance(session, tech_pvt, frame.samples);
+            // resample straight into the ring buffer
+            size_t dropped = 0;
+            size_t written = resample_write(tech_pvt->resampler, tech_pvt->channels, frame.data, frame.datalen,
+              pAudioPipe->binaryWritePtr(), available, &dropped);
+
+            if (written > 0) {
+              pAudioPipe->binaryWritePtrAdd(written);
+              bytes += written;
               available = pAudioPipe->binarySpaceAvailable();
-              
               dirty = true;
             }
-            if (available < pAudioPipe->binaryMinSpace()) {
+            // out of space: either some of this frame could not be resampled, or the next one may not fit
+            if (dropped > 0 || available < pAudioPipe->binaryMinSpace()) {
+              if (dropped > 0) stream_metrics::instance().framesDropped(1);
               if (!tech_pvt->buffer_overrun_notified) {
                 tech_pvt->buffer_overrun_notified = 1;
                 switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "(%u) dropping packets!\n", 
@@ -483,7 +532,27 @@ extern "C" {
 
       pAudioPipe->unlockAudioBuffer();
       switch_mutex_unlock(tech_pvt->mutex);
+      if (bytes) {
+        stream_metrics::mark_audio_sent(*tech_pvt);
+        stream_metrics::instance().bytesSent(bytes);
+      }
     }
     return SWITCH_TRUE;
   }
+
+  switch_status_t ibm_transcribe_metrics(switch_stream_handle_t *stream) {
+    std::string text;
+
+    stream_metrics::instance().render(text);
+    stream->write_function(stream, "%s", text.c_str());
+    return SWITCH_STATUS_SUCCESS;
+  }
+
+  switch_status_t ibm_transcribe_latency(switch_stream_handle_t *stream) {
+    std::string text;
+
+    stream_metrics::instance().latency(text);
+    stream->write_function(stream, "%s", text.c_str());
+    return SWITCH_STATUS_SUCCESS;
+  }
 }
@@ -153,6 +153,14 @@ SWITCH_STANDARD_API(ibm_transcribe_function)
 }
 
 
+#define METRICS_API_SYNTAX "[latency]"
+SWITCH_STANDARD_API(metrics_function)
+{
+	if (!zstr(cmd) && 0 == strcasecmp(cmd, "latency")) ibm_transcribe_latency(stream);
+	else ibm_transcribe_metrics(stream);
+	return SWITCH_STATUS_SUCCESS;
+}
+
 SWITCH_MODULE_LOAD_FUNCTION(mod_ibm_transcribe_load)
 {
 	switch_api_interface_t *api_interface;
@@ -199,6 +207,7 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_ibm_transcribe_load)
 	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "IBM Speech Transcription API successfully loaded\n");
 
 	SWITCH_ADD_API(api_interface, "uuid_ibm_transcribe", "IBM Speech Transcription API", ibm_transcribe_function, TRANSCRIBE_API_SYNTAX);
+	SWITCH_ADD_API(api_interface, "ibm_transcribe_metrics", "IBM Speech Transcription metrics in prometheus text format", metrics_function, METRICS_API_SYNTAX);
 	switch_console_set_complete("add uuid_ibm_transcribe start lang-code [interim|final] [stereo|mono]");
 	switch_console_set_complete("add uuid_ibm_transcribe stop ");
 
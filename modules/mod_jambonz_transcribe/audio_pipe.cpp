@@ -1,11 +1,17 @@
 #include "audio_pipe.hpp"
+#include "dns_cache.hpp"
+#include "stream_metrics.hpp"
 
 #include <cassert>
+#include <algorithm>
 #include <iostream>
 
 /* discard incoming text messages over the socket that are longer than this */
 #define MAX_RECV_BUF_SIZE (65 * 1024 * 10)
 #define RECV_BUF_REALLOC_SIZE (8 * 1024)
+#define HAPPY_EYEBALLS_DELAY_MS (250)
+/* tls client sessions each service context keeps for resumption, one per server */
+#define TLS_SESSION_CACHE_MAX (64)
 
 using namespace jambonz;
 
@@ -53,14 +59,24 @@ int AudioPipe::lws_callback(struct lws *wsi,
       processPendingDisconnects(vhd);
       processPendingWrites();
       break;
+    case LWS_CALLBACK_TIMER:
+      {
+        // the first address has not connected yet, race the other address family against it
+        AudioPipe* ap = findPendingConnect(wsi);
+        if (ap && !ap->m_fallbackStarted && !ap->m_address[1].empty()) ap->connect_attempt(1);
+      }
+      break;
+
     case LWS_CALLBACK_CLIENT_CONNECTION_ERROR:
       {
-        AudioPipe* ap = findAndRemovePendingConnect(wsi);
+        AudioPipe* ap = findPendingConnect(wsi);
         int rc = lws_http_client_http_response(wsi);
         lwsl_err("AudioPipe::lws_service_thread LWS_CALLBACK_CLIENT_CONNECTION_ERROR: %s, response status %d\n", in ? (char *)in : "(null)", rc); 
+        if (ap && ap->connect_fallback(wsi)) break;
+        ap = findAndRemovePendingConnect(wsi);
         if (ap) {
           ap->m_state = LWS_CLIENT_FAILED;
-          ap->m_callback(ap->m_uuid.c_str(), ap->m_bugname.c_str(), AudioPipe::CONNECT_FAIL, (char *) in, ap->isFinished());
+          ap->notify(AudioPipe::CONNECT_FAIL, (char *) in);
         }
         else {
           lwsl_err("AudioPipe::lws_service_thread LWS_CALLBACK_CLIENT_CONNECTION_ERROR unable to find wsi %p..\n", wsi); 
@@ -72,13 +88,20 @@ int AudioPipe::lws_callback(struct lws *wsi,
       {
         AudioPipe* ap = findAndRemovePendingConnect(wsi);
         if (ap) {
+          struct lws* other = ap->m_attempt[wsi == ap->m_attempt[0] ? 1 : 0];
+          ap->m_attempt[0] = ap->m_attempt[1] = nullptr;
+          if (other) lws_set_timeout(other, PENDING_TIMEOUT_USER_OK, LWS_TO_KILL_ASYNC);
+          ap->m_wsi = wsi;
+#if defined(LWS_WITH_TLS_SESSIONS)
+          if (lws_is_ssl(wsi)) stream_metrics::instance().tlsHandshake(lws_tls_session_is_reused(wsi));
+#endif
           *ppAp = ap;
           ap->m_vhd = vhd;
           ap->m_state = LWS_CLIENT_CONNECTED;
-          ap->m_callback(ap->m_uuid.c_str(), ap->m_bugname.c_str(), AudioPipe::CONNECT_SUCCESS, NULL,  ap->isFinished());
+          ap->notify(AudioPipe::CONNECT_SUCCESS, NULL);
         }
         else {
-          lwsl_err("AudioPipe::lws_service_thread LWS_CALLBACK_CLIENT_ESTABLISHED %s unable to find wsi %p..\n", ap->m_uuid.c_str(), wsi); 
+          lwsl_err("AudioPipe::lws_service_thread LWS_CALLBACK_CLIENT_ESTABLISHED unable to find wsi %p..\n", wsi); 
         }
       }      
       break;
@@ -86,19 +109,19 @@ int AudioPipe::lws_callback(struct lws *wsi,
       {
         AudioPipe* ap = *ppAp;
         if (!ap) {
-          lwsl_err("AudioPipe::lws_service_thread LWS_CALLBACK_CLIENT_CLOSED %s unable to find wsi %p..\n", ap->m_uuid.c_str(), wsi); 
+          lwsl_err("AudioPipe::lws_service_thread LWS_CALLBACK_CLIENT_CLOSED unable to find wsi %p..\n", wsi); 
           return 0;
         }
         if (ap->m_state == LWS_CLIENT_DISCONNECTING) {
           // closed by us
 
           lwsl_debug("%s socket closed by us\n", ap->m_uuid.c_str());
-          ap->m_callback(ap->m_uuid.c_str(), ap->m_bugname.c_str(), AudioPipe::CONNECTION_CLOSED_GRACEFULLY, NULL,  ap->isFinished());
+          ap->notify(AudioPipe::CONNECTION_CLOSED_GRACEFULLY, NULL);
         }
         else if (ap->m_state == LWS_CLIENT_CONNECTED) {
           // closed by far end
           lwsl_info("%s socket closed by far end\n", ap->m_uuid.c_str());
-          ap->m_callback(ap->m_uuid.c_str(), ap->m_bugname.c_str(), AudioPipe::CONNECTION_DROPPED, NULL,  ap->isFinished());
+          ap->notify(AudioPipe::CONNECTION_DROPPED, NULL);
         }
         ap->m_state = LWS_CLIENT_DISCONNECTED;
         ap->setClosed();
@@ -115,7 +138,7 @@ int AudioPipe::lws_callback(struct lws *wsi,
       {
         AudioPipe* ap = *ppAp;
         if (!ap) {
-          lwsl_err("AudioPipe::lws_service_thread LWS_CALLBACK_CLIENT_RECEIVE %s unable to find wsi %p..\n", ap->m_uuid.c_str(), wsi); 
+          lwsl_err("AudioPipe::lws_service_thread LWS_CALLBACK_CLIENT_RECEIVE unable to find wsi %p..\n", wsi); 
           return 0;
         }
 
@@ -160,7 +183,7 @@ int AudioPipe::lws_callback(struct lws *wsi,
           if (lws_is_final_fragment(wsi)) {
             if (nullptr != ap->m_recv_buf) {
               std::string msg((char *)ap->m_recv_buf, ap->m_recv_buf_ptr - ap->m_recv_buf);
-              ap->m_callback(ap->m_uuid.c_str(), ap->m_bugname.c_str(), AudioPipe::MESSAGE, msg.c_str(),  ap->isFinished());
+              ap->notify(AudioPipe::MESSAGE, msg.c_str());
               if (nullptr != ap->m_recv_buf) free(ap->m_recv_buf);
             }
             ap->m_recv_buf = ap->m_recv_buf_ptr = nullptr;
@@ -174,7 +197,7 @@ int AudioPipe::lws_callback(struct lws *wsi,
       {
         AudioPipe* ap = *ppAp;
         if (!ap) {
-          lwsl_err("AudioPipe::lws_service_thread LWS_CALLBACK_CLIENT_WRITEABLE %s unable to find wsi %p..\n", ap->m_uuid.c_str(), wsi); 
+          lwsl_err("AudioPipe::lws_service_thread LWS_CALLBACK_CLIENT_WRITEABLE unable to find wsi %p..\n", wsi); 
           return 0;
         }
 
@@ -256,22 +279,42 @@ AudioPipe::log_emit_function AudioPipe::logger;
 std::mutex AudioPipe::mapMutex;
 std::unordered_map<std::thread::id, bool> AudioPipe::stopFlags;
 std::queue<std::thread::id> AudioPipe::threadIds;
+std::mutex AudioPipe::mutex_pool;
+std::unordered_map<std::string, AudioPipe::PoolDemand> AudioPipe::pool;
+std::list<AudioPipe*> AudioPipe::poolClosing;
+unsigned int AudioPipe::poolSize = 0;
+unsigned int AudioPipe::poolTtlSecs = 0;
+bool AudioPipe::poolStop = false;
+std::condition_variable AudioPipe::poolCv;
+std::thread AudioPipe::poolThread;
 
 void AudioPipe::processPendingConnects(lws_per_vhost_data *vhd) {
-  std::list<AudioPipe*> connects;
+  std::list<AudioPipe*> connects, unresolved;
   {
     std::lock_guard<std::mutex> guard(mutex_connects);
-    for (auto it = pendingConnects.begin(); it != pendingConnects.end(); ++it) {
-      if ((*it)->m_state == LWS_CLIENT_IDLE) {
-        connects.push_back(*it);
-        (*it)->m_state = LWS_CLIENT_CONNECTING;
+    for (auto it = pendingConnects.begin(); it != pendingConnects.end();) {
+      AudioPipe* ap = *it;
+      if (ap->m_state == LWS_CLIENT_IDLE && ap->m_resolved && ap->m_address[0].empty()) {
+        unresolved.push_back(ap);
+        it = pendingConnects.erase(it);
+        continue;
+      }
+      if (ap->m_state == LWS_CLIENT_IDLE && ap->m_resolved) {
+        connects.push_back(ap);
+        ap->m_state = LWS_CLIENT_CONNECTING;
       }
+      ++it;
     }
   }
   for (auto it = connects.begin(); it != connects.end(); ++it) {
     AudioPipe* ap = *it;
     ap->connect_client(vhd);   
   }
+  for (auto it = unresolved.begin(); it != unresolved.end(); ++it) {
+    AudioPipe* ap = *it;
+    ap->m_state = LWS_CLIENT_FAILED;
+    ap->notify(AudioPipe::CONNECT_FAIL, "unable to resolve host");
+  }
 }
 
 void AudioPipe::processPendingDisconnects(lws_per_vhost_data *vhd) {
@@ -312,11 +355,11 @@ AudioPipe* AudioPipe::findAndRemovePendingConnect(struct lws *wsi) {
   for (auto it = pendingConnects.begin(); it != pendingConnects.end() && !ap; ++it) {
     int state = (*it)->m_state;
 
-    if ((*it)->m_wsi == nullptr)
+    if ((state == LWS_CLIENT_CONNECTING) && !(*it)->m_attempt[0] && !(*it)->m_attempt[1])
       toRemove.push_back(*it);
 
     if ((state == LWS_CLIENT_CONNECTING) &&
-      (*it)->m_wsi == wsi) ap = *it;
+      ((*it)->m_attempt[0] == wsi || (*it)->m_attempt[1] == wsi)) ap = *it;
   }
 
   for (auto it = toRemove.begin(); it != toRemove.end(); ++it)
@@ -336,7 +379,7 @@ AudioPipe* AudioPipe::findPendingConnect(struct lws *wsi) {
   for (auto it = pendingConnects.begin(); it != pendingConnects.end() && !ap; ++it) {
     int state = (*it)->m_state;
     if ((state == LWS_CLIENT_CONNECTING) &&
-      (*it)->m_wsi == wsi) ap = *it;
+      ((*it)->m_attempt[0] == wsi || (*it)->m_attempt[1] == wsi)) ap = *it;
   }
   return ap;
 }
@@ -348,6 +391,23 @@ void AudioPipe::addPendingConnect(AudioPipe* ap) {
     lwsl_debug("%s after adding connect there are %lu pending connects\n", 
       ap->m_uuid.c_str(), pendingConnects.size());
   }
+  // resolve off the service threads; the connect is picked up once the addresses are known
+  dns_cache::instance().resolve(ap->m_host, [ap](const std::vector<std::string>& v6, const std::vector<std::string>& v4) {
+    setResolved(ap, v6, v4);
+  });
+}
+void AudioPipe::setResolved(AudioPipe* ap, const std::vector<std::string>& v6, const std::vector<std::string>& v4) {
+  {
+    // the pipe may have gone while its name was being resolved
+    std::lock_guard<std::mutex> guard(mutex_connects);
+    if (std::find(pendingConnects.begin(), pendingConnects.end(), ap) == pendingConnects.end()) return;
+
+    // ipv6 first, with the first ipv4 address as the fallback
+    ap->m_address[0] = !v6.empty() ? v6[0] : (!v4.empty() ? v4[0] : "");
+    ap->m_address[1] = !v6.empty() && !v4.empty() ? v4[0] : "";
+    ap->m_resolved = true;
+    if (v6.empty() && v4.empty()) lwsl_notice("%s unable to resolve %s\n", ap->m_uuid.c_str(), ap->m_host.c_str());
+  }
   lws_cancel_service(contexts[nchild++ % numContexts]);
 }
 void AudioPipe::addPendingDisconnect(AudioPipe* ap) {
@@ -393,6 +453,10 @@ bool AudioPipe::lws_service_thread(unsigned int nServiceThread) {
   info.keepalive_timeout = 5;           // seconds to allow remote client to hold on to an idle HTTP/1.1 connection 
   info.timeout_secs_ah_idle = 10;       // secs to allow a client to hold an ah without using it
   info.retry_and_idle_policy = &retry;
+#if defined(LWS_WITH_TLS_SESSIONS)
+  // later connections to a server resume the session of an earlier one instead of a full handshake
+  info.tls_session_cache_max = TLS_SESSION_CACHE_MAX;
+#endif
 
   lwsl_notice("AudioPipe::lws_service_thread creating context in service thread %d.\n", nServiceThread);
 
@@ -432,8 +496,112 @@ void AudioPipe::initialize(unsigned int nThreads, int loglevel, log_emit_functio
   }
 }
 
+void AudioPipe::initializePool(unsigned int size, unsigned int ttlSecs) {
+  if (0 == size || 0 == ttlSecs) return;
+  poolSize = size;
+  poolTtlSecs = ttlSecs;
+
+  lwsl_notice("AudioPipe::initializePool keeping %u warm connections per endpoint for %u secs\n", size, ttlSecs);
+  poolThread = std::thread(&AudioPipe::poolMaintenance);
+}
+
+AudioPipe* AudioPipe::claim(const char* uuid, const char* bugname, const char* host, unsigned int port, const char* path,
+  int sslFlags, size_t bufLen, size_t minFreespace, const char* apiKey, notifyHandler_t callback) {
+  AudioPipe* ap = nullptr;
+
+  if (0 == poolSize) return nullptr;
+
+  std::string key = std::string(sslFlags ? "wss://" : "ws://") + host + ":" + std::to_string(port) + path + " " + apiKey;
+  std::lock_guard<std::mutex> guard(mutex_pool);
+  PoolDemand& demand = pool[key];
+  demand.host = host;
+  demand.port = port;
+  demand.path = path;
+  demand.sslFlags = sslFlags;
+  demand.apiKey = apiKey;
+  demand.bufLen = bufLen;
+  demand.minFreespace = minFreespace;
+  demand.callback = callback;
+  demand.lastClaim = std::chrono::steady_clock::now();
+
+  for (auto it = demand.pipes.begin(); it != demand.pipes.end(); ++it) {
+    if ((*it)->m_state == LWS_CLIENT_CONNECTED) {
+      ap = *it;
+      demand.pipes.erase(it);
+      ap->adopt(uuid, bugname, bufLen, minFreespace);
+      break;
+    }
+  }
+  lwsl_debug("%s %s warm connection for %s:%u, %lu left\n", uuid, ap ? "claimed" : "no", host, port, demand.pipes.size());
+  return ap;
+}
+
+// once a second: reap pipes that failed or closed, close those past their ttl,
+// and top up endpoints that have been asked for recently
+void AudioPipe::poolMaintenance(void) {
+  std::unique_lock<std::mutex> lock(mutex_pool);
+  while (!poolCv.wait_for(lock, std::chrono::seconds(1), [] { return poolStop; })) {
+    auto now = std::chrono::steady_clock::now();
+
+    for (auto it = poolClosing.begin(); it != poolClosing.end(); ) {
+      if ((*it)->m_state == LWS_CLIENT_DISCONNECTED || (*it)->m_state == LWS_CLIENT_FAILED) {
+        delete *it;
+        it = poolClosing.erase(it);
+      }
+      else ++it;
+    }
+
+    for (auto dit = pool.begin(); dit != pool.end(); ) {
+      PoolDemand& demand = dit->second;
+      for (auto it = demand.pipes.begin(); it != demand.pipes.end(); ) {
+        AudioPipe* ap = *it;
+        if (ap->m_state == LWS_CLIENT_DISCONNECTED || ap->m_state == LWS_CLIENT_FAILED) {
+          delete ap;
+          it = demand.pipes.erase(it);
+          continue;
+        }
+        if (ap->m_state == LWS_CLIENT_CONNECTED && now - ap->m_pooledAt >= std::chrono::seconds(poolTtlSecs)) {
+          ap->close();
+          poolClosing.push_back(ap);
+          it = demand.pipes.erase(it);
+          continue;
+        }
+        ++it;
+      }
+
+      if (now - demand.lastClaim < std::chrono::seconds(poolTtlSecs)) {
+        while (demand.pipes.size() < poolSize) {
+          AudioPipe* ap = new AudioPipe("", "", demand.host.c_str(), demand.port, demand.path.c_str(),
+            demand.sslFlags, demand.bufLen, demand.minFreespace, demand.apiKey.c_str(), demand.callback);
+          ap->m_pooledAt = now;
+          demand.pipes.push_back(ap);
+          ap->connect();
+        }
+      }
+      else if (demand.pipes.empty()) {
+        dit = pool.erase(dit);
+        continue;
+      }
+      ++dit;
+    }
+  }
+}
+
 bool AudioPipe::deinitialize() {
   lwsl_notice("AudioPipe::deinitialize\n"); 
+  // resolved names are handed back through the lws contexts, so the resolver must be gone before they are destroyed
+  dns_cache::instance().shutdown();
+  std::list<AudioPipe*> pooled;
+  {
+    std::lock_guard<std::mutex> guard(mutex_pool);
+    poolStop = true;
+    for (auto it = pool.begin(); it != pool.end(); ++it) pooled.splice(pooled.end(), it->second.pipes);
+    pooled.splice(pooled.end(), poolClosing);
+    pool.clear();
+  }
+  // the maintenance thread connects pipes on the lws contexts, so it must be gone before they are destroyed
+  poolCv.notify_all();
+  if (poolThread.joinable()) poolThread.join();
   std::lock_guard<std::mutex> lock(mapMutex);
   if (!threadIds.empty()) {
       std::thread::id id = threadIds.front();
@@ -456,6 +624,7 @@ bool AudioPipe::deinitialize() {
     lws_context_destroy(contexts[i]);
   }
   std::this_thread::sleep_for(std::chrono::seconds(2));
+  for (auto it = pooled.begin(); it != pooled.end(); ++it) delete *it;
   return true;
 }
 
@@ -468,6 +637,8 @@ AudioPipe::AudioPipe(const char* uuid, const char* bugname, const char* host, un
   m_state(LWS_CLIENT_IDLE), m_wsi(nullptr), m_vhd(nullptr), m_apiKey(apiKey), m_callback(callback) {
 
   m_audio_buffer = new uint8_t[m_audio_buffer_max_len];
+  m_attempt[0] = m_attempt[1] = nullptr;
+  m_resolved = m_fallbackStarted = false;
 }
 AudioPipe::~AudioPipe() {
   if (m_audio_buffer) delete [] m_audio_buffer;
@@ -478,29 +649,81 @@ void AudioPipe::connect(void) {
   addPendingConnect(this);
 }
 
+// events for pipes waiting in the pool (no uuid yet) are not delivered
+void AudioPipe::notify(NotifyEvent_t event, const char* message) {
+  std::string uuid, bugname;
+  {
+    std::lock_guard<std::mutex> lk(m_uuid_mutex);
+    uuid = m_uuid;
+    bugname = m_bugname;
+  }
+  if (!uuid.empty()) m_callback(uuid.c_str(), bugname.c_str(), event, message, isFinished());
+}
+
+void AudioPipe::adopt(const char* uuid, const char* bugname, size_t bufLen, size_t minFreespace) {
+  {
+    std::lock_guard<std::mutex> lk(m_uuid_mutex);
+    m_uuid = uuid;
+    m_bugname = bugname;
+  }
+  std::lock_guard<std::mutex> lk(m_audio_mutex);
+  if (bufLen != m_audio_buffer_max_len) {
+    delete [] m_audio_buffer;
+    m_audio_buffer = new uint8_t[bufLen];
+    m_audio_buffer_max_len = bufLen;
+  }
+  m_audio_buffer_min_freespace = minFreespace;
+  m_audio_buffer_write_offset = LWS_PRE;
+}
+
 bool AudioPipe::connect_client(struct lws_per_vhost_data *vhd) {
   assert(m_audio_buffer != nullptr);
   assert(m_vhd == nullptr);
+
+  m_state = LWS_CLIENT_CONNECTING;
+  m_vhd = vhd;
+
+  // the preferred address family goes first; the other joins in if it has not connected in time
+  connect_attempt(0);
+  if (m_attempt[0] && !m_address[1].empty()) lws_set_timer_usecs(m_attempt[0], HAPPY_EYEBALLS_DELAY_MS * 1000);
+
+  return nullptr != m_attempt[0] || m_fallbackStarted;
+}
+
+void AudioPipe::connect_attempt(int n) {
   struct lws_client_connect_info i;
 
   memset(&i, 0, sizeof(i));
-  i.context = vhd->context;
+  i.context = m_vhd->context;
   i.port = m_port;
-  i.address = m_host.c_str();
+  // connect to the resolved address (by name if there is none) but present the name for sni and certificate checks
+  i.address = m_address[n].c_str();
   i.path = m_path.c_str();
-  i.host = i.address;
-  i.origin = i.address;
+  i.host = m_host.c_str();
+  i.origin = m_host.c_str();
   i.ssl_connection = m_sslFlags;
   //i.protocol = protocolName.c_str();
-  i.pwsi = &(m_wsi);
+  i.pwsi = &(m_attempt[n]);
 
-  m_state = LWS_CLIENT_CONNECTING;
-  m_vhd = vhd;
+  if (n == 1) m_fallbackStarted = true;
+  m_attempt[n] = lws_client_connect_via_info(&i);
+  lwsl_debug("%s attempting connection to %s, wsi is %p\n", m_uuid.c_str(), i.address, m_attempt[n]);
+}
 
-  m_wsi = lws_client_connect_via_info(&i);
-  lwsl_debug("%s attempting connection, wsi is %p\n", m_uuid.c_str(), m_wsi);
+// an attempt failed: returns true if another attempt is still, or now, under way
+bool AudioPipe::connect_fallback(struct lws *wsi) {
+  int other = (wsi == m_attempt[0]) ? 1 : 0;
 
-  return nullptr != m_wsi;
+  if (m_attempt[other]) {
+    m_attempt[1 - other] = nullptr;
+    return true;
+  }
+  if (m_fallbackStarted || m_address[1].empty()) return false;
+
+  connect_attempt(1);
+  if (!m_attempt[1]) return false;
+  m_attempt[0] = nullptr;
+  return true;
 }
 
 void AudioPipe::bufferForSending(const char* text) {
@@ -0,0 +1,234 @@
+#ifndef __DNS_CACHE_HPP__
+#define __DNS_CACHE_HPP__
+
+#include <string>
+#include <vector>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <deque>
+#include <chrono>
+#include <functional>
+#include <unordered_map>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+
+#include <netdb.h>
+#include <resolv.h>
+#include <arpa/inet.h>
+#include <arpa/nameser.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+/*
+  Asynchronous cache of a host's A and AAAA records, held for the records' own TTL (clamped to
+  DNS_CACHE_MIN_TTL_SECS..DNS_CACHE_MAX_TTL_SECS).  Lookups run one at a time on a single resolver
+  thread owned by the cache, so a slow resolver never holds up an lws service thread; an expired
+  entry is served while it is refreshed.  Names the DNS query does not answer (e.g. from /etc/hosts)
+  are resolved with getaddrinfo and held for DNS_CACHE_DEFAULT_TTL_SECS.  shutdown() joins the
+  resolver thread and calls back anyone still waiting with no addresses; a later resolve() starts
+  it again.
+
+  Each module that uses an AudioPipe carries a copy of this file inside its own namespace, aliased
+  to dns_cache, so that the cache (a static local of an inline function) is not one object shared
+  by every loaded module.
+*/
+
+#define DNS_CACHE_MIN_TTL_SECS (5)
+#define DNS_CACHE_MAX_TTL_SECS (300)
+#define DNS_CACHE_DEFAULT_TTL_SECS (30)
+
+namespace jambonz {
+namespace dns_cache {
+
+  // addresses as text, ipv6 and ipv4 separately; both empty if the name could not be resolved
+  typedef std::function<void(const std::vector<std::string>& v6, const std::vector<std::string>& v4)> callback_t;
+
+  class Cache {
+  public:
+    Cache() : m_stop(false) {}
+    ~Cache() {
+      shutdown();
+    }
+
+    // calls back at once when the host is cached (or is an ip literal), otherwise from the resolver thread
+    void resolve(const std::string& host, callback_t callback) {
+      std::vector<std::string> v6, v4;
+      unsigned char buf[sizeof(struct in6_addr)];
+
+      if (1 == inet_pton(AF_INET6, host.c_str(), buf)) v6.push_back(host);
+      else if (1 == inet_pton(AF_INET, host.c_str(), buf)) v4.push_back(host);
+      if (!v6.empty() || !v4.empty()) {
+        callback(v6, v4);
+        return;
+      }
+
+      auto now = std::chrono::steady_clock::now();
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        Entry& entry = m_entries[host];
+        bool cached = entry.resolved && (!entry.v6.empty() || !entry.v4.empty());
+        if (cached) {
+          v6 = entry.v6;
+          v4 = entry.v4;
+        }
+        else {
+          entry.waiters.push_back(callback);
+        }
+        if (!entry.resolving && (!cached || now >= entry.expires)) {
+          entry.resolving = true;
+          m_queue.push_back(host);
+          if (!m_thread.joinable()) {
+            m_stop = false;
+            m_thread = std::thread(&Cache::run, this);
+          }
+          m_cv.notify_one();
+        }
+        if (!cached) return;
+      }
+      callback(v6, v4);
+    }
+
+    // stops and joins the resolver thread; callers still waiting on a lookup are called back with no addresses
+    void shutdown() {
+      std::list<callback_t> waiters;
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+        m_queue.clear();
+        for (auto it = m_entries.begin(); it != m_entries.end(); ++it) {
+          it->second.resolving = false;
+          waiters.splice(waiters.end(), it->second.waiters);
+        }
+      }
+      m_cv.notify_all();
+      if (m_thread.joinable()) m_thread.join();
+
+      std::vector<std::string> none;
+      for (auto it = waiters.begin(); it != waiters.end(); ++it) (*it)(none, none);
+    }
+
+  private:
+    struct Entry {
+      Entry() : resolved(false), resolving(false) {}
+      std::vector<std::string> v6;
+      std::vector<std::string> v4;
+      std::chrono::steady_clock::time_point expires;
+      bool resolved;
+      bool resolving;
+      std::list<callback_t> waiters;
+    };
+
+    void run() {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      for (;;) {
+        m_cv.wait(lock, [this]{ return m_stop || !m_queue.empty(); });
+        if (m_stop) return;
+        std::string host = m_queue.front();
+        m_queue.pop_front();
+        lock.unlock();
+        lookup(host);
+        lock.lock();
+      }
+    }
+
+    void lookup(const std::string& host) {
+      std::vector<std::string> v6, v4;
+      unsigned int ttl = UINT32_MAX;
+      struct __res_state res;
+
+      memset(&res, 0, sizeof(res));
+      if (0 == res_ninit(&res)) {
+        query(&res, host, ns_t_aaaa, v6, ttl);
+        query(&res, host, ns_t_a, v4, ttl);
+        res_nclose(&res);
+      }
+      if (v6.empty() && v4.empty()) {
+        addrinfo(host, v6, v4);
+        ttl = DNS_CACHE_DEFAULT_TTL_SECS;
+      }
+      ttl = std::max((unsigned int) DNS_CACHE_MIN_TTL_SECS, std::min(ttl, (unsigned int) DNS_CACHE_MAX_TTL_SECS));
+
+      std::list<callback_t> waiters;
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_stop) return;
+        Entry& entry = m_entries[host];
+        entry.resolving = false;
+        // keep serving the old addresses if a refresh fails
+        if (!v6.empty() || !v4.empty() || !entry.resolved) {
+          entry.v6 = v6;
+          entry.v4 = v4;
+          entry.resolved = true;
+          entry.expires = std::chrono::steady_clock::now() + std::chrono::seconds(ttl);
+        }
+        else {
+          v6 = entry.v6;
+          v4 = entry.v4;
+        }
+        waiters.swap(entry.waiters);
+      }
+      for (auto it = waiters.begin(); it != waiters.end(); ++it) (*it)(v6, v4);
+    }
+
+    // adds the answers to a query of the given type, lowering ttl to the shortest record ttl seen
+    static void query(res_state res, const std::string& host, int type, std::vector<std::string>& addrs, unsigned int& ttl) {
+      unsigned char answer[4096];
+      ns_msg msg;
+      ns_rr rr;
+      char text[INET6_ADDRSTRLEN];
+
+      int len = res_nquery(res, host.c_str(), ns_c_in, type, answer, sizeof(answer));
+      if (len <= 0 || ns_initparse(answer, len, &msg) < 0) return;
+      for (int i = 0; i < ns_msg_count(msg, ns_s_an); i++) {
+        if (ns_parserr(&msg, ns_s_an, i, &rr) < 0 || ns_rr_type(rr) != type) continue;
+        if (type == ns_t_aaaa && ns_rr_rdlen(rr) == 16) inet_ntop(AF_INET6, ns_rr_rdata(rr), text, sizeof(text));
+        else if (type == ns_t_a && ns_rr_rdlen(rr) == 4) inet_ntop(AF_INET, ns_rr_rdata(rr), text, sizeof(text));
+        else continue;
+        addrs.push_back(text);
+        ttl = std::min(ttl, (unsigned int) ns_rr_ttl(rr));
+      }
+    }
+
+    static void addrinfo(const std::string& host, std::vector<std::string>& v6, std::vector<std::string>& v4) {
+      struct addrinfo hints, *result = nullptr;
+      char text[INET6_ADDRSTRLEN];
+
+      memset(&hints, 0, sizeof(hints));
+      hints.ai_family = AF_UNSPEC;
+      hints.ai_socktype = SOCK_STREAM;
+      if (0 != getaddrinfo(host.c_str(), nullptr, &hints, &result)) return;
+      for (struct addrinfo* ai = result; ai; ai = ai->ai_next) {
+        if (ai->ai_family == AF_INET6) {
+          inet_ntop(AF_INET6, &((struct sockaddr_in6 *) ai->ai_addr)->sin6_addr, text, sizeof(text));
+          if (std::find(v6.begin(), v6.end(), text) == v6.end()) v6.push_back(text);
+        }
+        else if (ai->ai_family == AF_INET) {
+          inet_ntop(AF_INET, &((struct sockaddr_in *) ai->ai_addr)->sin_addr, text, sizeof(text));
+          if (std::find(v4.begin(), v4.end(), text) == v4.end()) v4.push_back(text);
+        }
+      }
+      freeaddrinfo(result);
+    }
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::unordered_map<std::string, Entry> m_entries;
+    std::deque<std::string> m_queue;
+    std::thread m_thread;
+    bool m_stop;
+  };
+
+  inline Cache& instance() {
+    static Cache cache;
+    return cache;
+  }
+}
+}
+
+namespace dns_cache = jambonz::dns_cache;
+
+#endif
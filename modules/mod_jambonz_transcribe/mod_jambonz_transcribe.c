@@ -28,6 +28,7 @@ static void responseHandler(switch_core_session_t* session,
 	}
 	if (json) switch_event_add_body(event, "%s", json);
 	if (bugname) switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "media-bugname", bugname);
+	media_clock_stamp(session, bugname, event, -1);
 	switch_event_fire(&event);
 }
 
@@ -176,6 +177,14 @@ SWITCH_STANDARD_API(jb_transcribe_function)
 }
 
 
+#define METRICS_API_SYNTAX "[latency]"
+SWITCH_STANDARD_API(metrics_function)
+{
+	if (!zstr(cmd) && 0 == strcasecmp(cmd, "latency")) jb_transcribe_latency(stream);
+	else jb_transcribe_metrics(stream);
+	return SWITCH_STATUS_SUCCESS;
+}
+
 SWITCH_MODULE_LOAD_FUNCTION(mod_jambonz_transcribe_load)
 {
 	switch_api_interface_t *api_interface;
@@ -198,6 +207,7 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_jambonz_transcribe_load)
 	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "jambonz Speech Transcription API successfully loaded\n");
 
 	SWITCH_ADD_API(api_interface, "uuid_jambonz_transcribe", "jambonz Speech Transcription API", jb_transcribe_function, TRANSCRIBE_API_SYNTAX);
+	SWITCH_ADD_API(api_interface, "jambonz_transcribe_metrics", "jambonz Speech Transcription metrics in prometheus text format", metrics_function, METRICS_API_SYNTAX);
 	switch_console_set_complete("add uuid_jambonz_transcribe start lang-code [interim|final] [stereo|mono]");
 	switch_console_set_complete("add uuid_jambonz_transcribe stop ");
 
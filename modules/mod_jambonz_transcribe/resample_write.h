@@ -0,0 +1,30 @@
+#ifndef __RESAMPLE_WRITE_H__
+#define __RESAMPLE_WRITE_H__
+
+#include <stddef.h>
+#include <speex/speex_resampler.h>
+
+/*
+ * Resamples one media bug frame of interleaved 16-bit audio straight into a region of the AudioPipe
+ * ring buffer.
+ *
+ * With SMBF_STEREO a frame's samples count is per channel while its datalen covers every channel, and
+ * speex_resampler_process_interleaved_int takes and returns lengths in samples per channel, so every
+ * length here is derived from one bytes-per-sample value (sizeof(spx_int16_t) * channels).  Returns the
+ * bytes written to dst, whole samples and never more than dst_bytes; *dropped_bytes is set to the input
+ * that did not fit.  examples/resample_sizing_check.c runs this against a guarded region.
+ */
+static inline size_t resample_write(SpeexResamplerState *resampler, unsigned int channels, const void *src,
+	size_t src_bytes, void *dst, size_t dst_bytes, size_t *dropped_bytes)
+{
+	const size_t bytes_per_sample = sizeof(spx_int16_t) * channels;
+	spx_uint32_t in_len = (spx_uint32_t) (src_bytes / bytes_per_sample);
+	spx_uint32_t frame_len = in_len;
+	spx_uint32_t out_len = (spx_uint32_t) (dst_bytes / bytes_per_sample);
+
+	speex_resampler_process_interleaved_int(resampler, (const spx_int16_t *) src, &in_len, (spx_int16_t *) dst, &out_len);
+	*dropped_bytes = (frame_len - in_len) * bytes_per_sample;
+	return out_len * bytes_per_sample;
+}
+
+#endif
@@ -16,7 +16,10 @@
 #include "nuance/asr/v1/recognizer.grpc.pb.h"
 
 #include "mod_nuance_transcribe.h"
+#include "resampler_pool.hpp"
 #include "simple_buffer.h"
+#include "deinterleave.h"
+#include "stream_metrics.hpp"
 
 using nuance::asr::v1::Recognizer;
 using nuance::asr::v1::RecognitionRequest;
@@ -474,10 +477,20 @@ private:
   char m_sessionId[256];
 };
 
+static void connect_legs(struct cap_cb *cb) {
+  stream_metrics::mark_connect_start(*cb);
+  for (int i = 0; i < cb->num_legs; i++) {
+    ((GStreamer *) cb->legs[i].streamer)->connect();
+  }
+  stream_metrics::mark_connected(*cb);
+}
+
 static void *SWITCH_THREAD_FUNC grpc_read_thread(switch_thread_t *thread, void *obj) {
   static int count;
-	struct cap_cb *cb = (struct cap_cb *) obj;
-	GStreamer* streamer = (GStreamer *) cb->streamer;
+  struct stream_leg *leg = (struct stream_leg *) obj;
+	struct cap_cb *cb = leg->cb;
+	GStreamer* streamer = (GStreamer *) leg->streamer;
+  int legId = cb->num_legs > 1 ? leg->leg : -1;
 
   bool connected = streamer->waitForConnect();
   if (!connected) {
@@ -507,12 +520,13 @@ static void *SWITCH_THREAD_FUNC grpc_read_thread(switch_thread_t *thread, void *
         switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "GStreamer %p got status code %d\n", streamer, code);
         if (code == 200) {
           switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "GStreamer %p transcription complete\n", streamer);
-          cb->responseHandler(session, "end_of_transcription", cb->bugname, NULL);
+          cb->responseHandler(session, "end_of_transcription", cb->bugname, NULL, legId);
         }
       }
       else {
         auto message = status.message();
         auto details = status.details();
+        stream_metrics::instance().error((int) code);
         cJSON* jError = cJSON_CreateObject();
         cJSON_AddStringToObject(jError, "type", "error");
         cJSON_AddNumberToObject(jError, "code", code);
@@ -521,7 +535,7 @@ static void *SWITCH_THREAD_FUNC grpc_read_thread(switch_thread_t *thread, void *
         char* error = cJSON_PrintUnformatted(jError);
 
         switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "GStreamer %p got non-success code %d - %s : %s\n", streamer, code, message.c_str(), details.c_str());
-        cb->responseHandler(session, "error", cb->bugname, error);
+        cb->responseHandler(session, "error", cb->bugname, error, legId);
 
         free(error);
         cJSON_Delete(jError);
@@ -532,13 +546,14 @@ static void *SWITCH_THREAD_FUNC grpc_read_thread(switch_thread_t *thread, void *
         auto start_of_speech = response.start_of_speech();
         auto first_audio_to_start_of_speech_ms = start_of_speech.first_audio_to_start_of_speech_ms();
         switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "GStreamer %p got start of speech %d\n", streamer, first_audio_to_start_of_speech_ms);	
-        cb->responseHandler(session, "start_of_speech", cb->bugname, NULL);
+        cb->responseHandler(session, "start_of_speech", cb->bugname, NULL, legId);
     }
     if (response.has_result()){
       processed = true;
       const Result& result = response.result();
       EnumResultType type = result.result_type();
       bool is_final = type == EnumResultType::FINAL;
+      stream_metrics::mark_result(*cb, is_final);
       int nAlternatives = result.hypotheses_size();
 
       cJSON * jResult = cJSON_CreateObject();
@@ -547,6 +562,8 @@ static void *SWITCH_THREAD_FUNC grpc_read_thread(switch_thread_t *thread, void *
 
       cJSON_AddItemToObject(jResult, "is_final", jIsFinal);
       cJSON_AddItemToObject(jResult, "alternatives", jAlternatives);
+      cJSON_AddNumberToObject(jResult, "abs_end_ms", result.abs_end_ms());
+      if (legId >= 0) cJSON_AddNumberToObject(jResult, "channel", legId);
 
       switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "GStreamer %p got a %s result with %d hypotheses\n", streamer, is_final ? "final" : "interim", nAlternatives);	
       for (int i = 0; i < nAlternatives; i++) {
@@ -583,7 +600,7 @@ static void *SWITCH_THREAD_FUNC grpc_read_thread(switch_thread_t *thread, void *
         cJSON_AddItemToArray(jAlternatives, jAlt);
       }
       char* json = cJSON_PrintUnformatted(jResult);
-      cb->responseHandler(session, (const char *) json, cb->bugname, NULL);
+      cb->responseHandler(session, (const char *) json, cb->bugname, NULL, legId);
       free(json);
 
       cJSON_Delete(jResult);
@@ -595,10 +612,12 @@ static void *SWITCH_THREAD_FUNC grpc_read_thread(switch_thread_t *thread, void *
 extern "C" {
 
     switch_status_t nuance_speech_init() {
+      stream_metrics::instance().init("nuance_transcribe");
       return SWITCH_STATUS_SUCCESS;
     }
 
     switch_status_t nuance_speech_cleanup() {
+      stream_metrics::instance().shutdown();
       return SWITCH_STATUS_SUCCESS;
     }
     switch_status_t nuance_speech_session_init(switch_core_session_t *session, responseHandler_t responseHandler, 
@@ -611,6 +630,7 @@ extern "C" {
       int err;
 
       cb =(struct cap_cb *) switch_core_session_alloc(session, sizeof(*cb));
+      stream_metrics::mark_init(*cb);
       strncpy(cb->sessionId, switch_core_session_get_uuid(session), MAX_SESSION_ID);
       strncpy(cb->bugname, bugname, MAX_BUG_LEN);
       cb->end_of_utterance = 0;
@@ -618,7 +638,7 @@ extern "C" {
       switch_mutex_init(&cb->mutex, SWITCH_MUTEX_NESTED, switch_core_session_get_pool(session));
       if (sampleRate != 8000) {
           switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "nuance_speech_session_init:  initializing resampler\n");
-          cb->resampler = speex_resampler_init(channels, sampleRate, 8000, SWITCH_RESAMPLE_QUALITY, &err);
+          cb->resampler = resampler_pool::acquire(channels, sampleRate, 8000, SWITCH_RESAMPLE_QUALITY, &err);
         if (0 != err) {
            switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "%s: Error initializing resampler: %s.\n",
                                  switch_channel_get_name(channel), speex_resampler_strerror(err));
@@ -659,29 +679,44 @@ extern "C" {
         }
       }
 
-      GStreamer *streamer = NULL;
-      try {
-        switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "nuance_speech_session_init:  allocating streamer\n");
-        streamer = new GStreamer(session, channels, lang, interim);
-        cb->streamer = streamer;
-      } catch (std::exception& e) {
-        switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "%s: Error initializing gstreamer: %s.\n", 
-          switch_channel_get_name(channel), e.what());
-        return SWITCH_STATUS_FALSE;
+      // nuance recognizes mono audio, so for stereo we de-interleave and open an independent stream per leg
+      cb->num_legs = channels > MAX_LEGS ? MAX_LEGS : channels;
+      for (int i = 0; i < cb->num_legs; i++) {
+        struct stream_leg *leg = &cb->legs[i];
+        leg->cb = cb;
+        leg->leg = i;
+        if (cb->num_legs > 1) {
+          leg->data = (int16_t *) switch_core_session_alloc(session, sizeof(int16_t) * SWITCH_RECOMMENDED_BUFFER_SIZE / 2);
+        }
+        try {
+          switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "nuance_speech_session_init:  allocating streamer for leg %d\n", i);
+          leg->streamer = new GStreamer(session, 1, lang, interim);
+        } catch (std::exception& e) {
+          switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "%s: Error initializing gstreamer: %s.\n", 
+            switch_channel_get_name(channel), e.what());
+          while (i-- > 0) {
+            delete (GStreamer *) cb->legs[i].streamer;
+            cb->legs[i].streamer = NULL;
+          }
+          return SWITCH_STATUS_FALSE;
+        }
       }
 
       if (!cb->vad) {
         switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "nuance_speech_session_init:  no vad so connecting to nuance immediately\n");
-        streamer->connect();
+        connect_legs(cb);
       }
+      for (int i = 0; i < cb->num_legs; i++) stream_metrics::instance().streamStarted();
 
-      // create the read thread
+      // create the read threads
       switch_threadattr_t *thd_attr = NULL;
       switch_memory_pool_t *pool = switch_core_session_get_pool(session);
 
       switch_threadattr_create(&thd_attr, pool);
       switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
-      switch_thread_create(&cb->thread, thd_attr, grpc_read_thread, cb, pool);
+      for (int i = 0; i < cb->num_legs; i++) {
+        switch_thread_create(&cb->legs[i].thread, thd_attr, grpc_read_thread, &cb->legs[i], pool);
+      }
 
       *ppUserData = cb;
       return SWITCH_STATUS_SUCCESS;
@@ -691,9 +726,10 @@ extern "C" {
       if (bug) {
         struct cap_cb *cb = (struct cap_cb *) switch_core_media_bug_get_user_data(bug);
         switch_mutex_lock(cb->mutex);
-        GStreamer* streamer = (GStreamer *) cb->streamer;
-
-        if (streamer) streamer->startTimers();
+        for (int i = 0; i < cb->num_legs; i++) {
+          GStreamer* streamer = (GStreamer *) cb->legs[i].streamer;
+          if (streamer) streamer->startTimers();
+        }
         switch_mutex_unlock(cb->mutex);
         return SWITCH_STATUS_SUCCESS;
       }
@@ -715,23 +751,27 @@ extern "C" {
         }
         switch_channel_set_private(channel, cb->bugname, NULL);
 
-        // close connection and get final responses
-        GStreamer* streamer = (GStreamer *) cb->streamer;
-
-        if (streamer) {
-          streamer->writesDone();
+        // close connections (all legs first, so they finish in parallel) and get final responses
+        for (int i = 0; i < cb->num_legs; i++) {
+          GStreamer* streamer = (GStreamer *) cb->legs[i].streamer;
+          if (streamer) streamer->writesDone();
+        }
+        for (int i = 0; i < cb->num_legs; i++) {
+          GStreamer* streamer = (GStreamer *) cb->legs[i].streamer;
+          if (!streamer) continue;
 
           switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "nuance_speech_session_cleanup: GStreamer (%p) waiting for read thread to complete\n", (void*)streamer);
           switch_status_t st;
-          switch_thread_join(&st, cb->thread);
+          switch_thread_join(&st, cb->legs[i].thread);
           switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "nuance_speech_session_cleanup:  GStreamer (%p) read thread completed\n", (void*)streamer);
 
           delete streamer;
-          cb->streamer = NULL;
+          cb->legs[i].streamer = NULL;
+          stream_metrics::instance().streamEnded();
         }
 
         if (cb->resampler) {
-          speex_resampler_destroy(cb->resampler);
+          resampler_pool::release(cb->resampler);
         }
         if (cb->vad) {
           switch_vad_destroy(&cb->vad);
@@ -754,10 +794,11 @@ extern "C" {
     }
 
     switch_bool_t nuance_speech_frame(switch_media_bug_t *bug, void* user_data) {
+    	stream_metrics::FrameTimer timer;
     	switch_core_session_t *session = switch_core_media_bug_get_session(bug);
     	struct cap_cb *cb = (struct cap_cb *) user_data;
-		  if (cb->streamer && !cb->end_of_utterance) {
-        GStreamer* streamer = (GStreamer *) cb->streamer;
+		  if (cb->legs[0].streamer && !cb->end_of_utterance) {
+        GStreamer* streamer = (GStreamer *) cb->legs[0].streamer;
         uint8_t data[SWITCH_RECOMMENDED_BUFFER_SIZE];
         switch_frame_t frame = {};
         frame.data = data;
@@ -766,30 +807,51 @@ extern "C" {
         if (switch_mutex_trylock(cb->mutex) == SWITCH_STATUS_SUCCESS) {
           while (switch_core_media_bug_read(bug, &frame, SWITCH_TRUE) == SWITCH_STATUS_SUCCESS && !switch_test_flag((&frame), SFF_CNG)) {
             if (frame.datalen) {
+              media_clock_advance(session, cb, frame.samples);
               if (cb->vad && !streamer->isConnected()) {
                 switch_vad_state_t state = switch_vad_process(cb->vad, (int16_t*) frame.data, frame.samples);
                 if (state == SWITCH_VAD_STATE_START_TALKING) {
                   switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_INFO, "detected speech, connect to google speech now\n");
-                  streamer->connect();
-                  cb->responseHandler(session, "vad_detected", cb->bugname, NULL);
+                  connect_legs(cb);
+                  cb->responseHandler(session, "vad_detected", cb->bugname, NULL, -1);
                 }
               }
 
+              // samples per leg; resampling (if any) is done on the interleaved audio
+              spx_int16_t out[SWITCH_RECOMMENDED_BUFFER_SIZE];
+              spx_int16_t *audio = (spx_int16_t *) frame.data;
+              spx_uint32_t samples = frame.datalen / (sizeof(spx_int16_t) * cb->num_legs);
+
               if (cb->resampler) {
-                spx_int16_t out[SWITCH_RECOMMENDED_BUFFER_SIZE];
-                spx_uint32_t out_len = SWITCH_RECOMMENDED_BUFFER_SIZE;
-                spx_uint32_t in_len = frame.samples;
-                size_t written;
+                spx_uint32_t out_len = SWITCH_RECOMMENDED_BUFFER_SIZE / cb->num_legs;
+                spx_uint32_t in_len = samples;
 
                 speex_resampler_process_interleaved_int(cb->resampler,
                   (const spx_int16_t *) frame.data,
                   (spx_uint32_t *) &in_len,
                   &out[0],
                   &out_len);
-                streamer->write( &out[0], sizeof(spx_int16_t) * out_len);
+                audio = &out[0];
+                samples = out_len;
+              }
+              if (cb->num_legs == 1) {
+                if (streamer->write(audio, sizeof(spx_int16_t) * samples)) {
+                  media_clock_stream_start(cb, frame.samples);
+                  stream_metrics::mark_audio_sent(*cb);
+                  stream_metrics::instance().bytesSent(sizeof(spx_int16_t) * samples);
+                }
+                else stream_metrics::instance().framesDropped(1);
               }
               else {
-                streamer->write( frame.data, sizeof(spx_int16_t) * frame.samples);
+                deinterleave_stereo(audio, samples, cb->legs[0].data, cb->legs[1].data);
+                for (int i = 0; i < cb->num_legs; i++) {
+                  if (((GStreamer *) cb->legs[i].streamer)->write(cb->legs[i].data, sizeof(spx_int16_t) * samples)) {
+                    media_clock_stream_start(cb, frame.samples);
+                    stream_metrics::mark_audio_sent(*cb);
+                    stream_metrics::instance().bytesSent(sizeof(spx_int16_t) * samples);
+                  }
+                  else stream_metrics::instance().framesDropped(1);
+                }
               }
             }
           }
@@ -798,4 +860,20 @@ extern "C" {
       }
       return SWITCH_TRUE;
     }
+
+    switch_status_t nuance_speech_metrics(switch_stream_handle_t *stream) {
+      std::string text;
+
+      stream_metrics::instance().render(text);
+      stream->write_function(stream, "%s", text.c_str());
+      return SWITCH_STATUS_SUCCESS;
+    }
+
+    switch_status_t nuance_speech_latency(switch_stream_handle_t *stream) {
+      std::string text;
+
+      stream_metrics::instance().latency(text);
+      stream->write_function(stream, "%s", text.c_str());
+      return SWITCH_STATUS_SUCCESS;
+    }
 }
@@ -8,5 +8,7 @@ switch_status_t nuance_speech_session_init(switch_core_session_t *session, respo
 switch_status_t nuance_speech_session_start_timers(switch_core_session_t *session, switch_media_bug_t *bug);
 switch_status_t nuance_speech_session_cleanup(switch_core_session_t *session, int channelIsClosing, switch_media_bug_t *bug);
 switch_bool_t nuance_speech_frame(switch_media_bug_t *bug, void* user_data);
+switch_status_t nuance_speech_metrics(switch_stream_handle_t *stream);
+switch_status_t nuance_speech_latency(switch_stream_handle_t *stream);
 
 #endif
\ No newline at end of file
@@ -20,10 +20,23 @@ SWITCH_MODULE_DEFINITION(mod_nvidia_transcribe, mod_transcribe_load, mod_transcr
 
 static switch_status_t do_stop(switch_core_session_t *session, char* bugname);
 
+/* offset of the end of the audio a riva result: the audio_processed so far, in seconds; -1 if it has none */
+static int64_t result_audio_ms(const char* json) {
+	int64_t audio_ms = -1;
+	cJSON* jMessage = cJSON_Parse(json);
+	if (jMessage) {
+		cJSON* jProcessed = cJSON_GetObjectItem(jMessage, "audio_processed");
+		if (cJSON_IsNumber(jProcessed)) audio_ms = (int64_t) (jProcessed->valuedouble * 1000);
+		cJSON_Delete(jMessage);
+	}
+	return audio_ms;
+}
+
 static void responseHandler(switch_core_session_t* session, const char * json, const char* bugname, 
 	const char* details) {
 	switch_event_t *event;
 	switch_channel_t *channel = switch_core_session_get_channel(session);
+	int64_t audio_ms = -1;
 
 	if (0 == strcmp("vad_detected", json)) {
 		switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, TRANSCRIBE_EVENT_VAD_DETECTED);
@@ -53,8 +66,10 @@ static void responseHandler(switch_core_session_t* session, const char * json, c
 		switch_channel_event_set_data(channel, event);
 		switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "transcription-vendor", "nvidia");
 		switch_event_add_body(event, "%s", json);
+		audio_ms = result_audio_ms(json);
 	}
 	if (bugname) switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "media-bugname", bugname);
+	media_clock_stamp(session, bugname, event, audio_ms);
 	switch_event_fire(&event);
 }
 
@@ -205,6 +220,14 @@ SWITCH_STANDARD_API(transcribe_function)
 	return SWITCH_STATUS_SUCCESS;
 }
 
+#define METRICS_API_SYNTAX "[latency]"
+SWITCH_STANDARD_API(metrics_function)
+{
+	if (!zstr(cmd) && 0 == strcasecmp(cmd, "latency")) nvidia_speech_latency(stream);
+	else nvidia_speech_metrics(stream);
+	return SWITCH_STATUS_SUCCESS;
+}
+
 SWITCH_MODULE_LOAD_FUNCTION(mod_transcribe_load)
 {
 	switch_api_interface_t *api_interface;
@@ -240,6 +263,7 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_transcribe_load)
 	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "Nvidia Speech Transcription API successfully loaded\n");
 
 	SWITCH_ADD_API(api_interface, "uuid_nvidia_transcribe", "Nvidia Speech Transcription API", transcribe_function, TRANSCRIBE_API_SYNTAX);
+	SWITCH_ADD_API(api_interface, "nvidia_transcribe_metrics", "Nvidia Speech Transcription metrics in prometheus text format", metrics_function, METRICS_API_SYNTAX);
 	switch_console_set_complete("add uuid_nvidia_transcribe start lang-code");
 	switch_console_set_complete("add uuid_nvidia_transcribe stop ");
 
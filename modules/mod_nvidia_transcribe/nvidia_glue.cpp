@@ -13,7 +13,9 @@ namespace nr_asr = nvidia::riva::asr;
 namespace nr = nvidia::riva;
 
 #include "mod_nvidia_transcribe.h"
+#include "resampler_pool.hpp"
 #include "simple_buffer.h"
+#include "stream_metrics.hpp"
 
 #define CHUNKSIZE (320)
 
@@ -325,6 +327,7 @@ static void *SWITCH_THREAD_FUNC grpc_read_thread(switch_thread_t *thread, void *
     for (int r = 0; r < response.results_size(); ++r) {
       const auto& result = response.results(r);
       bool is_final = result.is_final();
+      stream_metrics::mark_result(*cb, is_final);
       int num_alternatives = result.alternatives_size();
       int channel_tag = result.channel_tag();
       float stability = result.stability();
@@ -382,10 +385,12 @@ static void *SWITCH_THREAD_FUNC grpc_read_thread(switch_thread_t *thread, void *
 extern "C" {
 
     switch_status_t nvidia_speech_init() {
+      stream_metrics::instance().init("nvidia_transcribe");
       return SWITCH_STATUS_SUCCESS;
     }
 
     switch_status_t nvidia_speech_cleanup() {
+      stream_metrics::instance().shutdown();
       return SWITCH_STATUS_SUCCESS;
     }
     switch_status_t nvidia_speech_session_init(switch_core_session_t *session, responseHandler_t responseHandler, 
@@ -398,6 +403,7 @@ extern "C" {
       int err;
 
       cb =(struct cap_cb *) switch_core_session_alloc(session, sizeof(*cb));
+      stream_metrics::mark_init(*cb);
       strncpy(cb->sessionId, switch_core_session_get_uuid(session), MAX_SESSION_ID);
       strncpy(cb->bugname, bugname, MAX_BUG_LEN);
       cb->end_of_utterance = 0;
@@ -405,7 +411,7 @@ extern "C" {
       switch_mutex_init(&cb->mutex, SWITCH_MUTEX_NESTED, switch_core_session_get_pool(session));
       if (sampleRate != 8000) {
           switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "nvidia_speech_session_init:  initializing resampler\n");
-          cb->resampler = speex_resampler_init(channels, sampleRate, 8000, SWITCH_RESAMPLE_QUALITY, &err);
+          cb->resampler = resampler_pool::acquire(channels, sampleRate, 8000, SWITCH_RESAMPLE_QUALITY, &err);
         if (0 != err) {
            switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "%s: Error initializing resampler: %s.\n",
                                  switch_channel_get_name(channel), speex_resampler_strerror(err));
@@ -459,8 +465,11 @@ extern "C" {
 
       if (!cb->vad) {
         switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "nvidia_speech_session_init:  no vad so connecting to nvidia immediately\n");
+        stream_metrics::mark_connect_start(*cb);
         streamer->connect();
+        stream_metrics::mark_connected(*cb);
       }
+      stream_metrics::instance().streamStarted();
 
       // create the read thread
       switch_threadattr_t *thd_attr = NULL;
@@ -503,9 +512,10 @@ extern "C" {
           delete streamer;
           cb->streamer = NULL;
         }
+        stream_metrics::instance().streamEnded();
 
         if (cb->resampler) {
-          speex_resampler_destroy(cb->resampler);
+          resampler_pool::release(cb->resampler);
         }
         if (cb->vad) {
           switch_vad_destroy(&cb->vad);
@@ -528,6 +538,7 @@ extern "C" {
     }
 
     switch_bool_t nvidia_speech_frame(switch_media_bug_t *bug, void* user_data) {
+    	stream_metrics::FrameTimer timer;
     	switch_core_session_t *session = switch_core_media_bug_get_session(bug);
     	struct cap_cb *cb = (struct cap_cb *) user_data;
 		  if (cb->streamer && !cb->end_of_utterance) {
@@ -540,11 +551,17 @@ extern "C" {
         if (switch_mutex_trylock(cb->mutex) == SWITCH_STATUS_SUCCESS) {
           while (switch_core_media_bug_read(bug, &frame, SWITCH_TRUE) == SWITCH_STATUS_SUCCESS && !switch_test_flag((&frame), SFF_CNG)) {
             if (frame.datalen) {
+              size_t len;
+              bool ok;
+
+              media_clock_advance(session, cb, frame.samples);
               if (cb->vad && !streamer->isConnected()) {
                 switch_vad_state_t state = switch_vad_process(cb->vad, (int16_t*) frame.data, frame.samples);
                 if (state == SWITCH_VAD_STATE_START_TALKING) {
                   switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_INFO, "detected speech, connect to google speech now\n");
+                  stream_metrics::mark_connect_start(*cb);
                   streamer->connect();
+                  stream_metrics::mark_connected(*cb);
                   cb->responseHandler(session, "vad_detected", cb->bugname, NULL);
                 }
               }
@@ -553,18 +570,25 @@ extern "C" {
                 spx_int16_t out[SWITCH_RECOMMENDED_BUFFER_SIZE];
                 spx_uint32_t out_len = SWITCH_RECOMMENDED_BUFFER_SIZE;
                 spx_uint32_t in_len = frame.samples;
-                size_t written;
 
                 speex_resampler_process_interleaved_int(cb->resampler,
                   (const spx_int16_t *) frame.data,
                   (spx_uint32_t *) &in_len,
                   &out[0],
                   &out_len);
-                streamer->write( &out[0], sizeof(spx_int16_t) * out_len);
+                len = sizeof(spx_int16_t) * out_len;
+                ok = streamer->write( &out[0], len);
               }
               else {
-                streamer->write( frame.data, sizeof(spx_int16_t) * frame.samples);
+                len = sizeof(spx_int16_t) * frame.samples;
+                ok = streamer->write( frame.data, len);
+              }
+              if (ok) {
+                media_clock_stream_start(cb, frame.samples);
+                stream_metrics::mark_audio_sent(*cb);
+                stream_metrics::instance().bytesSent(len);
               }
+              else stream_metrics::instance().framesDropped(1);
             }
           }
           switch_mutex_unlock(cb->mutex);
@@ -572,4 +596,20 @@ extern "C" {
       }
       return SWITCH_TRUE;
     }
+
+    switch_status_t nvidia_speech_metrics(switch_stream_handle_t *stream) {
+      std::string text;
+
+      stream_metrics::instance().render(text);
+      stream->write_function(stream, "%s", text.c_str());
+      return SWITCH_STATUS_SUCCESS;
+    }
+
+    switch_status_t nvidia_speech_latency(switch_stream_handle_t *stream) {
+      std::string text;
+
+      stream_metrics::instance().latency(text);
+      stream->write_function(stream, "%s", text.c_str());
+      return SWITCH_STATUS_SUCCESS;
+    }
 }
@@ -32,10 +32,17 @@
 #include <switch_vad.h>
 #include <switch_json.h>
 
-#include <sys/time.h>
+#include "vad_kernel.h"
 
 #define EVENT_VAD_CHANGE   "mod_simple_vad::change"
 #define EVENT_VAD_SUMMARY   "mod_simple_vad::summary"
+#define EVENT_VAD_SEGMENTS   "mod_simple_vad::segments"
+
+#define DEFAULT_VOICE_MS (200)
+#define DEFAULT_SILENCE_MS (500)
+#define DEFAULT_SEGMENT_BATCH (10)
+#define DEFAULT_SEGMENT_FLUSH_MS (5000)
+#define MAX_SEGMENT_BATCH (32)
 
 /* Prototypes */
 SWITCH_MODULE_LOAD_FUNCTION(mod_simple_vad_load);
@@ -46,55 +53,257 @@ SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_simple_vad_shutdown);
  */
 SWITCH_MODULE_DEFINITION(mod_simple_vad, mod_simple_vad_load, mod_simple_vad_shutdown, NULL);
 
-struct cap_cb {
-	switch_vad_t *vad;
-	switch_mutex_t *mutex;
-	struct timeval start;
-	struct timeval last_segment_start;
-	uint32_t speech_segments;
-	long long speech_duration;
-	switch_vad_state_t vad_state;
+struct vad_segment {
+	uint64_t start;		/* samples since capture started */
+	uint64_t duration;	/* samples */
 };
 
-long long
-timeval_diff(struct timeval *difference,
-             struct timeval *end_time,
-             struct timeval *start_time
-            )
-{
-  struct timeval temp_diff;
+/*
+ * Everything in here except the published_* fields is owned by the media thread (and by the
+ * CLOSE callback, which the core never runs concurrently with READ); times are sample offsets
+ * from the start of the capture, per channel.
+ */
+struct vad_leg {
+	uint64_t last_change_at;
+	uint64_t speech_start;
+	uint64_t speech_samples;
+	uint32_t speech_segments;
+	switch_vad_state_t vad_state;		/* debounced state */
 
-  if(difference==NULL)
-  {
-    difference=&temp_diff;
-  }
+	/* a stop that is held back until the debounce window has passed without new speech */
+	int pending_stop;
+	uint64_t pending_stop_at;
 
-  difference->tv_sec =end_time->tv_sec -start_time->tv_sec ;
-  difference->tv_usec=end_time->tv_usec-start_time->tv_usec;
+	/* change events may lag vad_state when rate limited */
+	switch_vad_state_t emitted_state;
+	uint64_t emitted_at;
 
-  /* Using while instead of if below makes the code slightly more robust. */
+	/* segments mode: completed segments not yet reported */
+	struct vad_segment segments[MAX_SEGMENT_BATCH];
+	uint32_t num_segments;
 
-  while(difference->tv_usec<0)
-  {
-    difference->tv_usec+=1000000;
-    difference->tv_sec -=1;
-  }
+	/* totals published by the media thread for do_stop */
+	switch_atomic_t published_speech_ms;
+	switch_atomic_t published_segments;
+};
+
+typedef enum {
+	EVENT_MODE_TRANSITIONS,
+	EVENT_MODE_SEGMENTS
+} event_mode_t;
 
-  return 1000000LL*difference->tv_sec+
-                   difference->tv_usec;
+struct cap_cb {
+	switch_vad_t *vad;	/* native engine; NULL when using the built-in kernel */
+	uint32_t samples_per_second;
+	uint32_t channels;	/* 2 when running on both legs of a stereo bug */
+	uint64_t samples;	/* per channel, processed so far */
+	switch_time_t media_start;	/* wall clock when the first frame was read */
+	vad_kernel_t kernels[VAD_KERNEL_MAX_CHANNELS];	/* built-in engine, one per leg */
+	struct vad_leg legs[VAD_KERNEL_MAX_CHANNELS];
+
+	event_mode_t event_mode;
+	uint64_t debounce_samples;
+	uint32_t segment_batch;
+	uint64_t segment_flush_samples;
+
+	/* token bucket limiting change events; max_events_per_sec of 0 means unlimited */
+	uint32_t max_events_per_sec;
+	double event_tokens;
+	uint64_t tokens_at;
+	uint32_t suppressed_events;
+
+	switch_atomic_t published_total_ms;
+	switch_atomic_t published_suppressed;
+};
 
+static uint64_t ms_to_samples(struct cap_cb *cb, uint32_t ms)
+{
+	return (uint64_t) ms * cb->samples_per_second / 1000;
 }
 
-static void responseHandler(switch_core_session_t *session, const char * eventName, char * json) {
+static uint32_t samples_to_ms(struct cap_cb *cb, uint64_t samples)
+{
+	return (uint32_t) (samples * 1000 / cb->samples_per_second);
+}
+
+/* audio_ms is the media offset the event refers to; it is stamped on the event along with the
+ wall clock time and the processing latency (how long after that audio arrived the event was sent) */
+static void responseHandler(switch_core_session_t *session, struct cap_cb *cb, const char * eventName, char * json, uint32_t audio_ms) {
 	switch_event_t *event;
 	switch_channel_t *channel = switch_core_session_get_channel(session);
+	switch_time_t now = switch_micro_time_now();
 	if (json) switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "responseHandler: sending event payload: %s.\n", json);
 	switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, eventName);
 	switch_channel_event_set_data(channel, event);
+	if (cb->media_start) {
+		switch_event_add_header(event, SWITCH_STACK_BOTTOM, "media-time-ms", "%u", audio_ms);
+		switch_event_add_header(event, SWITCH_STACK_BOTTOM, "event-time", "%" SWITCH_TIME_T_FMT, now);
+		switch_event_add_header(event, SWITCH_STACK_BOTTOM, "processing-latency-ms", "%" SWITCH_INT64_T_FMT,
+			(int64_t) ((now - cb->media_start) / 1000) - audio_ms);
+	}
 	if (json) switch_event_add_body(event, "%s", json);
 	switch_event_fire(&event);
 }
 
+static switch_vad_state_t kernel_state(vad_kernel_state_t state)
+{
+	switch (state) {
+	case VAD_KERNEL_STATE_START_TALKING: return SWITCH_VAD_STATE_START_TALKING;
+	case VAD_KERNEL_STATE_TALKING: return SWITCH_VAD_STATE_TALKING;
+	case VAD_KERNEL_STATE_STOP_TALKING: return SWITCH_VAD_STATE_STOP_TALKING;
+	default: return SWITCH_VAD_STATE_NONE;
+	}
+}
+
+static int take_event_token(struct cap_cb *cb, uint64_t now)
+{
+	if (cb->max_events_per_sec == 0) return 1;
+
+	cb->event_tokens += (double) cb->max_events_per_sec * (now - cb->tokens_at) / cb->samples_per_second;
+	if (cb->event_tokens > cb->max_events_per_sec) cb->event_tokens = cb->max_events_per_sec;
+	cb->tokens_at = now;
+	if (cb->event_tokens < 1.0) return 0;
+	cb->event_tokens -= 1.0;
+	return 1;
+}
+
+/* report the leg's current state if it differs from what consumers last saw; transitions made while
+ rate limited are coalesced into a single change from the last reported state */
+static void emit_change(switch_core_session_t *session, struct cap_cb *cb, uint32_t channel, uint64_t now)
+{
+	struct vad_leg *leg = &cb->legs[channel];
+	char* json;
+	cJSON *jEvent;
+
+	if (leg->emitted_state == leg->vad_state || !take_event_token(cb, now)) return;
+
+	jEvent = cJSON_CreateObject();
+	cJSON_AddItemToObject(jEvent, "oldState", cJSON_CreateString(switch_vad_state2str(leg->emitted_state)));
+	cJSON_AddItemToObject(jEvent, "newState", cJSON_CreateString(switch_vad_state2str(leg->vad_state)));
+	cJSON_AddItemToObject(jEvent, "duration", cJSON_CreateNumber(samples_to_ms(cb, now - leg->emitted_at)));
+	if (cb->channels > 1) cJSON_AddItemToObject(jEvent, "channel", cJSON_CreateNumber(channel));
+	json = cJSON_PrintUnformatted(jEvent);
+	responseHandler(session, cb, EVENT_VAD_CHANGE, json, samples_to_ms(cb, leg->last_change_at));
+	free(json);
+	cJSON_Delete(jEvent);
+
+	leg->emitted_state = leg->vad_state;
+	leg->emitted_at = now;
+}
+
+static void flush_segments(switch_core_session_t *session, struct cap_cb *cb, uint32_t channel)
+{
+	struct vad_leg *leg = &cb->legs[channel];
+	char* json;
+	cJSON *jEvent, *jSegments;
+	uint32_t i;
+
+	if (leg->num_segments == 0) return;
+
+	jEvent = cJSON_CreateObject();
+	jSegments = cJSON_CreateArray();
+	for (i = 0; i < leg->num_segments; i++) {
+		cJSON *jSegment = cJSON_CreateObject();
+		cJSON_AddItemToObject(jSegment, "start", cJSON_CreateNumber(samples_to_ms(cb, leg->segments[i].start)));
+		cJSON_AddItemToObject(jSegment, "duration", cJSON_CreateNumber(samples_to_ms(cb, leg->segments[i].duration)));
+		cJSON_AddItemToArray(jSegments, jSegment);
+	}
+	cJSON_AddItemToObject(jEvent, "segments", jSegments);
+	if (cb->channels > 1) cJSON_AddItemToObject(jEvent, "channel", cJSON_CreateNumber(channel));
+	json = cJSON_PrintUnformatted(jEvent);
+	responseHandler(session, cb, EVENT_VAD_SEGMENTS, json,
+		samples_to_ms(cb, leg->segments[leg->num_segments - 1].start + leg->segments[leg->num_segments - 1].duration));
+	free(json);
+	cJSON_Delete(jEvent);
+
+	leg->num_segments = 0;
+}
+
+/* commit a (debounced) state change that happened at sample offset 'when' */
+static void change_state(switch_core_session_t *session, struct cap_cb *cb, uint32_t channel, switch_vad_state_t new_state,
+	uint64_t when)
+{
+	struct vad_leg *leg = &cb->legs[channel];
+
+	if (cb->event_mode == EVENT_MODE_TRANSITIONS && leg->emitted_state != leg->vad_state) cb->suppressed_events++;
+
+	if (new_state == SWITCH_VAD_STATE_START_TALKING) {
+		leg->speech_segments++;
+		leg->speech_start = when;
+	}
+	if (new_state == SWITCH_VAD_STATE_STOP_TALKING) {
+		leg->speech_samples += when - leg->speech_start;
+	}
+	leg->vad_state = new_state;
+	leg->last_change_at = when;
+
+	if (cb->event_mode == EVENT_MODE_TRANSITIONS) {
+		emit_change(session, cb, channel, when);
+	}
+	else if (new_state == SWITCH_VAD_STATE_STOP_TALKING) {
+		struct vad_segment *segment = &leg->segments[leg->num_segments++];
+		segment->start = leg->speech_start;
+		segment->duration = when - leg->speech_start;
+		if (leg->num_segments >= cb->segment_batch) flush_segments(session, cb, channel);
+	}
+}
+
+static void update_leg(switch_core_session_t *session, struct cap_cb *cb, uint32_t channel, switch_vad_state_t new_state)
+{
+	struct vad_leg *leg = &cb->legs[channel];
+	uint64_t now = cb->samples;
+
+	if (leg->pending_stop) {
+		if (new_state == SWITCH_VAD_STATE_START_TALKING || new_state == SWITCH_VAD_STATE_TALKING) {
+			/* speech resumed within the debounce window: treat it as one segment */
+			leg->pending_stop = 0;
+			return;
+		}
+		if (now - leg->pending_stop_at < cb->debounce_samples) return;
+		leg->pending_stop = 0;
+		change_state(session, cb, channel, SWITCH_VAD_STATE_STOP_TALKING, leg->pending_stop_at);
+	}
+
+	if (new_state != leg->vad_state) {
+		if (new_state == SWITCH_VAD_STATE_STOP_TALKING && cb->debounce_samples > 0) {
+			leg->pending_stop = 1;
+			leg->pending_stop_at = now;
+		}
+		else {
+			change_state(session, cb, channel, new_state, now);
+		}
+	}
+
+	if (cb->event_mode == EVENT_MODE_TRANSITIONS) {
+		if (leg->emitted_state != leg->vad_state) emit_change(session, cb, channel, now);
+	}
+	else if (leg->num_segments > 0) {
+		/* don't hold the oldest segment back for longer than the flush interval */
+		if (now - (leg->segments[0].start + leg->segments[0].duration) >= cb->segment_flush_samples) {
+			flush_segments(session, cb, channel);
+		}
+	}
+}
+
+/* make the running totals visible to do_stop; speech in progress counts up to now (or to a pending stop) */
+static void publish_totals(struct cap_cb *cb)
+{
+	uint32_t i;
+
+	for (i = 0; i < cb->channels; i++) {
+		struct vad_leg *leg = &cb->legs[i];
+		uint64_t speech = leg->speech_samples;
+
+		if (leg->vad_state == SWITCH_VAD_STATE_START_TALKING || leg->vad_state == SWITCH_VAD_STATE_TALKING) {
+			speech += (leg->pending_stop ? leg->pending_stop_at : cb->samples) - leg->speech_start;
+		}
+		switch_atomic_set(&leg->published_speech_ms, samples_to_ms(cb, speech));
+		switch_atomic_set(&leg->published_segments, leg->speech_segments);
+	}
+	switch_atomic_set(&cb->published_total_ms, samples_to_ms(cb, cb->samples));
+	switch_atomic_set(&cb->published_suppressed, cb->suppressed_events);
+}
+
 static switch_bool_t capture_callback(switch_media_bug_t *bug, void *user_data, switch_abc_type_t type)
 {
 	switch_core_session_t *session = switch_core_media_bug_get_session(bug);
@@ -106,66 +315,54 @@ static switch_bool_t capture_callback(switch_media_bug_t *bug, void *user_data,
 		break;
 	case SWITCH_ABC_TYPE_CLOSE:
 		{
+			uint32_t i;
+
 			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "simple_vad SWITCH_ABC_TYPE_CLOSE\n");
 
-			if (cb && cb->vad) {
+			/* settle anything still held back so the final events and totals are complete */
+			for (i = 0; i < cb->channels; i++) {
+				if (cb->legs[i].pending_stop) {
+					cb->legs[i].pending_stop = 0;
+					change_state(session, cb, i, SWITCH_VAD_STATE_STOP_TALKING, cb->legs[i].pending_stop_at);
+				}
+				flush_segments(session, cb, i);
+			}
+			publish_totals(cb);
+
+			if (cb->vad) {
 				switch_vad_destroy(&cb->vad);
 				cb->vad = NULL;
 			}
-			if (cb && cb->mutex) {
-				switch_mutex_destroy(cb->mutex);
-				cb->mutex = NULL;
-			}
 			switch_channel_set_private(channel, "simple_vad", NULL);
 		}
 
 		break;
 	case SWITCH_ABC_TYPE_READ:
-
-		if (cb->vad) {
+		{
 			uint8_t data[SWITCH_RECOMMENDED_BUFFER_SIZE];
 			switch_frame_t frame = { 0 };
 			frame.data = data;
 			frame.buflen = SWITCH_RECOMMENDED_BUFFER_SIZE;
 
-			if (cb->start.tv_sec == 0) {
-				gettimeofday(&cb->start, NULL);
-				gettimeofday(&cb->last_segment_start, NULL);
-			}
-
-			if (switch_mutex_trylock(cb->mutex) == SWITCH_STATUS_SUCCESS) {
-				switch_vad_state_t old_state = cb->vad_state;
-				while (switch_core_media_bug_read(bug, &frame, SWITCH_TRUE) == SWITCH_STATUS_SUCCESS && !switch_test_flag((&frame), SFF_CNG)) {
-					if (frame.datalen) {
-						switch_vad_state_t new_state = switch_vad_process(cb->vad, frame.data, frame.samples);
-						if (new_state != old_state /* && !(new_state == SWITCH_VAD_STATE_TALKING && old_state == SWITCH_VAD_STATE_START_TALKING ) */) {
-							struct timeval now;
-							char* json;
-							long long duration;
-							cJSON *jEvent, *jOldState, *jNewState, *jDuration;
-
-							gettimeofday(&now, NULL);
-							jEvent = cJSON_CreateObject();
-							jOldState = cJSON_CreateString(switch_vad_state2str(old_state));
-							jNewState = cJSON_CreateString(switch_vad_state2str(new_state));
-							cJSON_AddItemToObject(jEvent, "oldState", jOldState);							
-							cJSON_AddItemToObject(jEvent, "newState", jNewState);
-							duration = timeval_diff(NULL, &now, &cb->last_segment_start);
-							jDuration = cJSON_CreateNumber(duration/1000);
-							cJSON_AddItemToObject(jEvent, "duration", jDuration);
-							json = cJSON_PrintUnformatted(jEvent);
-							responseHandler(session, EVENT_VAD_CHANGE, json);	
-							free(json);
-							cJSON_Delete(jEvent);
-							cb->vad_state = new_state;
-							if (cb->vad_state == SWITCH_VAD_STATE_STOP_TALKING ) cb->speech_duration += duration;
-							if (cb->vad_state == SWITCH_VAD_STATE_START_TALKING) cb->speech_segments++;
-							gettimeofday(&cb->last_segment_start, NULL);
-						}
+			while (switch_core_media_bug_read(bug, &frame, SWITCH_TRUE) == SWITCH_STATUS_SUCCESS && !switch_test_flag((&frame), SFF_CNG)) {
+				if (frame.datalen) {
+					uint32_t samples = frame.datalen / (sizeof(int16_t) * cb->channels);
+					vad_kernel_state_t states[VAD_KERNEL_MAX_CHANNELS];
+					uint32_t i;
+
+					if (!cb->media_start) cb->media_start = switch_micro_time_now();
+					cb->samples += samples;
+					if (cb->vad) {
+						update_leg(session, cb, 0, switch_vad_process(cb->vad, frame.data, samples));
+						continue;
+					}
+					vad_kernel_process_interleaved(cb->kernels, cb->channels, frame.data, samples, states);
+					for (i = 0; i < cb->channels; i++) {
+						update_leg(session, cb, i, kernel_state(states[i]));
 					}
 				}
-				switch_mutex_unlock(cb->mutex);
 			}
+			publish_totals(cb);
 		}
 		break;
 	default:
@@ -175,6 +372,13 @@ static switch_bool_t capture_callback(switch_media_bug_t *bug, void *user_data,
 	return SWITCH_TRUE;
 }
 
+static uint32_t channel_var_uint(switch_channel_t *channel, const char *name, uint32_t dflt)
+{
+	const char *var = switch_channel_get_variable(channel, name);
+	int ms = var ? atoi(var) : 0;
+	return ms > 0 ? (uint32_t) ms : dflt;
+}
+
 static switch_status_t start_capture(switch_core_session_t *session, switch_media_bug_flag_t flags, int mode)
 {
 	switch_channel_t *channel = switch_core_session_get_channel(session);
@@ -182,6 +386,11 @@ static switch_status_t start_capture(switch_core_session_t *session, switch_medi
 	switch_status_t status;
 	switch_codec_implementation_t read_impl = { 0 };
 	struct cap_cb *cb;
+	const char *engine = switch_channel_get_variable(channel, "SIMPLE_VAD_ENGINE");
+	uint32_t voice_ms = channel_var_uint(channel, "SIMPLE_VAD_VOICE_MS", DEFAULT_VOICE_MS);
+	uint32_t silence_ms = channel_var_uint(channel, "SIMPLE_VAD_SILENCE_MS", DEFAULT_SILENCE_MS);
+	const char *event_mode = switch_channel_get_variable(channel, "SIMPLE_VAD_EVENT_MODE");
+	uint32_t i;
 
 	if (switch_channel_get_private(channel, "simple_vad")) {
 		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "Already Running.\n");
@@ -195,24 +404,44 @@ static switch_status_t start_capture(switch_core_session_t *session, switch_medi
 	}
 
 	cb = switch_core_session_alloc(session, sizeof(*cb));
-	switch_mutex_init(&cb->mutex, SWITCH_MUTEX_NESTED, switch_core_session_get_pool(session));
-	cb->vad = switch_vad_init(read_impl.samples_per_second, 1);
-	if (!cb->vad) {
-		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "Error allocating vad\n");
-		switch_mutex_destroy(cb->mutex);
-		return SWITCH_STATUS_FALSE;
-	}
-	switch_vad_set_mode(cb->vad, mode);
-	//switch_vad_set_param(cb->vad, "debug", 10);
-	cb->start.tv_sec = 0;
-	cb->start.tv_usec = 0;
-	cb->speech_segments = 0;
-	cb->speech_duration = 0;
-	cb->vad_state = SWITCH_VAD_STATE_NONE;
+	cb->channels = (flags & SMBF_STEREO) ? 2 : 1;
 
-	switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_INFO, "simple_vad: starting vad with mode %d\n", mode);
+	/* the native engine only handles a single channel, so stereo always uses the built-in kernel */
+	if (cb->channels == 1 && !(engine && !strcasecmp(engine, "builtin"))) {
+		cb->vad = switch_vad_init(read_impl.samples_per_second, 1);
+		if (!cb->vad) {
+			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "Error allocating vad\n");
+			return SWITCH_STATUS_FALSE;
+		}
+		switch_vad_set_mode(cb->vad, mode);
+		switch_vad_set_param(cb->vad, "voice_ms", voice_ms);
+		switch_vad_set_param(cb->vad, "silence_ms", silence_ms);
+		//switch_vad_set_param(cb->vad, "debug", 10);
+	}
+	else {
+		for (i = 0; i < cb->channels; i++) {
+			if (vad_kernel_init(&cb->kernels[i], read_impl.samples_per_second, mode, voice_ms, silence_ms) != 0) {
+				switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "simple_vad: unsupported sample rate %d\n",
+					read_impl.samples_per_second);
+				return SWITCH_STATUS_FALSE;
+			}
+		}
+	}
+	/* session memory is zeroed, so all per-leg state starts out at 0 / SWITCH_VAD_STATE_NONE */
+	cb->samples_per_second = read_impl.samples_per_second;
+	cb->event_mode = (event_mode && !strcasecmp(event_mode, "segments")) ? EVENT_MODE_SEGMENTS : EVENT_MODE_TRANSITIONS;
+	cb->debounce_samples = ms_to_samples(cb, channel_var_uint(channel, "SIMPLE_VAD_DEBOUNCE_MS", 0));
+	cb->segment_batch = channel_var_uint(channel, "SIMPLE_VAD_SEGMENT_BATCH", DEFAULT_SEGMENT_BATCH);
+	if (cb->segment_batch > MAX_SEGMENT_BATCH) cb->segment_batch = MAX_SEGMENT_BATCH;
+	cb->segment_flush_samples = ms_to_samples(cb, channel_var_uint(channel, "SIMPLE_VAD_SEGMENT_FLUSH_MS", DEFAULT_SEGMENT_FLUSH_MS));
+	cb->max_events_per_sec = channel_var_uint(channel, "SIMPLE_VAD_MAX_EVENTS_PER_SEC", 0);
+	cb->event_tokens = cb->max_events_per_sec;
+
+	switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_INFO, "simple_vad: starting %s vad with mode %d on %u channel(s)\n",
+		cb->vad ? "native" : "builtin", mode, cb->channels);
 
 	if ((status = switch_core_media_bug_add(session, "simple_vad", NULL, capture_callback, cb, 0, flags, &bug)) != SWITCH_STATUS_SUCCESS) {
+		if (cb->vad) switch_vad_destroy(&cb->vad);
 		return status;
 	}
 
@@ -228,49 +457,48 @@ static switch_status_t do_stop(switch_core_session_t *session)
 
 	if (bug) {
 		struct cap_cb *cb = (struct cap_cb *) switch_core_media_bug_get_user_data(bug);
-		struct timeval now;
 		char* json;
-		long long duration, speechDuration;
-		cJSON *jEvent, *jSpeechSegments, *jDuration, *jSpeechDuration;
+		uint32_t duration, speechDuration, speechSegments;
+		cJSON *jEvent;
+		uint32_t i;
 
 		if (!cb) {
 			return SWITCH_STATUS_FALSE;
 		}
 
-		switch_mutex_lock(cb->mutex);
-		gettimeofday(&now, NULL);
-		duration = timeval_diff(NULL, &now, &cb->start);
-		speechDuration = cb->speech_duration;
-		if (cb->vad_state == SWITCH_VAD_STATE_TALKING) {
-			speechDuration += timeval_diff(NULL, &now, &cb->last_segment_start);
-		}
+		/* removing the bug runs the CLOSE callback, which publishes the final totals; cb is session memory and outlives the bug */
+		switch_core_media_bug_remove(session, &bug);
+
+		duration = switch_atomic_read(&cb->published_total_ms);
+		speechDuration = switch_atomic_read(&cb->legs[0].published_speech_ms);
+		speechSegments = switch_atomic_read(&cb->legs[0].published_segments);
+
+		/* top-level figures are for the read leg, as before; stereo adds a per-channel breakdown */
 		jEvent = cJSON_CreateObject();
-		jDuration = cJSON_CreateNumber(duration/1000);
-		jSpeechDuration = cJSON_CreateNumber(speechDuration/1000);
-		jSpeechSegments = cJSON_CreateNumber(cb->speech_segments);
-		cJSON_AddItemToObject(jEvent, "speechDuration", jSpeechDuration);
-		cJSON_AddItemToObject(jEvent, "speechSegments", jSpeechSegments);
-		cJSON_AddItemToObject(jEvent, "totalDuration", jDuration);
+		cJSON_AddItemToObject(jEvent, "speechDuration", cJSON_CreateNumber(speechDuration));
+		cJSON_AddItemToObject(jEvent, "speechSegments", cJSON_CreateNumber(speechSegments));
+		cJSON_AddItemToObject(jEvent, "totalDuration", cJSON_CreateNumber(duration));
+		if (cb->channels > 1) {
+			cJSON *jChannels = cJSON_CreateArray();
+			for (i = 0; i < cb->channels; i++) {
+				cJSON *jChannel = cJSON_CreateObject();
+				cJSON_AddItemToObject(jChannel, "speechDuration", cJSON_CreateNumber(switch_atomic_read(&cb->legs[i].published_speech_ms)));
+				cJSON_AddItemToObject(jChannel, "speechSegments", cJSON_CreateNumber(switch_atomic_read(&cb->legs[i].published_segments)));
+				cJSON_AddItemToArray(jChannels, jChannel);
+			}
+			cJSON_AddItemToObject(jEvent, "channels", jChannels);
+		}
+		if (cb->max_events_per_sec > 0) {
+			cJSON_AddItemToObject(jEvent, "suppressedEvents", cJSON_CreateNumber(switch_atomic_read(&cb->published_suppressed)));
+		}
 		json = cJSON_PrintUnformatted(jEvent);
-		responseHandler(session, EVENT_VAD_SUMMARY, json);	
+		responseHandler(session, cb, EVENT_VAD_SUMMARY, json, duration);	
 		free(json);
 		cJSON_Delete(jEvent);
 
-/*
-		if (cb->vad) {
-			switch_vad_destroy(&cb->vad);
-			cb->vad = NULL;
-			switch_channel_set_private(channel, "simple_vad", NULL);
-		}
-*/
 		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_INFO, 
-			"simple_vad: stopped with %lld ms speech in %u segments over a total %lld duration\n",
-			speechDuration, cb->speech_segments, duration);
-
-		switch_mutex_unlock(cb->mutex);
-
-		switch_core_media_bug_remove(session, &bug);
-
+			"simple_vad: stopped with %u ms speech in %u segments over a total %u ms\n",
+			speechDuration, speechSegments, duration);
 
 		return SWITCH_STATUS_SUCCESS;
 	}
@@ -280,10 +508,10 @@ static switch_status_t do_stop(switch_core_session_t *session)
 
 }
 
-#define VAD_API_SYNTAX "<uuid> start|stop [mode]"
+#define VAD_API_SYNTAX "<uuid> start|stop [mode] [mono|stereo]"
 SWITCH_STANDARD_API(vad_function)
 {
-	char *mycmd = NULL, *argv[3] = { 0 };
+	char *mycmd = NULL, *argv[4] = { 0 };
 	int argc = 0;
 	switch_status_t status = SWITCH_STATUS_FALSE;
 
@@ -310,6 +538,9 @@ SWITCH_STANDARD_API(vad_function)
 						switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "invalid vad mode %d, must be 0, 1, 2, or 3\n", mode);
 					}
 				}
+				if (argc > 3 && !strcasecmp(argv[3], "stereo")) {
+					flags |= SMBF_WRITE_STREAM | SMBF_STEREO;
+				}
 				if (mode >= 0 && mode <= 3) status = start_capture(lsession, flags, mode);
 			}
 			switch_core_session_rwunlock(lsession);
@@ -343,6 +574,10 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_simple_vad_load)
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Couldn't register an event subclass EVENT_VAD_SUMMARY for mod_simple_vad API.\n");
 		return SWITCH_STATUS_TERM;
 	}
+	if (switch_event_reserve_subclass(EVENT_VAD_SEGMENTS) != SWITCH_STATUS_SUCCESS) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Couldn't register an event subclass EVENT_VAD_SEGMENTS for mod_simple_vad API.\n");
+		return SWITCH_STATUS_TERM;
+	}
 
 	/* connect my internal structure to the blank pointer passed to me */
 	*module_interface = switch_loadable_module_create_module_interface(pool, modname);
@@ -363,6 +598,7 @@ SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_simple_vad_shutdown)
 {
 	switch_event_free_subclass(EVENT_VAD_CHANGE);
 	switch_event_free_subclass(EVENT_VAD_SUMMARY);
+	switch_event_free_subclass(EVENT_VAD_SEGMENTS);
 
 	return SWITCH_STATUS_SUCCESS;
 }
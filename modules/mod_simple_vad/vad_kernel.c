@@ -0,0 +1,278 @@
+#include "vad_kernel.h"
+
+#include <math.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define MIN_NOISE_FLOOR_DB (25.0f)	/* don't let digital silence make the detector hair-triggered */
+#define FLUX_ONSET_DB (9.0f)		/* a rise this sharp in the band energies marks an onset */
+#define NOISY_ZCR (0.45f)			/* zero-crossing rate above which a block looks like noise or hiss */
+#define NOISY_EXTRA_MARGIN_DB (3.0f)
+
+static const float mode_margin_db[] = { 6.0f, 9.0f, 12.0f, 15.0f };
+
+typedef struct block_features {
+	uint64_t e0;	/* energy of x/2 */
+	uint64_t e1;	/* energy of the first difference, scaled by 1/2 */
+	uint64_t e2;	/* energy of the second difference, scaled by 1/4 */
+	uint32_t zc;	/* zero crossings */
+} block_features_t;
+
+/* t[0], t[1] are the last two samples of the previous block; the block itself is t[2] .. t[n + 1] */
+static void compute_features(const int16_t *t, uint32_t n, block_features_t *f)
+{
+	uint32_t i = 0;
+	uint64_t e0 = 0, e1 = 0, e2 = 0;
+	uint32_t zc = 0;
+
+#ifdef __SSE2__
+	{
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i ones = _mm_set1_epi16(1);
+		__m128i acc0 = zero, acc1 = zero, acc2 = zero, acczc = zero;
+
+		for (; i + 8 <= n; i += 8) {
+			__m128i x0 = _mm_srai_epi16(_mm_loadu_si128((const __m128i *) (t + i + 2)), 1);
+			__m128i x1 = _mm_srai_epi16(_mm_loadu_si128((const __m128i *) (t + i + 1)), 1);
+			__m128i x2 = _mm_srai_epi16(_mm_loadu_si128((const __m128i *) (t + i)), 1);
+			__m128i d1 = _mm_sub_epi16(x0, x1);
+			__m128i d2 = _mm_add_epi16(_mm_sub_epi16(_mm_srai_epi16(x0, 1), x1), _mm_srai_epi16(x2, 1));
+			__m128i p0 = _mm_madd_epi16(x0, x0);
+			__m128i p1 = _mm_madd_epi16(d1, d1);
+			__m128i p2 = _mm_madd_epi16(d2, d2);
+
+			/* products are non-negative and < 2^31, so widen to 64 bits before accumulating */
+			acc0 = _mm_add_epi64(acc0, _mm_add_epi64(_mm_unpacklo_epi32(p0, zero), _mm_unpackhi_epi32(p0, zero)));
+			acc1 = _mm_add_epi64(acc1, _mm_add_epi64(_mm_unpacklo_epi32(p1, zero), _mm_unpackhi_epi32(p1, zero)));
+			acc2 = _mm_add_epi64(acc2, _mm_add_epi64(_mm_unpacklo_epi32(p2, zero), _mm_unpackhi_epi32(p2, zero)));
+
+			/* sign bit of x[i] ^ x[i-1] is set where the signal crosses zero */
+			acczc = _mm_add_epi16(acczc, _mm_srli_epi16(_mm_xor_si128(x0, x1), 15));
+		}
+		{
+			uint64_t lanes[2];
+			uint32_t zlanes[4];
+
+			_mm_storeu_si128((__m128i *) lanes, acc0);
+			e0 = lanes[0] + lanes[1];
+			_mm_storeu_si128((__m128i *) lanes, acc1);
+			e1 = lanes[0] + lanes[1];
+			_mm_storeu_si128((__m128i *) lanes, acc2);
+			e2 = lanes[0] + lanes[1];
+			_mm_storeu_si128((__m128i *) zlanes, _mm_madd_epi16(acczc, ones));
+			zc = zlanes[0] + zlanes[1] + zlanes[2] + zlanes[3];
+		}
+	}
+#endif
+
+	for (; i < n; i++) {
+		int32_t x0 = t[i + 2] >> 1, x1 = t[i + 1] >> 1, x2 = t[i] >> 1;
+		int32_t d1 = x0 - x1;
+		int32_t d2 = (x0 >> 1) - x1 + (x2 >> 1);
+
+		e0 += (uint64_t) (x0 * x0);
+		e1 += (uint64_t) (d1 * d1);
+		e2 += (uint64_t) (d2 * d2);
+		zc += ((x0 ^ x1) < 0);
+	}
+
+	f->e0 = e0;
+	f->e1 = e1;
+	f->e2 = e2;
+	f->zc = zc;
+}
+
+static float to_db(uint64_t energy, uint32_t n)
+{
+	return 10.0f * log10f((float) energy / (float) n + 1.0f);
+}
+
+/* classify one complete block and advance the state machine */
+static vad_kernel_state_t process_block(vad_kernel_t *k, const int16_t *t)
+{
+	block_features_t f;
+	float band_db[3], floor_db, margin;
+	int voiced;
+	uint32_t n = k->block_size;
+
+	compute_features(t, n, &f);
+
+	k->energy_db = to_db(f.e0, n) + 6.02f;	/* undo the halving of the samples */
+	k->zcr = (float) f.zc / (float) n;
+	band_db[0] = k->energy_db;
+	band_db[1] = to_db(f.e1, n);
+	band_db[2] = to_db(f.e2, n);
+
+	k->flux = 0.0f;
+	if (k->blocks > 0) {
+		int j;
+		for (j = 0; j < 3; j++) {
+			if (band_db[j] > k->band_db[j]) k->flux += band_db[j] - k->band_db[j];
+		}
+	}
+	else {
+		k->noise_floor_db = k->energy_db;
+	}
+	memcpy(k->band_db, band_db, sizeof(band_db));
+	k->blocks++;
+
+	floor_db = k->noise_floor_db > MIN_NOISE_FLOOR_DB ? k->noise_floor_db : MIN_NOISE_FLOOR_DB;
+	margin = k->margin_db + (k->zcr > NOISY_ZCR ? NOISY_EXTRA_MARGIN_DB : 0.0f);
+	voiced = k->energy_db > floor_db + margin || (k->flux > FLUX_ONSET_DB && k->energy_db > floor_db + margin / 2);
+
+	/* noise floor falls quickly, rises slowly, and barely moves while someone is talking */
+	if (k->energy_db < k->noise_floor_db) {
+		k->noise_floor_db += 0.3f * (k->energy_db - k->noise_floor_db);
+	}
+	else {
+		k->noise_floor_db += (voiced ? 0.002f : 0.02f) * (k->energy_db - k->noise_floor_db);
+	}
+
+	if (voiced) {
+		k->voiced_run++;
+		k->unvoiced_run = 0;
+	}
+	else {
+		k->unvoiced_run++;
+		k->voiced_run = 0;
+	}
+
+	switch (k->state) {
+	case VAD_KERNEL_STATE_NONE:
+	case VAD_KERNEL_STATE_STOP_TALKING:
+		k->state = k->voiced_run >= k->voice_blocks ? VAD_KERNEL_STATE_START_TALKING : VAD_KERNEL_STATE_NONE;
+		break;
+	case VAD_KERNEL_STATE_START_TALKING:
+	case VAD_KERNEL_STATE_TALKING:
+		k->state = k->unvoiced_run >= k->silence_blocks ? VAD_KERNEL_STATE_STOP_TALKING : VAD_KERNEL_STATE_TALKING;
+		break;
+	}
+	return k->state;
+}
+
+int vad_kernel_init(vad_kernel_t *k, uint32_t samples_per_second, int mode, uint32_t voice_ms, uint32_t silence_ms)
+{
+	memset(k, 0, sizeof(*k));
+	k->block_size = samples_per_second / 100;
+	if (k->block_size == 0 || k->block_size > VAD_KERNEL_MAX_BLOCK) return -1;
+
+	if (mode < 0) mode = 0;
+	if (mode > 3) mode = 3;
+	k->margin_db = mode_margin_db[mode];
+	k->voice_blocks = voice_ms >= 10 ? voice_ms / 10 : 1;
+	k->silence_blocks = silence_ms >= 10 ? silence_ms / 10 : 1;
+	vad_kernel_reset(k);
+	return 0;
+}
+
+void vad_kernel_reset(vad_kernel_t *k)
+{
+	k->block_fill = 0;
+	k->block[0] = k->block[1] = 0;
+	k->noise_floor_db = 0.0f;
+	k->blocks = 0;
+	k->voiced_run = k->unvoiced_run = 0;
+	k->state = VAD_KERNEL_STATE_NONE;
+}
+
+/*
+ * Transient states (start/stop talking) only last for a single block, so if one occurs anywhere
+ * in this call we report it rather than the state of the final block; otherwise a 20 ms frame
+ * could start and settle into talking without the caller ever seeing the transition.
+ */
+static void run_blocks(vad_kernel_t *k, const int16_t *data, uint32_t samples, vad_kernel_state_t *result, int *transition)
+{
+	while (samples > 0) {
+		uint32_t take = k->block_size - k->block_fill;
+		if (take > samples) take = samples;
+		memcpy(k->block + 2 + k->block_fill, data, take * sizeof(int16_t));
+		k->block_fill += take;
+		data += take;
+		samples -= take;
+
+		if (k->block_fill == k->block_size) {
+			vad_kernel_state_t state = process_block(k, k->block);
+
+			k->block[0] = k->block[k->block_size];
+			k->block[1] = k->block[k->block_size + 1];
+			k->block_fill = 0;
+
+			if (state == VAD_KERNEL_STATE_START_TALKING || state == VAD_KERNEL_STATE_STOP_TALKING) {
+				*result = state;
+				*transition = 1;
+			}
+			else if (!*transition) {
+				*result = state;
+			}
+		}
+	}
+}
+
+vad_kernel_state_t vad_kernel_process(vad_kernel_t *k, const int16_t *data, uint32_t samples)
+{
+	vad_kernel_state_t result = k->state;
+	int transition = 0;
+
+	run_blocks(k, data, samples, &result, &transition);
+	return result;
+}
+
+void vad_kernel_process_interleaved(vad_kernel_t *k, uint32_t channels, const int16_t *data, uint32_t samples,
+	vad_kernel_state_t *states)
+{
+	int16_t left[VAD_KERNEL_MAX_BLOCK], right[VAD_KERNEL_MAX_BLOCK];
+	int transition[2] = { 0, 0 };
+	uint32_t i;
+
+	if (channels == 1) {
+		states[0] = vad_kernel_process(k, data, samples);
+		return;
+	}
+
+	states[0] = k[0].state;
+	states[1] = k[1].state;
+
+	/* de-interleave a block's worth at a time so each channel's kernel sees contiguous samples */
+	while (samples > 0) {
+		uint32_t n = samples > VAD_KERNEL_MAX_BLOCK ? VAD_KERNEL_MAX_BLOCK : samples;
+
+		i = 0;
+#ifdef __SSE2__
+		for (; i + 8 <= n; i += 8) {
+			__m128i a = _mm_loadu_si128((const __m128i *) (data + 2 * i));
+			__m128i b = _mm_loadu_si128((const __m128i *) (data + 2 * i + 8));
+			/* even (left) samples: sign-extend the low half of each 32-bit pair; odd (right): the high half */
+			__m128i la = _mm_srai_epi32(_mm_slli_epi32(a, 16), 16);
+			__m128i lb = _mm_srai_epi32(_mm_slli_epi32(b, 16), 16);
+			__m128i ra = _mm_srai_epi32(a, 16);
+			__m128i rb = _mm_srai_epi32(b, 16);
+			_mm_storeu_si128((__m128i *) (left + i), _mm_packs_epi32(la, lb));
+			_mm_storeu_si128((__m128i *) (right + i), _mm_packs_epi32(ra, rb));
+		}
+#endif
+		for (; i < n; i++) {
+			left[i] = data[2 * i];
+			right[i] = data[2 * i + 1];
+		}
+
+		run_blocks(&k[0], left, n, &states[0], &transition[0]);
+		run_blocks(&k[1], right, n, &states[1], &transition[1]);
+
+		data += 2 * n;
+		samples -= n;
+	}
+}
+
+const char *vad_kernel_state2str(vad_kernel_state_t state)
+{
+	switch (state) {
+	case VAD_KERNEL_STATE_NONE: return "none";
+	case VAD_KERNEL_STATE_START_TALKING: return "start_talking";
+	case VAD_KERNEL_STATE_TALKING: return "talking";
+	case VAD_KERNEL_STATE_STOP_TALKING: return "stop_talking";
+	}
+	return "unknown";
+}
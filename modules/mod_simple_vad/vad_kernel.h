@@ -0,0 +1,66 @@
+#ifndef __VAD_KERNEL_H__
+#define __VAD_KERNEL_H__
+
+#include <stdint.h>
+
+/*
+ * Built-in voice activity detector.
+ *
+ * Audio is analysed in 10 ms blocks.  For each block we compute the energy, the zero-crossing
+ * rate and a spectral flux estimate (the rise in log energy of the signal and of its first and
+ * second differences, which act as a crude low/mid/high band split).  The inner loops are
+ * vectorized with SSE2 where available.  A block is voiced when its energy is far enough above
+ * an adaptive noise floor; hangover counters turn voiced/unvoiced blocks into talking states.
+ *
+ * One kernel handles one channel; vad_kernel_process_interleaved() runs a kernel per channel
+ * over interleaved (e.g. stereo media bug) audio.
+ */
+
+#define VAD_KERNEL_MAX_CHANNELS (2)
+#define VAD_KERNEL_MAX_BLOCK (480)		/* 10 ms at 48 kHz */
+
+typedef enum {
+	VAD_KERNEL_STATE_NONE,
+	VAD_KERNEL_STATE_START_TALKING,
+	VAD_KERNEL_STATE_TALKING,
+	VAD_KERNEL_STATE_STOP_TALKING
+} vad_kernel_state_t;
+
+typedef struct vad_kernel {
+	uint32_t block_size;
+	uint32_t block_fill;
+	int16_t block[VAD_KERNEL_MAX_BLOCK + 2];	/* starts with the last two samples of the previous block */
+
+	/* tuning */
+	float margin_db;
+	uint32_t voice_blocks;
+	uint32_t silence_blocks;
+
+	/* adaptive state */
+	float noise_floor_db;
+	float band_db[3];
+	uint32_t blocks;
+	uint32_t voiced_run;
+	uint32_t unvoiced_run;
+	vad_kernel_state_t state;
+
+	/* features of the most recent block, for debugging */
+	float energy_db;
+	float zcr;
+	float flux;
+} vad_kernel_t;
+
+/* mode is 0 (least aggressive) to 3 (most aggressive), as for switch_vad */
+int vad_kernel_init(vad_kernel_t *k, uint32_t samples_per_second, int mode, uint32_t voice_ms, uint32_t silence_ms);
+void vad_kernel_reset(vad_kernel_t *k);
+
+/* mono audio; returns the state after the last complete block */
+vad_kernel_state_t vad_kernel_process(vad_kernel_t *k, const int16_t *data, uint32_t samples);
+
+/* interleaved audio with one kernel per channel (up to VAD_KERNEL_MAX_CHANNELS); samples is per channel */
+void vad_kernel_process_interleaved(vad_kernel_t *k, uint32_t channels, const int16_t *data, uint32_t samples,
+	vad_kernel_state_t *states);
+
+const char *vad_kernel_state2str(vad_kernel_state_t state);
+
+#endif
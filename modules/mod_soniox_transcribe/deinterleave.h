@@ -0,0 +1,35 @@
+#ifndef __DEINTERLEAVE_H__
+#define __DEINTERLEAVE_H__
+
+#include <stdint.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/**
+ * split interleaved stereo (L R L R ...) into two mono buffers;
+ * samples is the number of samples per channel
+ */
+static inline void deinterleave_stereo(const int16_t *in, uint32_t samples, int16_t *left, int16_t *right) {
+  uint32_t i = 0;
+#ifdef __SSE2__
+  for (; i + 8 <= samples; i += 8) {
+    __m128i a = _mm_loadu_si128((const __m128i *) (in + 2 * i));
+    __m128i b = _mm_loadu_si128((const __m128i *) (in + 2 * i + 8));
+    // left samples are the low half of each 32-bit pair, right samples the high half
+    __m128i la = _mm_srai_epi32(_mm_slli_epi32(a, 16), 16);
+    __m128i lb = _mm_srai_epi32(_mm_slli_epi32(b, 16), 16);
+    __m128i ra = _mm_srai_epi32(a, 16);
+    __m128i rb = _mm_srai_epi32(b, 16);
+    _mm_storeu_si128((__m128i *) (left + i), _mm_packs_epi32(la, lb));
+    _mm_storeu_si128((__m128i *) (right + i), _mm_packs_epi32(ra, rb));
+  }
+#endif
+  for (; i < samples; i++) {
+    left[i] = in[2 * i];
+    right[i] = in[2 * i + 1];
+  }
+}
+
+#endif
@@ -7,5 +7,7 @@ switch_status_t soniox_speech_session_init(switch_core_session_t *session, respo
 		uint32_t samples_per_second, uint32_t channels, char* lang, int interim, char *bugname, void **ppUserData);
 switch_status_t soniox_speech_session_cleanup(switch_core_session_t *session, int channelIsClosing, switch_media_bug_t *bug);
 switch_bool_t soniox_speech_frame(switch_media_bug_t *bug, void* user_data);
+switch_status_t soniox_speech_metrics(switch_stream_handle_t *stream);
+switch_status_t soniox_speech_latency(switch_stream_handle_t *stream);
 
 #endif
\ No newline at end of file